@@ -0,0 +1,27 @@
+#ifndef FONT_H
+#define FONT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Font descriptor
+// Glyph data is column-major and page-oriented like the display buffer:
+// each glyph is `pages` runs of `width` bytes, bit 0 = top pixel of the page.
+// Tables are generated from BDF sources by tools/bdf2font.py at build time.
+typedef struct {
+    uint8_t first;            // First character code in the table
+    uint8_t last;             // Last character code in the table
+    uint8_t height;           // Glyph height in pixels
+    uint8_t pages;            // Bytes per glyph column (height rounded up to 8)
+    uint8_t spacing;          // Blank columns drawn after each glyph
+    uint8_t fixed_width;      // Glyph width when widths is NULL
+    const uint8_t *widths;    // Per-glyph widths (NULL for fixed-width fonts)
+    const uint16_t *offsets;  // Per-glyph offsets into bitmap (NULL for fixed-width fonts)
+    const uint8_t *bitmap;    // Packed glyph data
+} font_t;
+
+// Built-in fonts (generated from assets/fonts/font5x7.bdf)
+extern const font_t font_5x7;       // Fixed 5x7 in a 6-pixel cell (default)
+extern const font_t font_5x7_prop;  // Same glyphs, proportional widths
+
+#endif // FONT_H
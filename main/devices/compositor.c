@@ -0,0 +1,313 @@
+/*
+* Compositor
+* ==========
+*
+* Off-screen 1-bpp layers composed onto the SSD1306 framebuffer.
+*
+* Each layer owns a bitmap in the display's page layout, a position, a
+* clip rect (screen coordinates; its own bounds until one is set, and
+* those move with it) and a z value. Drawing into a layer goes
+* through the regular drawing code: layer_begin() points the driver at the
+* layer bitmap with ssd1306_set_target(), and every change the driver
+* reports is translated to a screen rectangle and recorded in a per-page
+* dirty column range. Moving, restacking, hiding or re-clipping a layer
+* marks its old and new screen area the same way.
+*
+* compositor_compose() rebuilds only those ranges: per screen page it
+* starts from black and applies the layers bottom to top, one byte per
+* column (an unaligned layer is shifted across the two pages it
+* straddles). Opaque layers replace what is below them, others add their
+* lit pixels. The result is compared with the framebuffer so only bytes
+* that really changed are marked dirty for the next display update.
+*
+* Layer bitmaps come from one static pool sized at build time, so the RAM
+* cost is fixed and can be queried per layer.
+*/
+
+#include "compositor.h"
+#include <string.h>
+
+// Largest canvas in any orientation
+#define SCREEN_MAX ((SSD1306_WIDTH > SSD1306_HEIGHT) ? SSD1306_WIDTH : SSD1306_HEIGHT)
+#define SCREEN_MAX_PAGES (SCREEN_MAX / 8)
+
+struct layer {
+    int16_t x, y;                        // Top-left corner on screen
+    int16_t width, height;               // Size in pixels
+    int16_t clip_x0, clip_y0;            // Clip rect on screen (inclusive)
+    int16_t clip_x1, clip_y1;
+    int z;                               // Stacking order (higher = on top)
+    uint8_t flags;                       // LAYER_OPAQUE
+    bool visible;
+    bool clip_set;                       // Clip rect from layer_set_clip(), else the bounds
+    uint8_t *bitmap;                     // (height + 7) / 8 pages of width bytes
+};
+
+// Layer storage
+static uint8_t pool[COMPOSITOR_POOL_BYTES];
+static uint32_t pool_used;
+static struct layer layers[COMPOSITOR_MAX_LAYERS];
+static layer_t *stack[COMPOSITOR_MAX_LAYERS];  // Sorted by z, bottom first
+static int layer_count;
+
+// Layer being drawn into (between layer_begin and layer_end)
+static layer_t *drawing;
+
+// Screen columns to recompose per page: start..end-1 (end == 0 means clean)
+static uint8_t dirty_start[SCREEN_MAX_PAGES];
+static uint8_t dirty_end[SCREEN_MAX_PAGES];
+
+static inline int max_int(int a, int b) { return a > b ? a : b; }
+static inline int min_int(int a, int b) { return a < b ? a : b; }
+
+// Record a screen rectangle (inclusive) for recomposition
+static void compositor_mark(int x0, int y0, int x1, int y1) {
+    x0 = max_int(x0, 0);
+    y0 = max_int(y0, 0);
+    x1 = min_int(x1, SCREEN_MAX - 1);
+    y1 = min_int(y1, SCREEN_MAX - 1);
+    if (x0 > x1 || y0 > y1) {
+        return;
+    }
+
+    for (int page = y0 / 8; page <= y1 / 8; page++) {
+        if (dirty_end[page] == 0 || x0 < dirty_start[page]) dirty_start[page] = x0;
+        if (x1 + 1 > dirty_end[page]) dirty_end[page] = x1 + 1;
+    }
+}
+
+// Screen area a layer can cover: its bounds clipped by its clip rect
+// Returns false if that area is empty.
+static bool layer_screen_rect(const layer_t *layer, int *x0, int *y0, int *x1, int *y1) {
+    *x0 = max_int(layer->x, layer->clip_x0);
+    *y0 = max_int(layer->y, layer->clip_y0);
+    *x1 = min_int(layer->x + layer->width - 1, layer->clip_x1);
+    *y1 = min_int(layer->y + layer->height - 1, layer->clip_y1);
+    return *x0 <= *x1 && *y0 <= *y1;
+}
+
+// Mark everything a visible layer currently shows
+static void layer_mark(const layer_t *layer) {
+    int x0, y0, x1, y1;
+    if (layer->visible && layer_screen_rect(layer, &x0, &y0, &x1, &y1)) {
+        compositor_mark(x0, y0, x1, y1);
+    }
+}
+
+// Dirty callback for the drawing target: columns x0..x1 of a layer page
+static void layer_dirty(int page, int x0, int x1) {
+    const layer_t *layer = drawing;
+    int cx0, cy0, cx1, cy1;
+    if (!layer->visible || !layer_screen_rect(layer, &cx0, &cy0, &cx1, &cy1)) {
+        return;
+    }
+
+    int y = layer->y + page * 8;
+    compositor_mark(max_int(layer->x + x0, cx0), max_int(y, cy0),
+                    min_int(layer->x + x1, cx1), min_int(y + 7, cy1));
+}
+
+// Keep the stack ordered by z (layers with equal z keep their order)
+static void compositor_sort(void) {
+    for (int i = 1; i < layer_count; i++) {
+        layer_t *layer = stack[i];
+        int j = i - 1;
+        while (j >= 0 && stack[j]->z > layer->z) {
+            stack[j + 1] = stack[j];
+            j--;
+        }
+        stack[j + 1] = layer;
+    }
+}
+
+layer_t *layer_create(int x, int y, int width, int height, int z, uint8_t flags) {
+    if (layer_count >= COMPOSITOR_MAX_LAYERS || width <= 0 || width > SCREEN_MAX || height <= 0) {
+        return NULL;
+    }
+
+    uint32_t bytes = (uint32_t)width * ((height + 7) / 8);
+    if (pool_used + bytes > COMPOSITOR_POOL_BYTES) {
+        return NULL;
+    }
+
+    layer_t *layer = &layers[layer_count];
+    layer->x = x;
+    layer->y = y;
+    layer->width = width;
+    layer->height = height;
+    layer->clip_x0 = x;
+    layer->clip_y0 = y;
+    layer->clip_x1 = x + width - 1;
+    layer->clip_y1 = y + height - 1;
+    layer->z = z;
+    layer->flags = flags;
+    layer->visible = true;
+    layer->clip_set = false;
+    layer->bitmap = &pool[pool_used];
+    memset(layer->bitmap, 0, bytes);
+    pool_used += bytes;
+
+    stack[layer_count++] = layer;
+    compositor_sort();
+
+    // An empty opaque layer still hides what is below it
+    if (flags & LAYER_OPAQUE) {
+        layer_mark(layer);
+    }
+    return layer;
+}
+
+void layer_begin(layer_t *layer) {
+    drawing = layer;
+    ssd1306_set_target(layer->bitmap, layer->width, layer->height, layer_dirty);
+}
+
+void layer_end(void) {
+    ssd1306_set_target(NULL, 0, 0, NULL);
+    drawing = NULL;
+}
+
+void layer_move(layer_t *layer, int x, int y) {
+    if (layer->x == x && layer->y == y) {
+        return;
+    }
+
+    // A clip rect that was set is a screen area and stays where it is;
+    // otherwise the layer is clipped to its bounds, which move with it
+    layer_mark(layer);
+    if (!layer->clip_set) {
+        layer->clip_x0 += x - layer->x;
+        layer->clip_y0 += y - layer->y;
+        layer->clip_x1 += x - layer->x;
+        layer->clip_y1 += y - layer->y;
+    }
+    layer->x = x;
+    layer->y = y;
+    layer_mark(layer);
+}
+
+void layer_set_z(layer_t *layer, int z) {
+    if (layer->z != z) {
+        layer->z = z;
+        compositor_sort();
+        layer_mark(layer);
+    }
+}
+
+void layer_set_visible(layer_t *layer, bool visible) {
+    if (layer->visible != visible) {
+        layer_mark(layer);
+        layer->visible = visible;
+        layer_mark(layer);
+    }
+}
+
+void layer_set_clip(layer_t *layer, int x, int y, int w, int h) {
+    layer_mark(layer);
+    layer->clip_x0 = x;
+    layer->clip_y0 = y;
+    layer->clip_x1 = x + w - 1;
+    layer->clip_y1 = y + h - 1;
+    layer->clip_set = true;
+    layer_mark(layer);
+}
+
+uint32_t layer_memory(const layer_t *layer) {
+    return (uint32_t)layer->width * ((layer->height + 7) / 8) + sizeof(struct layer);
+}
+
+uint32_t compositor_memory_used(void) {
+    return pool_used + layer_count * sizeof(struct layer);
+}
+
+uint32_t compositor_memory_free(void) {
+    return COMPOSITOR_POOL_BYTES - pool_used;
+}
+
+// Apply one layer to columns x0..x1 of a screen page in out[]
+static void compositor_apply(const layer_t *layer, int page, int x0, int x1, uint8_t *out) {
+    int lx0, ly0, lx1, ly1;
+    if (!layer->visible || !layer_screen_rect(layer, &lx0, &ly0, &lx1, &ly1)) {
+        return;
+    }
+
+    int top = page * 8;
+    int r0 = max_int(ly0, top);
+    int r1 = min_int(ly1, top + 7);
+    int c0 = max_int(lx0, x0);
+    int c1 = min_int(lx1, x1);
+    if (r0 > r1 || c0 > c1) {
+        return;
+    }
+
+    // Rows of this screen page covered by the layer
+    uint8_t cover = (uint8_t)((0xFF << (r0 - top)) & (0xFF >> (top + 7 - r1)));
+
+    // Layer page holding the screen page's top row, and the shift to align it
+    int row = top - layer->y;
+    int lpage = row >> 3;   // Floor division, also for negative rows
+    int shift = row & 7;
+    int lpages = (layer->height + 7) / 8;
+    bool has_lo = lpage >= 0 && lpage < lpages;
+    bool has_hi = shift && lpage + 1 >= 0 && lpage + 1 < lpages;
+    int lo = lpage * layer->width - layer->x;  // Bitmap index of screen column 0
+    int hi = lo + layer->width;
+
+    bool opaque = layer->flags & LAYER_OPAQUE;
+    for (int x = c0; x <= c1; x++) {
+        uint8_t value = has_lo ? layer->bitmap[lo + x] >> shift : 0;
+        if (has_hi) {
+            value |= layer->bitmap[hi + x] << (8 - shift);
+        }
+        value &= cover;
+        out[x] = opaque ? (out[x] & ~cover) | value : out[x] | value;
+    }
+}
+
+void compositor_compose(void) {
+    int width = ssd1306_width();
+    int pages = ssd1306_height() / 8;
+
+    for (int page = 0; page < pages; page++) {
+        int x0 = dirty_start[page];
+        int x1 = min_int(dirty_end[page] - 1, width - 1);
+        dirty_start[page] = 0;
+        dirty_end[page] = 0;
+        if (x0 > x1) {
+            continue;
+        }
+
+        uint8_t out[SCREEN_MAX];
+        memset(&out[x0], 0, x1 - x0 + 1);
+        for (int i = 0; i < layer_count; i++) {
+            compositor_apply(stack[i], page, x0, x1, out);
+        }
+
+        // Copy into the framebuffer, marking only bytes that changed
+        uint8_t *row = ssd1306_page_buffer(page);
+        int first = -1;
+        int last = -1;
+        for (int x = x0; x <= x1; x++) {
+            if (row[x] != out[x]) {
+                row[x] = out[x];
+                if (first < 0) first = x;
+                last = x;
+            }
+        }
+        if (first >= 0) {
+            ssd1306_mark_page_dirty(page, first, last);
+        }
+    }
+}
+
+void compositor_invalidate(void) {
+    memset(dirty_start, 0, sizeof(dirty_start));
+    memset(dirty_end, SCREEN_MAX, sizeof(dirty_end));
+}
+
+void compositor_reset(void) {
+    layer_count = 0;
+    pool_used = 0;
+    drawing = NULL;
+    compositor_invalidate();
+}
@@ -0,0 +1,65 @@
+/*
+ * Compositor - off-screen 1-bpp layers stacked onto the SSD1306 buffer
+ * Layers are drawn with the normal ssd1306 and gfx drawing functions, and
+ * only the regions that changed are recomposed
+ */
+
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ssd1306.h"
+
+// Limits (layer bitmaps come from one static pool)
+#ifndef COMPOSITOR_MAX_LAYERS
+#define COMPOSITOR_MAX_LAYERS 4
+#endif
+// Two screens' worth: e.g. a status bar (128 bytes on 128x64) and a shell
+// below it (896) fill one, and pop-ups and sprites get the other
+#ifndef COMPOSITOR_POOL_BYTES
+#define COMPOSITOR_POOL_BYTES (2 * SSD1306_WIDTH * SSD1306_HEIGHT / 8)
+#endif
+
+// Layer flags
+#define LAYER_OPAQUE 0x01  // Hides everything below it (default: lit pixels only)
+
+typedef struct layer layer_t;
+
+// Create a layer of width x height pixels at (x, y) on screen
+// Higher z is drawn on top. The layer starts empty, visible and clipped
+// to its own bounds. Returns NULL if the pool or layer slots run out.
+layer_t *layer_create(int x, int y, int width, int height, int z, uint8_t flags);
+
+// Draw into a layer: between layer_begin() and layer_end() all drawing
+// functions use layer coordinates (0,0 = layer top left)
+void layer_begin(layer_t *layer);
+void layer_end(void);
+
+// Change position, stacking order, visibility or clip rect
+// (x, y, w, h of the clip rect are screen coordinates). Until a clip rect
+// is set the layer is clipped to its own bounds wherever it moves; a clip
+// rect that has been set stays put when the layer moves.
+void layer_move(layer_t *layer, int x, int y);
+void layer_set_z(layer_t *layer, int z);
+void layer_set_visible(layer_t *layer, bool visible);
+void layer_set_clip(layer_t *layer, int x, int y, int w, int h);
+
+// RAM used by one layer (bitmap + descriptor), in bytes
+uint32_t layer_memory(const layer_t *layer);
+
+// RAM used by all layers, and what is left in the pool, in bytes
+uint32_t compositor_memory_used(void);
+uint32_t compositor_memory_free(void);
+
+// Compose the changed regions of all layers into the display buffer
+// Call ssd1306_display() or ssd1306_display_async() afterwards.
+void compositor_compose(void);
+
+// Recompose the whole screen on the next compositor_compose()
+void compositor_invalidate(void);
+
+// Delete all layers and release the pool
+void compositor_reset(void);
+
+#endif // COMPOSITOR_H
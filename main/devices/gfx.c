@@ -0,0 +1,294 @@
+/*
+* Graphics Primitives
+* ===================
+*
+* Shapes and bitmaps drawn into the SSD1306 framebuffer.
+*
+* Spans are byte operations: horizontal and vertical lines and filled
+* shapes are decomposed into ssd1306_fill_rect() calls, which fill whole
+* page bytes with masks instead of touching pixels one at a time. Only
+* diagonal lines and outlines fall back to single pixels.
+*
+* Bitmaps use the same page layout as the display, so a page-aligned blit
+* is a byte copy and an unaligned blit is one shift per byte, split across
+* the two pages it straddles (same technique as ssd1306_draw_char).
+*
+* Everything is clipped to the screen, and every pixel of a shape is drawn
+* exactly once so XOR (SSD1306_INVERSE) drawing is reversible.
+*/
+
+#include "gfx.h"
+#include "ssd1306.h"
+
+void gfx_draw_hline(int x, int y, int w, uint8_t color) {
+    ssd1306_fill_rect(x, y, w, 1, color);
+}
+
+void gfx_draw_vline(int x, int y, int h, uint8_t color) {
+    ssd1306_fill_rect(x, y, 1, h, color);
+}
+
+void gfx_draw_line(int x0, int y0, int x1, int y1, uint8_t color) {
+    // Axis-aligned lines are spans
+    if (y0 == y1) {
+        if (x0 > x1) { int t = x0; x0 = x1; x1 = t; }
+        gfx_draw_hline(x0, y0, x1 - x0 + 1, color);
+        return;
+    }
+    if (x0 == x1) {
+        if (y0 > y1) { int t = y0; y0 = y1; y1 = t; }
+        gfx_draw_vline(x0, y0, y1 - y0 + 1, color);
+        return;
+    }
+
+    // Bresenham's line algorithm (all octants)
+    int dx = x1 > x0 ? x1 - x0 : x0 - x1;
+    int dy = y1 > y0 ? y0 - y1 : y1 - y0;  // Negative
+    int sx = x0 < x1 ? 1 : -1;
+    int sy = y0 < y1 ? 1 : -1;
+    int err = dx + dy;
+
+    while (1) {
+        ssd1306_set_pixel(x0, y0, color);
+        if (x0 == x1 && y0 == y1) {
+            break;
+        }
+        int e2 = 2 * err;
+        if (e2 >= dy) {
+            err += dy;
+            x0 += sx;
+        }
+        if (e2 <= dx) {
+            err += dx;
+            y0 += sy;
+        }
+    }
+}
+
+void gfx_draw_rect(int x, int y, int w, int h, uint8_t color) {
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+
+    gfx_draw_hline(x, y, w, color);
+    if (h > 1) {
+        gfx_draw_hline(x, y + h - 1, w, color);
+    }
+
+    // Sides exclude the corner pixels already drawn by the top and bottom
+    gfx_draw_vline(x, y + 1, h - 2, color);
+    if (w > 1) {
+        gfx_draw_vline(x + w - 1, y + 1, h - 2, color);
+    }
+}
+
+// Largest dy with dx^2 + dy^2 inside a circle of radius r
+// (uses r^2 + r as the limit, which matches the midpoint outline closely)
+static int gfx_circle_half_height(int r, int dx) {
+    int dy = r;
+    while (dy > 0 && dx * dx + dy * dy > r * r + r) {
+        dy--;
+    }
+    return dy;
+}
+
+void gfx_draw_circle(int x0, int y0, int r, uint8_t color) {
+    if (r < 0) {
+        return;
+    }
+    if (r == 0) {
+        ssd1306_set_pixel(x0, y0, color);
+        return;
+    }
+
+    // Midpoint circle algorithm, one octant mirrored eight ways
+    int x = 0;
+    int y = r;
+    int d = 1 - r;
+
+    while (x <= y) {
+        if (x == 0) {
+            // Axis points: only four distinct pixels
+            ssd1306_set_pixel(x0, y0 + y, color);
+            ssd1306_set_pixel(x0, y0 - y, color);
+            ssd1306_set_pixel(x0 + y, y0, color);
+            ssd1306_set_pixel(x0 - y, y0, color);
+        } else {
+            ssd1306_set_pixel(x0 + x, y0 + y, color);
+            ssd1306_set_pixel(x0 - x, y0 + y, color);
+            ssd1306_set_pixel(x0 + x, y0 - y, color);
+            ssd1306_set_pixel(x0 - x, y0 - y, color);
+            if (x != y) {
+                // Diagonal points would otherwise be drawn twice
+                ssd1306_set_pixel(x0 + y, y0 + x, color);
+                ssd1306_set_pixel(x0 - y, y0 + x, color);
+                ssd1306_set_pixel(x0 + y, y0 - x, color);
+                ssd1306_set_pixel(x0 - y, y0 - x, color);
+            }
+        }
+
+        x++;
+        if (d < 0) {
+            d += 2 * x + 1;
+        } else {
+            y--;
+            d += 2 * (x - y) + 1;
+        }
+    }
+}
+
+void gfx_fill_circle(int x0, int y0, int r, uint8_t color) {
+    if (r < 0) {
+        return;
+    }
+
+    // One vertical span per column
+    for (int dx = 0; dx <= r; dx++) {
+        int dy = gfx_circle_half_height(r, dx);
+        gfx_draw_vline(x0 + dx, y0 - dy, 2 * dy + 1, color);
+        if (dx != 0) {
+            gfx_draw_vline(x0 - dx, y0 - dy, 2 * dy + 1, color);
+        }
+    }
+}
+
+// Limit the corner radius so the two corners on each side never overlap
+static int gfx_clamp_radius(int w, int h, int r) {
+    int max_r = ((w < h ? w : h) - 2) / 2;
+    if (r > max_r) r = max_r;
+    if (r < 0) r = 0;
+    return r;
+}
+
+// Draw one quarter circle around (cx, cy); sx/sy (+1/-1) pick the quadrant
+static void gfx_draw_corner(int cx, int cy, int r, int sx, int sy, uint8_t color) {
+    int x = 0;
+    int y = r;
+    int d = 1 - r;
+
+    while (x <= y) {
+        ssd1306_set_pixel(cx + sx * x, cy + sy * y, color);
+        if (x != y) {
+            ssd1306_set_pixel(cx + sx * y, cy + sy * x, color);
+        }
+
+        x++;
+        if (d < 0) {
+            d += 2 * x + 1;
+        } else {
+            y--;
+            d += 2 * (x - y) + 1;
+        }
+    }
+}
+
+void gfx_draw_round_rect(int x, int y, int w, int h, int r, uint8_t color) {
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+    r = gfx_clamp_radius(w, h, r);
+    if (r == 0) {
+        gfx_draw_rect(x, y, w, h, color);
+        return;
+    }
+
+    // Straight edges between the corner arcs
+    gfx_draw_hline(x + r + 1, y, w - 2 * r - 2, color);
+    gfx_draw_hline(x + r + 1, y + h - 1, w - 2 * r - 2, color);
+    gfx_draw_vline(x, y + r + 1, h - 2 * r - 2, color);
+    gfx_draw_vline(x + w - 1, y + r + 1, h - 2 * r - 2, color);
+
+    // Corner arcs (each includes both of its end points)
+    gfx_draw_corner(x + r, y + r, r, -1, -1, color);
+    gfx_draw_corner(x + w - 1 - r, y + r, r, 1, -1, color);
+    gfx_draw_corner(x + r, y + h - 1 - r, r, -1, 1, color);
+    gfx_draw_corner(x + w - 1 - r, y + h - 1 - r, r, 1, 1, color);
+}
+
+void gfx_fill_round_rect(int x, int y, int w, int h, int r, uint8_t color) {
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+    r = gfx_clamp_radius(w, h, r);
+
+    // Full-height middle block, then one span per corner column
+    ssd1306_fill_rect(x + r, y, w - 2 * r, h, color);
+    for (int i = 0; i < r; i++) {
+        int inset = r - gfx_circle_half_height(r, r - i);
+        gfx_draw_vline(x + i, y + inset, h - 2 * inset, color);
+        gfx_draw_vline(x + w - 1 - i, y + inset, h - 2 * inset, color);
+    }
+}
+
+// Combine a run of source bytes into one logical page with a raster op
+// src[c0..c1) are the bitmap columns, already shifted into position;
+// mask selects which bits of each byte belong to the bitmap.
+// A target whose height is not a multiple of 8 ends in a partial page;
+// the rows below its bottom edge are left alone.
+static void gfx_rop_run(int page, int x, const uint8_t *src, int c0, int c1,
+                        int shift, uint8_t mask, gfx_rop_t rop) {
+    int height = ssd1306_height();
+    if (page < 0 || page >= (height + 7) / 8) {
+        return;
+    }
+    if (page == height / 8) {
+        mask &= (1 << (height & 7)) - 1;
+    }
+    if (mask == 0) {
+        return;
+    }
+
+    uint8_t *row = ssd1306_page_buffer(page);
+    int first = -1;
+    int last = -1;
+
+    for (int c = c0; c < c1; c++) {
+        uint8_t value = shift >= 0 ? (uint8_t)(src[c] << shift) : (uint8_t)(src[c] >> -shift);
+        uint8_t old = row[x + c];
+        uint8_t result;
+
+        switch (rop) {
+            case GFX_ROP_OR:  result = old | (value & mask); break;
+            case GFX_ROP_AND: result = old & (value | ~mask); break;
+            case GFX_ROP_XOR: result = old ^ (value & mask); break;
+            default:          result = (old & ~mask) | (value & mask); break;
+        }
+
+        if (result != old) {
+            row[x + c] = result;
+            if (first < 0) first = c;
+            last = c;
+        }
+    }
+
+    if (first >= 0) {
+        ssd1306_mark_page_dirty(page, x + first, x + last);
+    }
+}
+
+void gfx_draw_bitmap(int x, int y, const uint8_t *bitmap, int w, int h, gfx_rop_t rop) {
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+
+    // Clip columns once; pages are clipped per run
+    int c0 = x < 0 ? -x : 0;
+    int c1 = x + w > ssd1306_width() ? ssd1306_width() - x : w;
+    if (c0 >= c1) {
+        return;
+    }
+
+    int page = y >> 3;   // Floor division, also for negative y
+    int shift = y & 7;
+
+    for (int src_page = 0; src_page * 8 < h; src_page++) {
+        const uint8_t *src = &bitmap[src_page * w];
+        int rows = h - src_page * 8;
+        uint8_t mask = rows >= 8 ? 0xFF : (uint8_t)((1 << rows) - 1);
+
+        gfx_rop_run(page + src_page, x, src, c0, c1, shift, (uint8_t)(mask << shift), rop);
+        if (shift) {
+            gfx_rop_run(page + src_page + 1, x, src, c0, c1, shift - 8, mask >> (8 - shift), rop);
+        }
+    }
+}
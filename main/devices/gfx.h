@@ -0,0 +1,46 @@
+/*
+ * Graphics primitives for the SSD1306 framebuffer
+ * Lines, rectangles, circles and bitmaps with clipping and raster ops
+ */
+
+#ifndef GFX_H
+#define GFX_H
+
+#include <stdint.h>
+
+// Raster operations for bitmap blits
+typedef enum {
+    GFX_ROP_COPY,   // Destination = source (bitmap is opaque)
+    GFX_ROP_OR,     // Set pixels that are on in the bitmap
+    GFX_ROP_AND,    // Clear pixels that are off in the bitmap
+    GFX_ROP_XOR,    // Flip pixels that are on in the bitmap
+} gfx_rop_t;
+
+// All color arguments take SSD1306_BLACK, SSD1306_WHITE or SSD1306_INVERSE.
+// Every pixel of a shape is touched exactly once, so SSD1306_INVERSE (XOR)
+// drawing can be undone by drawing the same shape again.
+
+// Horizontal and vertical lines (whole-byte operations)
+void gfx_draw_hline(int x, int y, int w, uint8_t color);
+void gfx_draw_vline(int x, int y, int h, uint8_t color);
+
+// Line between two points (Bresenham)
+void gfx_draw_line(int x0, int y0, int x1, int y1, uint8_t color);
+
+// Rectangle outline
+void gfx_draw_rect(int x, int y, int w, int h, uint8_t color);
+
+// Circle outline and filled circle, centered at (x0, y0)
+void gfx_draw_circle(int x0, int y0, int r, uint8_t color);
+void gfx_fill_circle(int x0, int y0, int r, uint8_t color);
+
+// Rectangle with rounded corners of radius r (outline and filled)
+void gfx_draw_round_rect(int x, int y, int w, int h, int r, uint8_t color);
+void gfx_fill_round_rect(int x, int y, int w, int h, int r, uint8_t color);
+
+// Draw a 1-bpp bitmap at (x, y)
+// The bitmap uses the display's own layout: ceil(h / 8) pages of w bytes,
+// each byte a column of 8 pixels with bit 0 at the top.
+void gfx_draw_bitmap(int x, int y, const uint8_t *bitmap, int w, int h, gfx_rop_t rop);
+
+#endif // GFX_H
@@ -0,0 +1,290 @@
+/*
+* Grayscale
+* =========
+*
+* 4-level grayscale on the 1-bpp SSD1306 by temporal dithering.
+*
+* A 2-bit level is split into two bit-planes in the panel's page layout:
+* the high plane holds bit 1 and the low plane bit 0. Each grayscale frame
+* is three equal sub-frames showing high, high, low, so a pixel is lit for
+* level/3 of the time. Sub-frames are paced with the cycle counter, not by
+* how fast the bus happens to be, so the levels stay stable.
+*
+* Only what changes on the panel is sent:
+* - Panels with at most 4 pages leave half of the 64-row GDDRAM unused.
+*   Both planes are uploaded there once, and a sub-frame switch is a
+*   single start line command.
+* - Otherwise the panel RAM holds the plane on screen. High to high sends
+*   nothing, and a plane switch sends, per page, the column range where
+*   the planes differ. Flat areas (levels 0 and 3) cost no bus time; a
+*   full 128x64 frame of mid grays needs two 1 KB transfers per frame.
+*
+* Drawing converts 8-bit images with a 4x4 Bayer matrix, which keeps
+* gradients smooth without the frame-to-frame crawl of error diffusion.
+*
+* Each display has its own planes and sub-frame timing, so two panels can
+* show grayscale at once: the main loop steps each with its handle, and
+* drawing goes to the planes of the selected display, like ssd1306_*.
+*/
+
+#include "grayscale.h"
+#include "cpu.h"
+#include <string.h>
+
+#define GRAY_PLANE_BYTES (SSD1306_WIDTH * SSD1306_PAGES)
+
+// Both planes fit in GDDRAM next to each other
+#define GRAY_RAM_PLANES (SSD1306_PAGES * 2 <= 8)
+
+// Bus bytes to address a window and open its data transaction (as in
+// the driver's flush planner)
+#if SSD1306_PAGE_ADDRESSING
+#define GRAY_WINDOW_OVERHEAD 8
+#else
+#define GRAY_WINDOW_OVERHEAD 11
+#endif
+
+// Plane shown in each sub-frame (0 = high, 1 = low)
+static const uint8_t subframe_plane[GRAY_SUBFRAMES] = {0, 0, 1};
+
+// 4x4 Bayer threshold matrix (0-15)
+static const uint8_t bayer4[4][4] = {
+    { 0,  8,  2, 10},
+    {12,  4, 14,  6},
+    { 3, 11,  1,  9},
+    {15,  7, 13,  5},
+};
+
+// Grayscale state of one display
+typedef struct {
+    ssd1306_t *display;              // Owner (NULL = free)
+    uint8_t planes[2][GRAY_PLANE_BYTES];
+    bool planes_changed;             // Image changed since it was last sent
+    bool active;
+    int shown_plane;                 // Plane the panel shows (-1 = unknown)
+    uint8_t subframe;
+    uint32_t subframe_cycles;        // Sub-frame length
+    uint32_t next_subframe;          // Cycle count when the next one is due
+    uint32_t frame_start;
+    uint32_t frame_cycles;           // Length of the last complete frame
+} gray_context_t;
+
+static gray_context_t contexts[SSD1306_MAX_DISPLAYS];
+
+// The grayscale state of a display, set up on first use
+// Displays are never released, so the pool cannot run out.
+static gray_context_t *gray_context(ssd1306_t *display) {
+    gray_context_t *free_slot = NULL;
+    for (int i = 0; i < SSD1306_MAX_DISPLAYS; i++) {
+        if (contexts[i].display == display) {
+            return &contexts[i];
+        }
+        if (!contexts[i].display && !free_slot) {
+            free_slot = &contexts[i];
+        }
+    }
+    memset(free_slot, 0, sizeof(*free_slot));
+    free_slot->display = display;
+    free_slot->subframe_cycles = CPU_FREQ_HZ / GRAY_SUBFRAME_RATE;
+    return free_slot;
+}
+
+bool gray_begin(ssd1306_t *display) {
+    ssd1306_rotation_t rotation = ssd1306_get_rotation(display);
+    if (rotation == SSD1306_ROTATE_90 || rotation == SSD1306_ROTATE_270) {
+        return false;
+    }
+
+    // Let a pending update finish before the planes take over the RAM
+    if (!ssd1306_display(display)) {
+        return false;
+    }
+
+    gray_context_t *gray = gray_context(display);
+    ssd1306_set_start_line(display, 0);
+    gray->shown_plane = -1;
+    gray->planes_changed = true;
+    gray->subframe = 0;
+    gray->next_subframe = cpu_cycles();
+    gray->frame_start = gray->next_subframe;
+    gray->frame_cycles = 0;
+    gray->active = true;
+    return true;
+}
+
+void gray_end(ssd1306_t *display) {
+    gray_context(display)->active = false;
+    ssd1306_invalidate(display);
+}
+
+bool gray_active(ssd1306_t *display) {
+    return gray_context(display)->active;
+}
+
+// Send one page of a plane, columns x0..x1
+static void gray_send(gray_context_t *gray, int plane, int ram_page, int page, int x0, int x1) {
+    ssd1306_write_ram(gray->display, ram_page, x0, &gray->planes[plane][page * SSD1306_WIDTH + x0], x1 - x0 + 1);
+}
+
+#if !GRAY_RAM_PLANES
+// Columns of a page where the two planes differ; false if none
+static bool gray_diff(const gray_context_t *gray, int page, int *x0, int *x1) {
+    const uint8_t *hi = &gray->planes[0][page * SSD1306_WIDTH];
+    const uint8_t *lo = &gray->planes[1][page * SSD1306_WIDTH];
+    int first = 0;
+    int last = SSD1306_WIDTH - 1;
+    while (first <= last && hi[first] == lo[first]) first++;
+    while (last > first && hi[last] == lo[last]) last--;
+    *x0 = first;
+    *x1 = last;
+    return first <= last;
+}
+#endif
+
+// Put a plane on the panel
+static void gray_show(gray_context_t *gray, int plane) {
+#if GRAY_RAM_PLANES
+    if (gray->planes_changed) {
+        // Upload both: high plane at RAM page 0, low plane right below it
+        for (int p = 0; p < 2; p++) {
+            for (int page = 0; page < SSD1306_PAGES; page++) {
+                gray_send(gray, p, p * SSD1306_PAGES + page, page, 0, SSD1306_WIDTH - 1);
+            }
+        }
+        gray->planes_changed = false;
+        gray->shown_plane = -1;
+    }
+    if (plane != gray->shown_plane) {
+        ssd1306_set_start_line(gray->display, plane * SSD1306_PAGES * 8);
+    }
+#else
+    if (gray->planes_changed) {
+        for (int page = 0; page < SSD1306_PAGES; page++) {
+            gray_send(gray, plane, page, page, 0, SSD1306_WIDTH - 1);
+        }
+        gray->planes_changed = false;
+    } else if (plane != gray->shown_plane) {
+        for (int page = 0; page < SSD1306_PAGES; page++) {
+            int x0, x1;
+            if (gray_diff(gray, page, &x0, &x1)) {
+                gray_send(gray, plane, page, page, x0, x1);
+            }
+        }
+    }
+#endif
+    gray->shown_plane = plane;
+}
+
+void gray_step(ssd1306_t *display) {
+    gray_context_t *gray = gray_context(display);
+    if (!gray->active) {
+        return;
+    }
+
+    uint32_t now = cpu_cycles();
+    if ((int32_t)(now - gray->next_subframe) < 0) {
+        return;
+    }
+
+    // Keep a steady cadence, but don't try to catch up after a slow transfer
+    gray->next_subframe += gray->subframe_cycles;
+    if ((int32_t)(now - gray->next_subframe) >= 0) {
+        gray->next_subframe = now + gray->subframe_cycles;
+    }
+
+    if (gray->subframe == 0) {
+        gray->frame_cycles = now - gray->frame_start;
+        gray->frame_start = now;
+    }
+
+    gray_show(gray, subframe_plane[gray->subframe]);
+    gray->subframe = (gray->subframe + 1) % GRAY_SUBFRAMES;
+}
+
+void gray_clear(void) {
+    gray_context_t *gray = gray_context(ssd1306_selected());
+    memset(gray->planes, 0, sizeof(gray->planes));
+    gray->planes_changed = true;
+}
+
+void gray_set_pixel(int x, int y, uint8_t level) {
+    if (x < 0 || x >= SSD1306_WIDTH || y < 0 || y >= SSD1306_HEIGHT) {
+        return;
+    }
+
+    gray_context_t *gray = gray_context(ssd1306_selected());
+    int index = (y / 8) * SSD1306_WIDTH + x;
+    uint8_t bit = 1 << (y & 7);
+    for (int p = 0; p < 2; p++) {
+        bool on = level & (2 >> p);
+        uint8_t old = gray->planes[p][index];
+        gray->planes[p][index] = on ? old | bit : old & ~bit;
+        if (gray->planes[p][index] != old) {
+            gray->planes_changed = true;
+        }
+    }
+}
+
+void gray_draw_image(int x, int y, int w, int h, const uint8_t *pixels, gray_dither_t dither) {
+    for (int row = 0; row < h; row++) {
+        for (int col = 0; col < w; col++) {
+            // Scale to 0..765 so each level step is 255 wide
+            uint32_t value = pixels[row * w + col] * (GRAY_LEVELS - 1);
+            uint8_t level;
+            if (dither == GRAY_DITHER_BAYER) {
+                // Round up when the remainder beats the cell's threshold
+                uint32_t threshold = (2 * bayer4[(y + row) & 3][(x + col) & 3] + 1) * 255;
+                level = value / 255 + ((value % 255) * 32 > threshold);
+            } else {
+                level = (value + 127) / 255;
+            }
+            gray_set_pixel(x + col, y + row, level);
+        }
+    }
+}
+
+void gray_draw_2bpp(int x, int y, int w, int h, const uint8_t *data) {
+    int stride = (w + 3) / 4;
+    for (int row = 0; row < h; row++) {
+        for (int col = 0; col < w; col++) {
+            uint8_t byte = data[row * stride + col / 4];
+            gray_set_pixel(x + col, y + row, (byte >> (6 - 2 * (col & 3))) & 3);
+        }
+    }
+}
+
+void gray_set_subframe_rate(ssd1306_t *display, uint32_t hz) {
+    gray_context(display)->subframe_cycles = CPU_FREQ_HZ / (hz ? hz : 1);
+}
+
+uint32_t gray_frame_rate(ssd1306_t *display) {
+    gray_context_t *gray = gray_context(display);
+    return gray->frame_cycles ? CPU_FREQ_HZ / gray->frame_cycles : 0;
+}
+
+uint32_t gray_estimate_frame_rate(ssd1306_t *display, uint32_t bus_hz) {
+    gray_context_t *gray = gray_context(display);
+
+    // Bus bits for one plane switch (9 clocks per byte, ~2 for START/STOP)
+    uint32_t bits;
+#if GRAY_RAM_PLANES
+    bits = 3 * 9 + 2;  // Address, control byte, start line command
+#else
+    bits = 0;
+    for (int page = 0; page < SSD1306_PAGES; page++) {
+        int x0, x1;
+        if (gray_diff(gray, page, &x0, &x1)) {
+            bits += 9 * (x1 - x0 + 1 + GRAY_WINDOW_OVERHEAD) + 4;
+        }
+    }
+#endif
+
+    // A sub-frame lasts until its switch is sent, and at least its slot;
+    // two of the three begin with a switch
+    uint32_t slot_us = cpu_cycles_to_us(gray->subframe_cycles);
+    uint32_t switch_us = (uint32_t)((uint64_t)bits * 1000000 / bus_hz);
+    if (switch_us < slot_us) {
+        switch_us = slot_us;
+    }
+    return 1000000 / (slot_us + 2 * switch_us);
+}
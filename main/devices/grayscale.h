@@ -0,0 +1,72 @@
+/*
+ * Grayscale - 4-level temporal dithering on the monochrome SSD1306
+ * Two bit-planes are shown alternately, the high plane twice as long as
+ * the low one, so a pixel's brightness follows its 2-bit level
+ */
+
+#ifndef GRAYSCALE_H
+#define GRAYSCALE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ssd1306.h"
+
+// Gray levels: 0 = off, 1 = 1/3, 2 = 2/3, 3 = fully lit
+#define GRAY_LEVELS 4
+
+// Sub-frames per grayscale frame (high plane, high plane, low plane)
+#define GRAY_SUBFRAMES 3
+
+// Plane switches per second (a grayscale frame is GRAY_SUBFRAMES of them)
+#ifndef GRAY_SUBFRAME_RATE
+#define GRAY_SUBFRAME_RATE 120
+#endif
+
+// How 8-bit source pixels are reduced to 4 levels
+typedef enum {
+    GRAY_DITHER_NONE,   // Nearest level
+    GRAY_DITHER_BAYER,  // 4x4 ordered dither (smooth gradients, no drift)
+} gray_dither_t;
+
+// Take over a panel for grayscale output
+// Waits for a pending display update, then starts showing the planes.
+// Drawing uses panel coordinates (SSD1306_WIDTH x SSD1306_HEIGHT);
+// returns false in portrait orientation or if that update failed.
+// Each display keeps its own planes; the drawing calls below go to those
+// of the selected display (ssd1306_select()).
+bool gray_begin(ssd1306_t *display);
+
+// Give the panel back; the next display update resends the whole buffer
+void gray_end(ssd1306_t *display);
+
+// True between gray_begin() and gray_end()
+bool gray_active(ssd1306_t *display);
+
+// Show the next sub-frame when it is due (call from the main loop
+// instead of ssd1306_flush_step() while grayscale is active)
+void gray_step(ssd1306_t *display);
+
+// Set every pixel to level 0
+void gray_clear(void);
+
+// Set a pixel (x, y) to a level 0-3
+void gray_set_pixel(int x, int y, uint8_t level);
+
+// Draw a w x h 8-bit image (row-major, 0 = black, 255 = white) at (x, y)
+void gray_draw_image(int x, int y, int w, int h, const uint8_t *pixels, gray_dither_t dither);
+
+// Draw a w x h 2-bpp image at (x, y): rows of (w + 3) / 4 bytes, four
+// pixels per byte with the leftmost in the top two bits
+void gray_draw_2bpp(int x, int y, int w, int h, const uint8_t *data);
+
+// Change the sub-frame rate (plane switches per second)
+void gray_set_subframe_rate(ssd1306_t *display, uint32_t hz);
+
+// Grayscale frames per second measured over the last frame
+uint32_t gray_frame_rate(ssd1306_t *display);
+
+// Grayscale frames per second the current image allows on a bus running
+// at bus_hz (bus time per frame against the sub-frame rate)
+uint32_t gray_estimate_frame_rate(ssd1306_t *display, uint32_t bus_hz);
+
+#endif // GRAYSCALE_H
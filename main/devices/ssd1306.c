@@ -2,31 +2,104 @@
 * SSD1306 OLED Display Driver
 * ============================
 * 
-* Driver for 128x64 monochrome OLED displays using the SSD1306 controller.
-* Communicates via I²C interface.
+* Driver for monochrome OLED displays using the SSD1306 controller
+* (128x64, 128x32 and 72x40 panels) or the similar SH1106 (132x64 RAM).
+* Communicates via I²C interface. The panel is selected at build time,
+* see ssd1306_panel.h.
 * 
 * Features:
 * - Hardware I²C communication
-* - Full display buffer in RAM (1024 bytes)
-* - Text rendering with 5x7 font
+* - Full display buffer in RAM (1024 bytes on a 128x64 panel)
+* - Dirty-region tracking: only changed columns of changed pages are sent
+* - Hardware vertical scrolling via the display start line
+* - Non-blocking incremental flush (bounded bytes per main-loop iteration)
+* - Text rendering with generated fixed or proportional fonts
 * - Basic graphics (pixels, rectangles)
 * - Display control (contrast, invert, on/off)
+* - Transport statistics and per-flush cycle timing
+* - Several displays, on one bus or on separate ones
 * 
 * Memory Layout:
-* Display is organized as 8 pages of 128 columns
-* Each page is 8 pixels tall (1 byte = 8 vertical pixels)
+* Display is organized as pages of SSD1306_WIDTH columns (8 pages of 128
+* on a 128x64 panel). Each page is 8 pixels tall (1 byte = 8 vertical pixels)
 * 
 *     Page 0: Rows 0-7
 *     Page 1: Rows 8-15
 *     ...
 *     Page 7: Rows 56-63
 * 
+* The buffer only covers the visible area; SSD1306_COLUMN_OFFSET is added
+* when addressing GDDRAM (72x40 panels start at column 28, SH1106 at 2).
+* The SH1106 has no COLUMN_ADDR/PAGE_ADDR windows, only page addressing,
+* so there every window is one page and is addressed with 0xB0/0x00/0x10.
+* 
+* Dirty Tracking:
+* Every drawing call marks the columns it changed in a per-page bitmap.
+* A flush turns the bitmap into COLUMN_ADDR/PAGE_ADDR windows and streams
+* only their bytes. Opening a window costs about SSD1306_WINDOW_COST bytes
+* on the bus, so the planner works in bytes on the wire: gaps cheaper
+* than a new window are sent as part of the span, and spans on adjacent
+* pages are joined into one taller window when the extra clean bytes
+* cost less than re-addressing. A fully dirty frame ends up as a single
+* 1024-byte window and one changed character as a ~6-byte one.
+* 
+* Hardware Scrolling:
+* The buffer mirrors GDDRAM, which is used as a ring of pages. Logical
+* page 0 (top of the screen) lives in RAM page page_offset, and the
+* display start line is set to page_offset * 8 so the controller shows it
+* at the top. Scrolling by one text row just advances page_offset and
+* clears the page that wraps around to the bottom, so only that page has
+* to be resent instead of the whole frame. The start line always moves
+* through all 64 RAM rows, so panels with fewer pages scroll the buffer
+* in software instead.
+* 
+* Asynchronous Flush:
+* A flush first snapshots the dirty windows into flush_data (packed in
+* the order the controller expects them) and clears the dirty map, so the
+* application can keep drawing while the snapshot goes out. Each call to
+* ssd1306_flush_step() then sends at most a fixed number of data bytes.
+* GDDRAM keeps its address pointer between I²C transactions, so a window
+* can be split into any number of data transactions after it has been
+* addressed once. ssd1306_display() is the same machine run to completion.
+* 
+* Frame Pacing:
+* ssd1306_display_async() only raises a request. The snapshot is taken by
+* ssd1306_flush_step() once the previous one is on the panel and at least
+* one frame interval has passed since it was taken, so every request made
+* in the meantime (a command printing ten lines, say) lands in one update
+* and the bus is never busy more than SSD1306_FRAME_RATE times a second.
+* 
+* Rotation:
+* 0 and 180 degrees only change the SEG remap / COM scan direction, the
+* buffer stays as it is. For 90 and 270 degrees the buffer holds a
+* portrait canvas (SSD1306_HEIGHT x SSD1306_WIDTH, still page-oriented),
+* and the flush snapshot is produced with 8x8 bit-matrix transposes: one
+* canvas byte column block becomes one GDDRAM byte block in ~20 ALU ops,
+* instead of reading and writing 64 single pixels. A transpose alone
+* mirrors the image; flipping one hardware axis turns it into a rotation
+* (270 is 90 with both axes flipped). Dirty marks are converted to GDDRAM
+* coordinates as they are made, so the flush planner is unchanged.
+* Hardware scrolling needs landscape; portrait scrolls in the buffer.
+* 
+* Multiple Displays:
+* Everything a display needs lives in a struct ssd1306 from a fixed pool
+* (SSD1306_MAX_DISPLAYS). Everything that talks to the panel (updates,
+* frame pacing, statistics, raw RAM and commands) takes the display it is
+* for, so a main loop steps each display's flush with its own handle and
+* nothing depends on which one was touched last. Drawing acts on the
+* selected display, like it acts on the selected target: the drawing API
+* keeps its shape, and code built on it (graphics, text, the compositor)
+* works on any display without changes. Each display is an I²C device
+* with its own clock, so a display at 1MHz shares a bus with a 100kHz
+* sensor without being slowed to its speed.
+* 
 * Based on SSD1306 datasheet rev 1.1
 */
 
 #include "ssd1306.h"
 #include "i2c.h"
-#include "font5x7.h"
+#include "font.h"
+#include "cpu.h"
 #include <string.h>
 
 // SSD1306 Commands
@@ -47,6 +120,7 @@
 #define SSD1306_CMD_PAGE_ADDR               0x22  // Set page address range
 #define SSD1306_CMD_SET_LOW_COLUMN          0x00  // Set lower column start address
 #define SSD1306_CMD_SET_HIGH_COLUMN         0x10  // Set higher column start address
+#define SSD1306_CMD_SET_PAGE_START          0xB0  // Set page start address (page addressing mode)
 
 // Hardware Configuration Commands
 #define SSD1306_CMD_SET_COM_PINS            0xDA  // Set COM pins hardware config
@@ -64,163 +138,771 @@
 #define SSD1306_CMD_CHARGE_PUMP             0x8D  // Enable/disable charge pump
 #define SSD1306_CMD_EXTERNAL_VCC            0x01  // External VCC mode
 #define SSD1306_CMD_SWITCH_CAP_VCC          0x02  // Switched capacitor VCC mode
+#define SSD1306_CMD_SET_IREF                0xAD  // Internal IREF (SSD1306) / DC-DC control (SH1106)
 
 // I²C Control Bytes (determines command vs data)
 #define SSD1306_CONTROL_CMD_SINGLE  0x80  // Single command byte follows
 #define SSD1306_CONTROL_CMD_STREAM  0x00  // Stream of command bytes follows
 #define SSD1306_CONTROL_DATA_STREAM 0x40  // Stream of data bytes follows
 
-// Display buffer (128x64 = 8192 bits = 1024 bytes)
-static uint8_t ssd1306_buffer[SSD1306_WIDTH * SSD1306_HEIGHT / 8];
-static uint8_t ssd1306_i2c_addr;
+// Largest side of the drawing canvas
+#define SSD1306_CANVAS_MAX (SSD1306_WIDTH > SSD1306_HEIGHT ? SSD1306_WIDTH : SSD1306_HEIGHT)
 
-// Send command to SSD1306
-static bool ssd1306_send_command(uint8_t cmd) {
-    uint8_t data[2] = {SSD1306_CONTROL_CMD_SINGLE, cmd};
-    return i2c_write(ssd1306_i2c_addr, data, 2);
+// Dirty columns per RAM page (bit x of the page's bitmap = column x)
+#define DIRTY_WORDS ((SSD1306_WIDTH + 31) / 32)
+
+// One GDDRAM window of an in-progress flush
+typedef struct {
+    uint8_t x0, x1;     // Column range (inclusive)
+    uint8_t p0, p1;     // Page range (inclusive)
+    uint16_t offset;    // Start of this window's bytes in flush_data
+} flush_window_t;
+
+// Bus cost of opening a window, in byte times: the addressing transaction
+// (address + control + COLUMN_ADDR/PAGE_ADDR with arguments, or the three
+// SH1106 page/column commands) plus the address and control byte of the
+// extra data transaction, and START/STOP overhead.
+// A clean gap shorter than this is cheaper to resend than to skip.
+#if SSD1306_PAGE_ADDRESSING
+#define SSD1306_WINDOW_COST 8
+#else
+#define SSD1306_WINDOW_COST 11
+#endif
+
+// Most windows one page can produce (spans at least WINDOW_COST + 1 apart)
+#define SSD1306_MAX_PAGE_SPANS ((SSD1306_WIDTH + SSD1306_WINDOW_COST) / (SSD1306_WINDOW_COST + 1))
+
+// One display: its device, buffer, drawing target and flush state
+struct ssd1306 {
+    i2c_dev_t dev;
+
+    // Display buffer (128x64 = 8192 bits = 1024 bytes, 72x40 = 360 bytes)
+    uint8_t buffer[SSD1306_WIDTH * SSD1306_HEIGHT / 8];
+
+    // Drawing canvas: the buffer as seen by drawing code
+    // Landscape: SSD1306_WIDTH x SSD1306_HEIGHT, laid out exactly like GDDRAM.
+    // Portrait: SSD1306_HEIGHT x SSD1306_WIDTH, transposed while flushing.
+    ssd1306_rotation_t rotation;
+    bool portrait;
+    int canvas_width;
+    int canvas_height;
+    int canvas_pages;
+
+    // Drawing target: the canvas, or an off-screen bitmap (ssd1306_set_target)
+    uint8_t *draw_buffer;
+    int draw_width;
+    int draw_height;
+    int draw_pages;
+    bool draw_offscreen;          // Drawing to a bitmap, not the display
+    ssd1306_dirty_fn draw_dirty;  // Its change callback (may be NULL)
+
+    uint32_t dirty_cols[SSD1306_PAGES][DIRTY_WORDS];
+
+    // Font used for text rendering
+    const font_t *font;
+
+    // RAM page shown at the top of the screen (hardware scroll position)
+    uint8_t page_offset;
+    bool start_line_pending;
+
+    // Asynchronous flush state (snapshot of the frame being sent)
+    uint8_t flush_data[SSD1306_WIDTH * SSD1306_HEIGHT / 8];
+    uint16_t flush_data_len;
+    flush_window_t flush_windows[SSD1306_PAGES * SSD1306_MAX_PAGE_SPANS];
+    uint8_t flush_window_count;
+    uint8_t flush_window;      // Window currently being sent
+    uint16_t flush_sent;       // Bytes of that window already sent
+    bool flush_addressed;      // COLUMN_ADDR/PAGE_ADDR sent for it
+    bool flush_start_line_pending;
+    uint8_t flush_start_line;
+    bool flush_active;
+    bool flush_requested;
+    bool flush_failed;         // A window or the start line got a bus error
+    uint32_t flush_begin_cycles;  // When the running flush was captured
+    uint32_t flush_busy_cycles;   // CPU cycles spent sending it so far
+    uint32_t frame_interval_cycles;  // Minimum time between two captures
+
+    // Transport and timing statistics
+    ssd1306_stats_t stats;
+};
+
+static ssd1306_t displays[SSD1306_MAX_DISPLAYS];
+static int display_count;
+static ssd1306_t *disp;  // Selected display (ssd1306_select)
+
+// Map a logical page (0 = top of the target) to its buffer page
+// (page_offset is always 0 in portrait; off-screen targets never scroll)
+static inline int ssd1306_ram_page(int page) {
+#if SSD1306_HW_SCROLL
+    if (!disp->draw_offscreen) {
+        int ram_page = page + disp->page_offset;
+        return ram_page < disp->canvas_pages ? ram_page : ram_page - disp->canvas_pages;
+    }
+#endif
+    return page;
 }
 
-// Send data to SSD1306
+
+// Send one I²C transaction: control byte followed by a stream of bytes
 // Note: Uses low-level I2C for efficiency (sends control byte + up to 1024 bytes in one transaction)
-static bool ssd1306_send_data(const uint8_t *data, uint32_t len) {
-    if (!i2c_start()) {
+static bool ssd1306_send_stream(ssd1306_t *display, uint8_t control, const uint8_t *data, uint32_t len) {
+    display->stats.transactions++;
+    if (control == SSD1306_CONTROL_DATA_STREAM) {
+        display->stats.data_bytes += len;
+    } else {
+        display->stats.command_bytes += len;
+    }
+
+    i2c_bus_t *bus = display->dev.bus;
+    i2c_dev_select(&display->dev);
+    if (!i2c_start(bus)) {
+        display->stats.errors++;
         return false;
     }
 
     // Write device address with write bit
-    if (!i2c_write_byte(ssd1306_i2c_addr << 1)) {
-        i2c_stop();
+    if (!i2c_write_byte(bus, display->dev.addr << 1)) {
+        i2c_stop(bus);
+        display->stats.errors++;
         return false;
     }
 
-    // Write control byte for data stream
-    if (!i2c_write_byte(SSD1306_CONTROL_DATA_STREAM)) {
-        i2c_stop();
+    // Write control byte (command stream or data stream)
+    if (!i2c_write_byte(bus, control)) {
+        i2c_stop(bus);
+        display->stats.errors++;
         return false;
     }
 
-    // Write data bytes
+    // Write payload bytes
     for (uint32_t i = 0; i < len; i++) {
-        if (!i2c_write_byte(data[i])) {
-            i2c_stop();
+        if (!i2c_write_byte(bus, data[i])) {
+            i2c_stop(bus);
+            display->stats.errors++;
             return false;
         }
     }
 
-    i2c_stop();
+    i2c_stop(bus);
+    if (i2c_last_error(bus) != I2C_OK) {
+        display->stats.errors++;  // The STOP timed out
+        return false;
+    }
+    return true;
+}
+
+// Send a list of command bytes (and their arguments) in one transaction
+bool ssd1306_send_commands(ssd1306_t *display, const uint8_t *cmds, uint32_t len) {
+    return ssd1306_send_stream(display, SSD1306_CONTROL_CMD_STREAM, cmds, len);
+}
+
+// Send a single command byte to SSD1306
+static bool ssd1306_send_command(ssd1306_t *display, uint8_t cmd) {
+    uint8_t data[2] = {SSD1306_CONTROL_CMD_SINGLE, cmd};
+    display->stats.transactions++;
+    display->stats.command_bytes++;
+    if (!i2c_write(&display->dev, data, 2)) {
+        display->stats.errors++;
+        return false;
+    }
+    return true;
+}
+
+// Send display data (GDDRAM bytes) to SSD1306
+static bool ssd1306_send_data(ssd1306_t *display, const uint8_t *data, uint32_t len) {
+    return ssd1306_send_stream(display, SSD1306_CONTROL_DATA_STREAM, data, len);
+}
+
+// Mark GDDRAM columns x0..x1 of a page as dirty
+static void ssd1306_mark_gram(ssd1306_t *display, int page, int x0, int x1) {
+    for (int word = x0 / 32; word <= x1 / 32; word++) {
+        int base = word * 32;
+        uint32_t mask = 0xFFFFFFFF;
+        if (x0 > base) {
+            mask &= 0xFFFFFFFF << (x0 - base);
+        }
+        if (x1 < base + 31) {
+            mask &= 0xFFFFFFFF >> (base + 31 - x1);
+        }
+        display->dirty_cols[page][word] |= mask;
+    }
+}
+
+// Mark canvas columns x0..x1 of a buffer page as dirty
+// In portrait a canvas page is a band of 8 GDDRAM columns, and canvas
+// columns are GDDRAM rows.
+static void ssd1306_mark_dirty(int page, int x0, int x1) {
+    if (disp->draw_offscreen) {
+        if (disp->draw_dirty) {
+            disp->draw_dirty(page, x0, x1);
+        }
+        return;
+    }
+    if (!disp->portrait) {
+        ssd1306_mark_gram(disp, page, x0, x1);
+        return;
+    }
+    for (int gram_page = x0 / 8; gram_page <= x1 / 8; gram_page++) {
+        ssd1306_mark_gram(disp, gram_page, page * 8, page * 8 + 7);
+    }
+}
+
+// Mark every page as clean
+static void ssd1306_clear_dirty(ssd1306_t *display) {
+    memset(display->dirty_cols, 0, sizeof(display->dirty_cols));
+}
+
+// Mark the whole frame as dirty (forces a full update on next display)
+static void ssd1306_mark_all_dirty(ssd1306_t *display) {
+    for (int page = 0; page < SSD1306_PAGES; page++) {
+        ssd1306_mark_gram(display, page, 0, SSD1306_WIDTH - 1);
+    }
+}
+
+// Find the first column >= x of a page that is dirty (or clean)
+// Returns SSD1306_WIDTH if there is none.
+static int ssd1306_find_col(ssd1306_t *display, int page, int x, bool dirty) {
+    while (x < SSD1306_WIDTH) {
+        uint32_t word = display->dirty_cols[page][x / 32];
+        if (!dirty) {
+            word = ~word;
+        }
+        word >>= x & 31;
+        if (word) {
+            x += __builtin_ctz(word);
+            return x < SSD1306_WIDTH ? x : SSD1306_WIDTH;
+        }
+        x = (x / 32 + 1) * 32;
+    }
+    return SSD1306_WIDTH;
+}
+
+// Split a page's dirty columns into spans worth addressing separately
+// Runs separated by fewer than SSD1306_WINDOW_COST clean columns are
+// joined. Each gap is decided on its own, which is optimal within a page.
+// Returns the number of spans written to x0[]/x1[].
+static int ssd1306_page_spans(ssd1306_t *display, int page, uint8_t *x0, uint8_t *x1) {
+    int count = 0;
+    int x = ssd1306_find_col(display, page, 0, true);
+
+    while (x < SSD1306_WIDTH) {
+        int end = ssd1306_find_col(display, page, x, false) - 1;
+        for (;;) {
+            int next = ssd1306_find_col(display, page, end + 1, true);
+            if (next >= SSD1306_WIDTH || next - end - 1 >= SSD1306_WINDOW_COST) {
+                break;
+            }
+            end = ssd1306_find_col(display, page, next, false) - 1;
+        }
+
+        x0[count] = x;
+        x1[count] = end;
+        count++;
+        x = ssd1306_find_col(display, page, end + 1, true);
+    }
+    return count;
+}
+
+// Address one rectangular GDDRAM window: columns x0..x1, pages p0..p1
+#if SSD1306_PAGE_ADDRESSING
+static bool ssd1306_set_window(ssd1306_t *display, int x0, int x1, int p0, int p1) {
+    // Page addressing: set page and start column; the column pointer
+    // advances with each data byte but does not wrap to the next page,
+    // so windows are always one page tall here
+    int col = x0 + SSD1306_COLUMN_OFFSET;
+    const uint8_t window[] = {
+        SSD1306_CMD_SET_PAGE_START | p0,
+        SSD1306_CMD_SET_LOW_COLUMN | (col & 0x0F),
+        SSD1306_CMD_SET_HIGH_COLUMN | (col >> 4),
+    };
+    return ssd1306_send_commands(display, window, sizeof(window));
+}
+#else
+static bool ssd1306_set_window(ssd1306_t *display, int x0, int x1, int p0, int p1) {
+    // Column and page address range in a single command transaction
+    const uint8_t window[] = {
+        SSD1306_CMD_COLUMN_ADDR, x0 + SSD1306_COLUMN_OFFSET, x1 + SSD1306_COLUMN_OFFSET,  // Start/end column
+        SSD1306_CMD_PAGE_ADDR, p0, p1,  // Start/end page
+    };
+    return ssd1306_send_commands(display, window, sizeof(window));
+}
+#endif
+
+#if !SSD1306_PAGE_ADDRESSING
+// Grow the last window down by one page to cover columns x0..x1 of it,
+// if one taller window costs fewer bus bytes than adding a new window
+static bool ssd1306_extend_window(ssd1306_t *display, int x0, int x1) {
+    flush_window_t *w = &display->flush_windows[display->flush_window_count - 1];
+    int pages = w->p1 - w->p0 + 1;
+    int ux0 = x0 < w->x0 ? x0 : w->x0;
+    int ux1 = x1 > w->x1 ? x1 : w->x1;
+
+    int separate = (w->x1 - w->x0 + 1) * pages + (x1 - x0 + 1) + SSD1306_WINDOW_COST;
+    int merged = (ux1 - ux0 + 1) * (pages + 1);
+    if (merged > separate) {
+        return false;
+    }
+
+    w->x0 = ux0;
+    w->x1 = ux1;
+    w->p1++;
     return true;
 }
+#endif
+
+// Transpose an 8x8 bit matrix: bit b of out[j] = bit j of in[b]
+// Three delta swaps on two 32-bit halves (Hacker's Delight, 7-3), with the
+// byte order reversed so that bit 0 stays the top/left pixel.
+static void ssd1306_transpose8(const uint8_t *in, uint8_t *out) {
+    uint32_t x = ((uint32_t)in[7] << 24) | ((uint32_t)in[6] << 16) | ((uint32_t)in[5] << 8) | in[4];
+    uint32_t y = ((uint32_t)in[3] << 24) | ((uint32_t)in[2] << 16) | ((uint32_t)in[1] << 8) | in[0];
+    uint32_t t;
+
+    t = (x ^ (x >> 7)) & 0x00AA00AA;  x = x ^ t ^ (t << 7);
+    t = (y ^ (y >> 7)) & 0x00AA00AA;  y = y ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC; x = x ^ t ^ (t << 14);
+    t = (y ^ (y >> 14)) & 0x0000CCCC; y = y ^ t ^ (t << 14);
+    t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+    y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+    x = t;
+
+    out[7] = x >> 24; out[6] = x >> 16; out[5] = x >> 8; out[4] = x;
+    out[3] = y >> 24; out[2] = y >> 16; out[1] = y >> 8; out[0] = y;
+}
+
+// Copy a window's bytes into the flush snapshot in stream order
+// (horizontal addressing: x0..x1 of page p0, then x0..x1 of page p0+1, ...)
+static void ssd1306_snapshot_window(ssd1306_t *display, flush_window_t *w) {
+    w->offset = display->flush_data_len;
+
+    if (!display->portrait) {
+        for (int page = w->p0; page <= w->p1; page++) {
+            memcpy(&display->flush_data[display->flush_data_len], &display->buffer[page * SSD1306_WIDTH + w->x0], w->x1 - w->x0 + 1);
+            display->flush_data_len += w->x1 - w->x0 + 1;
+        }
+        return;
+    }
+
+    // Portrait: GDDRAM columns bx..bx+7 of a page are canvas columns
+    // page*8..page*8+7 of canvas page bx/8, transposed
+    for (int page = w->p0; page <= w->p1; page++) {
+        for (int bx = w->x0 & ~7; bx <= w->x1; bx += 8) {
+            uint8_t block[8];
+            ssd1306_transpose8(&display->buffer[(bx / 8) * display->canvas_width + page * 8], block);
+
+            int first = bx < w->x0 ? w->x0 - bx : 0;
+            int last = bx + 7 > w->x1 ? w->x1 - bx : 7;
+            memcpy(&display->flush_data[display->flush_data_len], &block[first], last - first + 1);
+            display->flush_data_len += last - first + 1;
+        }
+    }
+}
+
+// Capture the current dirty state into a new flush and clear the dirty map
+// Returns false if there is nothing to send.
+static bool ssd1306_flush_begin(ssd1306_t *display) {
+    display->flush_window_count = 0;
+    display->flush_data_len = 0;
+    display->flush_window = 0;
+    display->flush_sent = 0;
+    display->flush_addressed = false;
+
+    display->flush_start_line_pending = display->start_line_pending;
+    display->flush_start_line = display->page_offset * 8;
+    display->start_line_pending = false;
+
+    // Plan the windows page by page. A page with a single span may join
+    // the window above it when that window is the only one on its last
+    // page; everything else gets windows of its own. (Page addressing
+    // cannot cross pages, so there each page keeps its own windows.)
+#if !SSD1306_PAGE_ADDRESSING
+    bool extendable = false;
+#endif
+    for (int page = 0; page < SSD1306_PAGES; page++) {
+        uint8_t x0[SSD1306_MAX_PAGE_SPANS];
+        uint8_t x1[SSD1306_MAX_PAGE_SPANS];
+        int spans = ssd1306_page_spans(display, page, x0, x1);
 
-bool ssd1306_init(const ssd1306_config_t *config) {
-    ssd1306_i2c_addr = config->i2c_addr;
+#if !SSD1306_PAGE_ADDRESSING
+        if (spans == 1 && extendable && ssd1306_extend_window(display, x0[0], x1[0])) {
+            continue;
+        }
+#endif
+
+        for (int i = 0; i < spans; i++) {
+            flush_window_t *w = &display->flush_windows[display->flush_window_count++];
+            w->x0 = x0[i];
+            w->x1 = x1[i];
+            w->p0 = page;
+            w->p1 = page;
+        }
+#if !SSD1306_PAGE_ADDRESSING
+        extendable = spans == 1;
+#endif
+    }
+
+    for (int i = 0; i < display->flush_window_count; i++) {
+        ssd1306_snapshot_window(display, &display->flush_windows[i]);
+    }
+
+    ssd1306_clear_dirty(display);
+
+    display->flush_active = display->flush_start_line_pending || display->flush_window_count > 0;
+    display->flush_failed = false;
+    display->flush_begin_cycles = cpu_cycles();
+    display->flush_busy_cycles = 0;
+    return display->flush_active;
+}
 
-    // Initialize I²C peripheral
-    i2c_config_t i2c_cfg = {
-        .scl_pin = config->scl_pin,
-        .sda_pin = config->sda_pin,
-        .freq_hz = 400000  // 400kHz (fast mode I²C)
+// Point drawing at a display's own canvas
+static void ssd1306_target_canvas(ssd1306_t *display) {
+    display->draw_buffer = display->buffer;
+    display->draw_width = display->canvas_width;
+    display->draw_height = display->canvas_height;
+    display->draw_pages = display->canvas_pages;
+    display->draw_offscreen = false;
+    display->draw_dirty = NULL;
+}
+
+ssd1306_t *ssd1306_init(const ssd1306_config_t *config) {
+    if (display_count == SSD1306_MAX_DISPLAYS) {
+        return NULL;
+    }
+    ssd1306_t *display = &displays[display_count];
+    ssd1306_t *previous = disp;
+    memset(display, 0, sizeof(*display));
+
+    // Configuration runs at the datasheet's 400kHz (fast mode I²C); frame
+    // updates can then run faster, see config->freq_hz. The clock belongs
+    // to this display: other devices on the bus keep their own.
+    display->dev = (i2c_dev_t){
+        .bus = config->bus,
+        .addr = config->i2c_addr,
+        .freq_hz = 400000
     };
-    i2c_init(&i2c_cfg);
+    ssd1306_select(display);
+
+    // Blank buffer in the orientation init_sequence sets up
+    display->font = &font_5x7;
+    display->rotation = SSD1306_ROTATE_0;  // Matches the remap in init_sequence
+    display->canvas_width = SSD1306_WIDTH;
+    display->canvas_height = SSD1306_HEIGHT;
+    display->canvas_pages = SSD1306_PAGES;
+    ssd1306_target_canvas(display);
+    ssd1306_set_frame_rate(display, SSD1306_FRAME_RATE);
+    ssd1306_mark_all_dirty(display);
 
     // Power-up delay: Give display time to stabilize after power on
     for (volatile int i = 0; i < 100000; i++);
 
     // === SSD1306 Initialization Sequence ===
-    // Based on datasheet recommended initialization
-    
-    // Turn display off during configuration
-    ssd1306_send_command(SSD1306_CMD_DISPLAY_OFF);
+    // Based on datasheet recommended initialization, specialised for the
+    // panel at build time (multiplex ratio, COM pins, addressing, power).
+    // Sent as one command stream (control byte 0x00) instead of one
+    // transaction per byte, which cuts ~25 START/address/STOP round trips.
+    static const uint8_t init_sequence[] = {
+        // Turn display off during configuration
+        SSD1306_CMD_DISPLAY_OFF,
 
-    // Set display clock divide ratio/oscillator frequency
-    // Bits 3:0 = divide ratio (reset value = 0000b)
-    // Bits 7:4 = oscillator frequency (reset value = 1000b)
-    ssd1306_send_command(SSD1306_CMD_SET_DISPLAY_CLK_DIV);
-    ssd1306_send_command(0x80);  // Default value: divide ratio=1, freq=8
+        // Set display clock divide ratio/oscillator frequency
+        // Bits 3:0 = divide ratio (reset value = 0000b)
+        // Bits 7:4 = oscillator frequency (reset value = 1000b)
+        SSD1306_CMD_SET_DISPLAY_CLK_DIV, 0x80,  // Default value: divide ratio=1, freq=8
 
-    // Set multiplex ratio (number of display lines)
-    ssd1306_send_command(SSD1306_CMD_SET_MULTIPLEX);
-    ssd1306_send_command(SSD1306_HEIGHT - 1);  // 64 lines - 1 = 0x3F
+        // Set multiplex ratio (number of display lines)
+        SSD1306_CMD_SET_MULTIPLEX, SSD1306_HEIGHT - 1,  // e.g. 64 lines - 1 = 0x3F
 
-    // Set display vertical offset (shift mapping of rows)
-    ssd1306_send_command(SSD1306_CMD_SET_DISPLAY_OFFSET);
-    ssd1306_send_command(0x00);  // No offset
+        // Set display vertical offset (shift mapping of rows)
+        SSD1306_CMD_SET_DISPLAY_OFFSET, 0x00,  // No offset
 
-    // Set display start line (first row to display)
-    ssd1306_send_command(SSD1306_CMD_SET_START_LINE | 0x00);  // Start at line 0
+        // Set display start line (first row to display)
+        SSD1306_CMD_SET_START_LINE | 0x00,  // Start at line 0
 
-    // Enable internal charge pump (required for displays without external VCC)
-    ssd1306_send_command(SSD1306_CMD_CHARGE_PUMP);
-    ssd1306_send_command(0x14);  // 0x14 = enable, 0x10 = disable
+#if SSD1306_PANEL == SSD1306_PANEL_SH1106
+        // Enable the DC-DC converter (SH1106 equivalent of the charge pump)
+        SSD1306_CMD_SET_IREF, 0x8B,  // 0x8B = on, 0x8A = off
 
-    // Set memory addressing mode
-    ssd1306_send_command(SSD1306_CMD_MEMORY_MODE);
-    ssd1306_send_command(0x00);  // Horizontal addressing mode (auto-increment)
+        // No memory addressing mode command: the SH1106 is page-addressed only
+#else
+        // Enable internal charge pump (required for displays without external VCC)
+        SSD1306_CMD_CHARGE_PUMP, 0x14,  // 0x14 = enable, 0x10 = disable
 
-    // Set segment re-map (flip horizontally)
-    ssd1306_send_command(SSD1306_CMD_SEG_REMAP | 0x01);  // Column 127 mapped to SEG0
+        // Set memory addressing mode
+        SSD1306_CMD_MEMORY_MODE, 0x00,  // Horizontal addressing mode (auto-increment)
+#endif
 
-    // Set COM output scan direction (flip vertically)
-    ssd1306_send_command(SSD1306_CMD_COM_SCAN_DEC);  // Scan from COM[N-1] to COM0
+#if SSD1306_PANEL == SSD1306_PANEL_72X40
+        // 72x40 modules need the internal current reference enabled
+        SSD1306_CMD_SET_IREF, 0x30,
+#endif
 
-    // Set COM pins hardware configuration
-    ssd1306_send_command(SSD1306_CMD_SET_COM_PINS);
-    ssd1306_send_command(0x12);  // Alternative COM pin config, disable COM L/R remap
+        // Set segment re-map (flip horizontally)
+        SSD1306_CMD_SEG_REMAP | 0x01,  // Column 127 mapped to SEG0
 
-    // Set contrast level (brightness)
-    ssd1306_send_command(SSD1306_CMD_SET_CONTRAST);
-    ssd1306_send_command(0xCF);  // Max brightness (0x00-0xFF)
+        // Set COM output scan direction (flip vertically)
+        SSD1306_CMD_COM_SCAN_DEC,  // Scan from COM[N-1] to COM0
 
-    // Set pre-charge period
-    ssd1306_send_command(SSD1306_CMD_SET_PRECHARGE);
-    ssd1306_send_command(0xF1);  // Phase 1: 1 DCLK, Phase 2: 15 DCLKs
+        // Set COM pins hardware configuration
+        SSD1306_CMD_SET_COM_PINS, SSD1306_COM_PINS,  // Depends on how the panel is wired
 
-    // Set VCOMH deselect level
-    ssd1306_send_command(SSD1306_CMD_SET_VCOM_DETECT);
-    ssd1306_send_command(0x40);  // ~0.77 x VCC
+        // Set contrast level (brightness)
+        SSD1306_CMD_SET_CONTRAST, 0xCF,  // Max brightness (0x00-0xFF)
 
-    // Resume display from RAM content (don't force all pixels ON)
-    ssd1306_send_command(SSD1306_CMD_DISPLAY_ALL_ON_RESUME);
-    
-    // Normal display mode (not inverted)
-    ssd1306_send_command(SSD1306_CMD_NORMAL_DISPLAY);
+        // Set pre-charge period
+        SSD1306_CMD_SET_PRECHARGE, 0xF1,  // Phase 1: 1 DCLK, Phase 2: 15 DCLKs
 
-    // Turn display on
-    ssd1306_send_command(SSD1306_CMD_DISPLAY_ON);
+        // Set VCOMH deselect level
+        SSD1306_CMD_SET_VCOM_DETECT, 0x40,  // ~0.77 x VCC
 
-    // Clear display buffer and show blank screen
-    ssd1306_clear();
-    ssd1306_display();
+        // Resume display from RAM content (don't force all pixels ON)
+        SSD1306_CMD_DISPLAY_ALL_ON_RESUME,
 
-    return true;
+        // Normal display mode (not inverted)
+        SSD1306_CMD_NORMAL_DISPLAY,
+
+        // Turn display on
+        SSD1306_CMD_DISPLAY_ON,
+    };
+
+    if (!ssd1306_send_commands(display, init_sequence, sizeof(init_sequence))) {
+        // No ACK: display missing or wrong address. Without another
+        // display to go back to, this one stays selected so drawing
+        // still has a buffer to go to.
+        if (previous) {
+            ssd1306_select(previous);
+        }
+        return NULL;
+    }
+
+    // Panels take well over the rated 400kHz in practice (fast-mode plus
+    // 1MHz roughly doubles the frame rate)
+    if (config->freq_hz) {
+        display->dev.freq_hz = config->freq_hz;
+    }
+
+    // Show the blank buffer
+    // (GDDRAM content is undefined after power-up, so the whole frame is sent)
+    ssd1306_display(display);
+
+    display_count++;
+    return display;
+}
+
+// Make a display the one drawing calls act on
+void ssd1306_select(ssd1306_t *display) {
+    disp = display;
+}
+
+ssd1306_t *ssd1306_selected(void) {
+    return disp;
+}
+
+// The bus a display is on (for its traffic counters)
+i2c_bus_t *ssd1306_get_bus(ssd1306_t *display) {
+    return display->dev.bus;
 }
 
 // Clear the display buffer (set all pixels to black)
 // Note: Call ssd1306_display() to update the physical screen
+// With an off-screen target set, clears that bitmap instead.
 void ssd1306_clear(void) {
-    memset(ssd1306_buffer, 0, sizeof(ssd1306_buffer));
+    if (disp->draw_offscreen) {
+        memset(disp->draw_buffer, 0, disp->draw_width * disp->draw_pages);
+        for (int page = 0; page < disp->draw_pages; page++) {
+            ssd1306_mark_dirty(page, 0, disp->draw_width - 1);
+        }
+        return;
+    }
+    memset(disp->buffer, 0, sizeof(disp->buffer));
+    ssd1306_mark_all_dirty(disp);
 }
 
-// Update the physical display with the current buffer contents
-// Sends entire 1024-byte buffer to the display via I²C
-void ssd1306_display(void) {
-    // Set column address range
-    ssd1306_send_command(SSD1306_CMD_COLUMN_ADDR);
-    ssd1306_send_command(0);   // Start column
-    ssd1306_send_command(SSD1306_WIDTH - 1);  // End column
+// Request an update without blocking
+// The dirty state is captured by ssd1306_flush_step() when the next frame
+// is due; further requests until then are merged into that one.
+void ssd1306_display_async(ssd1306_t *display) {
+    if (display->flush_requested) {
+        display->stats.coalesced++;
+    }
+    display->flush_requested = true;
+}
 
-    // Set page address range
-    ssd1306_send_command(SSD1306_CMD_PAGE_ADDR);
-    ssd1306_send_command(0);   // Start page
-    ssd1306_send_command((SSD1306_HEIGHT / 8) - 1);  // End page
+void ssd1306_set_frame_rate(ssd1306_t *display, uint32_t fps) {
+    display->frame_interval_cycles = fps ? CPU_FREQ_HZ / fps : 0;
+}
 
-    // Send buffer
-    ssd1306_send_data(ssd1306_buffer, sizeof(ssd1306_buffer));
+// Give up on a window after a bus error: where the panel's RAM pointer
+// ended up is unknown, so its columns are marked dirty again and go out
+// with the next update instead of being resent from here
+static void ssd1306_flush_skip(ssd1306_t *display, const flush_window_t *w) {
+    for (int page = w->p0; page <= w->p1; page++) {
+        ssd1306_mark_gram(display, page, w->x0, w->x1);
+    }
+    display->flush_window++;
+    display->flush_sent = 0;
+    display->flush_addressed = false;
+    display->flush_failed = true;
+}
+
+// Send up to max_bytes of the running flush
+// Returns true when it is complete (check flush_failed for bus errors).
+static bool ssd1306_flush_send(ssd1306_t *display, uint32_t max_bytes) {
+    uint32_t step_start = cpu_cycles();
+
+    // Apply a pending scroll first so the exposed page appears at the bottom
+    if (display->flush_start_line_pending) {
+        if (!ssd1306_send_command(display, SSD1306_CMD_SET_START_LINE | display->flush_start_line)) {
+            display->start_line_pending = true;
+            display->flush_failed = true;
+        }
+        display->flush_start_line_pending = false;
+    }
+
+    while (max_bytes > 0 && display->flush_window < display->flush_window_count) {
+        const flush_window_t *w = &display->flush_windows[display->flush_window];
+        uint32_t total = (w->x1 - w->x0 + 1) * (w->p1 - w->p0 + 1);
+
+        if (!display->flush_addressed) {
+            if (!ssd1306_set_window(display, w->x0, w->x1, w->p0, w->p1)) {
+                ssd1306_flush_skip(display, w);
+                continue;
+            }
+            display->flush_addressed = true;
+        }
+
+        uint32_t chunk = total - display->flush_sent;
+        if (chunk > max_bytes) {
+            chunk = max_bytes;
+        }
+        max_bytes -= chunk;
+        if (!ssd1306_send_data(display, &display->flush_data[w->offset + display->flush_sent], chunk)) {
+            ssd1306_flush_skip(display, w);
+            continue;
+        }
+        display->flush_sent += chunk;
+
+        if (display->flush_sent == total) {
+            display->flush_window++;
+            display->flush_sent = 0;
+            display->flush_addressed = false;
+        }
+    }
+
+    uint32_t now = cpu_cycles();
+    uint32_t step_cycles = now - step_start;
+    display->flush_busy_cycles += step_cycles;
+    if (step_cycles > display->stats.max_step_cycles) {
+        display->stats.max_step_cycles = step_cycles;
+    }
+
+    if (display->flush_window < display->flush_window_count) {
+        return false;
+    }
+
+    // Flush complete: record how long it took
+    display->flush_active = false;
+    display->stats.flushes++;
+    display->stats.last_flush_cycles = display->flush_busy_cycles;
+    display->stats.last_flush_latency_cycles = now - display->flush_begin_cycles;
+    display->stats.total_flush_cycles += display->flush_busy_cycles;
+    if (display->flush_busy_cycles > display->stats.max_flush_cycles) {
+        display->stats.max_flush_cycles = display->flush_busy_cycles;
+    }
+    return true;
+}
+
+// Complete the flush on the wire, if any, without starting another
+// Returns false if part of it failed (those columns are dirty again).
+static bool ssd1306_flush_finish(ssd1306_t *display) {
+    if (!display->flush_active) {
+        return true;
+    }
+    while (!ssd1306_flush_send(display, UINT32_MAX));
+    return !display->flush_failed;
+}
+
+// Send up to max_bytes of pending frame data
+// Returns true when no flush is in progress (nothing left to send).
+// Unlike ssd1306_display(), this path retries: what a failed flush could
+// not send is requested again and goes out with the next frame.
+bool ssd1306_flush_step(ssd1306_t *display, uint32_t max_bytes) {
+    if (!display->flush_active) {
+        if (!display->flush_requested) {
+            return true;
+        }
+        if (cpu_cycles() - display->flush_begin_cycles < display->frame_interval_cycles) {
+            return false;  // Next frame not due yet
+        }
+        display->flush_requested = false;
+        if (!ssd1306_flush_begin(display)) {
+            return true;
+        }
+    }
+
+    if (!ssd1306_flush_send(display, max_bytes)) {
+        return false;
+    }
+    if (display->flush_failed) {
+        display->flush_requested = true;
+    }
+    return !display->flush_requested;
+}
+
+// Update the physical display with the changed parts of the buffer
+// Dirty spans are sent as the cheapest set of windows (see Dirty Tracking);
+// a fully dirty frame is a single 1024-byte transfer. Blocks until done.
+// Makes one pass: what the panel did not take stays dirty and the call
+// returns false, so a panel that is gone cannot hang the caller.
+bool ssd1306_display(ssd1306_t *display) {
+    // Let an asynchronous flush that is already on the wire finish first
+    // (whatever it failed to send is dirty again and goes out below)
+    ssd1306_flush_finish(display);
+
+    // This update includes anything still waiting for its frame slot
+    display->flush_requested = false;
+    if (!ssd1306_flush_begin(display)) {
+        return true;
+    }
+    while (!ssd1306_flush_send(display, UINT32_MAX));
+    return !display->flush_failed;
+}
+
+// Read or clear the transport and timing statistics
+void ssd1306_get_stats(ssd1306_t *display, ssd1306_stats_t *out) {
+    *out = display->stats;
+}
+
+void ssd1306_reset_stats(ssd1306_t *display) {
+    display->stats = (ssd1306_stats_t){0};
+}
+
+// Check whether an asynchronous flush is still sending data
+bool ssd1306_flush_busy(ssd1306_t *display) {
+    return display->flush_active || display->flush_requested;
+}
+
+// Write bytes straight into one GDDRAM page, starting at column x
+// The buffer no longer matches the panel afterwards; ssd1306_invalidate()
+// resends it.
+bool ssd1306_write_ram(ssd1306_t *display, int page, int x, const uint8_t *data, int len) {
+    return ssd1306_set_window(display, x, x + len - 1, page, page) && ssd1306_send_data(display, data, len);
+}
+
+// Show GDDRAM row `line` at the top of the panel
+bool ssd1306_set_start_line(ssd1306_t *display, int line) {
+    return ssd1306_send_command(display, SSD1306_CMD_SET_START_LINE | (line & 0x3F));
+}
+
+// Resend the whole buffer and the start line with the next update
+void ssd1306_invalidate(ssd1306_t *display) {
+    ssd1306_mark_all_dirty(display);
+    display->start_line_pending = true;
 }
 
 // Set a single pixel in the display buffer
-// x: column (0-127), y: row (0-63), color: 1=white, 0=black
+// x: column, y: row (0,0 = top left), color: 1=white, 0=black, 2=inverse
 void ssd1306_set_pixel(int x, int y, uint8_t color) {
-    if (x < 0 || x >= SSD1306_WIDTH || y < 0 || y >= SSD1306_HEIGHT) {
+    if (x < 0 || x >= disp->draw_width || y < 0 || y >= disp->draw_height) {
         return;
     }
     
@@ -230,7 +912,7 @@ void ssd1306_set_pixel(int x, int y, uint8_t color) {
      * - Each byte represents 8 vertical pixels
      * 
      * Buffer index calculation:
-     *   byte_index = x + (y / 8) * SSD1306_WIDTH
+     *   byte_index = x + (y / 8) * draw_width
      *   bit_position = y & 7  (same as y % 8)
      * 
      * Example: Pixel at (10, 20)
@@ -239,79 +921,398 @@ void ssd1306_set_pixel(int x, int y, uint8_t color) {
      *   bit = 20 % 8 = 4 (bit 4 in that byte)
      */
 
-    if (color) {
-        ssd1306_buffer[x + (y / 8) * SSD1306_WIDTH] |= (1 << (y & 7));
+    int page = ssd1306_ram_page(y / 8);
+    uint8_t *byte = &disp->draw_buffer[x + page * disp->draw_width];
+    uint8_t old = *byte;
+
+    if (color == SSD1306_INVERSE) {
+        *byte ^= (1 << (y & 7));
+    } else if (color) {
+        *byte |= (1 << (y & 7));
     } else {
-        ssd1306_buffer[x + (y / 8) * SSD1306_WIDTH] &= ~(1 << (y & 7));
+        *byte &= ~(1 << (y & 7));
+    }
+
+    // Only pixels that actually changed need to go out on the bus
+    if (*byte != old) {
+        ssd1306_mark_dirty(page, x, x);
     }
 }
 
-// Draw a single character using the 5x7 font
-// x, y: top-left corner position. Non-printable chars replaced with space
-void ssd1306_draw_char(int x, int y, char c) {
-    if (c < 32 || c > 126) {
-        c = 32;  // Replace with space
+// Direct access to the buffer row (ssd1306_width() bytes) of a logical page
+// Used by graphics layers that work on whole bytes. Callers must report
+// what they change with ssd1306_mark_page_dirty().
+uint8_t *ssd1306_page_buffer(int page) {
+    return &disp->draw_buffer[ssd1306_ram_page(page) * disp->draw_width];
+}
+
+// Record that columns x0..x1 of a logical page were modified
+void ssd1306_mark_page_dirty(int page, int x0, int x1) {
+    ssd1306_mark_dirty(ssd1306_ram_page(page), x0, x1);
+}
+
+// Read back a pixel from the display buffer
+// Returns 1 if lit, 0 if dark or outside the screen
+uint8_t ssd1306_get_pixel(int x, int y) {
+    if (x < 0 || x >= disp->draw_width || y < 0 || y >= disp->draw_height) {
+        return 0;
     }
+    int page = ssd1306_ram_page(y / 8);
+    return (disp->draw_buffer[x + page * disp->draw_width] >> (y & 7)) & 1;
+}
 
-    const uint8_t *glyph = font5x7[c - 32];
+// Clear a RAM page, marking only the columns that held pixels
+static void ssd1306_clear_ram_page(int page) {
+    uint8_t *row = &disp->draw_buffer[page * disp->draw_width];
 
-    for (int i = 0; i < 5; i++) {
-        uint8_t line = glyph[i];
-        for (int j = 0; j < 7; j++) {
-            if (line & (1 << j)) {
-                ssd1306_set_pixel(x + i, y + j, 1);
-            }
+    int first = 0;
+    int last = disp->draw_width - 1;
+    while (first <= last && row[first] == 0) first++;
+    while (last >= first && row[last] == 0) last--;
+
+    if (first <= last) {
+        memset(&row[first], 0, last - first + 1);
+        ssd1306_mark_dirty(page, first, last);
+    }
+}
+
+// Scroll the canvas up by one page (8 pixel rows) in the buffer
+// Each page takes the content of the one below it; only the columns whose
+// bytes actually change are marked dirty.
+static void ssd1306_scroll_buffer(void) {
+    for (int page = 0; page < disp->draw_pages - 1; page++) {
+        uint8_t *row = &disp->draw_buffer[page * disp->draw_width];
+        const uint8_t *below = row + disp->draw_width;
+
+        int first = 0;
+        int last = disp->draw_width - 1;
+        while (first <= last && row[first] == below[first]) first++;
+        while (last >= first && row[last] == below[last]) last--;
+
+        if (first <= last) {
+            memcpy(&row[first], &below[first], last - first + 1);
+            ssd1306_mark_dirty(page, first, last);
         }
     }
+    ssd1306_clear_ram_page(disp->draw_pages - 1);
+}
+
+// Scroll the screen (or off-screen target) up by one page (8 pixel rows)
+// In landscape on a full-height panel this is done in hardware: the page
+// that wraps around to the bottom is cleared and only columns that held
+// pixels are marked dirty, so an empty new row costs nothing to send.
+void ssd1306_scroll_page(void) {
+#if SSD1306_HW_SCROLL
+    if (!disp->portrait && !disp->draw_offscreen) {
+        ssd1306_clear_ram_page(disp->page_offset);  // Old top page becomes the new bottom page
+
+        disp->page_offset = (disp->page_offset + 1) % disp->canvas_pages;
+        disp->start_line_pending = true;
+        return;
+    }
+#endif
+    ssd1306_scroll_buffer();
+}
+
+// OR a run of column bytes into one logical page, starting at column x
+// Columns outside the screen are clipped; the dirty range is updated once.
+static void ssd1306_blit_columns(int x, int page, const uint8_t *cols, int n) {
+    if (page < 0 || page >= disp->draw_pages) {
+        return;
+    }
+
+    int first = 0;
+    int last = n - 1;
+    if (x + first < 0) first = -x;
+    if (x + last >= disp->draw_width) last = disp->draw_width - 1 - x;
+
+    int ram_page = ssd1306_ram_page(page);
+    uint8_t *row = &disp->draw_buffer[ram_page * disp->draw_width];
+    int dirty_first = disp->draw_width;
+    int dirty_last = -1;
+
+    for (int i = first; i <= last; i++) {
+        uint8_t old = row[x + i];
+        row[x + i] = old | cols[i];
+        if (row[x + i] != old) {
+            if (dirty_first == disp->draw_width) dirty_first = i;
+            dirty_last = i;
+        }
+    }
+
+    if (dirty_last >= 0) {
+        ssd1306_mark_dirty(ram_page, x + dirty_first, x + dirty_last);
+    }
+}
+
+// Look up a glyph in the current font
+// Characters outside the font are drawn as space (or the first glyph).
+static const uint8_t *ssd1306_glyph(char c, int *width) {
+    const font_t *font = disp->font;
+    uint8_t code = (uint8_t)c;
+
+    if (code < font->first || code > font->last) {
+        code = (' ' >= font->first && ' ' <= font->last) ? ' ' : font->first;
+    }
+
+    int index = code - font->first;
+    if (font->widths) {
+        *width = font->widths[index];
+        return &font->bitmap[font->offsets[index]];
+    }
+    *width = font->fixed_width;
+    return &font->bitmap[index * font->fixed_width * font->pages];
+}
+
+// Select the font used by draw_char/draw_string
+void ssd1306_set_font(const font_t *font) {
+    disp->font = font;
+}
+
+// Get the current font
+const font_t *ssd1306_get_font(void) {
+    return disp->font;
+}
+
+// Horizontal advance of one character (glyph width + spacing)
+int ssd1306_char_width(char c) {
+    int width;
+    ssd1306_glyph(c, &width);
+    return width + disp->font->spacing;
+}
+
+// Width in pixels of a single line of text in the current font
+int ssd1306_text_width(const char *str) {
+    int width = 0;
+    while (*str && *str != '\n') {
+        width += ssd1306_char_width(*str++);
+    }
+    return width;
+}
+
+// Draw a single character in the current font
+// x, y: top-left corner position. Characters missing from the font are drawn as space
+// Returns the horizontal advance (glyph width + spacing)
+//
+// Font tables are stored column-major with bit 0 at the top, which is
+// exactly the GDDRAM byte layout. Page-aligned text (y % 8 == 0, as the
+// shell draws it) is ORed into the buffer as whole bytes. Unaligned text is
+// shifted once per column and split across the two pages it straddles.
+int ssd1306_draw_char(int x, int y, char c) {
+    int width;
+    const uint8_t *glyph = ssd1306_glyph(c, &width);
+    int page = y >> 3;   // Floor division, also for negative y
+    int shift = y & 7;
+
+    // Columns that can reach the target; the glyph's pages stay `width`
+    // bytes apart in the font table
+    int columns = width < disp->draw_width ? width : disp->draw_width;
+
+    for (int p = 0; p < disp->font->pages; p++) {
+        const uint8_t *cols = &glyph[p * width];
+
+        if (shift == 0) {
+            ssd1306_blit_columns(x, page + p, cols, columns);
+            continue;
+        }
+
+        uint8_t upper[SSD1306_CANVAS_MAX];
+        uint8_t lower[SSD1306_CANVAS_MAX];
+        for (int i = 0; i < columns; i++) {
+            upper[i] = cols[i] << shift;
+            lower[i] = cols[i] >> (8 - shift);
+        }
+        ssd1306_blit_columns(x, page + p, upper, columns);
+        ssd1306_blit_columns(x, page + p + 1, lower, columns);
+    }
+
+    return width + disp->font->spacing;
 }
 
 // Draw a text string with automatic line wrapping
-// Supports '\n' for newlines. Each char is 6 pixels wide (5 + 1 spacing)
+// Supports '\n' for newlines. Characters advance by their width in the
+// current font; a character that would not fit starts a new line.
 void ssd1306_draw_string(int x, int y, const char *str) {
     int cursor_x = x;
+    int line_height = disp->font->pages * 8;
 
     while (*str) {
         if (*str == '\n') {
             cursor_x = x;
-            y += 8;
+            y += line_height;
         } else {
-            ssd1306_draw_char(cursor_x, y, *str);
-            cursor_x += 6;  // 5 pixels + 1 space
-
-            if (cursor_x >= SSD1306_WIDTH) {
+            int width;
+            ssd1306_glyph(*str, &width);
+            if (cursor_x > x && cursor_x + width > disp->draw_width) {
                 cursor_x = x;
-                y += 8;
+                y += line_height;
             }
+            cursor_x += ssd1306_draw_char(cursor_x, y, *str);
         }
         str++;
     }
 }
 
+// Apply a vertical bit mask to columns x0..x1 of one RAM page
+// Whole-byte fills use memset on the part of the run that actually
+// changes, so the dirty range stays exact.
+static void ssd1306_fill_page(int ram_page, int x0, int x1, uint8_t mask, uint8_t color) {
+    uint8_t *row = &disp->draw_buffer[ram_page * disp->draw_width];
+
+    if (mask == 0xFF && color != SSD1306_INVERSE) {
+        uint8_t value = color ? 0xFF : 0x00;
+        while (x0 <= x1 && row[x0] == value) x0++;
+        while (x1 >= x0 && row[x1] == value) x1--;
+        if (x0 <= x1) {
+            memset(&row[x0], value, x1 - x0 + 1);
+            ssd1306_mark_dirty(ram_page, x0, x1);
+        }
+        return;
+    }
+
+    int first = -1;
+    int last = -1;
+    for (int x = x0; x <= x1; x++) {
+        uint8_t old = row[x];
+        if (color == SSD1306_INVERSE) {
+            row[x] = old ^ mask;
+        } else if (color) {
+            row[x] = old | mask;
+        } else {
+            row[x] = old & ~mask;
+        }
+        if (row[x] != old) {
+            if (first < 0) first = x;
+            last = x;
+        }
+    }
+
+    if (first >= 0) {
+        ssd1306_mark_dirty(ram_page, first, last);
+    }
+}
+
 // Draw a filled rectangle
-// x, y: top-left corner, w: width, h: height, color: 1=white, 0=black
+// x, y: top-left corner, w: width, h: height, color: 1=white, 0=black, 2=inverse
+//
+// Works a page at a time: the top and bottom pages get a partial bit mask,
+// interior pages are whole bytes. Clearing a 128x8 text row is one memset.
 void ssd1306_fill_rect(int x, int y, int w, int h, uint8_t color) {
-    for (int i = x; i < x + w; i++) {
-        for (int j = y; j < y + h; j++) {
-            ssd1306_set_pixel(i, j, color);
+    // Clip to the screen
+    int x0 = x < 0 ? 0 : x;
+    int y0 = y < 0 ? 0 : y;
+    int x1 = x + w - 1;
+    int y1 = y + h - 1;
+    if (x1 >= disp->draw_width) x1 = disp->draw_width - 1;
+    if (y1 >= disp->draw_height) y1 = disp->draw_height - 1;
+    if (x0 > x1 || y0 > y1) {
+        return;
+    }
+
+    int top = y0 / 8;
+    int bottom = y1 / 8;
+    for (int page = top; page <= bottom; page++) {
+        uint8_t mask = 0xFF;
+        if (page == top) {
+            mask &= 0xFF << (y0 & 7);
         }
+        if (page == bottom) {
+            mask &= 0xFF >> (7 - (y1 & 7));
+        }
+        ssd1306_fill_page(ssd1306_ram_page(page), x0, x1, mask, color);
     }
 }
 
 // Set display brightness/contrast
 // contrast: 0 (dim) to 255 (bright)
-void ssd1306_set_contrast(uint8_t contrast) {
-    ssd1306_send_command(SSD1306_CMD_SET_CONTRAST);
-    ssd1306_send_command(contrast);
+void ssd1306_set_contrast(ssd1306_t *display, uint8_t contrast) {
+    const uint8_t cmds[] = {SSD1306_CMD_SET_CONTRAST, contrast};
+    ssd1306_send_commands(display, cmds, sizeof(cmds));
 }
 
 // Turn display on or off (sleep mode)
 // on: true=display on, false=display off (saves power)
-void ssd1306_display_on(bool on) {
-    ssd1306_send_command(on ? SSD1306_CMD_DISPLAY_ON : SSD1306_CMD_DISPLAY_OFF);
+void ssd1306_display_on(ssd1306_t *display, bool on) {
+    ssd1306_send_command(display, on ? SSD1306_CMD_DISPLAY_ON : SSD1306_CMD_DISPLAY_OFF);
 }
 
 // Invert display colors
 // invert: true=inverted (black on white), false=normal (white on black)
-void ssd1306_invert_display(bool invert) {
-    ssd1306_send_command(invert ? SSD1306_CMD_INVERT_DISPLAY : SSD1306_CMD_NORMAL_DISPLAY);
+void ssd1306_invert_display(ssd1306_t *display, bool invert) {
+    ssd1306_send_command(display, invert ? SSD1306_CMD_INVERT_DISPLAY : SSD1306_CMD_NORMAL_DISPLAY);
+}
+
+// Set the screen orientation
+// Switching between landscape and portrait clears the buffer, since the
+// canvas changes shape. The segment remap only applies to data written
+// after it, so the whole frame is resent on the next display update.
+void ssd1306_set_rotation(ssd1306_t *display, ssd1306_rotation_t new_rotation) {
+    // SEG remap / COM scan direction for 0, 90, 180 and 270 degrees.
+    // Portrait frames are transposed, which mirrors them; reversing one
+    // axis in hardware turns that into a rotation.
+    static const uint8_t remap[4][2] = {
+        {SSD1306_CMD_SEG_REMAP | 0x01, SSD1306_CMD_COM_SCAN_DEC},
+        {SSD1306_CMD_SEG_REMAP | 0x00, SSD1306_CMD_COM_SCAN_DEC},
+        {SSD1306_CMD_SEG_REMAP | 0x00, SSD1306_CMD_COM_SCAN_INC},
+        {SSD1306_CMD_SEG_REMAP | 0x01, SSD1306_CMD_COM_SCAN_INC},
+    };
+
+    // Finish the update that is on the wire; it was made for the old layout
+    // (a pending request waits for its frame slot and goes out in the new
+    // one; a failed asynchronous flush is retried like ssd1306_flush_step())
+    if (!ssd1306_flush_finish(display)) {
+        display->flush_requested = true;
+    }
+
+    bool new_portrait = new_rotation == SSD1306_ROTATE_90 || new_rotation == SSD1306_ROTATE_270;
+    if (new_portrait != display->portrait) {
+        display->portrait = new_portrait;
+        display->canvas_width = display->portrait ? SSD1306_HEIGHT : SSD1306_WIDTH;
+        display->canvas_height = display->portrait ? SSD1306_WIDTH : SSD1306_HEIGHT;
+        display->canvas_pages = display->canvas_height / 8;
+        memset(display->buffer, 0, sizeof(display->buffer));
+        if (!display->draw_offscreen) {
+            ssd1306_target_canvas(display);
+        }
+
+        // Portrait does not use hardware scrolling; start from line 0
+        display->start_line_pending = display->page_offset != 0;
+        display->page_offset = 0;
+    }
+
+    display->rotation = new_rotation;
+    ssd1306_send_commands(display, remap[display->rotation], sizeof(remap[display->rotation]));
+    ssd1306_mark_all_dirty(display);
+}
+
+// Get the screen orientation
+ssd1306_rotation_t ssd1306_get_rotation(ssd1306_t *display) {
+    return display->rotation;
+}
+
+// Redirect drawing to an off-screen bitmap, or back to the display (NULL)
+// The bitmap uses the display layout: height/8 pages of width bytes.
+// Every change is reported to dirty() instead of being queued for the
+// display, which lets a layer owner track what it has to recompose; with
+// dirty = NULL changes are not reported at all.
+void ssd1306_set_target(uint8_t *bitmap, int width, int height, ssd1306_dirty_fn dirty) {
+    if (bitmap) {
+        disp->draw_buffer = bitmap;
+        disp->draw_width = width;
+        disp->draw_height = height;
+        disp->draw_pages = (height + 7) / 8;
+        disp->draw_offscreen = true;
+        disp->draw_dirty = dirty;
+    } else {
+        ssd1306_target_canvas(disp);
+    }
+}
+
+// Size of the drawing target (the canvas in its current orientation)
+int ssd1306_width(void) {
+    return disp->draw_width;
+}
+
+int ssd1306_height(void) {
+    return disp->draw_height;
 }
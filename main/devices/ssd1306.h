@@ -3,50 +3,197 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "font.h"
+#include "i2c.h"
 
-// Display dimensions
-#define SSD1306_WIDTH  128
-#define SSD1306_HEIGHT 64
+// Panel dimensions (SSD1306_WIDTH, SSD1306_HEIGHT, SSD1306_PAGES)
+// come from the panel selected at build time. Drawing coordinates follow
+// the rotation, see ssd1306_width()/ssd1306_height().
+#include "ssd1306_panel.h"
 
 // Common I2C addresses
 #define SSD1306_I2C_ADDR_DEFAULT 0x3C
 #define SSD1306_I2C_ADDR_ALT     0x3D
 
+// Pixel colors
+#define SSD1306_BLACK   0
+#define SSD1306_WHITE   1
+#define SSD1306_INVERSE 2  // Flip the existing pixel
+
+// Screen orientation
+// 90 and 270 are portrait: the canvas is SSD1306_HEIGHT wide and
+// SSD1306_WIDTH tall (use ssd1306_width()/ssd1306_height()).
+typedef enum {
+    SSD1306_ROTATE_0,
+    SSD1306_ROTATE_90,
+    SSD1306_ROTATE_180,
+    SSD1306_ROTATE_270,
+} ssd1306_rotation_t;
+
+// Transport and timing statistics (cycles are CPU cycles, see cpu.h)
+typedef struct {
+    uint32_t flushes;                    // Completed display updates
+    uint32_t transactions;               // I2C transactions started by the driver
+    uint32_t command_bytes;              // Command bytes sent (arguments included)
+    uint32_t data_bytes;                 // GDDRAM bytes sent
+    uint32_t errors;                     // Transactions that failed (NACK)
+    uint32_t last_flush_cycles;          // Time spent sending the last update
+    uint32_t max_flush_cycles;           // Worst update so far
+    uint64_t total_flush_cycles;         // Sum over all updates
+    uint32_t last_flush_latency_cycles;  // Capture-to-complete time of the last update
+    uint32_t max_step_cycles;            // Longest single ssd1306_flush_step() call
+    uint32_t coalesced;                  // Update requests merged into a pending one
+} ssd1306_stats_t;
+
+// Displays that can be in use at once (each has its own buffers)
+#ifndef SSD1306_MAX_DISPLAYS
+#define SSD1306_MAX_DISPLAYS 2
+#endif
+
+// A display (from ssd1306_init())
+typedef struct ssd1306 ssd1306_t;
+
 // SSD1306 configuration
 typedef struct {
+    i2c_bus_t *bus;    // Bus the display is on (see i2c_bus_create())
     uint8_t i2c_addr;
-    int scl_pin;
-    int sda_pin;
+    uint32_t freq_hz;  // Bus clock for display updates (0 = 400kHz)
 } ssd1306_config_t;
 
-// Initialize display
-bool ssd1306_init(const ssd1306_config_t *config);
+// Initialize a display and select it
+// Returns NULL if it does not answer or SSD1306_MAX_DISPLAYS are in use.
+ssd1306_t *ssd1306_init(const ssd1306_config_t *config);
+
+// Select the display that drawing calls (ssd1306_* without a display
+// argument, and gfx_*, text, grayscale drawing and the compositor on top
+// of them) act on. Each display keeps its own buffer, font, rotation,
+// target and pending update, so with two displays, select one, draw,
+// then select the other. Calls that talk to the panel take the display
+// they are for: call ssd1306_flush_step() with each handle in turn to
+// keep both updating, whichever is selected.
+void ssd1306_select(ssd1306_t *display);
+ssd1306_t *ssd1306_selected(void);
+
+// Bus a display is on
+i2c_bus_t *ssd1306_get_bus(ssd1306_t *display);
 
 // Clear display (fill with black)
 void ssd1306_clear(void);
 
-// Update display with buffer contents
-void ssd1306_display(void);
+// Maximum frame bytes sent per ssd1306_flush_step() from the main loop
+// (~1ms of bus time at 400kHz, ~0.3ms at 1MHz; bounds console input latency)
+#define SSD1306_FLUSH_CHUNK_BYTES 32
+
+// Most asynchronous updates started per second (0 = no limit)
+// Requests made in between are merged into the next update.
+#ifndef SSD1306_FRAME_RATE
+#define SSD1306_FRAME_RATE 30
+#endif
+
+// Update display with buffer contents (blocks until sent)
+// Makes a single pass; returns false if the panel did not take all of it
+// (what failed stays dirty for the next update).
+bool ssd1306_display(ssd1306_t *display);
+
+// Request a display update without blocking
+// Only marks the update as wanted: the next ssd1306_flush_step() that falls
+// after the frame interval captures everything drawn up to then and sends
+// it, so any number of requests in between costs a single update.
+void ssd1306_display_async(ssd1306_t *display);
+
+// Send up to max_bytes of a pending asynchronous update
+// Returns true when there is nothing left to send
+bool ssd1306_flush_step(ssd1306_t *display, uint32_t max_bytes);
+
+// Limit asynchronous updates to fps per second (0 = start each one as
+// soon as the previous has been sent)
+void ssd1306_set_frame_rate(ssd1306_t *display, uint32_t fps);
+
+// True while an asynchronous update is in progress
+bool ssd1306_flush_busy(ssd1306_t *display);
 
-// Set a pixel (x, y) to on (1) or off (0)
+// Set a pixel (x, y) to on (1), off (0) or inverse (2)
 void ssd1306_set_pixel(int x, int y, uint8_t color);
 
-// Draw character at position
-void ssd1306_draw_char(int x, int y, char c);
+// Read a pixel back from the buffer (1 = on, 0 = off)
+uint8_t ssd1306_get_pixel(int x, int y);
+
+// Select the font for text drawing (default: font_5x7)
+void ssd1306_set_font(const font_t *font);
+
+// Get the current font
+const font_t *ssd1306_get_font(void);
+
+// Draw character at position, returns its advance in pixels
+int ssd1306_draw_char(int x, int y, char c);
 
 // Draw string at position
 void ssd1306_draw_string(int x, int y, const char *str);
 
-// Draw filled rectangle
+// Advance of one character / width of a line of text in the current font
+int ssd1306_char_width(char c);
+int ssd1306_text_width(const char *str);
+
+// Draw filled rectangle (color 0 clears, 1 fills, 2 inverts the area)
 void ssd1306_fill_rect(int x, int y, int w, int h, uint8_t color);
 
+// Buffer row of a logical page (0 = top), ssd1306_width() bytes, bit 0 = top row
+// For byte-level drawing code; report changes with ssd1306_mark_page_dirty()
+uint8_t *ssd1306_page_buffer(int page);
+
+// Mark columns x0..x1 (inclusive) of a logical page as changed
+void ssd1306_mark_page_dirty(int page, int x0, int x1);
+
+// Scroll the screen up by one 8-pixel text row using the hardware start line
+// The new bottom row is blank; call ssd1306_display() to apply
+// Panels that show fewer than 8 pages, portrait orientations and off-screen
+// targets scroll the buffer in software; only the columns whose bytes
+// change are marked dirty and resent.
+void ssd1306_scroll_page(void);
+
+// Send a sequence of raw command bytes in a single I2C transaction
+// (uses the command-stream control byte; returns false on NACK)
+bool ssd1306_send_commands(ssd1306_t *display, const uint8_t *cmds, uint32_t len);
+
+// Write len bytes straight into GDDRAM page `page` from column x, and set
+// the display start line (for modes that drive the panel RAM themselves,
+// like grayscale). Call ssd1306_invalidate() to hand the panel back to the
+// buffer: the next update then resends the whole frame.
+bool ssd1306_write_ram(ssd1306_t *display, int page, int x, const uint8_t *data, int len);
+bool ssd1306_set_start_line(ssd1306_t *display, int line);
+void ssd1306_invalidate(ssd1306_t *display);
+
+// Read or clear the driver statistics
+void ssd1306_get_stats(ssd1306_t *display, ssd1306_stats_t *stats);
+void ssd1306_reset_stats(ssd1306_t *display);
+
 // Set display contrast (0-255)
-void ssd1306_set_contrast(uint8_t contrast);
+void ssd1306_set_contrast(ssd1306_t *display, uint8_t contrast);
 
 // Turn display on/off
-void ssd1306_display_on(bool on);
+void ssd1306_display_on(ssd1306_t *display, bool on);
 
 // Invert display colors
-void ssd1306_invert_display(bool invert);
+void ssd1306_invert_display(ssd1306_t *display, bool invert);
+
+// Set or get the screen orientation (starts at 0 in ssd1306_init)
+// Changing between landscape and portrait clears the display's buffer;
+// drawing on it follows the new orientation whether it is selected or not.
+// Call ssd1306_display() afterwards to redraw the screen.
+void ssd1306_set_rotation(ssd1306_t *display, ssd1306_rotation_t rotation);
+ssd1306_rotation_t ssd1306_get_rotation(ssd1306_t *display);
+
+// Drawing target size: the canvas in the current orientation, or the
+// off-screen bitmap set with ssd1306_set_target()
+int ssd1306_width(void);
+int ssd1306_height(void);
+
+// Draw into an off-screen page-oriented bitmap instead of the display
+// (width bytes per 8-pixel page). All drawing functions, including gfx_*,
+// follow the target; changes are reported to dirty(page, x0, x1), or not
+// at all if dirty is NULL (the bitmap alone decides the target).
+// Pass bitmap = NULL to draw to the display again.
+typedef void (*ssd1306_dirty_fn)(int page, int x0, int x1);
+void ssd1306_set_target(uint8_t *bitmap, int width, int height, ssd1306_dirty_fn dirty);
 
 #endif // SSD1306_H
@@ -0,0 +1,69 @@
+/*
+ * OLED panel descriptors for the SSD1306 driver
+ *
+ * The panel is chosen at build time by defining SSD1306_PANEL (see
+ * main/CMakeLists.txt). Everything that depends on it - buffer size,
+ * init sequence, how windows are addressed - is resolved by the
+ * preprocessor, so the driver carries no runtime panel checks.
+ */
+
+#ifndef SSD1306_PANEL_H
+#define SSD1306_PANEL_H
+
+// Supported panels
+#define SSD1306_PANEL_128X64  1  // SSD1306, 128x64 (0.96")
+#define SSD1306_PANEL_128X32  2  // SSD1306, 128x32 (0.91")
+#define SSD1306_PANEL_72X40   3  // SSD1306, 72x40 (0.42"), columns 28-99 of GDDRAM
+#define SSD1306_PANEL_SH1106  4  // SH1106, 128x64 visible in 132-column RAM (1.3")
+
+#ifndef SSD1306_PANEL
+#define SSD1306_PANEL SSD1306_PANEL_128X64
+#endif
+
+/*
+ * Per-panel parameters:
+ *   SSD1306_WIDTH / SSD1306_HEIGHT  Visible pixels
+ *   SSD1306_COLUMN_OFFSET           First RAM column that is visible
+ *   SSD1306_COM_PINS                COM pins configuration (0xDA argument)
+ *   SSD1306_PAGE_ADDRESSING         1 = controller only has page addressing
+ *                                   (no COLUMN_ADDR/PAGE_ADDR windows)
+ */
+#if SSD1306_PANEL == SSD1306_PANEL_128X64
+#define SSD1306_WIDTH            128
+#define SSD1306_HEIGHT           64
+#define SSD1306_COLUMN_OFFSET    0
+#define SSD1306_COM_PINS         0x12  // Alternative COM pin config
+#define SSD1306_PAGE_ADDRESSING  0
+
+#elif SSD1306_PANEL == SSD1306_PANEL_128X32
+#define SSD1306_WIDTH            128
+#define SSD1306_HEIGHT           32
+#define SSD1306_COLUMN_OFFSET    0
+#define SSD1306_COM_PINS         0x02  // Sequential COM pin config
+#define SSD1306_PAGE_ADDRESSING  0
+
+#elif SSD1306_PANEL == SSD1306_PANEL_72X40
+#define SSD1306_WIDTH            72
+#define SSD1306_HEIGHT           40
+#define SSD1306_COLUMN_OFFSET    28
+#define SSD1306_COM_PINS         0x12
+#define SSD1306_PAGE_ADDRESSING  0
+
+#elif SSD1306_PANEL == SSD1306_PANEL_SH1106
+#define SSD1306_WIDTH            128
+#define SSD1306_HEIGHT           64
+#define SSD1306_COLUMN_OFFSET    2     // 132-column RAM, panel centred
+#define SSD1306_COM_PINS         0x12
+#define SSD1306_PAGE_ADDRESSING  1
+
+#else
+#error "Unknown SSD1306_PANEL"
+#endif
+
+#define SSD1306_PAGES (SSD1306_HEIGHT / 8)
+
+// Hardware scrolling moves the start line through all 64 GDDRAM rows,
+// so it only works when the panel shows every page of RAM
+#define SSD1306_HW_SCROLL (SSD1306_PAGES == 8)
+
+#endif // SSD1306_PANEL_H
@@ -0,0 +1,158 @@
+/*
+* Text Grid
+* =========
+*
+* Character-cell text layer for the SSD1306.
+*
+* The grid keeps the character in every cell plus one dirty bit per cell.
+* Writing a cell only sets its bit when the character actually changes,
+* and textgrid_render() rasterises just those cells straight into the
+* framebuffer (6 bytes per cell, one page tall). The driver's own dirty
+* tracking is told about the bytes that really changed, cell by cell, so
+* typing a single character results in a ~6-byte GDDRAM update instead of
+* a full frame, and two edits far apart on a row are not sent as one span
+* with everything in between (the driver's window planner merges cells
+* that are close enough to be cheaper as one window).
+*
+* Cells are drawn opaque (glyph plus spacing column), so a cell never
+* needs clearing before it is redrawn.
+*/
+
+#include "textgrid.h"
+#include "font.h"
+#include <string.h>
+
+#if TEXTGRID_COLS > 32
+#error "TEXTGRID_COLS must fit in the 32-bit per-row dirty mask"
+#endif
+
+// Characters on screen and one dirty bit per cell (bit n = column n)
+static char cells[TEXTGRID_ROWS][TEXTGRID_COLS];
+static uint32_t dirty[TEXTGRID_ROWS];
+
+// Current grid size (fits the canvas in its current orientation and
+// the storage)
+static int cols;
+static int rows;
+
+void textgrid_init(void) {
+    cols = ssd1306_width() / TEXTGRID_CELL_WIDTH;
+    rows = ssd1306_height() / TEXTGRID_CELL_HEIGHT;
+    if (cols > TEXTGRID_COLS) cols = TEXTGRID_COLS;
+    if (rows > TEXTGRID_ROWS) rows = TEXTGRID_ROWS;
+    memset(cells, ' ', sizeof(cells));
+    textgrid_invalidate();
+}
+
+int textgrid_cols(void) {
+    return cols;
+}
+
+int textgrid_rows(void) {
+    return rows;
+}
+
+void textgrid_clear(void) {
+    for (int row = 0; row < rows; row++) {
+        textgrid_set_line(row, "");
+    }
+}
+
+void textgrid_put(int col, int row, char c) {
+    if (col < 0 || col >= cols || row < 0 || row >= rows) {
+        return;
+    }
+    if (cells[row][col] != c) {
+        cells[row][col] = c;
+        dirty[row] |= (uint32_t)1 << col;
+    }
+}
+
+char textgrid_get(int col, int row) {
+    if (col < 0 || col >= cols || row < 0 || row >= rows) {
+        return '\0';
+    }
+    return cells[row][col];
+}
+
+void textgrid_set_line(int row, const char *text) {
+    int col = 0;
+    while (col < cols && text[col]) {
+        textgrid_put(col, row, text[col]);
+        col++;
+    }
+    while (col < cols) {
+        textgrid_put(col, row, ' ');
+        col++;
+    }
+}
+
+void textgrid_scroll(void) {
+    memmove(cells[0], cells[1], (rows - 1) * sizeof(cells[0]));
+    memset(cells[rows - 1], ' ', sizeof(cells[0]));
+
+    if (rows * TEXTGRID_CELL_HEIGHT == ssd1306_height()) {
+        // The driver scrolls the framebuffer (in hardware where it can),
+        // so cells keep their pixels and pending redraws simply move up
+        // with them. The new bottom row is cleared by the driver and
+        // starts out clean.
+        ssd1306_scroll_page();
+        memmove(&dirty[0], &dirty[1], (rows - 1) * sizeof(dirty[0]));
+        dirty[rows - 1] = 0;
+    } else {
+        // Grid covers only part of the screen: redraw it in place
+        textgrid_invalidate();
+    }
+}
+
+void textgrid_invalidate(void) {
+    uint32_t mask = cols < 32 ? ((uint32_t)1 << cols) - 1 : 0xFFFFFFFF;
+    for (int row = 0; row < rows; row++) {
+        dirty[row] = mask;
+    }
+}
+
+void textgrid_render(void) {
+    const font_t *font = &font_5x7;
+
+    for (int row = 0; row < rows; row++) {
+        if (!dirty[row]) {
+            continue;
+        }
+
+        uint8_t *line = ssd1306_page_buffer(row);
+
+        for (int col = 0; col < cols; col++) {
+            if (!(dirty[row] & ((uint32_t)1 << col))) {
+                continue;
+            }
+
+            uint8_t code = (uint8_t)cells[row][col];
+            if (code < font->first || code > font->last) {
+                code = ' ';
+            }
+            const uint8_t *glyph = &font->bitmap[(code - font->first) * font->fixed_width];
+
+            // Copy the glyph and blank the spacing column, noting changed bytes
+            uint8_t *cell = &line[col * TEXTGRID_CELL_WIDTH];
+            int first = -1;
+            int last = -1;
+            for (int i = 0; i < TEXTGRID_CELL_WIDTH; i++) {
+                uint8_t value = i < font->fixed_width ? glyph[i] : 0x00;
+                if (cell[i] != value) {
+                    cell[i] = value;
+                    if (first < 0) first = i;
+                    last = i;
+                }
+            }
+
+            // Each cell on its own: the driver decides which to send together
+            if (first >= 0) {
+                int x = col * TEXTGRID_CELL_WIDTH;
+                ssd1306_mark_page_dirty(row, x + first, x + last);
+            }
+        }
+
+        dirty[row] = 0;
+    }
+}
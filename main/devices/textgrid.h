@@ -0,0 +1,62 @@
+/*
+ * Text grid - retained character-cell layer on top of the SSD1306 buffer
+ * Stores the characters on screen and redraws only the cells that change
+ */
+
+#ifndef TEXTGRID_H
+#define TEXTGRID_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ssd1306.h"
+
+// Cell size in pixels (5x7 glyph + 1 column / 1 row of spacing)
+#define TEXTGRID_CELL_WIDTH  6
+#define TEXTGRID_CELL_HEIGHT 8
+
+// Grid storage in cells. The defaults come from the panel's longer side,
+// so the grid fills the canvas in any orientation (21 columns in
+// landscape and 16 rows in portrait on a 128x64 panel). Define smaller
+// values to save RAM; the grid then covers the top left of the canvas.
+#define TEXTGRID_PANEL_MAX   (SSD1306_WIDTH > SSD1306_HEIGHT ? SSD1306_WIDTH : SSD1306_HEIGHT)
+#ifndef TEXTGRID_COLS
+#define TEXTGRID_COLS (TEXTGRID_PANEL_MAX / TEXTGRID_CELL_WIDTH)
+#endif
+#ifndef TEXTGRID_ROWS
+#define TEXTGRID_ROWS (TEXTGRID_PANEL_MAX / TEXTGRID_CELL_HEIGHT)
+#endif
+
+// Size the grid to the current canvas (21x8 on a 128x64 landscape panel,
+// 10x16 in portrait), at most TEXTGRID_COLS x TEXTGRID_ROWS, reset every
+// cell to a space and mark the whole grid for redraw. Call again after
+// changing the display rotation.
+void textgrid_init(void);
+
+// Grid size in cells
+int textgrid_cols(void);
+int textgrid_rows(void);
+
+// Set every cell to a space (only cells that held text are redrawn)
+void textgrid_clear(void);
+
+// Set one cell
+void textgrid_put(int col, int row, char c);
+
+// Get one cell ('\0' if out of range)
+char textgrid_get(int col, int row);
+
+// Replace a whole row with text (truncated or padded with spaces)
+void textgrid_set_line(int row, const char *text);
+
+// Move every row up by one and blank the bottom row
+// Uses the display's hardware scroll when the grid covers the whole screen
+void textgrid_scroll(void);
+
+// Force every cell to be redrawn on the next render
+void textgrid_invalidate(void);
+
+// Rasterise the changed cells into the framebuffer
+// Call ssd1306_display() or ssd1306_display_async() afterwards to send them.
+void textgrid_render(void);
+
+#endif // TEXTGRID_H
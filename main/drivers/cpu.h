@@ -0,0 +1,79 @@
+/*
+ * CPU cycle counter and clock helpers
+ *
+ * The ESP32-C3 core has no standard RISC-V mcycle CSR. It provides its own
+ * performance counter instead (mpcer/mpcmr/mpccr, CSRs 0x7E0-0x7E2), which
+ * counts CPU clock cycles once enabled and wraps after 32 bits (~26s at
+ * 160MHz). Differences of cpu_cycles() values stay correct across a wrap.
+ *
+ * Defining CPU_HOST replaces the CSR accesses with functions the host
+ * test build provides (see tests/).
+ */
+
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+
+// CPU clock frequency (ESP-IDF default for the ESP32-C3)
+#define CPU_FREQ_HZ 160000000
+
+#ifdef CPU_HOST
+// Host builds (tests/) supply the cycle counter, the interrupt mask and
+// interrupt delivery, so the drivers run unchanged on a simulated clock
+void cpu_cycle_counter_init(void);
+uint32_t cpu_cycles(void);
+uint32_t cpu_irq_save(void);
+void cpu_irq_restore(uint32_t state);
+void cpu_wait_for_interrupt(void);
+
+#else
+
+// Performance counter CSRs
+#define CSR_MPCER 0x7E0  // Event select
+#define CSR_MPCMR 0x7E1  // Mode (bit 0 = count enable)
+#define CSR_MPCCR 0x7E2  // Counter value
+
+// Start counting CPU cycles
+static inline void cpu_cycle_counter_init(void) {
+    __asm__ volatile("csrw %0, %1" :: "i"(CSR_MPCER), "r"(1));  // Event: clock cycles
+    __asm__ volatile("csrw %0, %1" :: "i"(CSR_MPCMR), "r"(1));  // Enable counting
+}
+
+// Read the cycle counter
+static inline uint32_t cpu_cycles(void) {
+    uint32_t cycles;
+    __asm__ volatile("csrr %0, %1" : "=r"(cycles) : "i"(CSR_MPCCR));
+    return cycles;
+}
+
+// Mask machine interrupts, returning the previous mstatus.MIE state
+// (for short critical sections shared with interrupt handlers)
+static inline uint32_t cpu_irq_save(void) {
+    uint32_t mstatus;
+    __asm__ volatile("csrrci %0, mstatus, 8" : "=r"(mstatus) :: "memory");
+    return mstatus & 8;
+}
+
+// Restore the interrupt state returned by cpu_irq_save()
+static inline void cpu_irq_restore(uint32_t state) {
+    if (state) {
+        __asm__ volatile("csrsi mstatus, 8" ::: "memory");
+    }
+}
+
+// Sleep until an interrupt is pending. It wakes up with interrupts masked
+// too, and the handler then runs once they are restored, so a wait is:
+// mask, check the condition, sleep, restore (a wake-up cannot be missed).
+static inline void cpu_wait_for_interrupt(void) {
+    __asm__ volatile("wfi" ::: "memory");
+}
+
+#endif // CPU_HOST
+
+// Convert a cycle count to microseconds
+static inline uint32_t cpu_cycles_to_us(uint32_t cycles) {
+    return cycles / (CPU_FREQ_HZ / 1000000);
+}
+
+#endif // CPU_H
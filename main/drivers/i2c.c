@@ -1,6 +1,64 @@
+/*
+* I2C Master (bit-banged)
+* =======================
+*
+* Drives SCL/SDA as open-drain GPIOs. Every phase of the bus waits on the
+* CPU cycle counter (cpu.h) rather than a counted loop, so the timing no
+* longer depends on how fast the loop body happens to run:
+*
+* - Each line change records a timestamp; the next change waits until the
+*   phase's minimum length has passed since then. The code between two
+*   edges is part of the phase instead of being added on top of it.
+* - Minimum phase lengths come from the I2C specification for the mode
+*   the requested clock falls into (standard, fast, fast-mode plus). If
+*   the clock is slower than the mode allows, tLOW and tHIGH are stretched
+*   in proportion to reach it.
+* - The first i2c_bus_create() calibrates what an edge costs on top of
+*   the wait (GPIO writes go through the APB bus and take several cycles):
+*   releasing SCL also reads it back, pulling a line low does not. Each
+*   phase has the cost of the edge that ends it taken off.
+* - i2c_bus_create() measures the SCL rate the bus really gets, once,
+*   before any device traffic (see i2c_measure()). What a period takes
+*   beyond the phase lengths is kept, and the rate of any other clock is
+*   worked out from its phase lengths plus that; setting a clock or
+*   reading it with i2c_bus_freq() never puts anything on the bus.
+* - Clocks outside I2C_MIN_FREQ_HZ..I2C_MAX_FREQ_HZ are rejected.
+*
+* Faults:
+* - Releasing SCL waits for it to read back high, so a slave stretching
+*   the clock just lengthens the phase. If it stays low for longer than
+*   I2C_STRETCH_TIMEOUT_US the transfer fails with I2C_ERR_TIMEOUT.
+* - i2c_stop() after such a fault, and i2c_start() on a bus that is not
+*   idle, run the standard recovery: up to nine SCL clocks until the
+*   slave releases SDA, then a STOP.
+* - i2c_write(), i2c_write_reg() and i2c_transfer() retry a failed
+*   transaction up to I2C_RETRIES times, so a glitch costs one transaction.
+*
+* Asynchronous transactions (i2c_transfer_async()) run from a periodic
+* timer interrupt that calls i2c_bus_service() every I2C_TICK_US: each
+* call clocks one step, a START with the address, one data byte or the
+* STOP, with the same code and timing as the blocking calls, so an
+* interrupt never holds the CPU for more than a byte. A synchronous call
+* that finds one running finishes it step by step itself instead of
+* waiting for the ticks.
+*
+* Every bus keeps its own pins, timing and state in an i2c_bus_t from a
+* static pool of I2C_MAX_BUSES. Device-level calls first switch the bus to
+* the device's clock, which only recomputes the phase lengths.
+*
+* GPIO and IO MUX accesses go through I2C_GPIO_REG_READ/WRITE, and all
+* timing comes from cpu_cycles(). Defining both before building this file
+* runs it against a model of the open-drain lines: the model sees every
+* edge in order, answers reads of GPIO_IN with the wired-AND of master and
+* slaves, and advances the cycle count it returns, so the driver's waits
+* become simulated bus time.
+*/
+
 #include "i2c.h"
+#include "cpu.h"
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 // GPIO register base addresses
 #define GPIO_BASE           0x60004000
@@ -12,6 +70,8 @@
 #define GPIO_OUT_W1TS_REG   (GPIO_BASE + 0x0008)
 #define GPIO_OUT_W1TC_REG   (GPIO_BASE + 0x000C)
 #define GPIO_IN_REG         (GPIO_BASE + 0x003C)
+#define GPIO_PIN_REG(n)     (GPIO_BASE + 0x0074 + (n) * 4)
+#define GPIO_PIN_PAD_DRIVER (1 << 2)   // Open drain
 
 // IO MUX registers
 #define GPIO_PIN_MUX_REG(n) (IO_MUX_BASE + 0x0004 + (n * 4))
@@ -23,20 +83,116 @@
 #define FUN_WPU             (1 << 7)   // Weak pull-up
 #define FUN_WPD             (1 << 8)   // Weak pull-down
 
-// Register access macros
-#define REG_WRITE(addr, val) (*((volatile uint32_t *)(addr)) = (val))
-#define REG_READ(addr)       (*((volatile uint32_t *)(addr)))
+// Register access (overridable, see above)
+#ifndef I2C_GPIO_REG_WRITE
+#define I2C_GPIO_REG_WRITE(addr, val) (*((volatile uint32_t *)(addr)) = (val))
+#endif
+#ifndef I2C_GPIO_REG_READ
+#define I2C_GPIO_REG_READ(addr)       (*((volatile uint32_t *)(addr)))
+#endif
+
+#define REG_WRITE(addr, val) I2C_GPIO_REG_WRITE(addr, val)
+#define REG_READ(addr)       I2C_GPIO_REG_READ(addr)
 #define REG_SET_BIT(addr, bit)   REG_WRITE(addr, REG_READ(addr) | (bit))
 #define REG_CLR_BIT(addr, bit)   REG_WRITE(addr, REG_READ(addr) & ~(bit))
 
-// I2C timing delays (in CPU cycles for bit-banging)
-static uint32_t i2c_delay_cycles;
-static int scl_gpio;
-static int sda_gpio;
+// Minimum bus timing per mode in nanoseconds (I2C specification, UM10204)
+typedef struct {
+    uint32_t max_freq_hz;
+    uint16_t low;       // tLOW: SCL low
+    uint16_t high;      // tHIGH: SCL high
+    uint16_t su_sta;    // tSU;STA: SCL high before a (repeated) START
+    uint16_t hd_sta;    // tHD;STA: START to first SCL fall
+    uint16_t su_sto;    // tSU;STO: SCL high before STOP
+    uint16_t buf;       // tBUF: bus free between STOP and START
+    uint16_t su_dat;    // tSU;DAT: SDA stable before SCL rises
+    uint16_t hold;      // tHD;DAT: SDA unchanged after SCL falls (the
+                        // specification allows 0, the SSD1306 needs 300)
+} i2c_mode_t;
+
+// hold + su_dat fits in low, so SDA can change inside tLOW in every mode
+static const i2c_mode_t i2c_modes[] = {
+    { 100000, 4700, 4000, 4700, 4000, 4000, 4700, 250, 300},  // Standard mode
+    { 400000, 1300,  600,  600,  600,  600, 1300, 100, 300},  // Fast mode
+    {1000000,  500,  260,  260,  260,  260,  500,  50, 300},  // Fast mode plus
+};
+
+// SCL periods i2c_bus_create() times
+#define I2C_MEASURE_PERIODS 8
+
+// The same phases in CPU cycles, with the per-edge overhead taken off
+typedef struct {
+    uint32_t low, high, su_sta, hd_sta, su_sto, buf, su_dat, hold;
+} i2c_timing_t;
+
+struct i2c_bus {
+    int scl_gpio;
+    int sda_gpio;
+    uint32_t scl_mask;          // GPIO_OUT_W1TS/W1TC bit of each line
+    uint32_t sda_mask;
+
+    i2c_timing_t timing;
+    uint32_t freq_hz;           // Requested clock
+    uint32_t actual_freq;       // SCL rate reached at freq_hz
+    int32_t period_extra;       // Cycles I2C_MEASURE_PERIODS real periods
+                                // take beyond their phase lengths
+
+    uint32_t scl_edge;          // Cycle count of the last SCL change
+    uint32_t sda_edge;          // Cycle count of the last SDA change
+    bool bus_idle;              // Between STOP and START (both lines high)
+    volatile bool bus_owned;    // Between i2c_start() and i2c_stop(), or
+                                // for an asynchronous transaction
+    bool sda_level;             // Level SDA is currently set to
+
+    // Asynchronous transaction (i2c_transfer_async()), a step per tick
+    const i2c_dev_t *volatile async_dev;  // NULL when none runs
+    const i2c_segment_t *async_segments;
+    int async_count;
+    int async_segment;          // Segment being sent (async_count: the STOP)
+    int32_t async_byte;         // Its next byte (-1: START and address)
+    int async_attempt;
+    uint32_t async_freq;        // Clock to give back to synchronous callers
+    i2c_done_t async_done;
+    void *async_user;
+
+    // Traffic counters and error state
+    i2c_stats_t stats;
+    bool nack_pending;          // Last written byte was NACKed; a STOP now aborts
+    bool bus_fault;             // Transfer broke off mid-byte; a STOP recovers
+    i2c_err_t last_error;
+};
+
+static struct i2c_bus buses[I2C_MAX_BUSES];
+static int bus_count;
+
+// Shared by all buses: it depends only on the CPU
+static uint32_t rise_overhead;  // Cycles releasing SCL costs
+static uint32_t fall_overhead;  // Cycles driving a line costs
+static uint32_t stretch_limit = I2C_STRETCH_TIMEOUT_US * (CPU_FREQ_HZ / 1000000);
+
+// Record why the current transfer failed
+static void i2c_fail(i2c_bus_t *bus, i2c_err_t err) {
+    bus->last_error = err;
+    if (err == I2C_ERR_TIMEOUT) {
+        bus->stats.timeouts++;
+        bus->bus_fault = true;
+    }
+}
+
+// Convert a phase length to cycles, minus what the edge ending it costs
+static uint32_t i2c_phase_cycles(uint32_t ns, uint32_t overhead) {
+    uint32_t cycles = (ns * (CPU_FREQ_HZ / 1000000) + 999) / 1000;
+    return cycles > overhead ? cycles - overhead : 0;
+}
 
-// Delay function for I2C timing
-static void i2c_delay(void) {
-    for (volatile uint32_t i = 0; i < i2c_delay_cycles; i++);
+// Wait until `cycles` have passed since `since`
+static inline void i2c_wait(uint32_t since, uint32_t cycles) {
+    while (cpu_cycles() - since < cycles);
+}
+
+// Wait out tHD;DAT after the last SCL fall, before SDA may change
+static inline void i2c_hold(i2c_bus_t *bus) {
+    i2c_wait(bus->scl_edge, bus->timing.hold);
 }
 
 // Set pin as open-drain output with pull-up
@@ -60,170 +216,708 @@ static void gpio_set_opendrain(int gpio_num) {
 
     REG_WRITE(mux_reg, mux_val);
 
+    // Open drain: a high output releases the line instead of driving it,
+    // so a slave can hold SCL low to stretch or SDA low to ACK
+    REG_SET_BIT(GPIO_PIN_REG(gpio_num), GPIO_PIN_PAD_DRIVER);
+
     // Enable as output
     REG_SET_BIT(GPIO_ENABLE_REG, (1 << gpio_num));
 }
 
-// Set SCL high (release line, pulled up by resistor)
-static void scl_high(void) {
-    REG_WRITE(GPIO_OUT_W1TS_REG, (1 << scl_gpio));
-    i2c_delay();
+// Wait for a released SCL that still reads low: a slave is stretching
+// the clock. Returns false if it holds it past the timeout.
+static bool scl_wait_release(i2c_bus_t *bus) {
+    uint32_t released = cpu_cycles();
+    while (!(REG_READ(GPIO_IN_REG) & bus->scl_mask)) {
+        if (cpu_cycles() - released > stretch_limit) {
+            i2c_fail(bus, I2C_ERR_TIMEOUT);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Line changes: release (high, pulled up by resistor) or drive low,
+// recording when it happened. SDA is only written when its level changes.
+// Releasing SCL checks that it reads high; returns false on a timeout.
+static inline bool scl_high(i2c_bus_t *bus) {
+    REG_WRITE(GPIO_OUT_W1TS_REG, bus->scl_mask);
+    if (!(REG_READ(GPIO_IN_REG) & bus->scl_mask) && !scl_wait_release(bus)) {
+        return false;
+    }
+    bus->scl_edge = cpu_cycles();
+    return true;
 }
 
-// Set SCL low
-static void scl_low(void) {
-    REG_WRITE(GPIO_OUT_W1TC_REG, (1 << scl_gpio));
-    i2c_delay();
+static inline void scl_low(i2c_bus_t *bus) {
+    REG_WRITE(GPIO_OUT_W1TC_REG, bus->scl_mask);
+    bus->scl_edge = cpu_cycles();
 }
 
-// Set SDA high (release line)
-static void sda_high(void) {
-    REG_WRITE(GPIO_OUT_W1TS_REG, (1 << sda_gpio));
-    i2c_delay();
+static inline void sda_high(i2c_bus_t *bus) {
+    if (!bus->sda_level) {
+        REG_WRITE(GPIO_OUT_W1TS_REG, bus->sda_mask);
+        bus->sda_edge = cpu_cycles();
+        bus->sda_level = true;
+    }
+}
+
+static inline void sda_low(i2c_bus_t *bus) {
+    if (bus->sda_level) {
+        REG_WRITE(GPIO_OUT_W1TC_REG, bus->sda_mask);
+        bus->sda_edge = cpu_cycles();
+        bus->sda_level = false;
+    }
 }
 
-// Set SDA low
-static void sda_low(void) {
-    REG_WRITE(GPIO_OUT_W1TC_REG, (1 << sda_gpio));
-    i2c_delay();
+static inline void sda_set(i2c_bus_t *bus, bool level) {
+    if (level) {
+        sda_high(bus);
+    } else {
+        sda_low(bus);
+    }
 }
 
 // Read SDA state
-static bool sda_read(void) {
-    return (REG_READ(GPIO_IN_REG) & (1 << sda_gpio)) != 0;
+static bool sda_read(i2c_bus_t *bus) {
+    return (REG_READ(GPIO_IN_REG) & bus->sda_mask) != 0;
+}
+
+// Read SCL state
+static bool scl_read(i2c_bus_t *bus) {
+    return (REG_READ(GPIO_IN_REG) & bus->scl_mask) != 0;
+}
+
+// One SCL clock with SDA already set: low phase ends, high phase, fall
+static bool i2c_clock(i2c_bus_t *bus) {
+    i2c_wait(bus->scl_edge, bus->timing.low);
+    i2c_wait(bus->sda_edge, bus->timing.su_dat);
+    if (!scl_high(bus)) {
+        return false;
+    }
+    i2c_wait(bus->scl_edge, bus->timing.high);
+    scl_low(bus);
+    return true;
+}
+
+// Pick the mode for freq_hz and stretch tLOW/tHIGH to reach that rate
+static void i2c_set_timing(i2c_bus_t *bus, uint32_t freq_hz) {
+    int count = sizeof(i2c_modes) / sizeof(i2c_modes[0]);
+    const i2c_mode_t *mode = &i2c_modes[count - 1];
+    for (int i = 0; i < count; i++) {
+        if (freq_hz <= i2c_modes[i].max_freq_hz) {
+            mode = &i2c_modes[i];
+            break;
+        }
+    }
+
+    // freq_hz >= I2C_MIN_FREQ_HZ keeps period * low within 32 bits
+    uint32_t low = mode->low;
+    uint32_t high = mode->high;
+    uint32_t period = 1000000000 / freq_hz;
+    if (period > low + high) {
+        low = period * low / (low + high);
+        high = period - low;
+    }
+
+    // tLOW and tSU;DAT end with SCL released and read back, the others
+    // with a plain line change
+    i2c_timing_t *timing = &bus->timing;
+    timing->low = i2c_phase_cycles(low, rise_overhead);
+    timing->high = i2c_phase_cycles(high, fall_overhead);
+    timing->su_sta = i2c_phase_cycles(mode->su_sta, fall_overhead);
+    timing->hd_sta = i2c_phase_cycles(mode->hd_sta, fall_overhead);
+    timing->su_sto = i2c_phase_cycles(mode->su_sto, fall_overhead);
+    timing->buf = i2c_phase_cycles(mode->buf, fall_overhead);
+    timing->su_dat = i2c_phase_cycles(mode->su_dat, rise_overhead);
+    timing->hold = i2c_phase_cycles(mode->hold, fall_overhead);
+    bus->freq_hz = freq_hz;
 }
 
-void i2c_init(const i2c_config_t *config) {
-    scl_gpio = config->scl_pin;
-    sda_gpio = config->sda_pin;
+// Measure what the edges cost, with the bus idle (SCL and SDA high:
+// setting a line high again is invisible on the bus)
+static void i2c_calibrate(i2c_bus_t *bus) {
+    // The waits spin on the cycle counter, so make sure it is running
+    uint32_t t0 = cpu_cycles();
+    for (volatile int i = 0; i < 10; i++);
+    if (cpu_cycles() == t0) {
+        cpu_cycle_counter_init();
+    }
 
-    // Calculate delay cycles for desired frequency
-    // ESP32-C3 runs at 160MHz, adjust for desired I2C frequency
-    // For 100kHz I2C: period = 10us, half-period = 5us
-    // At 160MHz: 5us = 800 cycles
-    i2c_delay_cycles = (160000000 / config->freq_hz) / 4;
+    // Releasing SCL: write, read back, timestamp. The wait before an edge
+    // ends with the cycle counter read that finds the phase over, which
+    // counts towards the phase, so no wait here.
+    const int edges = 16;
+    uint32_t start = cpu_cycles();
+    for (int i = 0; i < edges; i++) {
+        if (!scl_high(bus)) {
+            rise_overhead = 0;  // SCL held low: nothing meaningful to measure
+            fall_overhead = 0;
+            return;
+        }
+    }
+    rise_overhead = (cpu_cycles() - start) / edges;
+
+    // Driving a line: write, timestamp (as scl_low(), but to the level
+    // the line already has)
+    start = cpu_cycles();
+    for (int i = 0; i < edges; i++) {
+        REG_WRITE(GPIO_OUT_W1TS_REG, bus->scl_mask);
+        bus->scl_edge = cpu_cycles();
+    }
+    fall_overhead = (cpu_cycles() - start) / edges;
+}
+
+// One SCL period as the phase lengths make it, edge costs included
+static uint32_t i2c_period_cycles(const i2c_bus_t *bus) {
+    return bus->timing.low + rise_overhead + bus->timing.high + fall_overhead;
+}
+
+// Clock SCL nine times with SDA released and return the cycles of the
+// I2C_MEASURE_PERIODS periods from the first falling edge to the last
+// one (0 if SCL is held low). Without a START no slave takes part, and
+// one that was left halfway through a byte lets go of SDA.
+static uint32_t i2c_measure(i2c_bus_t *bus) {
+    sda_high(bus);
+    i2c_wait(bus->scl_edge, bus->timing.high);
+    scl_low(bus);
+    uint32_t first_fall = bus->scl_edge;
+    for (int i = 0; i < I2C_MEASURE_PERIODS; i++) {
+        i2c_wait(bus->scl_edge, bus->timing.low);
+        if (!scl_high(bus)) {
+            return 0;
+        }
+        i2c_wait(bus->scl_edge, bus->timing.high);
+        scl_low(bus);
+    }
+    uint32_t cycles = bus->scl_edge - first_fall;
+    i2c_wait(bus->scl_edge, bus->timing.low);
+    if (!scl_high(bus)) {
+        return 0;
+    }
+    i2c_wait(bus->scl_edge, bus->timing.buf);
+    return cycles;
+}
+
+// Switch to freq_hz and work out the rate it gives from the phase
+// lengths and the measurement made at i2c_bus_create()
+static bool i2c_clock_select(i2c_bus_t *bus, uint32_t freq_hz) {
+    if (freq_hz < I2C_MIN_FREQ_HZ || freq_hz > I2C_MAX_FREQ_HZ) {
+        return false;
+    }
+    i2c_set_timing(bus, freq_hz);
+    int32_t cycles = (int32_t)(i2c_period_cycles(bus) * I2C_MEASURE_PERIODS) + bus->period_extra;
+    bus->actual_freq = cycles > 0 ? (uint64_t)CPU_FREQ_HZ * I2C_MEASURE_PERIODS / cycles : freq_hz;
+    return true;
+}
+
+i2c_bus_t *i2c_bus_create(const i2c_config_t *config) {
+    if (bus_count >= I2C_MAX_BUSES ||
+        config->freq_hz < I2C_MIN_FREQ_HZ || config->freq_hz > I2C_MAX_FREQ_HZ) {
+        return NULL;
+    }
+
+    i2c_bus_t *bus = &buses[bus_count++];
+    bus->scl_gpio = config->scl_pin;
+    bus->sda_gpio = config->sda_pin;
+    bus->scl_mask = 1 << bus->scl_gpio;
+    bus->sda_mask = 1 << bus->sda_gpio;
+    bus->bus_idle = true;
+
+    // Latch both lines high first, so enabling the outputs does not pull
+    // the bus low (a stray clock edge for the slaves)
+    REG_WRITE(GPIO_OUT_W1TS_REG, bus->scl_mask | bus->sda_mask);
+    bus->sda_level = true;
+    bus->sda_edge = cpu_cycles();
 
     // Configure pins as open-drain
-    gpio_set_opendrain(scl_gpio);
-    gpio_set_opendrain(sda_gpio);
+    gpio_set_opendrain(bus->scl_gpio);
+    gpio_set_opendrain(bus->sda_gpio);
+    scl_high(bus);
+
+    // The edge cost is the same on every bus; measure it once
+    if (bus_count == 1) {
+        i2c_calibrate(bus);
+    }
 
-    // Initialize both lines high
-    sda_high();
-    scl_high();
+    // Time the clock once, while no device can be in the middle of a
+    // transfer; every clock's rate is derived from this
+    i2c_set_timing(bus, config->freq_hz);
+    uint32_t cycles = i2c_measure(bus);
+    if (cycles) {
+        bus->period_extra = (int32_t)cycles - (int32_t)(i2c_period_cycles(bus) * I2C_MEASURE_PERIODS);
+    }
+    i2c_clock_select(bus, config->freq_hz);
+    return bus;
+}
+
+uint32_t i2c_bus_freq(i2c_bus_t *bus) {
+    return bus->actual_freq;
 }
 
-bool i2c_start(void) {
+i2c_err_t i2c_bus_recover(i2c_bus_t *bus) {
+    const i2c_timing_t *timing = &bus->timing;
+    bus->stats.recoveries++;
+    bus->bus_fault = false;
+    bus->nack_pending = false;
+
+    // Clock out whatever byte a slave was in the middle of sending,
+    // until it lets go of SDA (one byte plus ACK at most)
+    i2c_hold(bus);
+    sda_high(bus);
+    for (int i = 0; i < 9 && !sda_read(bus); i++) {
+        i2c_wait(bus->scl_edge, timing->high);
+        scl_low(bus);
+        i2c_wait(bus->scl_edge, timing->low);
+        if (!scl_high(bus)) {
+            bus->last_error = I2C_ERR_BUS;
+            return I2C_ERR_BUS;  // SCL held low: nothing the master can do
+        }
+    }
+
+    // STOP: SDA rises while SCL is high
+    i2c_wait(bus->scl_edge, timing->high);
+    scl_low(bus);
+    i2c_hold(bus);
+    sda_low(bus);
+    i2c_wait(bus->scl_edge, timing->low);
+    if (!scl_high(bus)) {
+        bus->last_error = I2C_ERR_BUS;
+        return I2C_ERR_BUS;
+    }
+    i2c_wait(bus->scl_edge, timing->su_sto);
+    sda_high(bus);
+    bus->bus_idle = true;
+
+    if (!sda_read(bus)) {
+        bus->last_error = I2C_ERR_BUS;
+        return I2C_ERR_BUS;
+    }
+    return I2C_OK;
+}
+
+i2c_err_t i2c_last_error(i2c_bus_t *bus) {
+    return bus->last_error;
+}
+
+bool i2c_bus_busy(i2c_bus_t *bus) {
+    return bus->bus_owned;
+}
+
+// START, or a repeated START within a transaction
+static bool i2c_start_condition(i2c_bus_t *bus) {
+    const i2c_timing_t *timing = &bus->timing;
+    bus->stats.transactions++;
+    bus->nack_pending = false;
+    bus->last_error = I2C_OK;
+
+    if (bus->bus_idle) {
+        // Both lines should be high; a slave holding SDA low is stuck
+        // mid-byte from an earlier transfer
+        if ((!sda_read(bus) || !scl_read(bus)) && i2c_bus_recover(bus) != I2C_OK) {
+            return false;
+        }
+        // Give the bus its free time after the STOP
+        i2c_wait(bus->sda_edge, timing->buf);
+    } else {
+        // Repeated START: release SDA while SCL is low, then raise SCL
+        i2c_hold(bus);
+        sda_high(bus);
+        i2c_wait(bus->scl_edge, timing->low);
+        if (!scl_high(bus)) {
+            i2c_bus_recover(bus);
+            return false;
+        }
+    }
+
     // SDA goes low while SCL is high
-    sda_high();
-    scl_high();
-    sda_low();
-    scl_low();
+    i2c_wait(bus->scl_edge, timing->su_sta);
+    sda_low(bus);
+    i2c_wait(bus->sda_edge, timing->hd_sta);
+    scl_low(bus);
+    bus->bus_idle = false;
     return true;
 }
 
-void i2c_stop(void) {
-    // SDA goes high while SCL is high
-    sda_low();
-    scl_high();
-    sda_high();
+// STOP, or recovery after a fault
+static void i2c_stop_condition(i2c_bus_t *bus) {
+    const i2c_timing_t *timing = &bus->timing;
+    if (bus->nack_pending) {
+        bus->stats.aborts++;
+        bus->nack_pending = false;
+    }
+
+    if (bus->bus_fault) {
+        bus->stats.aborts++;
+        i2c_bus_recover(bus);
+    } else {
+        // SDA goes high while SCL is high
+        i2c_hold(bus);
+        sda_low(bus);
+        i2c_wait(bus->scl_edge, timing->low);
+        i2c_wait(bus->sda_edge, timing->su_dat);
+        if (scl_high(bus)) {
+            i2c_wait(bus->scl_edge, timing->su_sto);
+            sda_high(bus);
+            bus->bus_idle = true;
+        } else {
+            i2c_bus_recover(bus);
+        }
+    }
 }
 
-bool i2c_write_byte(uint8_t data) {
-    // Write 8 bits
+// Transmit path: the hottest loop in the driver (every display byte).
+// Masks, timing and the last edge stay in registers, SDA is written only
+// when the bit differs from the previous one, and all waits count from
+// the SCL fall that starts the bit: tHD;DAT before SDA changes, tLOW
+// before SCL rises, tHIGH before it falls. tHD;DAT + tSU;DAT fit in tLOW
+// (see i2c_modes[]), so the tLOW wait also covers the setup time.
+// Releasing SCL still waits for it to read back high.
+bool i2c_write_byte(i2c_bus_t *bus, uint8_t data) {
+    const uint32_t scl = bus->scl_mask;
+    const uint32_t sda = bus->sda_mask;
+    const uint32_t t_low = bus->timing.low;
+    const uint32_t t_high = bus->timing.high;
+    const uint32_t t_hold = bus->timing.hold;
+    uint32_t edge = bus->scl_edge;
+    bool level = bus->sda_level;
+
     for (int i = 7; i >= 0; i--) {
-        if (data & (1 << i)) {
-            sda_high();
-        } else {
-            sda_low();
+        bool bit = (data >> i) & 1;
+        if (bit != level) {
+            while (cpu_cycles() - edge < t_hold);
+            REG_WRITE(bit ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG, sda);
+            level = bit;
+        }
+        while (cpu_cycles() - edge < t_low);
+        REG_WRITE(GPIO_OUT_W1TS_REG, scl);
+        if (!(REG_READ(GPIO_IN_REG) & scl) && !scl_wait_release(bus)) {
+            bus->sda_level = level;
+            return false;
         }
-        scl_high();
-        scl_low();
+        edge = cpu_cycles();
+        while (cpu_cycles() - edge < t_high);
+        REG_WRITE(GPIO_OUT_W1TC_REG, scl);
+        edge = cpu_cycles();
     }
 
-    // Read ACK bit
-    sda_high();  // Release SDA
-    scl_high();
-    bool ack = !sda_read();  // ACK is active low
-    scl_low();
+    bus->scl_edge = edge;
+    bus->sda_edge = edge;
+    bus->sda_level = level;
+
+    // Read ACK bit at the end of the high phase
+    i2c_hold(bus);
+    sda_high(bus);  // Release SDA
+    i2c_wait(bus->scl_edge, t_low);
+    if (!scl_high(bus)) {
+        return false;
+    }
+    i2c_wait(bus->scl_edge, t_high);
+    bool ack = !sda_read(bus);  // ACK is active low
+    scl_low(bus);
+
+    bus->stats.bytes++;
+    if (!ack) {
+        bus->stats.nacks++;
+        bus->nack_pending = true;
+        bus->last_error = I2C_ERR_NACK;
+    }
 
     return ack;
 }
 
-uint8_t i2c_read_byte(bool ack) {
+uint8_t i2c_read_byte(i2c_bus_t *bus, bool ack) {
     uint8_t data = 0;
 
-    sda_high();  // Release SDA for reading
+    sda_high(bus);  // Release SDA for reading
 
-    // Read 8 bits
+    // Read 8 bits, each at the end of its high phase
     for (int i = 7; i >= 0; i--) {
-        scl_high();
-        if (sda_read()) {
+        i2c_wait(bus->scl_edge, bus->timing.low);
+        if (!scl_high(bus)) {
+            return 0xFF;
+        }
+        i2c_wait(bus->scl_edge, bus->timing.high);
+        if (sda_read(bus)) {
             data |= (1 << i);
         }
-        scl_low();
+        scl_low(bus);
     }
 
     // Send ACK/NACK
-    if (ack) {
-        sda_low();
-    } else {
-        sda_high();
+    i2c_hold(bus);
+    sda_set(bus, !ack);
+    bool clocked = i2c_clock(bus);
+    i2c_hold(bus);
+    sda_high(bus);  // Release SDA
+    if (!clocked) {
+        return 0xFF;
     }
-    scl_high();
-    scl_low();
-    sda_high();  // Release SDA
 
+    bus->stats.bytes++;
     return data;
 }
 
-bool i2c_write(uint8_t addr, const uint8_t *data, uint32_t len) {
-    if (!i2c_start()) {
-        return false;
+// End the asynchronous transaction: give the bus and the synchronous
+// callers' clock back, then report
+static void i2c_async_finish(i2c_bus_t *bus, i2c_err_t error) {
+    if (bus->freq_hz != bus->async_freq) {
+        i2c_clock_select(bus, bus->async_freq);
+    }
+    i2c_done_t done = bus->async_done;
+    void *user = bus->async_user;
+    bus->last_error = error;
+    bus->async_dev = NULL;
+    bus->bus_owned = false;
+    if (done) {
+        done(error, user);
     }
+}
 
-    // Write device address with write bit
-    if (!i2c_write_byte(addr << 1)) {
-        i2c_stop();
-        return false;
+// After a failed attempt: start over at the next step, or give up
+static void i2c_async_retry(i2c_bus_t *bus) {
+    if (bus->async_attempt == I2C_RETRIES) {
+        i2c_async_finish(bus, bus->last_error);
+        return;
     }
+    bus->async_attempt++;
+    bus->stats.retries++;
+    bus->async_segment = 0;
+    bus->async_byte = -1;
+}
 
-    // Write data bytes
-    for (uint32_t i = 0; i < len; i++) {
-        if (!i2c_write_byte(data[i])) {
-            i2c_stop();
-            return false;
+// One step of the asynchronous transaction: a (repeated) START and the
+// address, one data byte, or the STOP. A failed step ends the attempt
+// the way the blocking calls do.
+static void i2c_async_step(i2c_bus_t *bus) {
+    if (bus->async_segment == bus->async_count) {
+        // The STOP can still time out on a stretched clock
+        i2c_stop_condition(bus);
+        if (bus->last_error == I2C_OK) {
+            i2c_async_finish(bus, I2C_OK);
+        } else {
+            i2c_async_retry(bus);
         }
+        return;
+    }
+
+    const i2c_segment_t *seg = &bus->async_segments[bus->async_segment];
+    int32_t i = bus->async_byte;
+    if (i < 0) {
+        if (!i2c_start_condition(bus)) {
+            i2c_async_retry(bus);  // Recovered, or the bus is stuck
+            return;
+        }
+        i2c_write_byte(bus, (bus->async_dev->addr << 1) | seg->read);
+    } else if (seg->read) {
+        // ACK every byte but the last, which hands the bus back
+        seg->rx[i] = i2c_read_byte(bus, (uint32_t)i + 1 < seg->len);
+    } else {
+        i2c_write_byte(bus, seg->tx[i]);
+    }
+    if (bus->last_error != I2C_OK) {
+        i2c_stop_condition(bus);
+        i2c_async_retry(bus);
+        return;
+    }
+    if ((uint32_t)++bus->async_byte == seg->len) {
+        bus->async_segment++;
+        bus->async_byte = -1;
+    }
+}
+
+void i2c_bus_service(i2c_bus_t *bus) {
+    if (bus->async_dev) {
+        i2c_async_step(bus);
+    }
+}
+
+// Wait until no asynchronous transaction runs, running its remaining
+// steps from here rather than at the timer's pace. Returns with
+// interrupts masked, so that none starts before the caller has taken the
+// bus or set its clock; restore them with the state returned.
+static uint32_t i2c_wait_async(i2c_bus_t *bus) {
+    uint32_t irq = cpu_irq_save();
+    while (bus->async_dev) {
+        i2c_async_step(bus);
+        cpu_irq_restore(irq);
+        cpu_irq_save();
+    }
+    return irq;
+}
+
+bool i2c_transfer_async(const i2c_dev_t *dev, const i2c_segment_t *segments, int count,
+                        i2c_done_t done, void *user) {
+    i2c_bus_t *bus = dev->bus;
+    uint32_t irq = cpu_irq_save();
+    if (bus->bus_owned || count < 1) {
+        cpu_irq_restore(irq);
+        return false;
+    }
+    bus->bus_owned = true;
+    bus->async_segments = segments;
+    bus->async_count = count;
+    bus->async_segment = 0;
+    bus->async_byte = -1;
+    bus->async_attempt = 0;
+    bus->async_done = done;
+    bus->async_user = user;
+    bus->async_freq = bus->freq_hz;
+    if (dev->freq_hz && dev->freq_hz != bus->freq_hz) {
+        i2c_clock_select(bus, dev->freq_hz);
+    }
+    bus->async_dev = dev;
+    cpu_irq_restore(irq);
+    return true;
+}
+
+bool i2c_set_freq(i2c_bus_t *bus, uint32_t freq_hz) {
+    uint32_t irq = i2c_wait_async(bus);
+    bool ok = i2c_clock_select(bus, freq_hz);
+    cpu_irq_restore(irq);
+    return ok;
+}
+
+void i2c_dev_select(const i2c_dev_t *dev) {
+    if (dev->freq_hz && dev->freq_hz != dev->bus->freq_hz) {
+        i2c_set_freq(dev->bus, dev->freq_hz);
     }
+}
 
-    i2c_stop();
+bool i2c_start(i2c_bus_t *bus) {
+    uint32_t irq = i2c_wait_async(bus);
+    bus->bus_owned = true;
+    cpu_irq_restore(irq);
+    if (!i2c_start_condition(bus)) {
+        bus->bus_owned = false;
+        return false;
+    }
     return true;
 }
 
-bool i2c_write_reg(uint8_t addr, uint8_t reg, const uint8_t *data, uint32_t len) {
-    if (!i2c_start()) {
+void i2c_stop(i2c_bus_t *bus) {
+    i2c_stop_condition(bus);
+    bus->bus_owned = false;
+}
+
+// One write transaction: address, optional register byte, data
+static bool i2c_write_once(const i2c_dev_t *dev, const uint8_t *reg, const uint8_t *data, uint32_t len) {
+    i2c_bus_t *bus = dev->bus;
+    if (!i2c_start(bus)) {
         return false;
     }
 
     // Write device address with write bit
-    if (!i2c_write_byte(addr << 1)) {
-        i2c_stop();
+    if (!i2c_write_byte(bus, dev->addr << 1)) {
+        i2c_stop(bus);
         return false;
     }
 
     // Write register address
-    if (!i2c_write_byte(reg)) {
-        i2c_stop();
+    if (reg && !i2c_write_byte(bus, *reg)) {
+        i2c_stop(bus);
         return false;
     }
 
     // Write data bytes
     for (uint32_t i = 0; i < len; i++) {
-        if (!i2c_write_byte(data[i])) {
-            i2c_stop();
+        if (!i2c_write_byte(bus, data[i])) {
+            i2c_stop(bus);
             return false;
         }
     }
 
-    i2c_stop();
-    return true;
+    // The STOP can still time out on a stretched clock
+    i2c_stop(bus);
+    return bus->last_error == I2C_OK;
+}
+
+// Repeat a failed write transaction up to I2C_RETRIES times
+static bool i2c_write_retry(const i2c_dev_t *dev, const uint8_t *reg, const uint8_t *data, uint32_t len) {
+    i2c_dev_select(dev);
+    for (int attempt = 0; ; attempt++) {
+        if (i2c_write_once(dev, reg, data, len)) {
+            return true;
+        }
+        if (attempt == I2C_RETRIES) {
+            return false;
+        }
+        dev->bus->stats.retries++;
+    }
+}
+
+bool i2c_write(const i2c_dev_t *dev, const uint8_t *data, uint32_t len) {
+    return i2c_write_retry(dev, NULL, data, len);
+}
+
+bool i2c_write_reg(const i2c_dev_t *dev, uint8_t reg, const uint8_t *data, uint32_t len) {
+    return i2c_write_retry(dev, &reg, data, len);
+}
+
+// One combined transaction: every segment starts with a (repeated)
+// START, and a single STOP ends the lot
+static bool i2c_transfer_once(const i2c_dev_t *dev, const i2c_segment_t *segments, int count) {
+    i2c_bus_t *bus = dev->bus;
+    for (int i = 0; i < count; i++) {
+        const i2c_segment_t *seg = &segments[i];
+        if (!i2c_start(bus)) {
+            return false;
+        }
+
+        // Write device address with the direction bit
+        if (!i2c_write_byte(bus, (dev->addr << 1) | seg->read)) {
+            i2c_stop(bus);
+            return false;
+        }
+
+        for (uint32_t j = 0; j < seg->len; j++) {
+            if (seg->read) {
+                // ACK every byte but the last, which hands the bus back
+                seg->rx[j] = i2c_read_byte(bus, j + 1 < seg->len);
+                if (bus->last_error != I2C_OK) {
+                    i2c_stop(bus);
+                    return false;
+                }
+            } else if (!i2c_write_byte(bus, seg->tx[j])) {
+                i2c_stop(bus);
+                return false;
+            }
+        }
+    }
+
+    i2c_stop(bus);
+    return bus->last_error == I2C_OK;
+}
+
+bool i2c_transfer(const i2c_dev_t *dev, const i2c_segment_t *segments, int count) {
+    i2c_dev_select(dev);
+    for (int attempt = 0; ; attempt++) {
+        if (i2c_transfer_once(dev, segments, count)) {
+            return true;
+        }
+        if (attempt == I2C_RETRIES) {
+            return false;
+        }
+        dev->bus->stats.retries++;
+    }
+}
+
+bool i2c_write_read(const i2c_dev_t *dev, const uint8_t *wr, uint32_t wr_len, uint8_t *rd, uint32_t rd_len) {
+    const i2c_segment_t segments[] = {
+        {.read = false, .tx = wr, .len = wr_len},
+        {.read = true, .rx = rd, .len = rd_len},
+    };
+    return i2c_transfer(dev, segments, 2);
+}
+
+bool i2c_read_reg(const i2c_dev_t *dev, uint8_t reg, uint8_t *data, uint32_t len) {
+    return i2c_write_read(dev, &reg, 1, data, len);
+}
+
+void i2c_get_stats(i2c_bus_t *bus, i2c_stats_t *out) {
+    *out = bus->stats;
+}
+
+void i2c_reset_stats(i2c_bus_t *bus) {
+    bus->stats = (i2c_stats_t){0};
 }
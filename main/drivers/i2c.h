@@ -1,35 +1,187 @@
+/*
+ * I2C master
+ * Implemented by i2c.c (bit-banged GPIO) or i2c_hw.c (I2C0 controller),
+ * selected with I2C_DRIVER in main/CMakeLists.txt
+ */
+
 #ifndef I2C_H
 #define I2C_H
 
 #include <stdint.h>
 #include <stdbool.h>
 
-// I2C configuration
+// Longest a slave may stretch the clock (hold SCL low) before the
+// transfer fails with I2C_ERR_TIMEOUT
+#ifndef I2C_STRETCH_TIMEOUT_US
+#define I2C_STRETCH_TIMEOUT_US 1000
+#endif
+
+// Extra attempts the device-level calls make after a failed transaction
+#ifndef I2C_RETRIES
+#define I2C_RETRIES 2
+#endif
+
+// Why the last transaction failed
+typedef enum {
+    I2C_OK = 0,
+    I2C_ERR_NACK,     // Address or data byte not acknowledged
+    I2C_ERR_TIMEOUT,  // SCL held low longer than I2C_STRETCH_TIMEOUT_US
+    I2C_ERR_BUS,      // Bus stuck or arbitration lost; recovery failed
+} i2c_err_t;
+
+// Clocks the drivers accept, from the SMBus minimum to fast-mode plus
+#define I2C_MIN_FREQ_HZ 10000
+#define I2C_MAX_FREQ_HZ 1000000
+
+// Buses that can exist at once (the hardware driver has one controller
+// and always allows just one)
+#ifndef I2C_MAX_BUSES
+#define I2C_MAX_BUSES 2
+#endif
+
+// A bus: its pins, clock, state and counters (from i2c_bus_create())
+typedef struct i2c_bus i2c_bus_t;
+
+// Bus configuration
 typedef struct {
     int scl_pin;
     int sda_pin;
-    uint32_t freq_hz;
+    uint32_t freq_hz;   // Clock until a device asks for another one
+                        // (I2C_MIN_FREQ_HZ..I2C_MAX_FREQ_HZ)
 } i2c_config_t;
 
-// Initialize I2C master
-void i2c_init(const i2c_config_t *config);
+// A device on a bus. Device-level calls switch the bus to freq_hz first,
+// so a fast display and a slow sensor can share a bus, and a slow device
+// on one bus does not hold back another bus.
+typedef struct {
+    i2c_bus_t *bus;
+    uint8_t addr;       // 7-bit address
+    uint32_t freq_hz;   // 0 = use whatever clock the bus runs at; one
+                        // outside the accepted range is ignored the same way
+} i2c_dev_t;
 
-// Start condition
-bool i2c_start(void);
+// One segment of a combined transaction: a (repeated) START, the device
+// address with the direction bit, then len bytes written from tx or read
+// into rx. Read segments need len >= 1; their last byte is NACKed as the
+// protocol requires before the next START or the STOP.
+typedef struct {
+    bool read;          // Read into rx instead of writing tx
+    const uint8_t *tx;  // Write segments: bytes to send
+    uint8_t *rx;        // Read segments: buffer to fill
+    uint32_t len;
+} i2c_segment_t;
+
+// Bus traffic counters (since creation or the last i2c_reset_stats())
+typedef struct {
+    uint32_t transactions;  // START conditions issued
+    uint32_t bytes;         // Bytes clocked on the bus (address bytes included)
+    uint32_t nacks;         // Written bytes that were not acknowledged
+    uint32_t aborts;        // Transactions stopped early after an error
+    uint32_t timeouts;      // Clock stretches that ran past the timeout
+    uint32_t recoveries;    // Bus recoveries (clocking out a stuck slave)
+    uint32_t retries;       // Transactions repeated by the device-level calls
+} i2c_stats_t;
+
+// Set up a bus on two pins
+// Returns NULL when I2C_MAX_BUSES buses exist already or the clock is
+// out of range.
+i2c_bus_t *i2c_bus_create(const i2c_config_t *config);
+
+// Byte level: a transaction by hand, at the bus's current clock
+// (call i2c_dev_select() first to use a device's clock)
+
+// Start condition (a repeated START if the bus is already owned)
+bool i2c_start(i2c_bus_t *bus);
 
 // Stop condition
-void i2c_stop(void);
+void i2c_stop(i2c_bus_t *bus);
 
 // Write byte (returns true if ACK received)
-bool i2c_write_byte(uint8_t data);
+bool i2c_write_byte(i2c_bus_t *bus, uint8_t data);
 
 // Read byte
-uint8_t i2c_read_byte(bool ack);
+uint8_t i2c_read_byte(i2c_bus_t *bus, bool ack);
+
+// True between i2c_start() and i2c_stop(), or while an asynchronous
+// transaction runs: someone owns the bus, so an interrupt handler must
+// not start a transaction of its own
+bool i2c_bus_busy(i2c_bus_t *bus);
+
+// Error of the current or last transaction (cleared by i2c_start())
+i2c_err_t i2c_last_error(i2c_bus_t *bus);
+
+// Free a stuck bus: clock SCL until a slave releases SDA, then send STOP
+// (done automatically after a timeout or when START finds the bus busy)
+i2c_err_t i2c_bus_recover(i2c_bus_t *bus);
+
+// Change the bus clock between transactions (e.g. 1000000 for fast-mode plus)
+// Returns false, keeping the current clock, if freq_hz is out of range.
+bool i2c_set_freq(i2c_bus_t *bus, uint32_t freq_hz);
+
+// SCL frequency the driver actually achieves (from the timing registers,
+// or from the rate measured once at i2c_bus_create(); neither setting nor
+// reading the clock puts anything on the bus)
+uint32_t i2c_bus_freq(i2c_bus_t *bus);
+
+// Read or clear the bus traffic counters
+void i2c_get_stats(i2c_bus_t *bus, i2c_stats_t *stats);
+void i2c_reset_stats(i2c_bus_t *bus);
+
+// Device level: whole transactions at the device's clock, retried up to
+// I2C_RETRIES times
+
+// Switch the device's bus to the device's clock
+void i2c_dev_select(const i2c_dev_t *dev);
 
 // Write multiple bytes to device
-bool i2c_write(uint8_t addr, const uint8_t *data, uint32_t len);
+bool i2c_write(const i2c_dev_t *dev, const uint8_t *data, uint32_t len);
 
 // Write register data
-bool i2c_write_reg(uint8_t addr, uint8_t reg, const uint8_t *data, uint32_t len);
+bool i2c_write_reg(const i2c_dev_t *dev, uint8_t reg, const uint8_t *data, uint32_t len);
+
+// Run segments back to back with repeated STARTs and a single STOP, so
+// no other transaction can get in between
+bool i2c_transfer(const i2c_dev_t *dev, const i2c_segment_t *segments, int count);
+
+// Write wr_len bytes, then read rd_len bytes after a repeated START
+bool i2c_write_read(const i2c_dev_t *dev, const uint8_t *wr, uint32_t wr_len, uint8_t *rd, uint32_t rd_len);
+
+// Read len bytes starting at register reg
+bool i2c_read_reg(const i2c_dev_t *dev, uint8_t reg, uint8_t *data, uint32_t len);
+
+// Interrupt driven: asynchronous transactions
+
+// How often the bit-banged driver wants i2c_bus_service() called, from a
+// periodic timer. Each call clocks one step of an asynchronous
+// transaction (a START with the address, one data byte, or the STOP):
+// ~25us of the period at 400kHz, ~100us at 100kHz.
+#ifndef I2C_TICK_US
+#define I2C_TICK_US 250
+#endif
+
+// Called once an asynchronous transaction has finished, from
+// i2c_bus_service() or from a synchronous call finishing it while it
+// waits for the bus; interrupts are masked either way. Keep it short and
+// make no synchronous calls from it; starting another asynchronous
+// transaction is fine.
+typedef void (*i2c_done_t)(i2c_err_t error, void *user);
+
+// Start segments as one transaction, like i2c_transfer() at the device's
+// clock and with its retries, and return at once. The bus's interrupt
+// runs it from there and calls done (optional) when it has finished.
+// It owns the bus from its first START to its STOP: i2c_bus_busy() is
+// true, and synchronous calls on the bus wait for it, then find their own
+// clock back. The segments and their buffers must stay valid until done.
+// Returns false, starting nothing, if the bus is owned. May be called
+// from an interrupt handler, done included.
+bool i2c_transfer_async(const i2c_dev_t *dev, const i2c_segment_t *segments, int count,
+                        i2c_done_t done, void *user);
+
+// The bus's interrupt handler (see main.c): call it from the I2C
+// controller's interrupt with the hardware driver, and every I2C_TICK_US
+// from a timer interrupt with the bit-banged one. It finishes the command
+// lists the hardware driver's blocking calls wait for, and moves
+// asynchronous transactions on.
+void i2c_bus_service(i2c_bus_t *bus);
 
 #endif // I2C_H
@@ -0,0 +1,870 @@
+/*
+* I2C Master (hardware controller)
+* ================================
+*
+* Implements i2c.h on the ESP32-C3 I2C0 peripheral instead of bit-banged
+* GPIOs. Selected at build time with I2C_DRIVER=hw (main/CMakeLists.txt).
+*
+* The controller runs a list of up to 8 commands (RSTART, WRITE n, READ n,
+* STOP, END) and shifts bytes out of a 32-byte TX FIFO, so SCL timing comes
+* from the peripheral clock and the CPU only refills the FIFO once per 32
+* bytes. The byte-at-a-time API maps onto it like this:
+*
+*   i2c_start()       queues RSTART
+*   i2c_write_byte()  the address byte is sent at once (RSTART, WRITE 1,
+*                     END) so its ACK is known; later bytes collect in the
+*                     FIFO and go out as WRITE 32 + END when it fills
+*   i2c_read_byte()   flushes queued writes, then READ 1 + END
+*   i2c_stop()        sends what is left in the FIFO followed by STOP
+*
+* i2c_transfer() reads a whole segment per command list instead, up to
+* 32 bytes at a time through the RX FIFO (READ n with ACK, a final READ 1
+* with NACK).
+*
+* END holds SCL low and keeps the transaction open until the next command
+* list is started, so the bus sees one continuous transaction. A NACK on a
+* data byte is reported by the i2c_write_byte() call that filled the FIFO,
+* or counted as an abort at i2c_stop() for the final chunk. A failed
+* command list resets the controller and both FIFOs, and the bytes it
+* carried are not counted in stats.bytes.
+*
+* Completion is interrupt driven: END_DETECT, TRANS_COMPLETE, NACK,
+* TIME_OUT and ARBITRATION_LOST are enabled at i2c_bus_create(), and
+* i2c_bus_service(), called from the controller's interrupt, records how
+* the running list ended. The blocking calls above sleep until it has
+* (cpu_wait_for_interrupt()) instead of polling INT_RAW, and give a list
+* up after I2C_RUN_TIMEOUT_US. i2c_transfer_async() runs a transaction
+* from the interrupt alone: each completion loads the next command list
+* (a segment's START and address, then up to a FIFO of data, END or the
+* final STOP), reads the RX FIFO, stops and retries after an error, and
+* finally calls the caller back. It owns the bus and its clock from its
+* first START to its STOP; synchronous callers wait for it and find their
+* own clock back afterwards.
+*
+* Clock stretching is handled by the controller; its bus timeout is set
+* from I2C_STRETCH_TIMEOUT_US. After a timeout or lost arbitration,
+* i2c_stop() resets the controller and has it clock SCL nine times to free
+* a slave stuck mid-byte. i2c_write(), i2c_write_reg() and i2c_transfer()
+* retry a failed transaction up to I2C_RETRIES times.
+*
+* The ESP32-C3 has a single I2C controller, so i2c_bus_create() hands out
+* one bus; I2C_MAX_BUSES does not apply here. Devices with different clocks
+* share it, and switching clocks only rewrites the timing registers.
+*
+* Register access goes through I2C_HW_REG_READ/WRITE, which can be defined
+* before building this file to run it against a register model.
+*
+* Based on ESP32-C3 Technical Reference Manual, chapter "I2C Controller"
+*/
+
+#include "i2c.h"
+#include "cpu.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Register access (overridable, see above)
+#ifndef I2C_HW_REG_WRITE
+#define I2C_HW_REG_WRITE(addr, val) (*((volatile uint32_t *)(addr)) = (val))
+#endif
+#ifndef I2C_HW_REG_READ
+#define I2C_HW_REG_READ(addr)       (*((volatile uint32_t *)(addr)))
+#endif
+
+// Peripheral base addresses
+#define I2C0_BASE           0x60013000
+#define GPIO_BASE           0x60004000
+#define IO_MUX_BASE         0x60009000
+#define SYSTEM_BASE         0x600C0000
+
+// System registers: peripheral clock gate and reset
+#define SYSTEM_PERIP_CLK_EN0_REG  (SYSTEM_BASE + 0x0010)
+#define SYSTEM_PERIP_RST_EN0_REG  (SYSTEM_BASE + 0x0018)
+#define SYSTEM_I2C_EXT0           (1 << 9)
+
+// I2C registers
+#define I2C_SCL_LOW_PERIOD_REG     (I2C0_BASE + 0x0000)
+#define I2C_CTR_REG                (I2C0_BASE + 0x0004)
+#define I2C_TO_REG                 (I2C0_BASE + 0x000C)
+#define I2C_FIFO_CONF_REG          (I2C0_BASE + 0x0018)
+#define I2C_DATA_REG               (I2C0_BASE + 0x001C)
+#define I2C_INT_RAW_REG            (I2C0_BASE + 0x0020)
+#define I2C_INT_CLR_REG            (I2C0_BASE + 0x0024)
+#define I2C_INT_ENA_REG            (I2C0_BASE + 0x0028)
+#define I2C_INT_STATUS_REG         (I2C0_BASE + 0x002C)
+#define I2C_SDA_HOLD_REG           (I2C0_BASE + 0x0030)
+#define I2C_SDA_SAMPLE_REG         (I2C0_BASE + 0x0034)
+#define I2C_SCL_HIGH_PERIOD_REG    (I2C0_BASE + 0x0038)
+#define I2C_SCL_START_HOLD_REG     (I2C0_BASE + 0x0040)
+#define I2C_SCL_RSTART_SETUP_REG   (I2C0_BASE + 0x0044)
+#define I2C_SCL_STOP_HOLD_REG      (I2C0_BASE + 0x0048)
+#define I2C_SCL_STOP_SETUP_REG     (I2C0_BASE + 0x004C)
+#define I2C_FILTER_CFG_REG         (I2C0_BASE + 0x0050)
+#define I2C_CLK_CONF_REG           (I2C0_BASE + 0x0054)
+#define I2C_COMD_REG(n)            (I2C0_BASE + 0x0058 + (n) * 4)
+#define I2C_SCL_SP_CONF_REG        (I2C0_BASE + 0x0080)
+
+// I2C_CTR_REG bits
+#define I2C_SDA_FORCE_OUT          (1 << 0)   // Open-drain output
+#define I2C_SCL_FORCE_OUT          (1 << 1)
+#define I2C_MS_MODE                (1 << 4)   // Master
+#define I2C_TRANS_START            (1 << 5)   // Run the command list
+#define I2C_CLK_EN                 (1 << 8)
+#define I2C_FSM_RST                (1 << 10)
+#define I2C_CONF_UPGATE            (1 << 11)  // Latch new timing configuration
+
+// I2C_TO_REG: timeout after 2^value source clocks of a stuck bus state
+#define I2C_TIME_OUT_MAX           22
+#define I2C_TIME_OUT_EN            (1 << 5)
+
+// I2C_SCL_SP_CONF_REG: send SCL_RST_SLV_NUM clocks to free a stuck slave
+#define I2C_SCL_RST_SLV_EN         (1 << 0)   // Cleared by the controller when done
+#define I2C_SCL_RST_SLV_NUM_SHIFT  1
+#define I2C_RECOVER_CLOCKS         9
+
+// I2C_FIFO_CONF_REG bits
+#define I2C_RX_FIFO_RST            (1 << 12)
+#define I2C_TX_FIFO_RST            (1 << 13)
+
+// I2C_FILTER_CFG_REG: ignore glitches shorter than 7 source clocks
+#define I2C_FILTER_CFG             ((7 << 0) | (7 << 4) | (1 << 8) | (1 << 9))
+
+// I2C_CLK_CONF_REG fields
+#define I2C_SCLK_DIV_NUM_SHIFT     0
+#define I2C_SCLK_ACTIVE            (1 << 21)
+
+// Interrupt bits (INT_RAW / INT_CLR / INT_ENA / INT_STATUS)
+#define I2C_END_DETECT_INT         (1 << 3)
+#define I2C_ARBITRATION_LOST_INT   (1 << 5)
+#define I2C_TRANS_COMPLETE_INT     (1 << 7)
+#define I2C_TIME_OUT_INT           (1 << 8)
+#define I2C_NACK_INT               (1 << 10)
+#define I2C_DONE_INTS              (I2C_END_DETECT_INT | I2C_TRANS_COMPLETE_INT)
+#define I2C_ERROR_INTS             (I2C_NACK_INT | I2C_TIME_OUT_INT | I2C_ARBITRATION_LOST_INT)
+
+// Command list entries
+#define I2C_CMD_RSTART             6
+#define I2C_CMD_WRITE              1
+#define I2C_CMD_READ               3
+#define I2C_CMD_STOP               2
+#define I2C_CMD_END                4
+#define I2C_CMD(op, bytes, flags)  (((op) << 11) | (flags) | (bytes))
+#define I2C_CMD_ACK_CHECK          (1 << 8)   // Stop with NACK_INT if not ACKed
+#define I2C_CMD_ACK_VALUE          (1 << 10)  // Level sent after a read byte (1 = NACK)
+
+#define I2C_FIFO_SIZE              32
+
+// Controller clock: XTAL (the default source)
+#define I2C_SOURCE_CLK_HZ          40000000
+
+// GPIO matrix routing to the controller
+#define GPIO_ENABLE_W1TS_REG       (GPIO_BASE + 0x0024)
+#define GPIO_PIN_REG(n)            (GPIO_BASE + 0x0074 + (n) * 4)
+#define GPIO_FUNC_IN_SEL_REG(sig)  (GPIO_BASE + 0x0154 + (sig) * 4)
+#define GPIO_FUNC_OUT_SEL_REG(n)   (GPIO_BASE + 0x0554 + (n) * 4)
+#define GPIO_PIN_PAD_DRIVER        (1 << 2)   // Open drain
+#define GPIO_SIG_IN_SEL            (1 << 6)   // Input through the matrix
+#define I2CEXT0_SCL_IDX            53
+#define I2CEXT0_SDA_IDX            54
+
+// IO MUX registers and bits
+#define GPIO_PIN_MUX_REG(n)        (IO_MUX_BASE + 0x0004 + (n) * 4)
+#define FUN_IE                     (1 << 9)
+#define FUN_WPU                    (1 << 7)
+#define FUN_DRV_SHIFT              10
+#define MCU_SEL_SHIFT              12
+
+// Give up on a command list that has not finished after this long. The
+// controller's own timeout normally ends it much earlier: the longest
+// list, 33 bytes at 10kHz each stretched to the limit, takes ~65ms.
+#define I2C_RUN_TIMEOUT_US         100000
+
+// Give up waiting for the recovery clocks after this many polls
+#define I2C_WAIT_POLLS             1000000
+
+// The controller: the one bus this driver can offer
+struct i2c_bus {
+    // Transaction state
+    int cmd_count;              // Commands queued in COMD0..
+    int fifo_count;             // Data bytes in the TX FIFO not yet sent
+    bool addr_pending;          // Next written byte is the address after a START
+    volatile bool bus_owned;    // Between i2c_start() and i2c_stop(), or
+                                // for an asynchronous transaction
+
+    // Running command list, finished by i2c_bus_service()
+    volatile bool run_pending;
+    uint32_t run_status;        // Interrupt bits it ended with (0 = hung)
+    uint32_t run_start;         // cpu_cycles() when started
+
+    // Asynchronous transaction (i2c_transfer_async())
+    const i2c_dev_t *volatile async_dev;  // NULL when none runs
+    const i2c_segment_t *async_segments;
+    int async_count;
+    int async_segment;          // Segment the running list belongs to
+    uint32_t async_offset;      // Bytes of it done before the running list
+    uint32_t async_chunk;       // Bytes of it in the running list
+    bool async_addressed;       // Its START and address have gone out
+    bool async_stopping;        // The running list ends with STOP
+    bool async_aborting;        // The running list is the STOP after an error
+    int async_attempt;
+    uint32_t async_freq;        // Clock to give back to synchronous callers
+    i2c_done_t async_done;
+    void *async_user;
+
+    uint32_t freq_hz;           // Requested clock
+    uint32_t bus_freq;          // SCL rate the timing registers give
+
+    // Traffic counters and error state
+    i2c_stats_t stats;
+    bool failed;                // Transaction failed; a STOP now aborts
+    bool bus_fault;             // Timeout or lost arbitration; a STOP recovers
+    i2c_err_t last_error;
+};
+
+static struct i2c_bus controller;
+static bool created;
+
+static void i2c_queue(i2c_bus_t *bus, uint32_t cmd) {
+    I2C_HW_REG_WRITE(I2C_COMD_REG(bus->cmd_count), cmd);
+    bus->cmd_count++;
+}
+
+// Start the queued command list; i2c_bus_service() sees it finish
+static void i2c_run_begin(i2c_bus_t *bus) {
+    I2C_HW_REG_WRITE(I2C_INT_CLR_REG, I2C_DONE_INTS | I2C_ERROR_INTS);
+    bus->run_status = 0;
+    bus->run_start = cpu_cycles();
+    bus->run_pending = true;
+    uint32_t ctr = I2C_HW_REG_READ(I2C_CTR_REG);
+    I2C_HW_REG_WRITE(I2C_CTR_REG, ctr | I2C_TRANS_START);
+}
+
+// Account for a finished command list from the interrupt bits it ended with
+// Returns false on NACK, timeout or lost arbitration (see last_error).
+static bool i2c_run_end(i2c_bus_t *bus, uint32_t status) {
+    int sent = bus->fifo_count;
+    bus->cmd_count = 0;
+    bus->fifo_count = 0;
+    if (status & I2C_ERROR_INTS || !(status & I2C_DONE_INTS)) {
+        // The controller stops where it failed, with the rest of a WRITE
+        // still in the TX FIFO; reset both for the next transaction
+        uint32_t ctr = I2C_HW_REG_READ(I2C_CTR_REG);
+        I2C_HW_REG_WRITE(I2C_CTR_REG, ctr | I2C_FSM_RST);
+        I2C_HW_REG_WRITE(I2C_CTR_REG, ctr);
+        I2C_HW_REG_WRITE(I2C_FIFO_CONF_REG, I2C_RX_FIFO_RST | I2C_TX_FIFO_RST);
+        I2C_HW_REG_WRITE(I2C_FIFO_CONF_REG, 0);
+        if (status & I2C_NACK_INT) {
+            bus->stats.nacks++;
+            bus->last_error = I2C_ERR_NACK;
+        } else if (status & I2C_TIME_OUT_INT) {
+            bus->stats.timeouts++;
+            bus->last_error = I2C_ERR_TIMEOUT;
+            bus->bus_fault = true;
+        } else {
+            bus->last_error = I2C_ERR_BUS;
+            bus->bus_fault = true;
+        }
+        bus->failed = true;
+        return false;
+    }
+    bus->stats.bytes += sent;
+    return true;
+}
+
+// Queue a WRITE for the bytes waiting in the FIFO
+static void i2c_queue_fifo(i2c_bus_t *bus) {
+    if (bus->fifo_count > 0) {
+        i2c_queue(bus, I2C_CMD(I2C_CMD_WRITE, bus->fifo_count, I2C_CMD_ACK_CHECK));
+    }
+}
+
+// Program SCL/SDA timing for freq_hz from the 40MHz source clock
+// Returns false for a clock outside I2C_MIN_FREQ_HZ..I2C_MAX_FREQ_HZ.
+static bool i2c_set_timing(i2c_bus_t *bus, uint32_t freq_hz) {
+    if (freq_hz < I2C_MIN_FREQ_HZ || freq_hz > I2C_MAX_FREQ_HZ) {
+        return false;
+    }
+
+    // At most 512 divided clocks per period, so the low and high periods
+    // fit their 9-bit fields
+    uint32_t div = I2C_SOURCE_CLK_HZ / (freq_hz * 512) + 1;
+    uint32_t period = I2C_SOURCE_CLK_HZ / div / freq_hz;
+    uint32_t half = period / 2;
+
+    // tLOW has the larger minimum (1.3us vs 0.6us in fast mode), so the
+    // low phase gets a little more than half of the period
+    uint32_t low = half + period / 16;
+    uint32_t high = period - low;
+    bus->freq_hz = freq_hz;
+    bus->bus_freq = I2C_SOURCE_CLK_HZ / div / period;
+
+    I2C_HW_REG_WRITE(I2C_CLK_CONF_REG, I2C_SCLK_ACTIVE | ((div - 1) << I2C_SCLK_DIV_NUM_SHIFT));
+    I2C_HW_REG_WRITE(I2C_SCL_LOW_PERIOD_REG, low - 1);
+    I2C_HW_REG_WRITE(I2C_SCL_HIGH_PERIOD_REG, high);
+    I2C_HW_REG_WRITE(I2C_SDA_HOLD_REG, half / 4);
+    I2C_HW_REG_WRITE(I2C_SDA_SAMPLE_REG, half / 2);
+    I2C_HW_REG_WRITE(I2C_SCL_START_HOLD_REG, half);
+    I2C_HW_REG_WRITE(I2C_SCL_RSTART_SETUP_REG, half);
+    I2C_HW_REG_WRITE(I2C_SCL_STOP_HOLD_REG, half);
+    I2C_HW_REG_WRITE(I2C_SCL_STOP_SETUP_REG, half);
+
+    // Bus timeout: the smallest power of two covering the stretch limit
+    uint32_t timeout = 1;
+    while (timeout < I2C_TIME_OUT_MAX &&
+           (1u << timeout) / (I2C_SOURCE_CLK_HZ / 1000000) < I2C_STRETCH_TIMEOUT_US) {
+        timeout++;
+    }
+    I2C_HW_REG_WRITE(I2C_TO_REG, I2C_TIME_OUT_EN | timeout);
+    return true;
+}
+
+// Route a pin to a controller signal as open-drain with pull-up
+static void i2c_route_pin(int gpio_num, int signal) {
+    if (gpio_num < 0 || gpio_num > 21) return;
+
+    uint32_t mux_reg = GPIO_PIN_MUX_REG(gpio_num);
+    uint32_t mux_val = I2C_HW_REG_READ(mux_reg);
+    mux_val &= ~(0x7 << MCU_SEL_SHIFT);
+    mux_val |= (1 << MCU_SEL_SHIFT);         // GPIO matrix function
+    mux_val |= FUN_IE | FUN_WPU;
+    mux_val &= ~(0x3 << FUN_DRV_SHIFT);
+    mux_val |= (2 << FUN_DRV_SHIFT);
+    I2C_HW_REG_WRITE(mux_reg, mux_val);
+
+    I2C_HW_REG_WRITE(GPIO_PIN_REG(gpio_num), I2C_HW_REG_READ(GPIO_PIN_REG(gpio_num)) | GPIO_PIN_PAD_DRIVER);
+    I2C_HW_REG_WRITE(GPIO_FUNC_OUT_SEL_REG(gpio_num), signal);  // Output enable from the peripheral
+    I2C_HW_REG_WRITE(GPIO_FUNC_IN_SEL_REG(signal), GPIO_SIG_IN_SEL | gpio_num);
+    I2C_HW_REG_WRITE(GPIO_ENABLE_W1TS_REG, 1 << gpio_num);
+}
+
+i2c_bus_t *i2c_bus_create(const i2c_config_t *config) {
+    if (created) {
+        return NULL;  // One controller, one bus
+    }
+    if (config->freq_hz < I2C_MIN_FREQ_HZ || config->freq_hz > I2C_MAX_FREQ_HZ) {
+        return NULL;
+    }
+    created = true;
+    i2c_bus_t *bus = &controller;
+
+    // Clock the controller and take it out of reset
+    uint32_t clk = I2C_HW_REG_READ(SYSTEM_PERIP_CLK_EN0_REG);
+    I2C_HW_REG_WRITE(SYSTEM_PERIP_CLK_EN0_REG, clk | SYSTEM_I2C_EXT0);
+    uint32_t rst = I2C_HW_REG_READ(SYSTEM_PERIP_RST_EN0_REG);
+    I2C_HW_REG_WRITE(SYSTEM_PERIP_RST_EN0_REG, rst | SYSTEM_I2C_EXT0);
+    I2C_HW_REG_WRITE(SYSTEM_PERIP_RST_EN0_REG, rst & ~SYSTEM_I2C_EXT0);
+
+    uint32_t ctr = I2C_MS_MODE | I2C_CLK_EN | I2C_SDA_FORCE_OUT | I2C_SCL_FORCE_OUT;
+    I2C_HW_REG_WRITE(I2C_CTR_REG, ctr);
+
+    I2C_HW_REG_WRITE(I2C_FIFO_CONF_REG, I2C_RX_FIFO_RST | I2C_TX_FIFO_RST);
+    I2C_HW_REG_WRITE(I2C_FIFO_CONF_REG, 0);
+    I2C_HW_REG_WRITE(I2C_FILTER_CFG_REG, I2C_FILTER_CFG);
+    i2c_set_timing(bus, config->freq_hz);
+    I2C_HW_REG_WRITE(I2C_CTR_REG, ctr | I2C_CONF_UPGATE);
+
+    // Command lists report their end through the interrupt
+    I2C_HW_REG_WRITE(I2C_INT_CLR_REG, I2C_DONE_INTS | I2C_ERROR_INTS);
+    I2C_HW_REG_WRITE(I2C_INT_ENA_REG, I2C_DONE_INTS | I2C_ERROR_INTS);
+
+    i2c_route_pin(config->scl_pin, I2CEXT0_SCL_IDX);
+    i2c_route_pin(config->sda_pin, I2CEXT0_SDA_IDX);
+
+    bus->cmd_count = 0;
+    bus->fifo_count = 0;
+    return bus;
+}
+
+// Program and latch a new clock
+static bool i2c_apply_freq(i2c_bus_t *bus, uint32_t freq_hz) {
+    if (!i2c_set_timing(bus, freq_hz)) {
+        return false;
+    }
+    uint32_t ctr = I2C_HW_REG_READ(I2C_CTR_REG);
+    I2C_HW_REG_WRITE(I2C_CTR_REG, ctr | I2C_CONF_UPGATE);
+    return true;
+}
+
+uint32_t i2c_bus_freq(i2c_bus_t *bus) {
+    return bus->bus_freq;
+}
+
+i2c_err_t i2c_bus_recover(i2c_bus_t *bus) {
+    bus->stats.recoveries++;
+    bus->bus_fault = false;
+    bus->failed = false;
+    bus->cmd_count = 0;
+    bus->fifo_count = 0;
+
+    // Let the controller clock SCL while SDA is released, then reset it
+    uint32_t ctr = I2C_HW_REG_READ(I2C_CTR_REG);
+    I2C_HW_REG_WRITE(I2C_SCL_SP_CONF_REG, I2C_SCL_RST_SLV_EN | (I2C_RECOVER_CLOCKS << I2C_SCL_RST_SLV_NUM_SHIFT));
+    I2C_HW_REG_WRITE(I2C_CTR_REG, ctr | I2C_CONF_UPGATE);
+    bool done = false;
+    for (uint32_t i = 0; i < I2C_WAIT_POLLS && !done; i++) {
+        done = !(I2C_HW_REG_READ(I2C_SCL_SP_CONF_REG) & I2C_SCL_RST_SLV_EN);
+    }
+    I2C_HW_REG_WRITE(I2C_CTR_REG, ctr | I2C_FSM_RST);
+    I2C_HW_REG_WRITE(I2C_CTR_REG, ctr);
+    I2C_HW_REG_WRITE(I2C_FIFO_CONF_REG, I2C_RX_FIFO_RST | I2C_TX_FIFO_RST);
+    I2C_HW_REG_WRITE(I2C_FIFO_CONF_REG, 0);
+
+    if (!done) {
+        bus->last_error = I2C_ERR_BUS;
+        return I2C_ERR_BUS;
+    }
+    return I2C_OK;
+}
+
+// Load the asynchronous transaction's next command list and start it
+static void i2c_async_load(i2c_bus_t *bus) {
+    const i2c_segment_t *seg = &bus->async_segments[bus->async_segment];
+    uint32_t room = I2C_FIFO_SIZE;
+    if (!bus->async_addressed) {
+        i2c_queue(bus, I2C_CMD(I2C_CMD_RSTART, 0, 0));
+        I2C_HW_REG_WRITE(I2C_DATA_REG, (bus->async_dev->addr << 1) | seg->read);
+        bus->fifo_count = 1;
+        bus->stats.transactions++;
+        room--;
+    }
+
+    uint32_t left = seg->len - bus->async_offset;
+    uint32_t chunk;
+    if (seg->read) {
+        // A FIFO of reads at a time, the last byte NACKed
+        i2c_queue_fifo(bus);
+        chunk = left < I2C_FIFO_SIZE ? left : I2C_FIFO_SIZE;
+        uint32_t acked = chunk == left ? chunk - 1 : chunk;
+        if (acked > 0) {
+            i2c_queue(bus, I2C_CMD(I2C_CMD_READ, acked, 0));
+        }
+        if (chunk == left) {
+            i2c_queue(bus, I2C_CMD(I2C_CMD_READ, 1, I2C_CMD_ACK_VALUE));
+        }
+    } else {
+        // Data fills what the address leaves of the FIFO
+        chunk = left < room ? left : room;
+        for (uint32_t i = 0; i < chunk; i++) {
+            I2C_HW_REG_WRITE(I2C_DATA_REG, seg->tx[bus->async_offset + i]);
+        }
+        bus->fifo_count += chunk;
+        i2c_queue_fifo(bus);
+    }
+    bus->async_chunk = chunk;
+    bus->async_stopping = chunk == left && bus->async_segment == bus->async_count - 1;
+    i2c_queue(bus, I2C_CMD(bus->async_stopping ? I2C_CMD_STOP : I2C_CMD_END, 0, 0));
+    i2c_run_begin(bus);
+}
+
+// Start (or restart) the asynchronous transaction at its first segment
+static void i2c_async_begin(i2c_bus_t *bus) {
+    bus->async_segment = 0;
+    bus->async_offset = 0;
+    bus->async_addressed = false;
+    bus->async_aborting = false;
+    bus->failed = false;
+    bus->last_error = I2C_OK;
+    i2c_async_load(bus);
+}
+
+// End the asynchronous transaction: give the bus and the synchronous
+// callers' clock back, then report
+static void i2c_async_finish(i2c_bus_t *bus, i2c_err_t error) {
+    if (bus->freq_hz != bus->async_freq) {
+        i2c_apply_freq(bus, bus->async_freq);
+    }
+    i2c_done_t done = bus->async_done;
+    void *user = bus->async_user;
+    bus->last_error = error;
+    bus->async_dev = NULL;
+    bus->bus_owned = false;
+    if (done) {
+        done(error, user);
+    }
+}
+
+// After a failed attempt and its STOP: try again, or give up
+static void i2c_async_retry(i2c_bus_t *bus) {
+    if (bus->async_attempt == I2C_RETRIES) {
+        i2c_async_finish(bus, bus->last_error);
+        return;
+    }
+    bus->async_attempt++;
+    bus->stats.retries++;
+    i2c_async_begin(bus);
+}
+
+// The asynchronous transaction's running command list has finished
+static void i2c_async_next(i2c_bus_t *bus, uint32_t status) {
+    if (bus->async_aborting) {
+        // The STOP after an error
+        bus->async_aborting = false;
+        if (!i2c_run_end(bus, status) && bus->bus_fault) {
+            i2c_bus_recover(bus);
+        }
+        bus->failed = false;
+        i2c_async_retry(bus);
+        return;
+    }
+
+    if (!i2c_run_end(bus, status)) {
+        // End the attempt like i2c_stop() does: a STOP, or recovery if
+        // the bus is stuck
+        bus->stats.aborts++;
+        if (bus->bus_fault) {
+            i2c_bus_recover(bus);
+            i2c_async_retry(bus);
+            return;
+        }
+        bus->async_aborting = true;
+        i2c_queue(bus, I2C_CMD(I2C_CMD_STOP, 0, 0));
+        i2c_run_begin(bus);
+        return;
+    }
+
+    const i2c_segment_t *seg = &bus->async_segments[bus->async_segment];
+    if (seg->read) {
+        for (uint32_t i = 0; i < bus->async_chunk; i++) {
+            seg->rx[bus->async_offset + i] = I2C_HW_REG_READ(I2C_DATA_REG) & 0xFF;
+        }
+        bus->stats.bytes += bus->async_chunk;
+    }
+    bus->async_addressed = true;
+    bus->async_offset += bus->async_chunk;
+    if (bus->async_offset == seg->len) {
+        bus->async_segment++;
+        bus->async_offset = 0;
+        bus->async_addressed = false;
+    }
+
+    if (bus->async_stopping) {
+        i2c_async_finish(bus, I2C_OK);
+        return;
+    }
+    i2c_async_load(bus);
+}
+
+void i2c_bus_service(i2c_bus_t *bus) {
+    uint32_t status = I2C_HW_REG_READ(I2C_INT_STATUS_REG) & (I2C_DONE_INTS | I2C_ERROR_INTS);
+    if (status) {
+        I2C_HW_REG_WRITE(I2C_INT_CLR_REG, status);
+    }
+    if (!bus->run_pending) {
+        return;
+    }
+    // Nothing yet: still running, unless it has hung
+    if (!status && cpu_cycles() - bus->run_start < I2C_RUN_TIMEOUT_US * (CPU_FREQ_HZ / 1000000)) {
+        return;
+    }
+
+    bus->run_pending = false;
+    if (bus->async_dev) {
+        i2c_async_next(bus, status);
+    } else {
+        bus->run_status = status;
+    }
+}
+
+// One step of a synchronous wait, entered with interrupts masked (irq:
+// the state to go back to). Sleep until an interrupt and let its handler
+// run, then serve the controller from here as well: for a caller that
+// has interrupts masked, and to give up on a list that has hung.
+static void i2c_sleep(i2c_bus_t *bus, uint32_t irq) {
+    cpu_wait_for_interrupt();
+    cpu_irq_restore(irq);
+    cpu_irq_save();
+    i2c_bus_service(bus);
+}
+
+// Start the queued command list and wait for it to stop or pause
+// Returns false on NACK, timeout or lost arbitration (see last_error).
+static bool i2c_run(i2c_bus_t *bus) {
+    uint32_t irq = cpu_irq_save();
+    i2c_run_begin(bus);
+    while (bus->run_pending) {
+        i2c_sleep(bus, irq);
+    }
+    cpu_irq_restore(irq);
+    return i2c_run_end(bus, bus->run_status);
+}
+
+// Wait until no asynchronous transaction runs. Returns with interrupts
+// masked, so that none starts before the caller has taken the bus or
+// set its clock; restore them with the state returned.
+static uint32_t i2c_wait_async(i2c_bus_t *bus) {
+    uint32_t irq = cpu_irq_save();
+    while (bus->async_dev) {
+        i2c_sleep(bus, irq);
+    }
+    return irq;
+}
+
+bool i2c_transfer_async(const i2c_dev_t *dev, const i2c_segment_t *segments, int count,
+                        i2c_done_t done, void *user) {
+    i2c_bus_t *bus = dev->bus;
+    uint32_t irq = cpu_irq_save();
+    if (bus->bus_owned || count < 1) {
+        cpu_irq_restore(irq);
+        return false;
+    }
+    bus->bus_owned = true;
+    bus->async_dev = dev;
+    bus->async_segments = segments;
+    bus->async_count = count;
+    bus->async_done = done;
+    bus->async_user = user;
+    bus->async_attempt = 0;
+    bus->async_freq = bus->freq_hz;
+    if (dev->freq_hz && dev->freq_hz != bus->freq_hz) {
+        i2c_apply_freq(bus, dev->freq_hz);
+    }
+    i2c_async_begin(bus);
+    cpu_irq_restore(irq);
+    return true;
+}
+
+bool i2c_set_freq(i2c_bus_t *bus, uint32_t freq_hz) {
+    uint32_t irq = i2c_wait_async(bus);
+    bool ok = i2c_apply_freq(bus, freq_hz);
+    cpu_irq_restore(irq);
+    return ok;
+}
+
+void i2c_dev_select(const i2c_dev_t *dev) {
+    if (dev->freq_hz && dev->freq_hz != dev->bus->freq_hz) {
+        i2c_set_freq(dev->bus, dev->freq_hz);
+    }
+}
+
+i2c_err_t i2c_last_error(i2c_bus_t *bus) {
+    return bus->last_error;
+}
+
+bool i2c_bus_busy(i2c_bus_t *bus) {
+    return bus->bus_owned;
+}
+
+bool i2c_start(i2c_bus_t *bus) {
+    uint32_t irq = i2c_wait_async(bus);
+    bus->bus_owned = true;
+    cpu_irq_restore(irq);
+    bus->stats.transactions++;
+    bus->failed = false;
+    bus->last_error = I2C_OK;
+
+    // Repeated START: finish the writes queued so far first
+    if (bus->fifo_count > 0) {
+        i2c_queue_fifo(bus);
+        i2c_queue(bus, I2C_CMD(I2C_CMD_END, 0, 0));
+        i2c_run(bus);
+    }
+
+    i2c_queue(bus, I2C_CMD(I2C_CMD_RSTART, 0, 0));
+    bus->addr_pending = true;
+    return true;
+}
+
+void i2c_stop(i2c_bus_t *bus) {
+    bus->addr_pending = false;
+    if (bus->bus_fault) {
+        bus->stats.aborts++;
+        i2c_bus_recover(bus);
+        bus->bus_owned = false;
+        return;
+    }
+
+    if (!bus->failed) {
+        i2c_queue_fifo(bus);
+    }
+    i2c_queue(bus, I2C_CMD(I2C_CMD_STOP, 0, 0));
+    if (!i2c_run(bus) || bus->failed) {
+        bus->stats.aborts++;
+        bus->failed = false;
+        if (bus->bus_fault) {
+            i2c_bus_recover(bus);
+        }
+    }
+    bus->bus_owned = false;
+}
+
+bool i2c_write_byte(i2c_bus_t *bus, uint8_t data) {
+    if (bus->failed) {
+        return false;  // Transaction already failed; wait for the STOP
+    }
+
+    I2C_HW_REG_WRITE(I2C_DATA_REG, data);
+    bus->fifo_count++;
+
+    // Send the address right away so a missing device is reported here;
+    // data bytes go out a full FIFO at a time
+    if (bus->addr_pending || bus->fifo_count == I2C_FIFO_SIZE) {
+        bus->addr_pending = false;
+        i2c_queue_fifo(bus);
+        i2c_queue(bus, I2C_CMD(I2C_CMD_END, 0, 0));
+        return i2c_run(bus);
+    }
+    return true;
+}
+
+// Read a segment into buf; the last byte is NACKed
+static bool i2c_read_bytes(i2c_bus_t *bus, uint8_t *buf, uint32_t len) {
+    i2c_queue_fifo(bus);
+    while (len > 0) {
+        uint32_t chunk = len < I2C_FIFO_SIZE ? len : I2C_FIFO_SIZE;
+        bool last = chunk == len;
+        uint32_t acked = last ? chunk - 1 : chunk;
+        if (acked > 0) {
+            i2c_queue(bus, I2C_CMD(I2C_CMD_READ, acked, 0));
+        }
+        if (last) {
+            i2c_queue(bus, I2C_CMD(I2C_CMD_READ, 1, I2C_CMD_ACK_VALUE));
+        }
+        i2c_queue(bus, I2C_CMD(I2C_CMD_END, 0, 0));
+        if (!i2c_run(bus)) {
+            return false;
+        }
+        bus->stats.bytes += chunk;
+        for (uint32_t i = 0; i < chunk; i++) {
+            *buf++ = I2C_HW_REG_READ(I2C_DATA_REG) & 0xFF;
+        }
+        len -= chunk;
+    }
+    return true;
+}
+
+uint8_t i2c_read_byte(i2c_bus_t *bus, bool ack) {
+    if (bus->failed) {
+        return 0xFF;
+    }
+
+    i2c_queue_fifo(bus);
+    i2c_queue(bus, I2C_CMD(I2C_CMD_READ, 1, ack ? 0 : I2C_CMD_ACK_VALUE));
+    i2c_queue(bus, I2C_CMD(I2C_CMD_END, 0, 0));
+    if (!i2c_run(bus)) {
+        return 0xFF;
+    }
+    bus->stats.bytes++;
+    return I2C_HW_REG_READ(I2C_DATA_REG) & 0xFF;
+}
+
+// One write transaction: address, optional register byte, data
+static bool i2c_write_once(const i2c_dev_t *dev, const uint8_t *reg, const uint8_t *data, uint32_t len) {
+    i2c_bus_t *bus = dev->bus;
+    if (!i2c_start(bus)) {
+        return false;
+    }
+
+    // Write device address with write bit
+    if (!i2c_write_byte(bus, dev->addr << 1)) {
+        i2c_stop(bus);
+        return false;
+    }
+
+    // Write register address
+    if (reg && !i2c_write_byte(bus, *reg)) {
+        i2c_stop(bus);
+        return false;
+    }
+
+    // Write data bytes
+    for (uint32_t i = 0; i < len; i++) {
+        if (!i2c_write_byte(bus, data[i])) {
+            i2c_stop(bus);
+            return false;
+        }
+    }
+
+    // The last FIFO chunk goes out with the STOP
+    i2c_stop(bus);
+    return bus->last_error == I2C_OK;
+}
+
+// Repeat a failed write transaction up to I2C_RETRIES times
+static bool i2c_write_retry(const i2c_dev_t *dev, const uint8_t *reg, const uint8_t *data, uint32_t len) {
+    i2c_dev_select(dev);
+    for (int attempt = 0; ; attempt++) {
+        if (i2c_write_once(dev, reg, data, len)) {
+            return true;
+        }
+        if (attempt == I2C_RETRIES) {
+            return false;
+        }
+        dev->bus->stats.retries++;
+    }
+}
+
+bool i2c_write(const i2c_dev_t *dev, const uint8_t *data, uint32_t len) {
+    return i2c_write_retry(dev, NULL, data, len);
+}
+
+bool i2c_write_reg(const i2c_dev_t *dev, uint8_t reg, const uint8_t *data, uint32_t len) {
+    return i2c_write_retry(dev, &reg, data, len);
+}
+
+// One combined transaction: every segment starts with a (repeated)
+// START, and a single STOP ends the lot
+static bool i2c_transfer_once(const i2c_dev_t *dev, const i2c_segment_t *segments, int count) {
+    i2c_bus_t *bus = dev->bus;
+    for (int i = 0; i < count; i++) {
+        const i2c_segment_t *seg = &segments[i];
+        if (!i2c_start(bus)) {
+            return false;
+        }
+
+        // Write device address with the direction bit
+        if (!i2c_write_byte(bus, (dev->addr << 1) | seg->read)) {
+            i2c_stop(bus);
+            return false;
+        }
+
+        if (seg->read) {
+            if (!i2c_read_bytes(bus, seg->rx, seg->len)) {
+                i2c_stop(bus);
+                return false;
+            }
+            continue;
+        }
+        for (uint32_t j = 0; j < seg->len; j++) {
+            if (!i2c_write_byte(bus, seg->tx[j])) {
+                i2c_stop(bus);
+                return false;
+            }
+        }
+    }
+
+    i2c_stop(bus);
+    return bus->last_error == I2C_OK;
+}
+
+bool i2c_transfer(const i2c_dev_t *dev, const i2c_segment_t *segments, int count) {
+    i2c_dev_select(dev);
+    for (int attempt = 0; ; attempt++) {
+        if (i2c_transfer_once(dev, segments, count)) {
+            return true;
+        }
+        if (attempt == I2C_RETRIES) {
+            return false;
+        }
+        dev->bus->stats.retries++;
+    }
+}
+
+bool i2c_write_read(const i2c_dev_t *dev, const uint8_t *wr, uint32_t wr_len, uint8_t *rd, uint32_t rd_len) {
+    const i2c_segment_t segments[] = {
+        {.read = false, .tx = wr, .len = wr_len},
+        {.read = true, .rx = rd, .len = rd_len},
+    };
+    return i2c_transfer(dev, segments, 2);
+}
+
+bool i2c_read_reg(const i2c_dev_t *dev, uint8_t reg, uint8_t *data, uint32_t len) {
+    return i2c_write_read(dev, &reg, 1, data, len);
+}
+
+void i2c_get_stats(i2c_bus_t *bus, i2c_stats_t *out) {
+    *out = bus->stats;
+}
+
+void i2c_reset_stats(i2c_bus_t *bus) {
+    bus->stats = (i2c_stats_t){0};
+}
@@ -0,0 +1,128 @@
+/*
+* I2C Transaction Queue
+* =====================
+*
+* Transactions are caller-owned descriptors linked into one FIFO, so the
+* queue needs no memory of its own and has no size limit.
+*
+* The queue runs from the bus's interrupt. The oldest transaction goes
+* out as an i2c_transfer_async(), and its completion, in the interrupt
+* handler, retires it and starts the next one:
+* - Transactions complete in the order they were submitted, whoever
+*   submitted them, one at a time. A user's transaction waits at most for
+*   the ones already queued, so one busy user cannot starve another (a
+*   callback that resubmits goes to the back).
+* - The main loop never waits for the bus. Submitting starts the queue
+*   if it was idle; after that it keeps itself going.
+* - Each transaction owns its bus from its first START to its STOP, so a
+*   synchronous caller on the same bus waits for the one running and
+*   never sees its clock changed.
+*
+* Submitting and cancelling may also happen in interrupt handlers: list
+* changes are made with interrupts masked, and the head stays in the
+* queue while it runs, marked active. A transaction whose turn comes
+* while its bus is owned by a synchronous caller stays queued until the
+* next i2c_queue_poll() from the main loop.
+*/
+
+#include "i2c_queue.h"
+#include "cpu.h"
+#include <stddef.h>
+
+static i2c_txn_t *head;  // Oldest (next to run)
+static i2c_txn_t *tail;
+static volatile int pending;
+
+// Start the head if it is waiting, with done for its completion (the
+// queue's own, passed in since it starts the next one itself). Call with
+// interrupts masked.
+static void i2c_queue_start(i2c_done_t done) {
+    i2c_txn_t *txn = head;
+    if (txn && txn->state == I2C_TXN_QUEUED &&
+        i2c_transfer_async(txn->dev, txn->segments, txn->count, done, txn)) {
+        txn->state = I2C_TXN_ACTIVE;
+    }
+}
+
+// Completion of the head, from the bus's interrupt: retire it before its
+// callback, which may queue a follow-up, and start the next
+static void i2c_queue_done(i2c_err_t error, void *user) {
+    i2c_txn_t *txn = user;
+    head = txn->next;
+    if (!head) {
+        tail = NULL;
+    }
+    pending--;
+    txn->error = error;
+    txn->state = I2C_TXN_DONE;
+
+    if (txn->done) {
+        txn->done(txn);
+    }
+    i2c_queue_start(i2c_queue_done);
+}
+
+bool i2c_queue_submit(i2c_txn_t *txn) {
+    uint32_t irq = cpu_irq_save();
+    if (txn->state == I2C_TXN_QUEUED || txn->state == I2C_TXN_ACTIVE) {
+        cpu_irq_restore(irq);
+        return false;
+    }
+
+    txn->state = I2C_TXN_QUEUED;
+    txn->error = I2C_OK;
+    txn->next = NULL;
+    if (tail) {
+        tail->next = txn;
+    } else {
+        head = txn;
+    }
+    tail = txn;
+    pending++;
+    i2c_queue_start(i2c_queue_done);
+    cpu_irq_restore(irq);
+    return true;
+}
+
+bool i2c_queue_cancel(i2c_txn_t *txn) {
+    uint32_t irq = cpu_irq_save();
+    if (txn->state != I2C_TXN_QUEUED) {
+        cpu_irq_restore(irq);
+        return false;
+    }
+
+    // Unlink it (it is in the list, so the search finds it)
+    i2c_txn_t *prev = NULL;
+    i2c_txn_t *t = head;
+    while (t != txn) {
+        prev = t;
+        t = t->next;
+    }
+    if (prev) {
+        prev->next = txn->next;
+    } else {
+        head = txn->next;
+    }
+    if (tail == txn) {
+        tail = prev;
+    }
+    txn->state = I2C_TXN_IDLE;
+    pending--;
+
+    // The one behind a cancelled head may start now
+    i2c_queue_start(i2c_queue_done);
+    cpu_irq_restore(irq);
+    return true;
+}
+
+bool i2c_queue_poll(void) {
+    uint32_t irq = cpu_irq_save();
+    i2c_queue_start(i2c_queue_done);
+    bool empty = head == NULL;
+    cpu_irq_restore(irq);
+    return empty;
+}
+
+int i2c_queue_pending(void) {
+    return pending;
+}
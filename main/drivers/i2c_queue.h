@@ -0,0 +1,62 @@
+/*
+ * I2C transaction queue
+ * A FIFO drained by the bus's interrupt: users hand in transactions
+ * instead of running them, each runs as an i2c_transfer_async(), and the
+ * next starts from the completion of the one before, so the main loop
+ * never waits for the bus.
+ */
+
+#ifndef I2C_QUEUE_H
+#define I2C_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "i2c.h"
+
+// Where a transaction is in its life
+typedef enum {
+    I2C_TXN_IDLE,    // Never submitted, or cancelled
+    I2C_TXN_QUEUED,  // Waiting for its turn
+    I2C_TXN_ACTIVE,  // On the bus
+    I2C_TXN_DONE,    // Finished; see error
+} i2c_txn_state_t;
+
+typedef struct i2c_txn i2c_txn_t;
+
+// Called once a transaction has finished, from the bus's interrupt
+// (see i2c_done_t): keep it short. It may submit further transactions.
+typedef void (*i2c_txn_done_t)(i2c_txn_t *txn);
+
+// A queued transaction. The caller owns it and the segment buffers, which
+// must stay valid until the transaction is done or cancelled.
+struct i2c_txn {
+    const i2c_dev_t *dev;           // Device, and with it the bus and clock
+    const i2c_segment_t *segments;  // Run as one i2c_transfer_async()
+    int count;
+    i2c_txn_done_t done;            // Optional
+    void *user;                     // For the callback
+    volatile i2c_txn_state_t state;
+    i2c_err_t error;                // I2C_OK on success
+    i2c_txn_t *next;                // Queue link (internal)
+};
+
+// Append a transaction to the queue (also from an interrupt handler),
+// starting it if the queue was idle
+// Returns false if it is already queued or running.
+bool i2c_queue_submit(i2c_txn_t *txn);
+
+// Take a transaction out of the queue before it starts (also from an
+// interrupt handler)
+// Returns false if it is not waiting (already running or done).
+bool i2c_queue_cancel(i2c_txn_t *txn);
+
+// Start the oldest transaction if it is still waiting because its bus
+// was owned (between i2c_start() and i2c_stop()) when its turn came.
+// Never waits; call it from the main loop.
+// Returns true when the queue is empty.
+bool i2c_queue_poll(void);
+
+// Number of transactions waiting or running
+int i2c_queue_pending(void);
+
+#endif // I2C_QUEUE_H
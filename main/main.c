@@ -13,36 +13,96 @@
 #include <stdio.h>
 #include "esp_task_wdt.h"
 #include "console.h"
+#include "cpu.h"
 #include "gpio.h"
+#include "i2c_queue.h"
 #include "ssd1306.h"
+#include "grayscale.h"
 #include "shell.h"
+#if I2C_DRIVER_HW
+#include "esp_intr_alloc.h"
+#include "soc/interrupts.h"
+
+// The I2C controller's interrupt: it ends every command list
+static void i2c_isr(void *arg) {
+    i2c_bus_service(arg);
+}
+#else
+#include "driver/gptimer.h"
+
+// The bit-banged bus's tick: one step of an asynchronous transaction
+static bool i2c_tick(gptimer_handle_t timer, const gptimer_alarm_event_data_t *event, void *arg) {
+    i2c_bus_service(arg);
+    return false;
+}
+
+// Call i2c_tick() every I2C_TICK_US
+static void i2c_tick_start(i2c_bus_t *bus) {
+    gptimer_handle_t timer;
+    gptimer_config_t timer_config = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = 1000000,
+    };
+    gptimer_alarm_config_t alarm = {
+        .alarm_count = I2C_TICK_US,
+        .reload_count = 0,
+        .flags.auto_reload_on_alarm = true,
+    };
+    gptimer_event_callbacks_t callbacks = {.on_alarm = i2c_tick};
+    gptimer_new_timer(&timer_config, &timer);
+    gptimer_set_alarm_action(timer, &alarm);
+    gptimer_register_event_callbacks(timer, &callbacks, bus);
+    gptimer_enable(timer);
+    gptimer_start(timer);
+}
+#endif
 
 void app_main(void) {
     // Disable watchdog FIRST
     esp_task_wdt_deinit();
 
+    // Start the cycle counter used for display/bus timing
+    cpu_cycle_counter_init();
+
     // Initialize console
     console_init();
     console_puts("\n\n=== BARE METAL OS BOOTING ===\n");
 
+    // Initialize the I2C bus (devices pick their own clock on it)
+    i2c_config_t bus_config = {
+        .scl_pin = 7,   // GPIO7 (SCL/D5 on XIAO ESP32-C3)
+        .sda_pin = 6,   // GPIO6 (SDA/D4 on XIAO ESP32-C3)
+        .freq_hz = 400000
+    };
+    i2c_bus_t *bus = i2c_bus_create(&bus_config);
+#if I2C_DRIVER_HW
+    esp_intr_alloc(ETS_I2C_EXT0_INTR_SOURCE, 0, i2c_isr, bus, NULL);
+#else
+    i2c_tick_start(bus);
+#endif
+
     // Initialize OLED display
     console_puts("Initializing OLED display...\n");
     ssd1306_config_t oled_config = {
+        .bus = bus,
         .i2c_addr = SSD1306_I2C_ADDR_DEFAULT,  // 0x3C (try 0x3D if this doesn't work)
-        .scl_pin = 7,   // GPIO7 (SCL/D5 on XIAO ESP32-C3)
-        .sda_pin = 6    // GPIO6 (SDA/D4 on XIAO ESP32-C3)
+        .freq_hz = 1000000  // 1MHz frame updates (use 400000 if the panel misbehaves)
     };
 
-    if (ssd1306_init(&oled_config)) {
+    ssd1306_t *oled = ssd1306_init(&oled_config);
+    if (oled) {
         console_puts("OLED initialized successfully!\n");
     } else {
         console_puts("OLED initialization failed!\n");
-        // Continue anyway - shell can work without OLED
+        // Continue anyway - shell can work without OLED (it draws into the
+        // display ssd1306_init() left selected; its updates just fail)
+        oled = ssd1306_selected();
     }
 
     // Initialize shell
     console_puts("Initializing shell...\n");
-    shell_init();
+    shell_init(oled);
     console_puts("\nShell ready! Type commands in your terminal.\n");
     console_puts("Commands will appear on the OLED display.\n\n");
 
@@ -55,6 +115,19 @@ void app_main(void) {
             shell_process_char((char)c);
         }
 
+        // Queued bus transactions run from the bus's interrupt; this only
+        // picks up one that found the bus taken when its turn came
+        i2c_queue_poll();
+
+        // Push a bounded slice of any pending display update, so a redraw
+        // never holds off keyboard input for a whole frame transfer.
+        // In grayscale mode the panel shows the bit-planes instead.
+        if (gray_active(oled)) {
+            gray_step(oled);
+        } else {
+            ssd1306_flush_step(oled, SSD1306_FLUSH_CHUNK_BYTES);
+        }
+
         // Small delay to avoid busy-waiting
         for (volatile int i = 0; i < 100; i++);
     }
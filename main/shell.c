@@ -5,17 +5,23 @@
 
 #include "shell.h"
 #include "ssd1306.h"
+#include "textgrid.h"
+#include "grayscale.h"
 #include "console.h"
+#include "i2c.h"
+#include "cpu.h"
 #include <string.h>
 
 // Shell state
+static ssd1306_t *oled;  // Display the text grid is shown on
 static char input_buffer[SHELL_MAX_LINE_LENGTH];
 static uint8_t input_pos = 0;
 
-// Output line buffer (8 lines on 64-pixel display with 8-pixel font height)
-#define MAX_LINES 8
-static char display_lines[MAX_LINES][22];  // 21 chars per line (128px / 6px per char) + null terminator
-static uint8_t current_line = 0;
+// Output goes to the text grid (21x8 cells on a 128x64 display)
+static uint8_t current_line = 0;  // Next free grid row
+
+// The prompt row shows the input as it is typed
+static bool prompt_active = false;  // Prompt is on row current_line - 1
 
 // Simple string utilities
 static void str_copy(char *dest, const char *src, int max_len) {
@@ -33,6 +39,22 @@ static int str_len(const char *s) {
     return len;
 }
 
+// Format an unsigned number as decimal; returns the number of characters written
+static int str_from_uint(char *dest, uint32_t value) {
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = '0' + (value % 10);
+        value /= 10;
+    } while (value);
+
+    for (int i = 0; i < n; i++) {
+        dest[i] = digits[n - 1 - i];
+    }
+    dest[n] = '\0';
+    return n;
+}
+
 static bool str_equals(const char *s1, const char *s2) {
     int i = 0;
     while (s1[i] && s2[i]) {
@@ -42,34 +64,86 @@ static bool str_equals(const char *s1, const char *s2) {
     return s1[i] == s2[i];
 }
 
-// Print a line to the display buffer
+// Send the changed cells to the display
+// Only the cells that changed are redrawn, so this sends a few bytes for a
+// keystroke and a single page at most for a new line (plus the start line
+// command when the screen scrolled). The transfer runs in the background
+// from the main loop at the display's frame rate, so all lines printed by
+// one command go out together.
+static void shell_update_display(void) {
+    textgrid_render();
+    ssd1306_display_async(oled);
+}
+
+// Print a line to the display
 static void shell_print(const char *text) {
     // Echo to serial console for debugging
     console_puts(text);
     console_puts("\n");
 
-    // Add to display buffer
-    if (current_line >= MAX_LINES) {
-        // Scroll up: shift all lines up by one
-        for (int i = 0; i < MAX_LINES - 1; i++) {
-            str_copy(display_lines[i], display_lines[i + 1], 22);
+    int row;
+    if (prompt_active) {
+        // Replace the live prompt row
+        prompt_active = false;
+        row = current_line - 1;
+    } else {
+        if (current_line >= textgrid_rows()) {
+            // Scroll up by one row; the display scrolls its own RAM
+            textgrid_scroll();
+            current_line = textgrid_rows() - 1;
         }
-        current_line = MAX_LINES - 1;
+        row = current_line++;
     }
 
-    str_copy(display_lines[current_line], text, 22);
-    current_line++;
+    textgrid_set_line(row, text);
+    shell_update_display();
+}
 
-    shell_refresh_display();
+// Show a fresh prompt row
+static void shell_show_prompt(void) {
+    shell_print(">");
+    prompt_active = true;
+}
+
+// Redraw the prompt row with the current input
+// Shows the end of the input when it is wider than the screen.
+static void shell_update_prompt(void) {
+    if (!prompt_active) {
+        return;
+    }
+
+    int width = textgrid_cols() - 2;
+    const char *visible = input_buffer;
+    if (input_pos > width) {
+        visible += input_pos - width;
+    }
+
+    char line[TEXTGRID_COLS + 1];
+    line[0] = '>';
+    line[1] = ' ';
+    str_copy(line + 2, visible, width + 1);
+    textgrid_set_line(current_line - 1, line);
+    shell_update_display();
+}
+
+// Print "<label>: <value><unit>" as one line
+static void shell_print_value(const char *label, uint32_t value, const char *unit) {
+    char line[SHELL_MAX_LINE_LENGTH];
+    str_copy(line, label, SHELL_MAX_LINE_LENGTH);
+    int pos = str_len(line);
+    line[pos++] = ':';
+    line[pos++] = ' ';
+    pos += str_from_uint(line + pos, value);
+    str_copy(line + pos, unit, SHELL_MAX_LINE_LENGTH - pos);
+    shell_print(line);
 }
 
 // Clear the display
 static void shell_clear(void) {
-    for (int i = 0; i < MAX_LINES; i++) {
-        display_lines[i][0] = '\0';
-    }
+    textgrid_clear();
     current_line = 0;
-    shell_refresh_display();
+    prompt_active = false;
+    shell_update_display();
 }
 
 // Command: help
@@ -78,6 +152,10 @@ static void cmd_help(int argc, char **argv) {
     shell_print("  help  - Show help");
     shell_print("  clear - Clear screen");
     shell_print("  echo  - Echo text");
+    shell_print("  dump  - Screen to PBM");
+    shell_print("  stats - Bus/flush stats");
+    shell_print("  rotate - Rotate");
+    shell_print("  gray  - Grayscale demo");
 }
 
 // Command: clear
@@ -110,6 +188,122 @@ static void cmd_echo(int argc, char **argv) {
     shell_print(message);
 }
 
+// Command: dump
+// Writes the framebuffer to the serial console as a plain PBM (P1) image.
+// Capture everything from "P1" to the blank line and save it as a .pbm file.
+static void cmd_dump(int argc, char **argv) {
+    shell_print("Dumping to serial");
+
+    char header[24] = "P1\n";
+    int pos = 3;
+    pos += str_from_uint(header + pos, ssd1306_width());
+    header[pos++] = ' ';
+    pos += str_from_uint(header + pos, ssd1306_height());
+    header[pos++] = '\n';
+    header[pos] = '\0';
+    console_puts(header);
+
+    for (int y = 0; y < ssd1306_height(); y++) {
+        for (int x = 0; x < ssd1306_width(); x++) {
+            console_putc(ssd1306_get_pixel(x, y) ? '1' : '0');
+            // Keep lines under the 70 characters PBM readers expect
+            if ((x & 63) == 63) {
+                console_putc('\n');
+            }
+        }
+    }
+    console_puts("\n");
+}
+
+// Command: stats [reset]
+// Traffic on the display's bus and update timing since boot (or the last reset)
+static void cmd_stats(int argc, char **argv) {
+    i2c_bus_t *i2c = ssd1306_get_bus(oled);
+    if (argc > 1 && str_equals(argv[1], "reset")) {
+        i2c_reset_stats(i2c);
+        ssd1306_reset_stats(oled);
+        shell_print("Stats cleared");
+        return;
+    }
+
+    // Snapshot first: printing the report updates the display itself
+    i2c_stats_t bus;
+    ssd1306_stats_t panel;
+    i2c_get_stats(i2c, &bus);
+    ssd1306_get_stats(oled, &panel);
+
+    shell_print_value("i2c clk", i2c_bus_freq(i2c) / 1000, "kHz");
+    shell_print_value("i2c txn", bus.transactions, "");
+    shell_print_value("i2c bytes", bus.bytes, "");
+    shell_print_value("i2c nack", bus.nacks, "");
+    shell_print_value("i2c abort", bus.aborts, "");
+    shell_print_value("i2c tmo", bus.timeouts, "");
+    shell_print_value("i2c recov", bus.recoveries, "");
+    shell_print_value("i2c retry", bus.retries, "");
+    shell_print_value("oled flush", panel.flushes, "");
+    shell_print_value("oled data", panel.data_bytes, "");
+    shell_print_value("oled cmd", panel.command_bytes, "");
+    shell_print_value("oled err", panel.errors, "");
+    shell_print_value("flush last", cpu_cycles_to_us(panel.last_flush_cycles), "us");
+    shell_print_value("flush max", cpu_cycles_to_us(panel.max_flush_cycles), "us");
+    shell_print_value("step max", cpu_cycles_to_us(panel.max_step_cycles), "us");
+    shell_print_value("merged", panel.coalesced, "");
+}
+
+// Command: rotate <0|90|180|270>
+// Portrait (90/270) gives a 10x16 text grid; the screen starts over empty.
+static void cmd_rotate(int argc, char **argv) {
+    static const char *const angles[] = {"0", "90", "180", "270"};
+
+    if (argc < 2) {
+        shell_print("Usage: rotate <deg>");
+        return;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        if (str_equals(argv[1], angles[i])) {
+            ssd1306_set_rotation(oled, (ssd1306_rotation_t)i);
+            textgrid_init();
+            current_line = 0;
+            prompt_active = false;
+            shell_refresh_display();
+            return;
+        }
+    }
+    shell_print("Angle: 0/90/180/270");
+}
+
+// Command: gray
+// Shows a dithered gradient above the four gray levels until a key is
+// pressed, after printing the frame rate the image allows per bus speed.
+static void cmd_gray(int argc, char **argv) {
+    static const uint32_t bus_speeds[] = {100000, 400000, 1000000};
+    static const char *const bus_names[] = {"100kHz", "400kHz", "1MHz"};
+
+    gray_clear();
+    uint8_t ramp[SSD1306_WIDTH];
+    for (int x = 0; x < SSD1306_WIDTH; x++) {
+        ramp[x] = x * 255 / (SSD1306_WIDTH - 1);
+    }
+    for (int y = 0; y < SSD1306_HEIGHT / 2; y++) {
+        gray_draw_image(0, y, SSD1306_WIDTH, 1, ramp, GRAY_DITHER_BAYER);
+    }
+    for (int x = 0; x < SSD1306_WIDTH; x++) {
+        for (int y = SSD1306_HEIGHT / 2; y < SSD1306_HEIGHT; y++) {
+            gray_set_pixel(x, y, x * GRAY_LEVELS / SSD1306_WIDTH);
+        }
+    }
+
+    for (int i = 0; i < 3; i++) {
+        shell_print_value(bus_names[i], gray_estimate_frame_rate(oled, bus_speeds[i]), "fps");
+    }
+    if (!gray_begin(oled)) {
+        shell_print(ssd1306_width() < ssd1306_height() ? "Landscape only" : "Display error");
+        return;
+    }
+    console_puts("Press any key to leave grayscale\n");
+}
+
 // Command table
 typedef struct {
     const char *name;
@@ -120,19 +314,16 @@ static const command_t commands[] = {
     {"help", cmd_help},
     {"clear", cmd_clear},
     {"echo", cmd_echo},
+    {"dump", cmd_dump},
+    {"stats", cmd_stats},
+    {"rotate", cmd_rotate},
+    {"gray", cmd_gray},
 };
 
 #define NUM_COMMANDS (sizeof(commands) / sizeof(commands[0]))
 
-// Parse command line and execute
-void shell_execute(const char *cmdline) {
-    // Echo the command
-    char prompt_line[SHELL_MAX_LINE_LENGTH];
-    prompt_line[0] = '>';
-    prompt_line[1] = ' ';
-    str_copy(prompt_line + 2, cmdline, SHELL_MAX_LINE_LENGTH - 2);
-    shell_print(prompt_line);
-
+// Parse command line and execute (without echoing it)
+static void shell_run(const char *cmdline) {
     // Skip leading whitespace
     while (*cmdline == ' ') cmdline++;
 
@@ -178,13 +369,13 @@ void shell_execute(const char *cmdline) {
     }
 
     if (!found) {
-        // Check if error message fits on one line (21 chars max per line)
+        // Check if error message fits on one line
         const char *prefix = "command unknown: ";
         int prefix_len = str_len(prefix);
         int cmd_len = str_len(argv[0]);
         int total_len = prefix_len + cmd_len;
 
-        if (total_len <= 21) {
+        if (total_len <= textgrid_cols()) {
             // Fits on one line
             char err_msg[SHELL_MAX_LINE_LENGTH];
             str_copy(err_msg, prefix, SHELL_MAX_LINE_LENGTH);
@@ -198,24 +389,42 @@ void shell_execute(const char *cmdline) {
     }
 }
 
+// Echo the command, then execute it
+void shell_execute(const char *cmdline) {
+    char prompt_line[SHELL_MAX_LINE_LENGTH];
+    prompt_line[0] = '>';
+    prompt_line[1] = ' ';
+    str_copy(prompt_line + 2, cmdline, SHELL_MAX_LINE_LENGTH - 2);
+    shell_print(prompt_line);
+
+    shell_run(cmdline);
+}
+
 // Initialize shell
-void shell_init(void) {
+void shell_init(ssd1306_t *display) {
+    oled = display;
     input_pos = 0;
     current_line = 0;
-
-    // Clear display lines
-    for (int i = 0; i < MAX_LINES; i++) {
-        display_lines[i][0] = '\0';
-    }
+    prompt_active = false;
+    textgrid_init();
 
     // Show welcome message
     shell_print("RISC-V Shell v1.0");
     shell_print("Type 'help'");
-    shell_print(">");
+    shell_show_prompt();
 }
 
 // Process incoming character from serial
 void shell_process_char(char c) {
+    // Any key leaves the grayscale demo
+    if (gray_active(oled)) {
+        uint32_t fps = gray_frame_rate(oled);
+        gray_end(oled);
+        shell_print_value("gray", fps, "fps");
+        shell_refresh_display();
+        return;
+    }
+
     // Handle backspace
     if (c == '\b' || c == 127) {  // Backspace or DEL
         if (input_pos > 0) {
@@ -224,6 +433,7 @@ void shell_process_char(char c) {
             console_putc('\b');
             console_putc(' ');
             console_putc('\b');
+            shell_update_prompt();
         }
         return;
     }
@@ -233,12 +443,19 @@ void shell_process_char(char c) {
         console_putc('\n');
         input_buffer[input_pos] = '\0';
 
-        if (input_pos > 0) {
-            shell_execute(input_buffer);
+        // The prompt row already shows the command; keep it as the echo
+        if (prompt_active) {
+            input_pos = 0;  // Show the start of long commands
+            shell_update_prompt();
+            prompt_active = false;
+        }
+
+        if (input_buffer[0] != '\0') {
+            shell_run(input_buffer);
         }
 
         // Show prompt after command execution
-        shell_print(">");
+        shell_show_prompt();
 
         input_pos = 0;
         input_buffer[0] = '\0';
@@ -251,20 +468,14 @@ void shell_process_char(char c) {
             input_buffer[input_pos++] = c;
             input_buffer[input_pos] = '\0';
             console_putc(c);  // Echo to serial
+            shell_update_prompt();
         }
     }
 }
 
-// Refresh OLED display with current buffer
+// Redraw the whole OLED display from the text grid
 void shell_refresh_display(void) {
     ssd1306_clear();
-
-    // Draw each line
-    for (int i = 0; i < MAX_LINES; i++) {
-        if (display_lines[i][0] != '\0') {
-            ssd1306_draw_string(0, i * 8, display_lines[i]);
-        }
-    }
-
-    ssd1306_display();
+    textgrid_invalidate();
+    shell_update_display();
 }
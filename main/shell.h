@@ -9,14 +9,15 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "ssd1306.h"
 
 // Shell configuration
 #define SHELL_MAX_LINE_LENGTH 64
 #define SHELL_MAX_ARGS 8
 #define SHELL_HISTORY_SIZE 5
 
-// Initialize shell system
-void shell_init(void);
+// Initialize shell system, showing its output on display
+void shell_init(ssd1306_t *display);
 
 // Process incoming character from serial input
 void shell_process_char(char c);
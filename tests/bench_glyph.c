@@ -0,0 +1,170 @@
+/*
+ * Glyph blitting and portrait transposes, against per-pixel references
+ *
+ * draw_char ORs whole font bytes into the buffer (split across two pages
+ * when y is not page-aligned); the reference sets each lit pixel on its
+ * own, as the driver used to. Portrait frames are turned into GDDRAM
+ * bytes with 8x8 bit-matrix transposes; the reference reads every pixel
+ * back. Both pairs have to produce the same result, and the fast path
+ * has to be clearly faster (best of several runs, loose ratios so a busy
+ * CI machine does not fail it).
+ */
+
+#include "test.h"
+#include "display_fixture.h"
+#include <string.h>
+#include <time.h>
+
+#define RUNS 7
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Per-pixel glyph drawing (fixed-width font)
+static int draw_char_pixels(int x, int y, char c) {
+    const font_t *font = ssd1306_get_font();
+    uint8_t code = (uint8_t)c;
+    if (code < font->first || code > font->last) {
+        code = ' ';
+    }
+    const uint8_t *glyph = &font->bitmap[(code - font->first) * font->fixed_width * font->pages];
+    for (int p = 0; p < font->pages; p++) {
+        for (int col = 0; col < font->fixed_width; col++) {
+            uint8_t bits = glyph[p * font->fixed_width + col];
+            for (int row = 0; row < 8; row++) {
+                if (bits & (1 << row)) {
+                    ssd1306_set_pixel(x + col, y + p * 8 + row, SSD1306_WHITE);
+                }
+            }
+        }
+    }
+    return font->fixed_width + font->spacing;
+}
+
+static const char text[] = "The quick brown fox j";  // 21 cells, one row
+
+// Fill the screen with text rows at y offset `shift`
+static void draw_screen(int (*draw)(int, int, char), int shift) {
+    for (int row = 0; row < SSD1306_HEIGHT / 8 - 1; row++) {
+        int x = 0;
+        for (const char *s = text; *s; s++) {
+            x += draw(x, row * 8 + shift, *s);
+        }
+    }
+}
+
+// Best time of RUNS of drawing a screen of text
+static double time_screen(int (*draw)(int, int, char), int shift) {
+    double best = 1e30;
+    for (int run = 0; run < RUNS; run++) {
+        ssd1306_clear();
+        double start = now_ns();
+        for (int i = 0; i < 20; i++) {
+            draw_screen(draw, shift);
+        }
+        double t = now_ns() - start;
+        best = t < best ? t : best;
+    }
+    return best;
+}
+
+static void bench_glyphs(int shift, double min_ratio) {
+    static uint8_t fast[SSD1306_HEIGHT][SSD1306_WIDTH];
+    double t_fast = time_screen(ssd1306_draw_char, shift);
+    for (int y = 0; y < SSD1306_HEIGHT; y++) {
+        for (int x = 0; x < SSD1306_WIDTH; x++) {
+            fast[y][x] = ssd1306_get_pixel(x, y);
+        }
+    }
+
+    double t_ref = time_screen(draw_char_pixels, shift);
+    int differ = 0;
+    for (int y = 0; y < SSD1306_HEIGHT; y++) {
+        for (int x = 0; x < SSD1306_WIDTH; x++) {
+            differ += fast[y][x] != ssd1306_get_pixel(x, y);
+        }
+    }
+
+    int glyphs = 20 * (SSD1306_HEIGHT / 8 - 1) * (int)strlen(text);
+    printf("glyphs, y%%8=%d: %6.1f ns/glyph blit, %6.1f ns/glyph per-pixel (%.1fx)\n",
+           shift, t_fast / glyphs, t_ref / glyphs, t_ref / t_fast);
+    CHECK_EQ(differ, 0);
+    CHECK(t_ref > min_ratio * t_fast);
+}
+
+// GDDRAM bytes of a portrait canvas, pixel by pixel
+// (GDDRAM row r of column x holds canvas pixel (r, x); the SEG remap
+// turns that mirror image into a rotation on the glass)
+static void transpose_pixels(uint8_t *gram) {
+    for (int page = 0; page < SSD1306_PAGES; page++) {
+        for (int x = 0; x < SSD1306_WIDTH; x++) {
+            uint8_t byte = 0;
+            for (int bit = 0; bit < 8; bit++) {
+                byte |= ssd1306_get_pixel(page * 8 + bit, x) << bit;
+            }
+            gram[page * SSD1306_WIDTH + x] = byte;
+        }
+    }
+}
+
+// Best time of RUNS full-frame updates in the current rotation
+static double time_full_frames(void) {
+    double best = 1e30;
+    for (int run = 0; run < RUNS; run++) {
+        double start = now_ns();
+        for (int i = 0; i < 20; i++) {
+            ssd1306_invalidate(oled);
+            ssd1306_display(oled);
+        }
+        double t = now_ns() - start;
+        best = t < best ? t : best;
+    }
+    return best / 20;
+}
+
+static void bench_transpose(void) {
+    ssd1306_set_rotation(oled, SSD1306_ROTATE_0);
+    draw_screen(ssd1306_draw_char, 3);
+    double t_landscape = time_full_frames();
+
+    ssd1306_set_rotation(oled, SSD1306_ROTATE_90);
+    for (int i = 0; i < 200; i++) {
+        ssd1306_set_pixel((i * 37) % SSD1306_HEIGHT, (i * 53) % SSD1306_WIDTH, SSD1306_WHITE);
+    }
+    ssd1306_draw_string(0, 0, "portrait text");
+    double t_portrait = time_full_frames();
+
+    static uint8_t gram[SSD1306_WIDTH * SSD1306_PAGES];
+    double best = 1e30;
+    for (int run = 0; run < RUNS; run++) {
+        double start = now_ns();
+        transpose_pixels(gram);
+        double t = now_ns() - start;
+        best = t < best ? t : best;
+    }
+
+    // The panel got the same bytes the reference computes
+    int differ = 0;
+    for (int page = 0; page < SSD1306_PAGES; page++) {
+        differ += memcmp(&model.gram[page][SSD1306_COLUMN_OFFSET], &gram[page * SSD1306_WIDTH], SSD1306_WIDTH) != 0;
+    }
+    CHECK_EQ(differ, 0);
+
+    // What the transposes add to a frame, against doing it per pixel
+    double t_transpose = t_portrait > t_landscape ? t_portrait - t_landscape : 0;
+    printf("portrait frame: %.0f ns transposing (%.0f ns/frame vs %.0f landscape), %.0f ns per-pixel\n",
+           t_transpose, t_portrait, t_landscape, best);
+    CHECK(best > 1.5 * t_transpose);
+}
+
+int main(void) {
+    CHECK(fixture_init(1000000) != NULL);
+    // Unaligned glyphs do twice the byte work, hence the lower bar
+    bench_glyphs(0, 3.0);
+    bench_glyphs(3, 1.5);
+    bench_transpose();
+    return test_done("bench_glyph");
+}
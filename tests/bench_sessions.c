@@ -0,0 +1,145 @@
+/*
+ * Bus bytes of recorded shell sessions: the flush planner against
+ * naive update strategies
+ *
+ * A session file holds lines typed at the shell ('#' lines are comments,
+ * "\b" is a backspace). Each key is fed to the shell and the update it
+ * causes is sent, as the main loop does. For every update the panel's
+ * RAM before and after gives what really changed, and the strategies
+ * are charged for it on the same bus:
+ *   full frame  - the whole frame in one window per update
+ *   whole pages - every changed page in full, one window each
+ *   per span    - one window per run of changed columns
+ * All of them pay the same for start line commands. The planner (what
+ * the driver actually sent, counted on the bus) has to beat all three
+ * on every session.
+ */
+
+#include "test.h"
+#include "display_fixture.h"
+#include "shell.h"
+#include <string.h>
+
+// Bus bytes to open a window (address + control + window commands, then
+// address + control of the data transaction), as the driver counts it
+#if SSD1306_PAGE_ADDRESSING
+#define WINDOW_COST 8
+#else
+#define WINDOW_COST 11
+#endif
+
+// Bus bytes of a start line command (address, control, command)
+#define START_LINE_COST 3
+
+typedef struct {
+    uint32_t updates;  // Keys that caused bus traffic
+    uint32_t planner;
+    uint32_t full_frame;
+    uint32_t whole_pages;
+    uint32_t per_span;
+} session_cost_t;
+
+static uint8_t before[8][132];
+
+// Charge the naive strategies for the change from `before` to the model
+static void charge_naive(session_cost_t *cost, uint32_t start_lines) {
+    bool any = start_lines > 0;
+    for (int page = 0; page < SSD1306_PAGES; page++) {
+        const uint8_t *old = &before[page][SSD1306_COLUMN_OFFSET];
+        const uint8_t *now = &model.gram[page][SSD1306_COLUMN_OFFSET];
+        bool page_changed = false;
+        for (int x = 0; x < SSD1306_WIDTH; ) {
+            if (old[x] == now[x]) {
+                x++;
+                continue;
+            }
+            int start = x;
+            while (x < SSD1306_WIDTH && old[x] != now[x]) {
+                x++;
+            }
+            cost->per_span += WINDOW_COST + (x - start);
+            page_changed = true;
+        }
+        if (page_changed) {
+            cost->whole_pages += WINDOW_COST + SSD1306_WIDTH;
+            any = true;
+        }
+    }
+    if (any) {
+        cost->full_frame += WINDOW_COST + SSD1306_WIDTH * SSD1306_PAGES;
+    }
+    cost->full_frame += start_lines * START_LINE_COST;
+    cost->whole_pages += start_lines * START_LINE_COST;
+    cost->per_span += start_lines * START_LINE_COST;
+}
+
+// Feed one key and send the update it causes
+static void key(session_cost_t *cost, char c) {
+    memcpy(before, model.gram, sizeof(before));
+    uint32_t start_lines = model.start_line_commands;
+    fixture_bus_bytes();
+
+    shell_process_char(c);
+    fixture_flush();
+
+    uint32_t bytes = fixture_bus_bytes();
+    cost->planner += bytes;
+    cost->updates += bytes > 0;
+    charge_naive(cost, model.start_line_commands - start_lines);
+
+    // Time between keystrokes
+    host_cycles_advance(CPU_FREQ_HZ / 8);
+}
+
+static bool run_session(const char *path, session_cost_t *cost) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+
+    memset(cost, 0, sizeof(*cost));
+    shell_execute("clear");
+    fixture_flush();
+
+    char line[128];
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') {
+            continue;
+        }
+        for (const char *s = line; *s; s++) {
+            if (s[0] == '\\' && s[1] == 'b') {
+                key(cost, '\b');
+                s++;
+            } else {
+                key(cost, *s);
+            }
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    CHECK(fixture_init(1000000) != NULL);
+    shell_init(oled);
+    fixture_flush();
+
+    printf("%-12s %7s %9s %11s %11s %9s\n", "session", "updates", "planner", "full frame", "whole pages", "per span");
+    for (int i = 1; i < argc; i++) {
+        session_cost_t cost;
+        CHECK(run_session(argv[i], &cost));
+
+        const char *name = strrchr(argv[i], '/');
+        name = name ? name + 1 : argv[i];
+        printf("%-12s %7u %9u %11u %11u %9u\n", name, (unsigned)cost.updates, (unsigned)cost.planner,
+               (unsigned)cost.full_frame, (unsigned)cost.whole_pages, (unsigned)cost.per_span);
+
+        CHECK(cost.updates > 0);
+        CHECK(cost.planner <= cost.full_frame);
+        CHECK(cost.planner <= cost.whole_pages);
+        CHECK(cost.planner <= cost.per_span);
+    }
+    CHECK_EQ(model.unknown_commands, 0);
+    return test_done("bench_sessions_" TEST_PANEL_NAME);
+}
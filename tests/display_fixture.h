@@ -0,0 +1,88 @@
+/*
+ * A display on a fake bus, with the controller model as the panel
+ *
+ * Shared set-up for the tests that drive the display stack: one bus,
+ * the model for the panel this test is built for, ssd1306_init().
+ */
+
+#ifndef DISPLAY_FIXTURE_H
+#define DISPLAY_FIXTURE_H
+
+#include "ssd1306.h"
+#include "ssd1306_model.h"
+#include "cpu.h"
+#include "host.h"
+#if defined(TEST_I2C_LINES)
+#include "i2c_lines.h"
+#elif defined(TEST_I2C_HW)
+#include "i2c_hw_mock.h"
+#else
+#include "i2c_fake.h"
+#endif
+
+static ssd1306_model_t model;
+static i2c_bus_t *bus;
+static sim_i2c_bus_t *sim;
+static ssd1306_t *oled;
+
+// The bus's interrupt, wired up like main.c does on the target: the
+// controller's, a periodic timer for the bit-banged driver, or the fake
+// bus's completion line
+static void fixture_bus_isr(void *arg) {
+    i2c_bus_service(arg);
+}
+
+// Bring up the bus, the panel model and the display, oled (bus_hz for frames)
+// With TEST_I2C_LINES the bus is the bit-banged driver on the line model,
+// with TEST_I2C_HW the hardware driver on the controller model.
+static inline ssd1306_t *fixture_init(uint32_t bus_hz) {
+    i2c_config_t bus_config = {.scl_pin = 7, .sda_pin = 6, .freq_hz = 400000};
+#if defined(TEST_I2C_LINES)
+    static sim_i2c_bus_t lines_sim;
+    sim_i2c_init(&lines_sim);
+    i2c_lines_init(&lines_sim, bus_config.scl_pin, bus_config.sda_pin);
+    bus = i2c_bus_create(&bus_config);
+    host_irq_attach(host_timer_line(I2C_TICK_US * (CPU_FREQ_HZ / 1000000)), fixture_bus_isr, bus);
+    sim = i2c_lines_sim();
+#elif defined(TEST_I2C_HW)
+    static sim_i2c_bus_t hw_sim;
+    sim_i2c_init(&hw_sim);
+    i2c_hw_mock_init(&hw_sim);
+    bus = i2c_bus_create(&bus_config);
+    host_irq_attach(i2c_hw_mock_irq(), fixture_bus_isr, bus);
+    sim = i2c_hw_mock_sim();
+#else
+    bus = i2c_bus_create(&bus_config);
+    host_irq_attach(i2c_fake_irq(bus), fixture_bus_isr, bus);
+    sim = i2c_fake_sim(bus);
+#endif
+
+#if SSD1306_PANEL == SSD1306_PANEL_SH1106
+    ssd1306_model_init(&model, SSD1306_MODEL_SH1106, 0x3C, SSD1306_WIDTH, SSD1306_HEIGHT, SSD1306_COLUMN_OFFSET);
+#else
+    ssd1306_model_init(&model, SSD1306_MODEL_SSD1306, 0x3C, SSD1306_WIDTH, SSD1306_HEIGHT, SSD1306_COLUMN_OFFSET);
+#endif
+    sim_i2c_attach(sim, &model.dev);
+
+    ssd1306_config_t config = {.bus = bus, .i2c_addr = 0x3C, .freq_hz = bus_hz};
+    oled = ssd1306_init(&config);
+    return oled;
+}
+
+// Run the main loop's flush steps until the pending update is out,
+// letting simulated time pass for the frame pacing
+static inline void fixture_flush(void) {
+    for (int i = 0; i < 100000 && !ssd1306_flush_step(oled, SSD1306_FLUSH_CHUNK_BYTES); i++) {
+        host_cycles_advance(CPU_FREQ_HZ / 10000);
+    }
+}
+
+// Bytes on the bus (address and control bytes included) since the last call
+static inline uint32_t fixture_bus_bytes(void) {
+    static uint32_t last;
+    uint32_t bytes = sim->bytes - last;
+    last = sim->bytes;
+    return bytes;
+}
+
+#endif // DISPLAY_FIXTURE_H
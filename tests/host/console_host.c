@@ -0,0 +1,59 @@
+/*
+ * Host console (console.h): output to a buffer, input from a queue
+ */
+
+#include "console.h"
+#include "host.h"
+#include <string.h>
+
+#define HOST_CONSOLE_SIZE 65536
+
+static char output[HOST_CONSOLE_SIZE];
+static int output_len;
+static char input[HOST_CONSOLE_SIZE];
+static int input_head;
+static int input_len;
+
+void console_init(void) {
+}
+
+void console_putc(char c) {
+    if (output_len < HOST_CONSOLE_SIZE - 1) {
+        output[output_len++] = c;
+        output[output_len] = '\0';
+    }
+}
+
+void console_puts(const char *s) {
+    while (*s) {
+        console_putc(*s++);
+    }
+}
+
+int console_getc(void) {
+    if (input_head == input_len) {
+        return -1;
+    }
+    return (unsigned char)input[input_head++];
+}
+
+void host_console_input(const char *text) {
+    if (input_head == input_len) {
+        input_head = input_len = 0;
+    }
+    int len = strlen(text);
+    if (input_len + len > HOST_CONSOLE_SIZE) {
+        len = HOST_CONSOLE_SIZE - input_len;
+    }
+    memcpy(&input[input_len], text, len);
+    input_len += len;
+}
+
+const char *host_console_output(void) {
+    return output;
+}
+
+void host_console_clear(void) {
+    output_len = 0;
+    output[0] = '\0';
+}
@@ -0,0 +1,123 @@
+/*
+ * Host cycle counter, interrupt mask and interrupt lines (cpu.h with
+ * CPU_HOST)
+ */
+
+#include "cpu.h"
+#include "host.h"
+
+// Cycles one cpu_cycles() call takes, roughly what the read costs on
+// the target
+#define HOST_CYCLES_PER_READ 4
+
+// How far cpu_wait_for_interrupt() moves time with no line due, like
+// a periodic interrupt would wake the target
+#define HOST_IDLE_CYCLES (CPU_FREQ_HZ / 1000000)
+
+static uint64_t cycles;
+static bool irq_enabled = true;
+
+static struct {
+    host_irq_due_t due;         // NULL for a timer
+    void *model;
+    uint32_t period;            // Timer: cycles between ticks
+    uint64_t next;              // Timer: next tick
+    host_irq_handler_t handler;
+    void *arg;
+} lines[HOST_IRQ_LINES];
+static int line_count;
+
+static uint64_t line_due(int i) {
+    return lines[i].due ? lines[i].due(lines[i].model) : lines[i].next;
+}
+
+// Run the handler of each asserted line, if interrupts are enabled
+static void irq_deliver(void) {
+    for (int i = 0; i < line_count && irq_enabled; i++) {
+        if (lines[i].handler && line_due(i) <= cycles) {
+            uint64_t taken = cycles;
+            irq_enabled = false;
+            lines[i].handler(lines[i].arg);
+            irq_enabled = true;
+            while (!lines[i].due && lines[i].next <= taken) {
+                lines[i].next += lines[i].period;
+            }
+        }
+    }
+}
+
+void cpu_cycle_counter_init(void) {
+}
+
+uint32_t cpu_cycles(void) {
+    cycles += HOST_CYCLES_PER_READ;
+    irq_deliver();
+    return (uint32_t)cycles;
+}
+
+void host_cycles_advance(uint32_t n) {
+    cycles += n;
+    irq_deliver();
+}
+
+uint64_t host_cycles_total(void) {
+    return cycles;
+}
+
+uint32_t cpu_irq_save(void) {
+    uint32_t state = irq_enabled;
+    irq_enabled = false;
+    return state;
+}
+
+void cpu_irq_restore(uint32_t state) {
+    if (state) {
+        irq_enabled = true;
+        irq_deliver();
+    }
+}
+
+void cpu_wait_for_interrupt(void) {
+    uint64_t next = UINT64_MAX;
+    for (int i = 0; i < line_count; i++) {
+        if (lines[i].handler) {
+            uint64_t due = line_due(i);
+            next = due < next ? due : next;
+        }
+    }
+    if (next == UINT64_MAX) {
+        cycles += HOST_IDLE_CYCLES;
+    } else if (next > cycles) {
+        cycles = next;
+    }
+    irq_deliver();
+}
+
+int host_irq_line(host_irq_due_t due, void *model) {
+    if (line_count == HOST_IRQ_LINES) {
+        return -1;
+    }
+    lines[line_count].due = due;
+    lines[line_count].model = model;
+    return line_count++;
+}
+
+int host_timer_line(uint32_t period) {
+    if (line_count == HOST_IRQ_LINES || period == 0) {
+        return -1;
+    }
+    lines[line_count].period = period;
+    lines[line_count].next = cycles + period;
+    return line_count++;
+}
+
+void host_irq_attach(int line, host_irq_handler_t handler, void *arg) {
+    if (line >= 0 && line < line_count) {
+        lines[line].handler = handler;
+        lines[line].arg = arg;
+    }
+}
+
+bool host_irq_enabled(void) {
+    return irq_enabled;
+}
@@ -0,0 +1,49 @@
+/*
+ * Host test support
+ *
+ * What the target hardware provides to the drivers, replaced for a host
+ * build (CPU_HOST, see cpu.h): a simulated cycle counter, interrupt mask
+ * and interrupt lines, and a console that records output and plays back
+ * input.
+ */
+
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Simulated time: every cpu_cycles() call moves the counter on by a few
+// cycles, so the drivers' spin waits end; models add bus time on top
+void host_cycles_advance(uint32_t cycles);
+uint64_t host_cycles_total(void);  // Cycles since start, without wrap
+
+// Interrupt mask as set by cpu_irq_save()/cpu_irq_restore()
+bool host_irq_enabled(void);
+
+// Simulated interrupt lines. A model adds a line with a function telling
+// from which cycle count (host_cycles_total()) it is asserted, UINT64_MAX
+// while it is not; a test attaches the firmware's handler, as the target
+// does with its interrupt allocator. The handler runs with interrupts
+// masked as soon as the line is asserted while they are enabled: checked
+// whenever simulated time moves and when they are restored.
+// cpu_wait_for_interrupt() moves time on to the next asserted line.
+#define HOST_IRQ_LINES 8
+typedef uint64_t (*host_irq_due_t)(void *model);
+typedef void (*host_irq_handler_t)(void *arg);
+int host_irq_line(host_irq_due_t due, void *model);  // -1 if all lines are taken
+void host_irq_attach(int line, host_irq_handler_t handler, void *arg);
+
+// A periodic timer's line, due every period cycles. Like a hardware
+// alarm flag, ticks that pass before its handler runs make a single
+// interrupt, and one that comes while the handler runs is taken again
+// right after it.
+int host_timer_line(uint32_t period);
+
+// Console: input queued for console_getc(), output collected from
+// console_putc()/console_puts()
+void host_console_input(const char *text);
+const char *host_console_output(void);
+void host_console_clear(void);
+
+#endif // HOST_H
@@ -0,0 +1,84 @@
+/*
+ * 24Cxx serial EEPROM model (see eeprom_model.h)
+ */
+
+#include "eeprom_model.h"
+#include "cpu.h"
+#include "host.h"
+#include <string.h>
+
+static bool eeprom_model_start(sim_i2c_device_t *dev, bool read) {
+    eeprom_model_t *e = (eeprom_model_t *)dev;
+    if (host_cycles_total() < e->busy_until) {
+        e->busy_nacks++;
+        return false;
+    }
+    if (!read) {
+        e->addr_received = 0;
+        e->data_received = 0;
+        memset(e->page_dirty, 0, sizeof(e->page_dirty));
+    }
+    return true;
+}
+
+static bool eeprom_model_write(sim_i2c_device_t *dev, uint8_t byte) {
+    eeprom_model_t *e = (eeprom_model_t *)dev;
+    if (e->addr_received < e->addr_bytes) {
+        e->pointer = e->addr_received++ ? (e->pointer << 8) | byte : byte;
+        if (e->addr_received == e->addr_bytes) {
+            e->pointer &= e->size - 1;
+            e->page_base = e->pointer & ~(e->page_size - 1);
+        }
+        return true;
+    }
+
+    // Data: the address counter's low bits wrap within the page
+    uint32_t offset = e->pointer & (e->page_size - 1);
+    e->page[offset] = byte;
+    e->page_dirty[offset] = true;
+    if (e->data_received++ == e->page_size) {
+        e->rollovers++;
+    }
+    e->pointer = e->page_base | ((offset + 1) & (e->page_size - 1));
+    return true;
+}
+
+static uint8_t eeprom_model_read(sim_i2c_device_t *dev) {
+    eeprom_model_t *e = (eeprom_model_t *)dev;
+    uint8_t byte = e->mem[e->pointer];
+    e->pointer = (e->pointer + 1) & (e->size - 1);
+    return byte;
+}
+
+static void eeprom_model_stop(sim_i2c_device_t *dev) {
+    eeprom_model_t *e = (eeprom_model_t *)dev;
+    if (e->data_received == 0) {
+        return;  // Address only: sets up a random read
+    }
+
+    for (uint32_t i = 0; i < e->page_size; i++) {
+        if (e->page_dirty[i]) {
+            e->mem[e->page_base + i] = e->page[i];
+        }
+    }
+    e->data_received = 0;
+    e->write_cycles_done++;
+    e->busy_until = host_cycles_total() + e->write_cycles;
+}
+
+void eeprom_model_init(eeprom_model_t *e, uint8_t addr, uint32_t size, int addr_bytes,
+                       uint32_t page_size, uint32_t write_us) {
+    memset(e, 0, sizeof(*e));
+    e->dev.name = "24cxx";
+    e->dev.addr = addr;
+    e->dev.start = eeprom_model_start;
+    e->dev.write = eeprom_model_write;
+    e->dev.read = eeprom_model_read;
+    e->dev.stop = eeprom_model_stop;
+
+    e->size = size;
+    e->addr_bytes = addr_bytes;
+    e->page_size = page_size;
+    e->write_cycles = write_us * (CPU_FREQ_HZ / 1000000);
+    memset(e->mem, 0xFF, sizeof(e->mem));
+}
@@ -0,0 +1,54 @@
+/*
+ * 24Cxx serial EEPROM model
+ *
+ * One or two address bytes set the word address; further bytes fill the
+ * page buffer, wrapping within the page as the datasheets describe, and
+ * the STOP starts the internal write cycle. For tWR after that the chip
+ * does not acknowledge its address (the "ACK polling" drivers rely on).
+ * Reads run on from the word address and wrap at the end of the array.
+ *
+ *   24C02: 256 bytes, 1 address byte, 8-byte pages
+ *   24C32: 4 KB, 2 address bytes, 32-byte pages
+ */
+
+#ifndef EEPROM_MODEL_H
+#define EEPROM_MODEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sim_i2c.h"
+
+#define EEPROM_MODEL_MAX_BYTES 4096
+#define EEPROM_MODEL_MAX_PAGE  64
+
+typedef struct {
+    sim_i2c_device_t dev;  // Attach &eeprom.dev to a bus
+
+    uint32_t size;
+    int addr_bytes;
+    uint32_t page_size;
+    uint32_t write_cycles;  // tWR in CPU cycles
+
+    uint8_t mem[EEPROM_MODEL_MAX_BYTES];
+    uint32_t pointer;       // Word address
+
+    // Write being received
+    int addr_received;
+    uint32_t page_base;
+    uint8_t page[EEPROM_MODEL_MAX_PAGE];
+    bool page_dirty[EEPROM_MODEL_MAX_PAGE];
+    uint32_t data_received;
+    uint64_t busy_until;    // End of the internal write cycle
+
+    // Counters
+    uint32_t write_cycles_done;
+    uint32_t busy_nacks;    // Address bytes refused during a write cycle
+    uint32_t rollovers;     // Writes that wrapped within their page
+} eeprom_model_t;
+
+// A 24C02 (size 256, 1 address byte, page 8) or 24C32 (4096, 2, 32);
+// tWR is write_us. Memory starts erased (0xFF).
+void eeprom_model_init(eeprom_model_t *e, uint8_t addr, uint32_t size, int addr_bytes,
+                       uint32_t page_size, uint32_t write_us);
+
+#endif // EEPROM_MODEL_H
@@ -0,0 +1,348 @@
+/*
+ * Fake I2C master on a simulated bus (see i2c_fake.h)
+ */
+
+#include "i2c_fake.h"
+#include "cpu.h"
+#include "host.h"
+#include <stddef.h>
+
+struct i2c_bus {
+    sim_i2c_bus_t sim;
+    uint32_t freq_hz;
+    bool owned;
+    bool nack_pending;
+    bool fault;
+    i2c_err_t last_error;
+    i2c_stats_t stats;
+
+    // Asynchronous transaction: it runs on the simulated bus as it
+    // starts, with its bus time added up instead of passed, and
+    // i2c_bus_service() finishes it once that time has gone by
+    volatile bool async_running;
+    bool deferring;             // Bus time goes to deferred, not the clock
+    uint64_t deferred;
+    uint64_t async_done_at;
+    uint32_t async_freq;        // Clock to give back to synchronous callers
+    i2c_err_t async_error;
+    i2c_done_t async_done;
+    void *async_user;
+    int irq_line;
+};
+
+static struct i2c_bus buses[I2C_MAX_BUSES];
+static int bus_count;
+
+sim_i2c_bus_t *i2c_fake_sim(i2c_bus_t *bus) {
+    return &bus->sim;
+}
+
+int i2c_fake_irq(i2c_bus_t *bus) {
+    return bus->irq_line;
+}
+
+// Bus time passing
+static void i2c_fake_time(i2c_bus_t *bus, uint32_t cycles) {
+    if (bus->deferring) {
+        bus->deferred += cycles;
+    } else {
+        host_cycles_advance(cycles);
+    }
+}
+
+// Bus time of `bits` SCL periods
+static void i2c_fake_bits(i2c_bus_t *bus, uint32_t bits) {
+    i2c_fake_time(bus, bits * (CPU_FREQ_HZ / bus->freq_hz));
+}
+
+// A slave stretching the clock after a byte; false once it runs past
+// the timeout
+static bool i2c_fake_stretch(i2c_bus_t *bus) {
+    uint32_t us = bus->sim.stretch_us;
+    if (bus->sim.scl_stuck || us > I2C_STRETCH_TIMEOUT_US) {
+        i2c_fake_time(bus, I2C_STRETCH_TIMEOUT_US * (CPU_FREQ_HZ / 1000000));
+        bus->last_error = I2C_ERR_TIMEOUT;
+        bus->stats.timeouts++;
+        bus->fault = true;
+        return false;
+    }
+    i2c_fake_time(bus, us * (CPU_FREQ_HZ / 1000000));
+    return true;
+}
+
+// Interrupt line: asserted once the asynchronous transaction's time is up
+static uint64_t i2c_fake_irq_due(void *model) {
+    i2c_bus_t *bus = model;
+    return bus->async_running ? bus->async_done_at : UINT64_MAX;
+}
+
+i2c_bus_t *i2c_bus_create(const i2c_config_t *config) {
+    if (bus_count >= I2C_MAX_BUSES ||
+        config->freq_hz < I2C_MIN_FREQ_HZ || config->freq_hz > I2C_MAX_FREQ_HZ) {
+        return NULL;
+    }
+    i2c_bus_t *bus = &buses[bus_count++];
+    sim_i2c_init(&bus->sim);
+    bus->freq_hz = config->freq_hz;
+    bus->irq_line = host_irq_line(i2c_fake_irq_due, bus);
+    return bus;
+}
+
+i2c_err_t i2c_bus_recover(i2c_bus_t *bus) {
+    bus->stats.recoveries++;
+    bus->fault = false;
+    bus->nack_pending = false;
+
+    if (bus->sim.scl_stuck) {
+        bus->last_error = I2C_ERR_BUS;
+        return I2C_ERR_BUS;
+    }
+    for (int i = 0; i < 9 && bus->sim.sda_stuck; i++) {
+        i2c_fake_bits(bus, 1);
+        if (bus->sim.sda_stuck_clocks > 0 && --bus->sim.sda_stuck_clocks == 0) {
+            bus->sim.sda_stuck = false;
+        }
+    }
+    sim_i2c_stop(&bus->sim);
+    i2c_fake_bits(bus, 1);
+    if (bus->sim.sda_stuck) {
+        bus->last_error = I2C_ERR_BUS;
+        return I2C_ERR_BUS;
+    }
+    return I2C_OK;
+}
+
+i2c_err_t i2c_last_error(i2c_bus_t *bus) {
+    return bus->last_error;
+}
+
+bool i2c_bus_busy(i2c_bus_t *bus) {
+    return bus->owned;
+}
+
+static bool i2c_fake_start(i2c_bus_t *bus) {
+    bus->stats.transactions++;
+    bus->nack_pending = false;
+    bus->last_error = I2C_OK;
+
+    if (!bus->owned && (bus->sim.sda_stuck || bus->sim.scl_stuck) && i2c_bus_recover(bus) != I2C_OK) {
+        return false;
+    }
+    bus->owned = true;
+    sim_i2c_start(&bus->sim);
+    i2c_fake_bits(bus, 1);
+    return true;
+}
+
+void i2c_stop(i2c_bus_t *bus) {
+    if (bus->nack_pending) {
+        bus->stats.aborts++;
+        bus->nack_pending = false;
+    }
+    if (bus->fault) {
+        bus->stats.aborts++;
+        i2c_bus_recover(bus);
+    } else {
+        sim_i2c_stop(&bus->sim);
+        i2c_fake_bits(bus, 1);
+    }
+    bus->owned = false;
+}
+
+bool i2c_write_byte(i2c_bus_t *bus, uint8_t data) {
+    i2c_fake_bits(bus, 9);
+    if (bus->sim.stretch_us || bus->sim.scl_stuck) {
+        if (!i2c_fake_stretch(bus)) {
+            return false;
+        }
+    }
+    bool ack = sim_i2c_write(&bus->sim, data);
+    bus->stats.bytes++;
+    if (!ack) {
+        bus->stats.nacks++;
+        bus->nack_pending = true;
+        bus->last_error = I2C_ERR_NACK;
+    }
+    return ack;
+}
+
+uint8_t i2c_read_byte(i2c_bus_t *bus, bool ack) {
+    i2c_fake_bits(bus, 9);
+    if (bus->sim.stretch_us || bus->sim.scl_stuck) {
+        if (!i2c_fake_stretch(bus)) {
+            return 0xFF;
+        }
+    }
+    bus->stats.bytes++;
+    return sim_i2c_read(&bus->sim, ack);
+}
+
+uint32_t i2c_bus_freq(i2c_bus_t *bus) {
+    return bus->freq_hz;
+}
+
+// One combined transaction, as the real drivers run it
+static bool i2c_fake_transfer_once(const i2c_dev_t *dev, const i2c_segment_t *segments, int count) {
+    i2c_bus_t *bus = dev->bus;
+    for (int i = 0; i < count; i++) {
+        const i2c_segment_t *seg = &segments[i];
+        if (!i2c_fake_start(bus)) {
+            return false;
+        }
+        if (!i2c_write_byte(bus, (dev->addr << 1) | seg->read)) {
+            i2c_stop(bus);
+            return false;
+        }
+        for (uint32_t j = 0; j < seg->len; j++) {
+            if (seg->read) {
+                seg->rx[j] = i2c_read_byte(bus, j + 1 < seg->len);
+                if (bus->last_error != I2C_OK) {
+                    i2c_stop(bus);
+                    return false;
+                }
+            } else if (!i2c_write_byte(bus, seg->tx[j])) {
+                i2c_stop(bus);
+                return false;
+            }
+        }
+    }
+    i2c_stop(bus);
+    return bus->last_error == I2C_OK;
+}
+
+static bool i2c_fake_transfer_retry(const i2c_dev_t *dev, const i2c_segment_t *segments, int count) {
+    for (int attempt = 0; ; attempt++) {
+        if (i2c_fake_transfer_once(dev, segments, count)) {
+            return true;
+        }
+        if (attempt == I2C_RETRIES) {
+            return false;
+        }
+        dev->bus->stats.retries++;
+    }
+}
+
+void i2c_bus_service(i2c_bus_t *bus) {
+    if (!bus->async_running || host_cycles_total() < bus->async_done_at) {
+        return;
+    }
+    i2c_done_t done = bus->async_done;
+    void *user = bus->async_user;
+    bus->freq_hz = bus->async_freq;
+    bus->last_error = bus->async_error;
+    bus->async_running = false;
+    bus->owned = false;
+    if (done) {
+        done(bus->async_error, user);
+    }
+}
+
+// Wait for the asynchronous transaction to finish, asleep as the hardware
+// driver does. Returns with interrupts masked (restore with the state
+// returned), so that none starts before the caller has the bus.
+static uint32_t i2c_fake_wait_async(i2c_bus_t *bus) {
+    uint32_t irq = cpu_irq_save();
+    while (bus->async_running) {
+        cpu_wait_for_interrupt();
+        cpu_irq_restore(irq);
+        cpu_irq_save();
+        i2c_bus_service(bus);
+    }
+    return irq;
+}
+
+bool i2c_transfer_async(const i2c_dev_t *dev, const i2c_segment_t *segments, int count,
+                        i2c_done_t done, void *user) {
+    i2c_bus_t *bus = dev->bus;
+    uint32_t irq = cpu_irq_save();
+    if (bus->owned || count < 1) {
+        cpu_irq_restore(irq);
+        return false;
+    }
+    bus->async_freq = bus->freq_hz;
+    if (dev->freq_hz) {
+        bus->freq_hz = dev->freq_hz;
+    }
+    bus->deferring = true;
+    bus->deferred = 0;
+    bool ok = i2c_fake_transfer_retry(dev, segments, count);
+    bus->deferring = false;
+
+    bus->async_error = ok ? I2C_OK : bus->last_error;
+    bus->async_done = done;
+    bus->async_user = user;
+    bus->async_done_at = host_cycles_total() + bus->deferred;
+    bus->owned = true;
+    bus->async_running = true;
+    cpu_irq_restore(irq);
+    return true;
+}
+
+bool i2c_start(i2c_bus_t *bus) {
+    uint32_t irq = i2c_fake_wait_async(bus);
+    bool ok = i2c_fake_start(bus);
+    cpu_irq_restore(irq);
+    return ok;
+}
+
+bool i2c_set_freq(i2c_bus_t *bus, uint32_t freq_hz) {
+    if (freq_hz < I2C_MIN_FREQ_HZ || freq_hz > I2C_MAX_FREQ_HZ) {
+        return false;
+    }
+    uint32_t irq = i2c_fake_wait_async(bus);
+    bus->freq_hz = freq_hz;
+    cpu_irq_restore(irq);
+    return true;
+}
+
+void i2c_dev_select(const i2c_dev_t *dev) {
+    if (dev->freq_hz) {
+        i2c_set_freq(dev->bus, dev->freq_hz);
+    }
+}
+
+bool i2c_transfer(const i2c_dev_t *dev, const i2c_segment_t *segments, int count) {
+    i2c_dev_select(dev);
+    uint32_t irq = i2c_fake_wait_async(dev->bus);
+    bool ok = i2c_fake_transfer_retry(dev, segments, count);
+    cpu_irq_restore(irq);
+    return ok;
+}
+
+bool i2c_write(const i2c_dev_t *dev, const uint8_t *data, uint32_t len) {
+    const i2c_segment_t seg = {.read = false, .tx = data, .len = len};
+    return i2c_transfer(dev, &seg, 1);
+}
+
+bool i2c_write_reg(const i2c_dev_t *dev, uint8_t reg, const uint8_t *data, uint32_t len) {
+    // Register byte and data go out as one segment
+    uint8_t buf[1 + 256];
+    if (len > 256) {
+        return false;
+    }
+    buf[0] = reg;
+    for (uint32_t i = 0; i < len; i++) {
+        buf[1 + i] = data[i];
+    }
+    return i2c_write(dev, buf, len + 1);
+}
+
+bool i2c_write_read(const i2c_dev_t *dev, const uint8_t *wr, uint32_t wr_len, uint8_t *rd, uint32_t rd_len) {
+    const i2c_segment_t segments[] = {
+        {.read = false, .tx = wr, .len = wr_len},
+        {.read = true, .rx = rd, .len = rd_len},
+    };
+    return i2c_transfer(dev, segments, 2);
+}
+
+bool i2c_read_reg(const i2c_dev_t *dev, uint8_t reg, uint8_t *data, uint32_t len) {
+    return i2c_write_read(dev, &reg, 1, data, len);
+}
+
+void i2c_get_stats(i2c_bus_t *bus, i2c_stats_t *out) {
+    *out = bus->stats;
+}
+
+void i2c_reset_stats(i2c_bus_t *bus) {
+    bus->stats = (i2c_stats_t){0};
+}
@@ -0,0 +1,27 @@
+/*
+ * Fake I2C master: i2c.h implemented directly on a simulated bus
+ *
+ * For tests of code above the I2C driver (display, shell, queue). Every
+ * byte moves the host cycle counter on by nine bit times at the bus's
+ * clock, START and STOP by one, so frame times and rates come out as
+ * they would on the wire. Faults injected on the simulated bus (NACKs,
+ * stretching, stuck lines) surface as the real drivers report them.
+* i2c_transfer_async() runs the transaction on the simulated bus at once
+* but reports it through the bus's interrupt only after its bus time.
+ */
+
+#ifndef I2C_FAKE_H
+#define I2C_FAKE_H
+
+#include "i2c.h"
+#include "sim_i2c.h"
+
+// Simulated bus behind a bus from i2c_bus_create()
+sim_i2c_bus_t *i2c_fake_sim(i2c_bus_t *bus);
+
+// The bus's interrupt line (host.h), asserted when an asynchronous
+// transaction's bus time is over; attach a handler calling
+// i2c_bus_service()
+int i2c_fake_irq(i2c_bus_t *bus);
+
+#endif // I2C_FAKE_H
@@ -0,0 +1,448 @@
+/*
+ * I2C0 controller register model under the hardware driver (see i2c_hw_mock.h)
+ */
+
+#include "i2c_hw_mock.h"
+#include "cpu.h"
+#include "host.h"
+#include <stdio.h>
+#include <string.h>
+
+// The registers and bits i2c_hw.c uses (ESP32-C3 TRM, I2C Controller chapter)
+#define I2C0_BASE                0x60013000
+#define I2C_SCL_LOW_PERIOD_REG   (I2C0_BASE + 0x0000)
+#define I2C_CTR_REG              (I2C0_BASE + 0x0004)
+#define I2C_TO_REG               (I2C0_BASE + 0x000C)
+#define I2C_FIFO_CONF_REG        (I2C0_BASE + 0x0018)
+#define I2C_DATA_REG             (I2C0_BASE + 0x001C)
+#define I2C_INT_RAW_REG          (I2C0_BASE + 0x0020)
+#define I2C_INT_CLR_REG          (I2C0_BASE + 0x0024)
+#define I2C_INT_ENA_REG          (I2C0_BASE + 0x0028)
+#define I2C_INT_STATUS_REG       (I2C0_BASE + 0x002C)
+#define I2C_SCL_HIGH_PERIOD_REG  (I2C0_BASE + 0x0038)
+#define I2C_CLK_CONF_REG         (I2C0_BASE + 0x0054)
+#define I2C_COMD_REG(n)          (I2C0_BASE + 0x0058 + (n) * 4)
+#define I2C_SCL_SP_CONF_REG      (I2C0_BASE + 0x0080)
+
+#define I2C_TRANS_START          (1 << 5)
+#define I2C_FSM_RST              (1 << 10)
+#define I2C_CONF_UPGATE          (1 << 11)
+#define I2C_TIME_OUT_EN          (1 << 5)
+#define I2C_SCL_RST_SLV_EN       (1 << 0)
+#define I2C_RX_FIFO_RST          (1 << 12)
+#define I2C_TX_FIFO_RST          (1 << 13)
+
+#define I2C_END_DETECT_INT       (1 << 3)
+#define I2C_ARBITRATION_LOST_INT (1 << 5)
+#define I2C_TRANS_COMPLETE_INT   (1 << 7)
+#define I2C_TIME_OUT_INT         (1 << 8)
+#define I2C_NACK_INT             (1 << 10)
+
+#define I2C_CMD_RSTART           6
+#define I2C_CMD_WRITE            1
+#define I2C_CMD_READ             3
+#define I2C_CMD_STOP             2
+#define I2C_CMD_END              4
+#define I2C_CMD_ACK_CHECK        (1 << 8)
+#define I2C_CMD_ACK_VALUE        (1 << 10)
+#define I2C_CMD_DONE             (1u << 31)  // Set by the controller once run
+
+#define I2C_COMMANDS             8
+#define I2C_FIFO_SIZE            32
+#define I2C_SOURCE_CLK_HZ        40000000
+
+// Cycles one register access takes
+#define I2C_HW_MOCK_ACCESS_CYCLES 6
+
+// Registers outside the controller (clock gate, pin routing) just keep
+// what was written
+#define OTHER_REGS 64
+
+static struct {
+    sim_i2c_bus_t *sim;
+
+    uint32_t ctr;
+    uint32_t int_raw;
+    uint32_t int_ena;
+    uint32_t sp_conf;
+    uint32_t comd[I2C_COMMANDS];
+
+    uint8_t tx[I2C_FIFO_SIZE];
+    int tx_count;
+    uint8_t rx[I2C_FIFO_SIZE];
+    int rx_head;
+    int rx_count;
+
+    // Timing registers as written, and as latched by CONF_UPGATE
+    uint32_t clk_conf;
+    uint32_t low_period;
+    uint32_t high_period;
+    uint32_t to;
+    uint32_t scl_cycles;        // CPU cycles per SCL period
+    uint32_t timeout_us;        // 0 = no timeout
+
+    // The running command list: its bus time so far, and the interrupt
+    // bits it raises once host time reaches done_at
+    uint64_t run_cycles;
+    uint32_t int_pending;
+    uint64_t done_at;
+
+    struct {
+        uint32_t addr;
+        uint32_t val;
+    } other[OTHER_REGS];
+    int other_count;
+
+    char trace[I2C_HW_MOCK_TRACE_SIZE];
+    int trace_len;
+    i2c_hw_mock_stats_t stats;
+} hw;
+
+static int irq_line = -1;
+
+void i2c_hw_mock_reset_stats(void) {
+    memset(&hw.stats, 0, sizeof(hw.stats));
+}
+
+void i2c_hw_mock_trace_clear(void) {
+    hw.trace_len = 0;
+    hw.trace[0] = '\0';
+}
+
+// The command list's interrupt bits once it has finished
+static void update(void) {
+    if (hw.int_pending && host_cycles_total() >= hw.done_at) {
+        hw.int_raw |= hw.int_pending;
+        hw.int_pending = 0;
+    }
+}
+
+// Interrupt line: asserted while an enabled bit is raised
+static uint64_t irq_due(void *model) {
+    update();
+    if (hw.int_raw & hw.int_ena) {
+        return 0;
+    }
+    return (hw.int_pending & hw.int_ena) ? hw.done_at : UINT64_MAX;
+}
+
+void i2c_hw_mock_init(sim_i2c_bus_t *sim) {
+    memset(&hw, 0, sizeof(hw));
+    hw.sim = sim;
+    if (irq_line < 0) {
+        irq_line = host_irq_line(irq_due, NULL);
+    }
+}
+
+int i2c_hw_mock_irq(void) {
+    return irq_line;
+}
+
+sim_i2c_bus_t *i2c_hw_mock_sim(void) {
+    return hw.sim;
+}
+
+const char *i2c_hw_mock_trace(void) {
+    return hw.trace;
+}
+
+void i2c_hw_mock_get_stats(i2c_hw_mock_stats_t *out) {
+    *out = hw.stats;
+}
+
+static void trace(const char *fmt, unsigned n) {
+    if (hw.trace_len < I2C_HW_MOCK_TRACE_SIZE - 1) {
+        int len = snprintf(hw.trace + hw.trace_len, I2C_HW_MOCK_TRACE_SIZE - hw.trace_len, fmt, n);
+        hw.trace_len += len;
+        if (hw.trace_len > I2C_HW_MOCK_TRACE_SIZE - 1) {
+            hw.trace_len = I2C_HW_MOCK_TRACE_SIZE - 1;
+        }
+    }
+}
+
+uint32_t i2c_hw_mock_scl_freq(void) {
+    return hw.scl_cycles ? CPU_FREQ_HZ / hw.scl_cycles : 0;
+}
+
+// CONF_UPGATE: take over the clock divider, SCL periods and timeout
+static void latch_timing(void) {
+    uint32_t div = (hw.clk_conf & 0xFF) + 1;
+    uint32_t period = (hw.low_period + 1) + hw.high_period;
+    hw.scl_cycles = (uint32_t)((uint64_t)CPU_FREQ_HZ * div * period / I2C_SOURCE_CLK_HZ);
+    hw.timeout_us = (hw.to & I2C_TIME_OUT_EN) ? (1u << (hw.to & 0x1F)) / (I2C_SOURCE_CLK_HZ / 1000000) : 0;
+}
+
+// Bus time of `bits` SCL periods
+static void bus_bits(uint32_t bits) {
+    hw.run_cycles += bits * hw.scl_cycles;
+}
+
+// A slave stretching SCL after a byte; false once it runs past the timeout
+static bool stretch(void) {
+    uint32_t us = hw.sim->stretch_us;
+    if (hw.sim->scl_stuck || (hw.timeout_us && us > hw.timeout_us)) {
+        hw.run_cycles += hw.timeout_us * (CPU_FREQ_HZ / 1000000);
+        return false;
+    }
+    hw.run_cycles += us * (CPU_FREQ_HZ / 1000000);
+    return true;
+}
+
+static bool run_write(uint32_t count, bool ack_check) {
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t byte = 0xFF;
+        if (hw.tx_count > 0) {
+            byte = hw.tx[0];
+            memmove(hw.tx, hw.tx + 1, --hw.tx_count);
+        } else if (i == 0) {
+            hw.stats.tx_underflows++;
+        }
+        bus_bits(9);
+        bool ack = sim_i2c_write(hw.sim, byte);
+        if (!ack && ack_check) {
+            hw.int_pending |= I2C_NACK_INT;
+            return false;
+        }
+        if (!stretch()) {
+            hw.int_pending |= I2C_TIME_OUT_INT;
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool run_read(uint32_t count, bool nack) {
+    for (uint32_t i = 0; i < count; i++) {
+        bus_bits(9);
+        uint8_t byte = sim_i2c_read(hw.sim, !nack);
+        if (hw.rx_count < I2C_FIFO_SIZE) {
+            hw.rx[(hw.rx_head + hw.rx_count++) % I2C_FIFO_SIZE] = byte;
+        } else {
+            hw.stats.rx_overflows++;
+        }
+        if (!stretch()) {
+            hw.int_pending |= I2C_TIME_OUT_INT;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Run COMD0.. until END, STOP or an error
+static void run_commands(void) {
+    if (hw.trace_len > 0) {
+        trace(" | ", 0);
+    }
+
+    for (int i = 0; i < I2C_COMMANDS; i++) {
+        uint32_t cmd = hw.comd[i];
+        uint32_t op = (cmd >> 11) & 0x7;
+        uint32_t count = cmd & 0xFF;
+        if (i > 0) {
+            trace(" ", 0);
+        }
+        hw.comd[i] |= I2C_CMD_DONE;
+
+        switch (op) {
+            case I2C_CMD_RSTART:
+                trace("RSTART", 0);
+                if (hw.sim->scl_stuck) {
+                    hw.run_cycles += hw.timeout_us * (CPU_FREQ_HZ / 1000000);
+                    hw.int_pending |= I2C_TIME_OUT_INT;
+                    return;
+                }
+                if (hw.sim->sda_stuck) {
+                    hw.int_pending |= I2C_ARBITRATION_LOST_INT;  // SDA low that nobody drove
+                    return;
+                }
+                bus_bits(1);
+                sim_i2c_start(hw.sim);
+                break;
+
+            case I2C_CMD_WRITE:
+                trace("WRITE%u", count);
+                if (!run_write(count, cmd & I2C_CMD_ACK_CHECK)) {
+                    return;
+                }
+                break;
+
+            case I2C_CMD_READ:
+                trace((cmd & I2C_CMD_ACK_VALUE) ? "READ%uN" : "READ%u", count);
+                if (!run_read(count, cmd & I2C_CMD_ACK_VALUE)) {
+                    return;
+                }
+                break;
+
+            case I2C_CMD_STOP:
+                trace("STOP", 0);
+                bus_bits(1);
+                sim_i2c_stop(hw.sim);
+                hw.int_pending |= I2C_TRANS_COMPLETE_INT;
+                return;
+
+            case I2C_CMD_END:
+                trace("END", 0);
+                hw.int_pending |= I2C_END_DETECT_INT;
+                return;
+
+            default:
+                trace("?%u", op);
+                return;  // The controller hangs: no done interrupt
+        }
+    }
+}
+
+// TRANS_START: the bus sees the list at once, the interrupt comes when
+// its bus time has passed
+static void start_run(void) {
+    hw.stats.runs++;
+    if (hw.int_pending) {
+        hw.stats.busy_starts++;
+    }
+    hw.run_cycles = 0;
+    hw.int_pending = 0;
+    run_commands();
+    hw.done_at = host_cycles_total() + hw.run_cycles;
+}
+
+// SCL_SP_CONF recovery: clock SCL with SDA released, then a STOP
+static void scl_reset(void) {
+    hw.stats.scl_resets++;
+    if (hw.sim->scl_stuck) {
+        return;  // Never finishes: SCL_RST_SLV_EN stays set
+    }
+    uint32_t clocks = (hw.sp_conf >> 1) & 0x1F;
+    for (uint32_t i = 0; i < clocks && hw.sim->sda_stuck; i++) {
+        host_cycles_advance(hw.scl_cycles);
+        if (hw.sim->sda_stuck_clocks > 0 && --hw.sim->sda_stuck_clocks == 0) {
+            hw.sim->sda_stuck = false;
+        }
+    }
+    sim_i2c_stop(hw.sim);
+    hw.sp_conf &= ~I2C_SCL_RST_SLV_EN;
+}
+
+static void write_ctr(uint32_t val) {
+    if (val & I2C_FSM_RST) {
+        hw.stats.fsm_resets++;
+        hw.int_pending = 0;  // Abandons a running list
+    }
+    if (val & I2C_CONF_UPGATE) {
+        latch_timing();
+        if (hw.sp_conf & I2C_SCL_RST_SLV_EN) {
+            scl_reset();
+        }
+    }
+    // TRANS_START, FSM_RST and CONF_UPGATE clear themselves
+    hw.ctr = val & ~(I2C_TRANS_START | I2C_FSM_RST | I2C_CONF_UPGATE);
+    if (val & I2C_TRANS_START) {
+        start_run();
+    }
+}
+
+static uint32_t *other_reg(uint32_t addr) {
+    for (int i = 0; i < hw.other_count; i++) {
+        if (hw.other[i].addr == addr) {
+            return &hw.other[i].val;
+        }
+    }
+    if (hw.other_count == OTHER_REGS) {
+        return NULL;
+    }
+    hw.other[hw.other_count].addr = addr;
+    hw.other[hw.other_count].val = 0;
+    return &hw.other[hw.other_count++].val;
+}
+
+uint32_t i2c_hw_mock_peek(uint32_t addr) {
+    update();
+    if (addr == I2C_CTR_REG) {
+        return hw.ctr;
+    } else if (addr == I2C_INT_RAW_REG) {
+        return hw.int_raw;
+    } else if (addr == I2C_INT_ENA_REG) {
+        return hw.int_ena;
+    } else if (addr == I2C_INT_STATUS_REG) {
+        return hw.int_raw & hw.int_ena;
+    } else if (addr == I2C_SCL_SP_CONF_REG) {
+        return hw.sp_conf;
+    } else if (addr >= I2C_COMD_REG(0) && addr < I2C_COMD_REG(I2C_COMMANDS)) {
+        return hw.comd[(addr - I2C_COMD_REG(0)) / 4];
+    } else if (addr == I2C_CLK_CONF_REG) {
+        return hw.clk_conf;
+    } else if (addr == I2C_SCL_LOW_PERIOD_REG) {
+        return hw.low_period;
+    } else if (addr == I2C_SCL_HIGH_PERIOD_REG) {
+        return hw.high_period;
+    } else if (addr == I2C_TO_REG) {
+        return hw.to;
+    } else if (addr == I2C_DATA_REG) {
+        return hw.rx_count ? hw.rx[hw.rx_head] : 0;
+    }
+    uint32_t *reg = other_reg(addr);
+    return reg ? *reg : 0;
+}
+
+uint32_t i2c_hw_mock_reg_read(uint32_t addr) {
+    host_cycles_advance(I2C_HW_MOCK_ACCESS_CYCLES);
+    if (addr == I2C_INT_RAW_REG) {
+        hw.stats.int_raw_reads++;
+    } else if (addr == I2C_DATA_REG) {
+        if (hw.rx_count == 0) {
+            hw.stats.rx_underflows++;
+            return 0;
+        }
+        uint8_t byte = hw.rx[hw.rx_head];
+        hw.rx_head = (hw.rx_head + 1) % I2C_FIFO_SIZE;
+        hw.rx_count--;
+        return byte;
+    }
+    return i2c_hw_mock_peek(addr);
+}
+
+void i2c_hw_mock_reg_write(uint32_t addr, uint32_t val) {
+    host_cycles_advance(I2C_HW_MOCK_ACCESS_CYCLES);
+
+    if (addr == I2C_CTR_REG) {
+        write_ctr(val);
+    } else if (addr == I2C_DATA_REG) {
+        if (hw.tx_count < I2C_FIFO_SIZE) {
+            hw.tx[hw.tx_count++] = val & 0xFF;
+            if ((uint32_t)hw.tx_count > hw.stats.tx_fifo_max) {
+                hw.stats.tx_fifo_max = hw.tx_count;
+            }
+        } else {
+            hw.stats.tx_overflows++;
+        }
+    } else if (addr == I2C_INT_CLR_REG) {
+        update();
+        hw.int_raw &= ~val;
+    } else if (addr == I2C_INT_ENA_REG) {
+        hw.int_ena = val;
+    } else if (addr == I2C_FIFO_CONF_REG) {
+        if (val & I2C_TX_FIFO_RST) {
+            hw.tx_count = 0;
+        }
+        if (val & I2C_RX_FIFO_RST) {
+            hw.rx_head = 0;
+            hw.rx_count = 0;
+        }
+    } else if (addr >= I2C_COMD_REG(0) && addr < I2C_COMD_REG(I2C_COMMANDS)) {
+        hw.comd[(addr - I2C_COMD_REG(0)) / 4] = val & ~I2C_CMD_DONE;
+    } else if (addr == I2C_SCL_SP_CONF_REG) {
+        hw.sp_conf = val;
+    } else if (addr == I2C_CLK_CONF_REG) {
+        hw.clk_conf = val;
+    } else if (addr == I2C_SCL_LOW_PERIOD_REG) {
+        hw.low_period = val;
+    } else if (addr == I2C_SCL_HIGH_PERIOD_REG) {
+        hw.high_period = val;
+    } else if (addr == I2C_TO_REG) {
+        hw.to = val;
+    } else {
+        uint32_t *reg = other_reg(addr);
+        if (reg) {
+            *reg = val;
+        }
+    }
+}
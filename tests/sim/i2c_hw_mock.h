@@ -0,0 +1,84 @@
+/*
+ * I2C0 controller register model under the hardware driver (i2c_hw.c)
+ *
+ * i2c_hw.c built with this header force-included and I2C_HW_MOCK_HOOKS
+ * defined (see tests/CMakeLists.txt) sends its register accesses to
+ * i2c_hw_mock_reg_read()/i2c_hw_mock_reg_write() instead. The model keeps
+ * the command list (COMD0..7), the 32-byte TX and RX FIFOs and the raw
+ * interrupt bits, and runs the list when TRANS_START is written:
+ *   RSTART   (repeated) START on the simulated bus
+ *   WRITE n  n bytes from the TX FIFO; with ack_check a NACK ends the
+ *            list with NACK_INT
+ *   READ n   n bytes into the RX FIFO, each answered with ack_value
+ *   STOP     STOP, then TRANS_COMPLETE_INT
+ *   END      pause with SCL held low, then END_DETECT_INT
+ * Its effect on the simulated bus is immediate, but its interrupt bits
+ * show in INT_RAW only once the host cycle counter has reached the end
+ * of its bus time, nine SCL periods per byte as the timing registers set
+ * them. The bits enabled in INT_ENA assert an interrupt line
+ * (i2c_hw_mock_irq(), see host.h), which is how the driver learns that a
+ * list has finished. Faults injected on the simulated bus show up
+ * the way the controller reports them: stretching past the TO_REG timeout
+ * and a stuck SCL as TIME_OUT_INT, SDA held low at START as
+ * ARBITRATION_LOST_INT. The SCL_SP_CONF recovery clocks free a slave
+ * holding SDA for sda_stuck_clocks clocks.
+ *
+ * Each run is appended to a trace, so tests can check the command
+ * sequences the driver builds, e.g. "RSTART WRITE1 END | WRITE31 STOP".
+ */
+
+#ifndef I2C_HW_MOCK_H
+#define I2C_HW_MOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sim_i2c.h"
+
+#define I2C_HW_MOCK_TRACE_SIZE 4096
+
+typedef struct {
+    uint32_t runs;              // Command lists started with TRANS_START
+    uint32_t fsm_resets;        // FSM_RST writes
+    uint32_t scl_resets;        // SCL_SP_CONF recovery sequences
+    uint32_t tx_fifo_max;       // Highest TX FIFO fill
+    uint32_t tx_overflows;      // Bytes written to a full TX FIFO (lost)
+    uint32_t tx_underflows;     // WRITE commands that found the FIFO empty
+    uint32_t rx_overflows;      // Bytes read into a full RX FIFO (lost)
+    uint32_t rx_underflows;     // DATA reads with the RX FIFO empty
+    uint32_t busy_starts;       // TRANS_START before the last list finished
+    uint32_t int_raw_reads;     // INT_RAW reads (the driver waits for the interrupt)
+} i2c_hw_mock_stats_t;
+
+// Put the controller on a simulated bus, registers at their reset values
+void i2c_hw_mock_init(sim_i2c_bus_t *sim);
+
+// Simulated bus the controller is on
+sim_i2c_bus_t *i2c_hw_mock_sim(void);
+
+// The controller's interrupt line, for host_irq_attach()
+int i2c_hw_mock_irq(void);
+
+// Command lists run since the last clear
+const char *i2c_hw_mock_trace(void);
+void i2c_hw_mock_trace_clear(void);
+
+void i2c_hw_mock_get_stats(i2c_hw_mock_stats_t *out);
+void i2c_hw_mock_reset_stats(void);
+
+// SCL rate the clock and timing registers give, as last latched with
+// CONF_UPGATE
+uint32_t i2c_hw_mock_scl_freq(void);
+
+// Register value without side effects (DATA not popped)
+uint32_t i2c_hw_mock_peek(uint32_t addr);
+
+// Register hooks for i2c_hw.c
+uint32_t i2c_hw_mock_reg_read(uint32_t addr);
+void i2c_hw_mock_reg_write(uint32_t addr, uint32_t val);
+
+#ifdef I2C_HW_MOCK_HOOKS
+#define I2C_HW_REG_READ(addr)       i2c_hw_mock_reg_read(addr)
+#define I2C_HW_REG_WRITE(addr, val) i2c_hw_mock_reg_write(addr, val)
+#endif
+
+#endif // I2C_HW_MOCK_H
@@ -0,0 +1,328 @@
+/*
+ * Open-drain SDA/SCL line model under the bit-banged driver (see i2c_lines.h)
+ */
+
+#include "i2c_lines.h"
+#include "cpu.h"
+#include "host.h"
+#include <string.h>
+
+// The registers i2c.c touches (ESP32-C3 TRM, GPIO and IO MUX chapters)
+#define GPIO_BASE            0x60004000
+#define IO_MUX_BASE          0x60009000
+#define GPIO_OUT_REG         (GPIO_BASE + 0x0004)
+#define GPIO_OUT_W1TS_REG    (GPIO_BASE + 0x0008)
+#define GPIO_OUT_W1TC_REG    (GPIO_BASE + 0x000C)
+#define GPIO_ENABLE_REG      (GPIO_BASE + 0x0020)
+#define GPIO_ENABLE_W1TS_REG (GPIO_BASE + 0x0024)
+#define GPIO_ENABLE_W1TC_REG (GPIO_BASE + 0x0028)
+#define GPIO_IN_REG          (GPIO_BASE + 0x003C)
+#define GPIO_PIN_REG(n)      (GPIO_BASE + 0x0074 + (n) * 4)
+#define GPIO_PIN_PAD_DRIVER  (1 << 2)
+#define GPIO_PIN_MUX_REG(n)  (IO_MUX_BASE + 0x0004 + (n) * 4)
+
+#define GPIO_PINS 22
+
+// Slave side of the current byte
+typedef enum {
+    SLAVE_IDLE,      // No transaction, or not addressed (wait for START/STOP)
+    SLAVE_RECEIVE,   // Master clocks in a byte (address or data)
+    SLAVE_ACK,       // Slave answers in the ninth clock
+    SLAVE_SEND,      // Slave shifts out a read byte
+    SLAVE_READ_ACK,  // Master answers in the ninth clock
+} slave_state_t;
+
+static struct {
+    sim_i2c_bus_t *sim;
+    uint32_t scl_mask;
+    uint32_t sda_mask;
+
+    // Master side: GPIO and IO MUX registers
+    uint32_t out;
+    uint32_t enable;
+    uint32_t pin[GPIO_PINS];
+    uint32_t mux[GPIO_PINS];
+
+    // Lines as last seen
+    bool scl;
+    bool sda;
+    uint64_t scl_edge;
+
+    // Slave side
+    slave_state_t state;
+    bool address;          // The byte being received is the address
+    int bit;               // Bits of the byte done
+    uint8_t shift;
+    bool ack;              // Slave ACKed the byte (SLAVE_ACK)
+    bool master_ack;       // Master ACKed the read byte (SLAVE_READ_ACK)
+    bool slave_sda_low;    // Slave pulls SDA low (ACK or a 0 bit)
+    bool sda_stuck;        // sim->sda_stuck as last seen
+    uint64_t stretch_until;
+
+    i2c_lines_stats_t stats;
+} lines;
+
+void i2c_lines_reset_stats(void) {
+    memset(&lines.stats, 0, sizeof(lines.stats));
+    lines.stats.scl_low_min = UINT32_MAX;
+    lines.stats.scl_high_min = UINT32_MAX;
+    lines.stats.sda_hold_min = UINT32_MAX;
+}
+
+void i2c_lines_init(sim_i2c_bus_t *sim, int scl_pin, int sda_pin) {
+    memset(&lines, 0, sizeof(lines));
+    lines.sim = sim;
+    lines.scl_mask = 1u << scl_pin;
+    lines.sda_mask = 1u << sda_pin;
+    lines.scl = true;
+    lines.sda = true;
+    i2c_lines_reset_stats();
+}
+
+sim_i2c_bus_t *i2c_lines_sim(void) {
+    return lines.sim;
+}
+
+// Master pulls a line low: output enabled and latched low
+static bool master_low(uint32_t mask) {
+    return (lines.enable & mask) && !(lines.out & mask);
+}
+
+// Master drives a line high: output enabled, latched high, push-pull pad
+static bool master_high(uint32_t mask, int pin) {
+    return (lines.enable & mask) && (lines.out & mask) && !(lines.pin[pin] & GPIO_PIN_PAD_DRIVER);
+}
+
+static int mask_pin(uint32_t mask) {
+    return __builtin_ctz(mask);
+}
+
+static bool slave_scl_low(void) {
+    return lines.sim->scl_stuck || host_cycles_total() < lines.stretch_until;
+}
+
+static bool slave_sda_low(void) {
+    return lines.sim->sda_stuck || lines.slave_sda_low;
+}
+
+bool i2c_lines_scl(void) {
+    return !master_low(lines.scl_mask) && !slave_scl_low();
+}
+
+bool i2c_lines_sda(void) {
+    return !master_low(lines.sda_mask) && !slave_sda_low();
+}
+
+// Put the next bit of the read byte on SDA (MSB first)
+static void slave_send_bit(void) {
+    lines.slave_sda_low = !((lines.shift >> (7 - lines.bit)) & 1);
+}
+
+static void slave_rise(void) {
+    sim_i2c_bus_t *sim = lines.sim;
+    if (sim->sda_stuck && sim->sda_stuck_clocks > 0 && --sim->sda_stuck_clocks == 0) {
+        sim->sda_stuck = false;
+    }
+
+    if (lines.state == SLAVE_RECEIVE && lines.bit < 8) {
+        lines.shift = (lines.shift << 1) | lines.sda;
+        lines.bit++;
+    } else if (lines.state == SLAVE_READ_ACK) {
+        lines.master_ack = !lines.sda;
+    }
+}
+
+static void slave_fall(void) {
+    sim_i2c_bus_t *sim = lines.sim;
+    switch (lines.state) {
+        case SLAVE_RECEIVE:
+            if (lines.bit == 8) {
+                lines.ack = sim_i2c_write(sim, lines.shift);
+                lines.slave_sda_low = lines.ack;
+                lines.state = SLAVE_ACK;
+            }
+            break;
+
+        case SLAVE_ACK:
+            lines.slave_sda_low = false;
+            lines.bit = 0;
+            lines.shift = 0;
+            if (!lines.ack) {
+                lines.state = SLAVE_IDLE;
+            } else if (lines.address && sim->reading) {
+                lines.shift = sim_i2c_read_next(sim);
+                lines.state = SLAVE_SEND;
+                slave_send_bit();
+            } else {
+                lines.state = SLAVE_RECEIVE;
+            }
+            lines.address = false;
+            lines.stretch_until = host_cycles_total() + (uint64_t)sim->stretch_us * (CPU_FREQ_HZ / 1000000);
+            break;
+
+        case SLAVE_SEND:
+            if (++lines.bit < 8) {
+                slave_send_bit();
+            } else {
+                lines.slave_sda_low = false;  // Master's ACK slot
+                lines.state = SLAVE_READ_ACK;
+            }
+            break;
+
+        case SLAVE_READ_ACK:
+            sim_i2c_read_done(sim, lines.shift, lines.master_ack);
+            lines.bit = 0;
+            if (lines.master_ack) {
+                lines.shift = sim_i2c_read_next(sim);
+                lines.state = SLAVE_SEND;
+                slave_send_bit();
+            } else {
+                lines.state = SLAVE_IDLE;  // Master is done: STOP or repeated START next
+            }
+            lines.stretch_until = host_cycles_total() + (uint64_t)sim->stretch_us * (CPU_FREQ_HZ / 1000000);
+            break;
+
+        case SLAVE_IDLE:
+            break;
+    }
+}
+
+// SDA changed while SCL is high: START, STOP, or a glitch in mid-byte
+static void slave_sda_edge(bool sda) {
+    // Legal only where the next byte would start: right after its first
+    // rising SCL edge (which the slave took as bit 7) or before it
+    bool mid_byte = (lines.state == SLAVE_RECEIVE && lines.bit > 1) ||
+                    (lines.state == SLAVE_SEND && lines.bit > 0) ||
+                    lines.state == SLAVE_ACK || lines.state == SLAVE_READ_ACK;
+    if (mid_byte) {
+        lines.stats.glitches++;
+    }
+
+    lines.slave_sda_low = false;
+    lines.bit = 0;
+    lines.shift = 0;
+    if (!sda) {
+        sim_i2c_start(lines.sim);
+        lines.state = SLAVE_RECEIVE;
+        lines.address = true;
+    } else {
+        sim_i2c_stop(lines.sim);
+        lines.state = SLAVE_IDLE;
+    }
+}
+
+// Work out both lines and let the slave react to what changed
+static void lines_update(void) {
+    int scl_pin = mask_pin(lines.scl_mask);
+    int sda_pin = mask_pin(lines.sda_mask);
+    if ((slave_scl_low() && master_high(lines.scl_mask, scl_pin)) ||
+        (slave_sda_low() && master_high(lines.sda_mask, sda_pin))) {
+        lines.stats.contention++;
+    }
+
+    // Each settled change can make the slave change SDA in turn
+    for (int pass = 0; pass < 4; pass++) {
+        bool scl = i2c_lines_scl();
+        bool sda = i2c_lines_sda();
+        uint64_t now = host_cycles_total();
+
+        if (scl != lines.scl) {
+            uint32_t phase = (uint32_t)(now - lines.scl_edge);
+            lines.scl = scl;
+            lines.scl_edge = now;
+            if (scl) {
+                if (phase < lines.stats.scl_low_min && lines.stats.falls) {
+                    lines.stats.scl_low_min = phase;
+                }
+                lines.stats.scl_rises++;
+                lines.sda = sda;
+                slave_rise();
+            } else {
+                if (phase < lines.stats.scl_high_min && lines.stats.scl_rises) {
+                    lines.stats.scl_high_min = phase;
+                }
+                if (lines.stats.falls++ == 0) {
+                    lines.stats.first_fall = now;
+                }
+                lines.stats.last_fall = now;
+                lines.sda = sda;
+                slave_fall();
+            }
+        } else if (sda != lines.sda) {
+            lines.sda = sda;
+            if (lines.sim->sda_stuck != lines.sda_stuck) {
+                // The stuck slave grabbed or let go of SDA: not the master's
+                // START or STOP, and whatever byte was under way is lost
+                lines.sda_stuck = lines.sim->sda_stuck;
+                lines.slave_sda_low = false;
+                lines.state = SLAVE_IDLE;
+            } else if (scl) {
+                slave_sda_edge(sda);
+            }
+        } else {
+            return;
+        }
+    }
+}
+
+uint32_t i2c_lines_reg_read(uint32_t addr) {
+    host_cycles_advance(I2C_LINES_ACCESS_CYCLES);
+    lines_update();  // A stretch may have ended since the last access
+
+    if (addr == GPIO_IN_REG) {
+        return (i2c_lines_scl() ? lines.scl_mask : 0) | (i2c_lines_sda() ? lines.sda_mask : 0);
+    } else if (addr == GPIO_OUT_REG) {
+        return lines.out;
+    } else if (addr == GPIO_ENABLE_REG) {
+        return lines.enable;
+    } else if (addr >= GPIO_PIN_REG(0) && addr < GPIO_PIN_REG(GPIO_PINS)) {
+        return lines.pin[(addr - GPIO_PIN_REG(0)) / 4];
+    } else if (addr >= GPIO_PIN_MUX_REG(0) && addr < GPIO_PIN_MUX_REG(GPIO_PINS)) {
+        return lines.mux[(addr - GPIO_PIN_MUX_REG(0)) / 4];
+    }
+    return 0;
+}
+
+void i2c_lines_reg_write(uint32_t addr, uint32_t val) {
+    host_cycles_advance(I2C_LINES_ACCESS_CYCLES);
+    uint32_t out = lines.out;
+
+    if (addr == GPIO_OUT_W1TS_REG) {
+        lines.out |= val;
+    } else if (addr == GPIO_OUT_W1TC_REG) {
+        lines.out &= ~val;
+    } else if (addr == GPIO_OUT_REG) {
+        lines.out = val;
+    } else if (addr == GPIO_ENABLE_REG) {
+        lines.enable = val;
+    } else if (addr == GPIO_ENABLE_W1TS_REG) {
+        lines.enable |= val;
+    } else if (addr == GPIO_ENABLE_W1TC_REG) {
+        lines.enable &= ~val;
+    } else if (addr >= GPIO_PIN_REG(0) && addr < GPIO_PIN_REG(GPIO_PINS)) {
+        lines.pin[(addr - GPIO_PIN_REG(0)) / 4] = val;
+    } else if (addr >= GPIO_PIN_MUX_REG(0) && addr < GPIO_PIN_MUX_REG(GPIO_PINS)) {
+        lines.mux[(addr - GPIO_PIN_MUX_REG(0)) / 4] = val;
+    }
+
+    // The master moved SDA while SCL is low: time since the fall
+    if (((out ^ lines.out) & lines.sda_mask) && !lines.scl && lines.stats.falls) {
+        uint32_t hold = (uint32_t)(host_cycles_total() - lines.scl_edge);
+        if (hold < lines.stats.sda_hold_min) {
+            lines.stats.sda_hold_min = hold;
+        }
+    }
+    lines_update();
+}
+
+void i2c_lines_get_stats(i2c_lines_stats_t *out) {
+    *out = lines.stats;
+}
+
+uint32_t i2c_lines_scl_freq(void) {
+    if (lines.stats.falls < 2) {
+        return 0;
+    }
+    uint64_t cycles = lines.stats.last_fall - lines.stats.first_fall;
+    return cycles ? (uint32_t)((uint64_t)CPU_FREQ_HZ * (lines.stats.falls - 1) / cycles) : 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * Open-drain SDA/SCL line model under the bit-banged driver (i2c.c)
+ *
+ * i2c.c built with this header force-included and I2C_LINES_HOOKS defined
+ * (see tests/CMakeLists.txt) sends its GPIO and IO MUX register accesses
+ * to i2c_lines_reg_read()/i2c_lines_reg_write() instead. The
+ * model keeps the output latch, the output enables and the pad settings,
+ * works out both line levels as the wired-AND of the master and the
+ * slaves, and plays the slave side bit by bit: START and STOP from SDA
+ * edges while SCL is high, data sampled on rising SCL, ACKs and read
+ * bits driven after falling SCL. Whole bytes go to the simulated bus
+ * (sim_i2c), so device models and injected faults are the same as with
+ * the fake driver:
+ * - nack_bytes / nack_addr: the slave leaves SDA released in the ACK slot
+ * - stretch_us: SCL held low for that long after every ACK slot
+ * - sda_stuck / sda_stuck_clocks, scl_stuck: lines held low
+ *
+ * Every register access costs a few cycles (I2C_LINES_ACCESS_CYCLES), like
+ * an APB access on the target, and every SCL edge is timed, so tests can
+ * check the clock the driver really produces.
+ */
+
+#ifndef I2C_LINES_H
+#define I2C_LINES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sim_i2c.h"
+
+// Cycles one GPIO register access takes
+#ifndef I2C_LINES_ACCESS_CYCLES
+#define I2C_LINES_ACCESS_CYCLES 6
+#endif
+
+typedef struct {
+    uint32_t scl_rises;         // Rising SCL edges since the last reset
+    uint32_t scl_low_min;       // Shortest low / high phase, in cycles
+    uint32_t scl_high_min;
+    uint64_t first_fall;        // Time of the first / last falling edge
+    uint64_t last_fall;
+    uint32_t falls;             // Falling SCL edges
+    uint32_t contention;        // Accesses where the master drove a line high
+                                // while a slave pulled it low (push-pull pad)
+    uint32_t glitches;          // SDA changes while SCL was high in mid-byte
+    uint32_t sda_hold_min;      // Shortest time from SCL falling to the
+                                // master changing SDA (tHD;DAT), in cycles
+} i2c_lines_stats_t;
+
+// Wire SCL and SDA of GPIO pins scl_pin and sda_pin to a simulated bus
+void i2c_lines_init(sim_i2c_bus_t *sim, int scl_pin, int sda_pin);
+
+// Simulated bus the lines are wired to
+sim_i2c_bus_t *i2c_lines_sim(void);
+
+// Line levels as any device on the bus sees them
+bool i2c_lines_scl(void);
+bool i2c_lines_sda(void);
+
+// Edge timing and protocol checks
+void i2c_lines_get_stats(i2c_lines_stats_t *out);
+void i2c_lines_reset_stats(void);
+
+// SCL rate over the falling edges since the last reset (0 if fewer than two)
+uint32_t i2c_lines_scl_freq(void);
+
+// Register hooks for i2c.c
+uint32_t i2c_lines_reg_read(uint32_t addr);
+void i2c_lines_reg_write(uint32_t addr, uint32_t val);
+
+#ifdef I2C_LINES_HOOKS
+#define I2C_GPIO_REG_READ(addr)       i2c_lines_reg_read(addr)
+#define I2C_GPIO_REG_WRITE(addr, val) i2c_lines_reg_write(addr, val)
+#endif
+
+#endif // I2C_LINES_H
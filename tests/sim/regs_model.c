@@ -0,0 +1,45 @@
+/*
+ * Register-file sensor model (see regs_model.h)
+ */
+
+#include "regs_model.h"
+#include <string.h>
+
+static bool regs_model_start(sim_i2c_device_t *dev, bool read) {
+    regs_model_t *r = (regs_model_t *)dev;
+    r->pointer_set = false;
+    return true;
+}
+
+static bool regs_model_write(sim_i2c_device_t *dev, uint8_t byte) {
+    regs_model_t *r = (regs_model_t *)dev;
+    if (!r->pointer_set) {
+        r->pointer = byte;
+        r->pointer_set = true;
+        return true;
+    }
+
+    if (r->read_only[r->pointer]) {
+        r->ignored_writes++;
+    } else {
+        r->regs[r->pointer] = byte;
+        r->reg_writes++;
+    }
+    r->pointer++;
+    return true;
+}
+
+static uint8_t regs_model_read(sim_i2c_device_t *dev) {
+    regs_model_t *r = (regs_model_t *)dev;
+    r->reg_reads++;
+    return r->regs[r->pointer++];
+}
+
+void regs_model_init(regs_model_t *r, uint8_t addr) {
+    memset(r, 0, sizeof(*r));
+    r->dev.name = "regs";
+    r->dev.addr = addr;
+    r->dev.start = regs_model_start;
+    r->dev.write = regs_model_write;
+    r->dev.read = regs_model_read;
+}
@@ -0,0 +1,35 @@
+/*
+ * Register-file sensor model
+ *
+ * The common layout of I2C sensors: the first byte of a write selects a
+ * register, further bytes are written from there on, and reads return
+ * registers from the selected one on. The register pointer advances
+ * after each byte. Read-only registers (a WHO_AM_I, measurement results)
+ * ignore writes; the test sets their values directly.
+ */
+
+#ifndef REGS_MODEL_H
+#define REGS_MODEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sim_i2c.h"
+
+typedef struct {
+    sim_i2c_device_t dev;  // Attach &regs.dev to a bus
+
+    uint8_t regs[256];
+    bool read_only[256];
+    uint8_t pointer;
+    bool pointer_set;       // First byte of this write selected the register
+
+    // Counters
+    uint32_t reg_writes;
+    uint32_t reg_reads;
+    uint32_t ignored_writes;  // Writes to read-only registers
+} regs_model_t;
+
+// Registers start at 0, all writable
+void regs_model_init(regs_model_t *r, uint8_t addr);
+
+#endif // REGS_MODEL_H
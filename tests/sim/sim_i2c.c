@@ -0,0 +1,136 @@
+/*
+ * Simulated I2C bus: byte-level slave side shared by all transports
+ */
+
+#include "sim_i2c.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+void sim_i2c_init(sim_i2c_bus_t *bus) {
+    memset(bus, 0, sizeof(*bus));
+    bus->sda_stuck_clocks = -1;
+}
+
+void sim_i2c_attach(sim_i2c_bus_t *bus, sim_i2c_device_t *dev) {
+    if (bus->count < SIM_I2C_MAX_DEVICES) {
+        bus->devices[bus->count++] = dev;
+    }
+}
+
+void sim_i2c_log_clear(sim_i2c_bus_t *bus) {
+    bus->log_len = 0;
+    bus->log[0] = '\0';
+}
+
+void sim_i2c_log(sim_i2c_bus_t *bus, const char *fmt, ...) {
+    if (!bus->logging || bus->log_len >= SIM_I2C_LOG_SIZE - 1) {
+        return;
+    }
+    if (bus->log_len > 0) {
+        bus->log[bus->log_len++] = ' ';
+    }
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(bus->log + bus->log_len, SIM_I2C_LOG_SIZE - bus->log_len, fmt, args);
+    va_end(args);
+    if (n > 0) {
+        bus->log_len += n;
+        if (bus->log_len > SIM_I2C_LOG_SIZE - 1) {
+            bus->log_len = SIM_I2C_LOG_SIZE - 1;
+        }
+    }
+}
+
+// End the addressed device's part of the transaction
+static void sim_i2c_release(sim_i2c_bus_t *bus) {
+    if (bus->active && bus->active->stop) {
+        bus->active->stop(bus->active);
+    }
+    bus->active = NULL;
+}
+
+void sim_i2c_start(sim_i2c_bus_t *bus) {
+    sim_i2c_release(bus);
+    bus->transactions++;
+    bus->in_transaction = true;
+    bus->expect_addr = true;
+    bus->reading = false;
+    sim_i2c_log(bus, "S");
+}
+
+// Take one byte of an injected NACK burst
+static bool sim_i2c_nack_injected(sim_i2c_bus_t *bus) {
+    if (bus->nack_bytes > 0) {
+        bus->nack_bytes--;
+        return true;
+    }
+    return false;
+}
+
+bool sim_i2c_write(sim_i2c_bus_t *bus, uint8_t byte) {
+    bus->bytes++;
+    bool ack = false;
+
+    if (!bus->in_transaction) {
+        // Bytes outside START/STOP are ignored by every slave
+    } else if (bus->expect_addr) {
+        bus->expect_addr = false;
+        bus->reading = byte & 1;
+        uint8_t addr = byte >> 1;
+        if (addr != bus->nack_addr || bus->nack_addr == 0) {
+            for (int i = 0; i < bus->count; i++) {
+                sim_i2c_device_t *dev = bus->devices[i];
+                if (dev->addr == addr && (!dev->start || dev->start(dev, bus->reading))) {
+                    bus->active = dev;
+                    ack = true;
+                    break;
+                }
+            }
+        }
+        if (ack && sim_i2c_nack_injected(bus)) {
+            sim_i2c_release(bus);
+            ack = false;
+        }
+    } else if (bus->active && !bus->reading) {
+        ack = !bus->active->write || bus->active->write(bus->active, byte);
+        if (ack && sim_i2c_nack_injected(bus)) {
+            ack = false;
+        }
+    }
+
+    if (!ack) {
+        bus->nacks++;
+    }
+    sim_i2c_log(bus, ack ? "%02X" : "%02X!", byte);
+    return ack;
+}
+
+uint8_t sim_i2c_read_next(sim_i2c_bus_t *bus) {
+    uint8_t byte = 0xFF;  // Nobody drives SDA: the pull-up reads as ones
+    if (bus->in_transaction && bus->active && bus->reading && bus->active->read) {
+        byte = bus->active->read(bus->active);
+    }
+    return byte;
+}
+
+void sim_i2c_read_done(sim_i2c_bus_t *bus, uint8_t byte, bool ack) {
+    bus->bytes_read++;
+    sim_i2c_log(bus, ack ? "R%02X" : "R%02X!", byte);
+}
+
+uint8_t sim_i2c_read(sim_i2c_bus_t *bus, bool ack) {
+    uint8_t byte = sim_i2c_read_next(bus);
+    sim_i2c_read_done(bus, byte, ack);
+    return byte;
+}
+
+void sim_i2c_stop(sim_i2c_bus_t *bus) {
+    sim_i2c_release(bus);
+    if (bus->in_transaction) {
+        bus->stops++;
+    }
+    bus->in_transaction = false;
+    bus->expect_addr = false;
+    sim_i2c_log(bus, "P");
+}
@@ -0,0 +1,90 @@
+/*
+ * Simulated I2C bus for host tests
+ *
+ * A bus holds device models and plays the slave side of the protocol at
+ * byte level. The transports that connect a driver to it all end up in
+ * the sim_i2c_* calls below:
+ *   i2c_fake.c     - i2c.h implemented directly on top of the bus
+ *   i2c_lines.c    - SDA/SCL line model under the bit-banged i2c.c
+ *   i2c_hw_mock.c  - I2C0 register model under i2c_hw.c
+ *
+ * Faults (NACKs, clock stretching, stuck lines) are injected on the bus,
+ * so every transport sees the same device behaviour.
+ */
+
+#ifndef SIM_I2C_H
+#define SIM_I2C_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SIM_I2C_MAX_DEVICES 8
+#define SIM_I2C_LOG_SIZE    4096
+
+typedef struct sim_i2c_device sim_i2c_device_t;
+
+// A device model. Unused callbacks may be NULL.
+struct sim_i2c_device {
+    const char *name;
+    uint8_t addr;  // 7-bit address
+
+    // Addressed after a (repeated) START; return false to NACK
+    bool (*start)(sim_i2c_device_t *dev, bool read);
+    // Byte written by the master; return false to NACK
+    bool (*write)(sim_i2c_device_t *dev, uint8_t byte);
+    // Next byte for the master to read
+    uint8_t (*read)(sim_i2c_device_t *dev);
+    // STOP, or a repeated START that ends this device's part
+    void (*stop)(sim_i2c_device_t *dev);
+};
+
+typedef struct {
+    sim_i2c_device_t *devices[SIM_I2C_MAX_DEVICES];
+    int count;
+
+    // Protocol state
+    sim_i2c_device_t *active;  // Addressed device, NULL if none answered
+    bool expect_addr;          // Next byte written is an address
+    bool reading;
+    bool in_transaction;
+
+    // Fault injection
+    int nack_bytes;            // NACK this many of the next bytes written
+    uint8_t nack_addr;         // NACK every address byte of this device (0 = off)
+    uint32_t stretch_us;       // Slaves hold SCL low this long after each byte
+    bool sda_stuck;            // A slave holds SDA low
+    int sda_stuck_clocks;      // ... until this many SCL clocks free it (-1 = never)
+    bool scl_stuck;            // A slave holds SCL low for good
+
+    // Traffic, as the slaves saw it
+    uint32_t transactions;     // STARTs, repeated ones included
+    uint32_t stops;
+    uint32_t bytes;            // Bytes written, address bytes included
+    uint32_t bytes_read;
+    uint32_t nacks;
+
+    // Protocol log, when enabled: "S 78 00 AE P" for a write, with "!" after
+    // a NACKed byte and "R5A" for a byte read ("R5A!" when the master NACKed)
+    bool logging;
+    char log[SIM_I2C_LOG_SIZE];
+    int log_len;
+} sim_i2c_bus_t;
+
+void sim_i2c_init(sim_i2c_bus_t *bus);
+void sim_i2c_attach(sim_i2c_bus_t *bus, sim_i2c_device_t *dev);
+
+// Slave side of the protocol, driven by a transport
+void sim_i2c_start(sim_i2c_bus_t *bus);
+bool sim_i2c_write(sim_i2c_bus_t *bus, uint8_t byte);  // Address or data; true = ACK
+uint8_t sim_i2c_read(sim_i2c_bus_t *bus, bool ack);
+// The same in two steps, for transports that put the byte on the wire
+// before the master's ACK is known
+uint8_t sim_i2c_read_next(sim_i2c_bus_t *bus);
+void sim_i2c_read_done(sim_i2c_bus_t *bus, uint8_t byte, bool ack);
+void sim_i2c_stop(sim_i2c_bus_t *bus);
+
+// Protocol log
+void sim_i2c_log_clear(sim_i2c_bus_t *bus);
+void sim_i2c_log(sim_i2c_bus_t *bus, const char *fmt, ...);
+
+#endif // SIM_I2C_H
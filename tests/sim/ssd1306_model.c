@@ -0,0 +1,265 @@
+/*
+ * SSD1306 / SH1106 controller model (see ssd1306_model.h)
+ *
+ * Based on the SSD1306 datasheet rev 1.1 and the SH1106 datasheet v2.3
+ */
+
+#include "ssd1306_model.h"
+#include <string.h>
+
+// Argument bytes a command takes; -1 if the chip has no such command
+static int ssd1306_model_args(const ssd1306_model_t *m, uint8_t c) {
+    if (c <= 0x1F || (c >= 0x40 && c <= 0x7F) || (c >= 0xB0 && c <= 0xB7)) {
+        return 0;  // Column nibbles, start line, page start
+    }
+    switch (c) {
+        case 0xA0: case 0xA1: case 0xA4: case 0xA5: case 0xA6: case 0xA7:
+        case 0xAE: case 0xAF: case 0xC0: case 0xC8: case 0xE3:
+            return 0;
+        case 0x81: case 0xA8: case 0xAD: case 0xD3: case 0xD5: case 0xD9:
+        case 0xDA: case 0xDB:
+            return 1;
+    }
+    if (m->chip == SSD1306_MODEL_SH1106) {
+        switch (c) {
+            case 0x30: case 0x31: case 0x32: case 0x33:  // Pump voltage
+            case 0xE0: case 0xEE:                        // Read-modify-write
+                return 0;
+        }
+        return -1;
+    }
+    switch (c) {
+        case 0x20: case 0x8D:
+            return 1;
+        case 0x21: case 0x22: case 0xA3:
+            return 2;
+        case 0x29: case 0x2A:
+            return 5;
+        case 0x26: case 0x27:
+            return 6;
+        case 0x2E: case 0x2F:
+            return 0;
+    }
+    return -1;
+}
+
+// Run a complete command
+static void ssd1306_model_execute(ssd1306_model_t *m) {
+    const uint8_t *c = m->cmd;
+    m->commands++;
+
+    if (c[0] <= 0x0F) {
+        m->column = (m->column & 0xF0) | c[0];
+    } else if (c[0] <= 0x1F) {
+        m->column = (m->column & 0x0F) | ((c[0] & 0x0F) << 4);
+    } else if (c[0] >= 0x40 && c[0] <= 0x7F) {
+        m->start_line = c[0] & 0x3F;
+        m->start_line_commands++;
+    } else if (c[0] >= 0xB0 && c[0] <= 0xB7) {
+        m->page = c[0] & 0x07;
+    } else {
+        switch (c[0]) {
+            case 0x20: m->mode = c[1] & 3; break;
+            case 0x21:
+                m->column_start = m->column = c[1] & 0x7F;
+                m->column_end = c[2] & 0x7F;
+                break;
+            case 0x22:
+                m->page_start = m->page = c[1] & 7;
+                m->page_end = c[2] & 7;
+                break;
+            case 0x81: m->contrast = c[1]; break;
+            case 0x8D: m->charge_pump = (c[1] & 0x04) != 0; break;
+            case 0xA0: case 0xA1: m->seg_remap = c[0] & 1; break;
+            case 0xA4: case 0xA5: m->entire_on = c[0] & 1; break;
+            case 0xA6: case 0xA7: m->inverted = c[0] & 1; break;
+            case 0xA8: m->multiplex = (c[1] & 0x3F) + 1; break;
+            case 0xAE: case 0xAF: m->display_on = c[0] & 1; break;
+            case 0xC0: case 0xC8: m->com_reverse = c[0] == 0xC8; break;
+            case 0xD3: m->display_offset = c[1] & 0x3F; break;
+            case 0xDA: m->com_pins = c[1]; break;
+        }
+    }
+}
+
+static void ssd1306_model_command(ssd1306_model_t *m, uint8_t byte) {
+    m->command_bytes++;
+    if (m->cmd_len == 0) {
+        int args = ssd1306_model_args(m, byte);
+        if (args < 0) {
+            m->unknown_commands++;
+            return;
+        }
+        m->cmd_need = args + 1;
+    }
+    m->cmd[m->cmd_len++] = byte;
+    if (m->cmd_len == m->cmd_need) {
+        ssd1306_model_execute(m);
+        m->cmd_len = 0;
+    }
+}
+
+// Store a GDDRAM byte and advance the address pointer
+static void ssd1306_model_data(ssd1306_model_t *m, uint8_t byte) {
+    m->data_bytes++;
+    if (m->column < m->ram_columns) {
+        m->gram[m->page][m->column] = byte;
+    }
+
+    if (m->chip == SSD1306_MODEL_SH1106 || m->mode == 2) {
+        // Page addressing: the column advances within the page
+        // (the SSD1306 wraps to column 0, the SH1106 stops at the end)
+        if (m->column < m->ram_columns) {
+            m->column++;
+        }
+        if (m->chip == SSD1306_MODEL_SSD1306 && m->column == m->ram_columns) {
+            m->column = 0;
+        }
+    } else if (m->mode == 0) {
+        if (m->column == m->column_end) {
+            m->column = m->column_start;
+            m->page = m->page == m->page_end ? m->page_start : m->page + 1;
+        } else {
+            m->column = (m->column + 1) & 0x7F;
+        }
+    } else {
+        if (m->page == m->page_end) {
+            m->page = m->page_start;
+            m->column = m->column == m->column_end ? m->column_start : m->column + 1;
+        } else {
+            m->page++;
+        }
+    }
+}
+
+static bool ssd1306_model_start(sim_i2c_device_t *dev, bool read) {
+    ssd1306_model_t *m = (ssd1306_model_t *)dev;
+    m->transactions++;
+    m->expect_control = true;
+    return !read;  // Write-only over I2C in this model
+}
+
+static bool ssd1306_model_write(sim_i2c_device_t *dev, uint8_t byte) {
+    ssd1306_model_t *m = (ssd1306_model_t *)dev;
+    if (m->expect_control) {
+        m->single = byte & 0x80;
+        m->data = byte & 0x40;
+        m->expect_control = false;
+        return true;
+    }
+
+    if (m->data) {
+        ssd1306_model_data(m, byte);
+    } else {
+        ssd1306_model_command(m, byte);
+    }
+    if (m->single) {
+        m->expect_control = true;
+    }
+    return true;
+}
+
+static void ssd1306_model_stop(sim_i2c_device_t *dev) {
+    ssd1306_model_t *m = (ssd1306_model_t *)dev;
+    if (m->cmd_len) {
+        m->truncated_commands++;
+        m->cmd_len = 0;
+    }
+}
+
+void ssd1306_model_init(ssd1306_model_t *m, ssd1306_model_chip_t chip, uint8_t addr,
+                        int width, int height, int column_offset) {
+    memset(m, 0, sizeof(*m));
+    m->dev.name = chip == SSD1306_MODEL_SH1106 ? "sh1106" : "ssd1306";
+    m->dev.addr = addr;
+    m->dev.start = ssd1306_model_start;
+    m->dev.write = ssd1306_model_write;
+    m->dev.stop = ssd1306_model_stop;
+
+    m->chip = chip;
+    m->width = width;
+    m->height = height;
+    m->column_offset = column_offset;
+    m->ram_columns = chip == SSD1306_MODEL_SH1106 ? 132 : 128;
+
+    // Reset values (datasheet command tables)
+    m->mode = 2;  // Both chips come up in page addressing
+    m->column_end = 127;
+    m->page_end = 7;
+    m->multiplex = 64;
+    m->contrast = 0x7F;
+    m->com_pins = 0x12;
+
+    for (int page = 0; page < 8; page++) {
+        for (int col = 0; col < 132; col++) {
+            m->gram[page][col] = (uint8_t)(0xA5 ^ (page * 31 + col * 7));
+        }
+    }
+}
+
+int ssd1306_model_pixel(const ssd1306_model_t *m, int x, int y) {
+    if (x < 0 || x >= m->width || y < 0 || y >= m->height) {
+        return 0;
+    }
+    if (!m->display_on) {
+        return 0;
+    }
+    if (m->entire_on) {
+        return 1;
+    }
+
+    // Glass column x sits on the segment that shows RAM column
+    // x + column_offset with the remap on; without it the columns run
+    // the other way across the RAM
+    int column = x + m->column_offset;
+    if (!m->seg_remap) {
+        column = m->ram_columns - 1 - column;
+    }
+
+    // Glass row y is driven by the COM line that scans RAM row y from the
+    // start line in reverse scan; normal scan runs the other way
+    if (y >= m->multiplex) {
+        return 0;
+    }
+    int line = m->com_reverse ? y : m->multiplex - 1 - y;
+    int row = (line + m->start_line + m->display_offset) & 63;
+
+    int lit = (m->gram[row / 8][column] >> (row & 7)) & 1;
+    return m->inverted ? !lit : lit;
+}
+
+int ssd1306_model_compare(const ssd1306_model_t *m, int (*expected)(int x, int y)) {
+    int differ = 0;
+    for (int y = 0; y < m->height; y++) {
+        for (int x = 0; x < m->width; x++) {
+            differ += ssd1306_model_pixel(m, x, y) != (expected(x, y) != 0);
+        }
+    }
+    return differ;
+}
+
+bool ssd1306_model_write_pbm(const ssd1306_model_t *m, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "P1\n%d %d\n", m->width, m->height);
+    for (int y = 0; y < m->height; y++) {
+        for (int x = 0; x < m->width; x++) {
+            fputc(ssd1306_model_pixel(m, x, y) ? '1' : '0', f);
+            if ((x & 63) == 63 || x == m->width - 1) {
+                fputc('\n', f);
+            }
+        }
+    }
+    return fclose(f) == 0;
+}
+
+void ssd1306_model_print(const ssd1306_model_t *m, FILE *out) {
+    for (int y = 0; y < m->height; y++) {
+        for (int x = 0; x < m->width; x++) {
+            fputc(ssd1306_model_pixel(m, x, y) ? '#' : '.', out);
+        }
+        fputc('\n', out);
+    }
+}
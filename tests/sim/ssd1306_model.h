@@ -0,0 +1,97 @@
+/*
+ * SSD1306 / SH1106 controller model
+ *
+ * Decodes the I2C byte stream the way the controller does - control
+ * bytes, commands with their arguments, the addressing modes and the
+ * column/page window - into a model GDDRAM, and shows it through the
+ * start line, segment remap, COM scan direction, invert and on/off state
+ * as the glass would. What the tests compare is what the panel shows,
+ * not what the driver meant to send.
+ *
+ * The glass is assumed mounted the way the driver's default orientation
+ * expects (SEG remap 0xA1, COM scan 0xC8 show the RAM upright).
+ */
+
+#ifndef SSD1306_MODEL_H
+#define SSD1306_MODEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "sim_i2c.h"
+
+typedef enum {
+    SSD1306_MODEL_SSD1306,  // 128-column RAM, horizontal/vertical/page addressing
+    SSD1306_MODEL_SH1106,   // 132-column RAM, page addressing only
+} ssd1306_model_chip_t;
+
+typedef struct {
+    sim_i2c_device_t dev;  // Attach &model.dev to a bus
+    ssd1306_model_chip_t chip;
+
+    // Glass: visible size and the first RAM column it shows
+    int width;
+    int height;
+    int column_offset;
+    int ram_columns;
+
+    uint8_t gram[8][132];
+
+    // Control byte state
+    bool expect_control;
+    bool single;            // Co set: one byte, then another control byte
+    bool data;              // D/C#
+
+    // Command being assembled
+    uint8_t cmd[8];
+    int cmd_len;
+    int cmd_need;
+
+    // Addressing
+    int mode;               // 0 horizontal, 1 vertical, 2 page
+    int column, page;
+    int column_start, column_end;
+    int page_start, page_end;
+
+    // Display state
+    int start_line;
+    int display_offset;
+    int multiplex;          // Rows driven (multiplex ratio + 1)
+    bool seg_remap;
+    bool com_reverse;
+    bool inverted;
+    bool entire_on;
+    bool display_on;
+    uint8_t contrast;
+    uint8_t com_pins;
+    bool charge_pump;
+
+    // Counters
+    uint32_t transactions;
+    uint32_t data_bytes;
+    uint32_t command_bytes;
+    uint32_t commands;
+    uint32_t start_line_commands;
+    uint32_t unknown_commands;    // Bytes that are no command of this chip
+    uint32_t truncated_commands;  // Commands whose arguments a STOP cut off
+} ssd1306_model_t;
+
+// Set up a model at power-on state (RAM content is random on real parts;
+// the model fills it with a pattern so a missed byte shows up)
+void ssd1306_model_init(ssd1306_model_t *m, ssd1306_model_chip_t chip, uint8_t addr,
+                        int width, int height, int column_offset);
+
+// Pixel as the glass shows it (x, y from the top left), 1 = lit
+int ssd1306_model_pixel(const ssd1306_model_t *m, int x, int y);
+
+// Count the pixels that differ from an expected image
+// expected(x, y) returns 1 for a lit pixel.
+int ssd1306_model_compare(const ssd1306_model_t *m, int (*expected)(int x, int y));
+
+// Write what the glass shows as a plain PBM (P1) image
+bool ssd1306_model_write_pbm(const ssd1306_model_t *m, const char *path);
+
+// Print the glass as text ('#' lit, '.' dark), for failing tests
+void ssd1306_model_print(const ssd1306_model_t *m, FILE *out);
+
+#endif // SSD1306_MODEL_H
@@ -0,0 +1,42 @@
+/*
+ * Minimal test helpers for the host tests
+ *
+ * CHECK() records a failure and carries on, so one run shows every
+ * broken expectation; test_done() turns the count into the exit status
+ * ctest looks at.
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+static int test_failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            test_failures++; \
+        } \
+    } while (0)
+
+// Compare two integers and print both on a mismatch
+#define CHECK_EQ(a, b) do { \
+        long long a_ = (long long)(a), b_ = (long long)(b); \
+        if (a_ != b_) { \
+            fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", \
+                    __FILE__, __LINE__, #a, #b, a_, b_); \
+            test_failures++; \
+        } \
+    } while (0)
+
+static inline int test_done(const char *name) {
+    if (test_failures) {
+        fprintf(stderr, "%s: %d check(s) failed\n", name, test_failures);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
+
+#endif // TEST_H
@@ -0,0 +1,105 @@
+/*
+ * Bytes on the wire per drawing operation
+ *
+ * Regression test for dirty tracking: an update sends the changed
+ * columns of the changed pages and nothing else. Counted on the fake bus
+ * as the panel receives them, address and control bytes included.
+ */
+
+#include "test.h"
+#include "display_fixture.h"
+#include "shell.h"
+#include "textgrid.h"
+#include <string.h>
+
+// Bus bytes a window costs on top of its data (see SSD1306_WINDOW_COST)
+#if SSD1306_PAGE_ADDRESSING
+#define WINDOW_OVERHEAD 8
+#else
+#define WINDOW_OVERHEAD 11
+#endif
+
+static uint32_t update_bytes(void) {
+    fixture_bus_bytes();
+    ssd1306_display(oled);
+    return fixture_bus_bytes();
+}
+
+int main(void) {
+    CHECK(fixture_init(1000000) != NULL);
+    CHECK_EQ(model.data_bytes, SSD1306_WIDTH * SSD1306_PAGES);  // Init sends the whole frame
+
+    // Nothing drawn, nothing sent; redrawing what is there is free too
+    CHECK_EQ(update_bytes(), 0);
+    ssd1306_fill_rect(0, 0, 10, 8, SSD1306_BLACK);
+    ssd1306_set_pixel(3, 3, SSD1306_BLACK);
+    CHECK_EQ(update_bytes(), 0);
+
+    // One character: its five columns plus one window
+    ssd1306_draw_char(40, 16, 'A');
+    uint32_t bytes = update_bytes();
+    CHECK(bytes <= 6 + WINDOW_OVERHEAD);
+    CHECK(bytes >= 5);
+
+    // A full text row costs one page, not the frame
+    char row[64];
+    memset(row, 'W', sizeof(row));
+    row[SSD1306_WIDTH / 6] = '\0';
+    ssd1306_draw_string(0, 24, row);
+    bytes = update_bytes();
+    CHECK(bytes <= SSD1306_WIDTH + WINDOW_OVERHEAD);
+    CHECK(bytes >= SSD1306_WIDTH - 6);
+
+    // Overwriting the character with itself changes nothing
+    ssd1306_draw_char(40, 16, 'A');
+    CHECK_EQ(update_bytes(), 0);
+
+    // Shell: typing costs a few bytes per key, a command's output one
+    // page at most
+    ssd1306_clear();
+    ssd1306_display(oled);
+    shell_init(oled);
+    const char *clear = "clear\n";  // Room below the prompt on 4-row panels too
+    while (*clear) {
+        shell_process_char(*clear++);
+    }
+    fixture_flush();
+    fixture_bus_bytes();
+
+    shell_process_char('e');
+    fixture_flush();
+    bytes = fixture_bus_bytes();
+    CHECK(bytes > 0);
+    CHECK(bytes <= 6 + WINDOW_OVERHEAD);
+
+    const char *rest = "cho hello";
+    while (*rest) {
+        shell_process_char(*rest++);
+    }
+    fixture_flush();
+    fixture_bus_bytes();
+
+    shell_process_char('\n');
+    fixture_flush();
+    bytes = fixture_bus_bytes();
+    printf("one-line shell update: %u bus bytes\n", (unsigned)bytes);
+    CHECK(bytes <= SSD1306_WIDTH + 2 * WINDOW_OVERHEAD);
+
+#if SSD1306_HW_SCROLL
+    // Once the screen is full, a new line scrolls the panel's RAM: the
+    // start line plus the new rows, still no full frame (shell_execute
+    // prints the command line and its output, two rows)
+    for (int i = 0; i < textgrid_rows(); i++) {
+        shell_execute("echo scroll");
+        fixture_flush();
+    }
+    fixture_bus_bytes();
+    shell_execute("echo one more");
+    fixture_flush();
+    bytes = fixture_bus_bytes();
+    printf("scrolled line: %u bus bytes\n", (unsigned)bytes);
+    CHECK(bytes <= 2 * (SSD1306_WIDTH + WINDOW_OVERHEAD) + 3);
+#endif
+
+    return test_done("test_bytes_" TEST_PANEL_NAME);
+}
@@ -0,0 +1,94 @@
+/*
+ * Compositor layers as the panel shows them
+ *
+ * A layer moved without a clip rect of its own shows whole at its new
+ * place; one with a clip rect set stays cut to that screen area. Z
+ * values beyond the int8_t range still stack in order. The
+ * default pool holds a status bar, a shell below it and a pop-up.
+ */
+
+#include "test.h"
+#include "display_fixture.h"
+#include "compositor.h"
+
+static int box_x, box_y;
+
+// A 16x16 lit box at (box_x, box_y)
+static int expect_box(int x, int y) {
+    return x >= box_x && x < box_x + 16 && y >= box_y && y < box_y + 16;
+}
+
+// The same box cut to the screen area 0..23 x 0..23
+static int expect_clipped_box(int x, int y) {
+    return expect_box(x, y) && x < 24 && y < 24;
+}
+
+static layer_t *filled_layer(int x, int y) {
+    layer_t *layer = layer_create(x, y, 16, 16, 0, 0);
+    CHECK(layer != NULL);
+    layer_begin(layer);
+    ssd1306_fill_rect(0, 0, 16, 16, SSD1306_WHITE);
+    layer_end();
+    return layer;
+}
+
+static void show(void) {
+    compositor_compose();
+    ssd1306_display(oled);
+}
+
+int main(void) {
+    CHECK(fixture_init(400000) != NULL);
+    ssd1306_clear();
+    compositor_reset();
+
+    // Default clip: follows the layer
+    layer_t *layer = filled_layer(4, 4);
+    box_x = 4;
+    box_y = 4;
+    show();
+    CHECK_EQ(ssd1306_model_compare(&model, expect_box), 0);
+
+    layer_move(layer, 20, 11);
+    box_x = 20;
+    box_y = 11;
+    show();
+    CHECK_EQ(ssd1306_model_compare(&model, expect_box), 0);
+
+    // Explicit clip: stays on screen where it was set
+    compositor_reset();
+    ssd1306_clear();
+    layer = filled_layer(0, 0);
+    layer_set_clip(layer, 0, 0, 24, 24);
+    layer_move(layer, 12, 12);
+    box_x = 12;
+    box_y = 12;
+    show();
+    CHECK_EQ(ssd1306_model_compare(&model, expect_clipped_box), 0);
+
+    // Stacking uses the whole int range: z 200 is above z 100
+    compositor_reset();
+    ssd1306_clear();
+    layer_t *top = layer_create(0, 0, 16, 16, 200, LAYER_OPAQUE);
+    layer_t *below = filled_layer(0, 0);
+    layer_set_z(below, 100);
+    CHECK(top != NULL);
+    box_x = SSD1306_WIDTH;  // Nothing lit: the empty opaque layer hides the box
+    box_y = 0;
+    show();
+    CHECK_EQ(ssd1306_model_compare(&model, expect_box), 0);
+    layer_set_z(below, 300);
+    box_x = 0;
+    show();
+    CHECK_EQ(ssd1306_model_compare(&model, expect_box), 0);
+
+    // Status bar, shell and a pop-up fit the default pool
+    compositor_reset();
+    CHECK(layer_create(0, 0, SSD1306_WIDTH, 8, 1, LAYER_OPAQUE) != NULL);
+    CHECK(layer_create(0, 8, SSD1306_WIDTH, SSD1306_HEIGHT - 8, 0, LAYER_OPAQUE) != NULL);
+    CHECK(layer_create(SSD1306_WIDTH / 4, SSD1306_HEIGHT / 4,
+                       SSD1306_WIDTH / 2, SSD1306_HEIGHT / 2, 2, LAYER_OPAQUE) != NULL);
+    compositor_reset();
+
+    return test_done("test_compositor");
+}
@@ -0,0 +1,60 @@
+/*
+ * Glyphs wider than the drawing target
+ *
+ * draw_char clips such a glyph to the target, but its pages still lie
+ * a full glyph width apart in the font table.
+ */
+
+#include "test.h"
+#include "display_fixture.h"
+#include <string.h>
+
+// One 6x16 glyph ('A'): page 0 columns are 0x01..0x06, page 1 0x81..0x86
+static const uint8_t tall_bitmap[] = {
+    0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+    0x81, 0x82, 0x83, 0x84, 0x85, 0x86,
+};
+
+static const font_t tall_font = {
+    .first = 'A',
+    .last = 'A',
+    .height = 16,
+    .pages = 2,
+    .spacing = 1,
+    .fixed_width = 6,
+    .bitmap = tall_bitmap,
+};
+
+static uint8_t target[4 * 3];
+
+static void dirty(int page, int x0, int x1) {
+}
+
+int main(void) {
+    CHECK(fixture_init(400000) != NULL);
+    ssd1306_set_font(&tall_font);
+
+    // A 4-column target cuts the glyph after its fourth column
+    ssd1306_set_target(target, 4, 24, dirty);
+    CHECK_EQ(ssd1306_draw_char(0, 0, 'A'), 7);
+    static const uint8_t aligned[] = {
+        0x01, 0x02, 0x03, 0x04,
+        0x81, 0x82, 0x83, 0x84,
+        0x00, 0x00, 0x00, 0x00,
+    };
+    CHECK(memcmp(target, aligned, sizeof(target)) == 0);
+
+    // Shifted by 4 rows: each glyph page is split across two target pages
+    memset(target, 0, sizeof(target));
+    ssd1306_draw_char(0, 4, 'A');
+    static const uint8_t shifted[] = {
+        0x10, 0x20, 0x30, 0x40,
+        0x10, 0x20, 0x30, 0x40,
+        0x08, 0x08, 0x08, 0x08,
+    };
+    CHECK(memcmp(target, shifted, sizeof(target)) == 0);
+
+    ssd1306_set_target(NULL, 0, 0, NULL);
+    ssd1306_set_font(&font_5x7);
+    return test_done("test_draw_char");
+}
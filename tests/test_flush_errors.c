@@ -0,0 +1,73 @@
+/*
+ * Display updates against a panel that stops answering
+ *
+ * Blocking callers make one pass and report the failure; only the
+ * asynchronous path requests the failed windows again. Each case here
+ * used to spin forever while the panel NACKed.
+ */
+
+#include "test.h"
+#include "display_fixture.h"
+#include "grayscale.h"
+
+// A filled block, upright or turned by 180 degrees
+static int expect_block(int x, int y) {
+    return x >= 10 && x < 30 && y >= 5 && y < 20;
+}
+
+static int expect_block_180(int x, int y) {
+    return expect_block(SSD1306_WIDTH - 1 - x, SSD1306_HEIGHT - 1 - y);
+}
+
+int main(void) {
+    CHECK(fixture_init(400000) != NULL);
+    ssd1306_clear();
+    ssd1306_fill_rect(10, 5, 20, 15, SSD1306_WHITE);
+
+    // Blocking update: fails once, leaves the frame dirty, sends it later
+    sim->nack_addr = 0x3C;
+    CHECK(!ssd1306_display(oled));
+    CHECK(!ssd1306_flush_busy(oled));
+    sim->nack_addr = 0;
+    CHECK(ssd1306_display(oled));
+    CHECK_EQ(ssd1306_model_compare(&model, expect_block), 0);
+
+    // Asynchronous update: retried with the next frame until it gets through
+    ssd1306_invalidate(oled);
+    sim->nack_addr = 0x3C;
+    ssd1306_display_async(oled);
+    for (int i = 0; i < 3; i++) {
+        fixture_flush();
+        CHECK(ssd1306_flush_busy(oled));
+    }
+    sim->nack_addr = 0;
+    fixture_flush();
+    CHECK(!ssd1306_flush_busy(oled));
+    CHECK_EQ(ssd1306_model_compare(&model, expect_block), 0);
+
+    // Grayscale waits for the pending update and gives up if it fails
+    ssd1306_invalidate(oled);
+    sim->nack_addr = 0x3C;
+    CHECK(!gray_begin(oled));
+    CHECK(!gray_active(oled));
+    sim->nack_addr = 0;
+    CHECK(gray_begin(oled));
+    gray_end(oled);
+    CHECK(ssd1306_display(oled));
+
+    // Rotation finishes the flush on the wire; a failed one is retried
+    ssd1306_invalidate(oled);
+    ssd1306_display_async(oled);
+    host_cycles_advance(CPU_FREQ_HZ);
+    CHECK(!ssd1306_flush_step(oled, SSD1306_FLUSH_CHUNK_BYTES));
+    sim->nack_addr = 0x3C;
+    ssd1306_set_rotation(oled, SSD1306_ROTATE_180);
+    CHECK(ssd1306_flush_busy(oled));
+    sim->nack_addr = 0;
+    ssd1306_set_rotation(oled, SSD1306_ROTATE_180);  // Its remap was NACKed too
+    fixture_flush();
+    CHECK(!ssd1306_flush_busy(oled));
+    CHECK_EQ(ssd1306_model_compare(&model, expect_block_180), 0);
+
+    return test_done("test_flush_errors");
+}
@@ -0,0 +1,169 @@
+/*
+ * Proportional font against its BDF source
+ *
+ * Reads the BDF the font tables are generated from (path as the first
+ * argument) and checks, for every character, that font_5x7_prop keeps
+ * the inked columns of the glyph (a blank glyph half the cell) followed
+ * by the BDF's spacing, and that font_5x7 advances by DWIDTH. A string
+ * drawn in the proportional font must then light exactly the BDF pixels
+ * at those advances.
+ */
+
+#include "test.h"
+#include "display_fixture.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CELL_W 5
+#define CELL_H 7
+
+typedef struct {
+    bool present;
+    int advance;             // DWIDTH
+    uint8_t pixels[CELL_H];  // Row bits, bit (CELL_W - 1 - x) = column x
+} bdf_glyph_t;
+
+static bdf_glyph_t glyphs[128];
+
+// Parse the glyphs of a BDF with a 5x7 bounding box at offset 0
+static bool load_bdf(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+
+    char line[128];
+    bdf_glyph_t *glyph = NULL;
+    int row = -1;
+    while (fgets(line, sizeof(line), f)) {
+        int value, w, h, xoff, yoff;
+        if (sscanf(line, "ENCODING %d", &value) == 1) {
+            glyph = value >= 0 && value < 128 ? &glyphs[value] : NULL;
+        } else if (glyph && sscanf(line, "DWIDTH %d", &value) == 1) {
+            glyph->advance = value;
+        } else if (glyph && sscanf(line, "BBX %d %d %d %d", &w, &h, &xoff, &yoff) == 4) {
+            CHECK(w == CELL_W && h == CELL_H && xoff == 0 && yoff == 0);
+        } else if (glyph && strncmp(line, "BITMAP", 6) == 0) {
+            row = 0;
+        } else if (glyph && strncmp(line, "ENDCHAR", 7) == 0) {
+            glyph->present = row == CELL_H;
+            glyph = NULL;
+            row = -1;
+        } else if (glyph && row >= 0 && row < CELL_H) {
+            // One byte per row, leftmost pixel in the top bit
+            glyph->pixels[row++] = (uint8_t)(strtol(line, NULL, 16) >> (8 - CELL_W));
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+static bool bdf_pixel(const bdf_glyph_t *glyph, int x, int y) {
+    return (glyph->pixels[y] >> (CELL_W - 1 - x)) & 1;
+}
+
+// Inked columns of a glyph: first..last, or last < first when blank
+static void bdf_ink(const bdf_glyph_t *glyph, int *first, int *last) {
+    *first = CELL_W;
+    *last = -1;
+    for (int x = 0; x < CELL_W; x++) {
+        for (int y = 0; y < CELL_H; y++) {
+            if (bdf_pixel(glyph, x, y)) {
+                if (x < *first) *first = x;
+                *last = x;
+            }
+        }
+    }
+}
+
+// Gap between glyphs: what DWIDTH adds to the cell (as bdf2font.py)
+static int bdf_spacing(void) {
+    return glyphs['0'].advance - CELL_W;
+}
+
+static void check_advances(void) {
+    int spacing = bdf_spacing();
+    CHECK(spacing > 0);
+    CHECK_EQ(font_5x7_prop.spacing, spacing);
+
+    for (int c = font_5x7_prop.first; c <= font_5x7_prop.last; c++) {
+        const bdf_glyph_t *glyph = &glyphs[c];
+        CHECK(glyph->present);
+        int first, last;
+        bdf_ink(glyph, &first, &last);
+        int width = last >= first ? last - first + 1 : (CELL_W + 1) / 2;
+
+        int index = c - font_5x7_prop.first;
+        if (font_5x7_prop.widths[index] != width) {
+            fprintf(stderr, "'%c': width %d, BDF ink %d\n", c, font_5x7_prop.widths[index], width);
+        }
+        CHECK_EQ(font_5x7_prop.widths[index], width);
+
+        ssd1306_set_font(&font_5x7_prop);
+        CHECK_EQ(ssd1306_char_width((char)c), width + spacing);
+        ssd1306_set_font(&font_5x7);
+        CHECK_EQ(ssd1306_char_width((char)c), glyph->advance);
+    }
+}
+
+// The string as the BDF draws it with proportional advances
+static const char *const sample = "Hi, il1! WM";
+#define SAMPLE_X 3
+#define SAMPLE_Y 10  // Not page aligned
+
+static uint8_t expected[SSD1306_HEIGHT][SSD1306_WIDTH];
+
+static int expect_image(int x, int y) {
+    return expected[y][x];
+}
+
+static int expect_sample(void) {
+    memset(expected, 0, sizeof(expected));
+    int cursor = SAMPLE_X;
+    for (const char *s = sample; *s; s++) {
+        const bdf_glyph_t *glyph = &glyphs[(uint8_t)*s];
+        int first, last;
+        bdf_ink(glyph, &first, &last);
+        if (last < first) {
+            cursor += (CELL_W + 1) / 2 + bdf_spacing();
+            continue;
+        }
+        for (int x = first; x <= last; x++) {
+            for (int y = 0; y < CELL_H; y++) {
+                expected[SAMPLE_Y + y][cursor + x - first] = bdf_pixel(glyph, x, y);
+            }
+        }
+        cursor += last - first + 1 + bdf_spacing();
+    }
+    return cursor - SAMPLE_X;
+}
+
+static void check_string(void) {
+    int width = expect_sample();
+    ssd1306_set_font(&font_5x7_prop);
+    CHECK_EQ(ssd1306_text_width(sample), width);
+    ssd1306_clear();
+    ssd1306_draw_string(SAMPLE_X, SAMPLE_Y, sample);
+    ssd1306_display(oled);
+    CHECK_EQ(ssd1306_model_compare(&model, expect_image), 0);
+
+    // Narrower than the same string in the fixed font
+    ssd1306_set_font(&font_5x7);
+    CHECK(width < ssd1306_text_width(sample));
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s font5x7.bdf\n", argv[0]);
+        return 1;
+    }
+    CHECK(fixture_init(400000) != NULL);
+    CHECK(load_bdf(argv[1]));
+
+    check_advances();
+    check_string();
+
+    ssd1306_set_font(&font_5x7);
+    return test_done("test_font_prop");
+}
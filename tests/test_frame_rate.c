@@ -0,0 +1,83 @@
+/*
+ * Asynchronous update pacing
+ *
+ * Requests made between two frames are merged into one capture, counted
+ * in stats.coalesced, and the capture waits for the frame interval set
+ * with ssd1306_set_frame_rate(); 0 sends each request as soon as the
+ * previous update is out.
+ */
+
+#include "test.h"
+#include "display_fixture.h"
+
+#define MS (CPU_FREQ_HZ / 1000)
+
+// Updates captured over one simulated second with a request every ms
+static uint32_t updates_per_second(void) {
+    ssd1306_stats_t stats;
+    ssd1306_reset_stats(oled);
+    for (int ms = 0; ms < 1000; ms++) {
+        ssd1306_set_pixel(ms % SSD1306_WIDTH, 0, SSD1306_INVERSE);
+        ssd1306_display_async(oled);
+        ssd1306_flush_step(oled, SSD1306_FLUSH_CHUNK_BYTES);
+        host_cycles_advance(MS);
+    }
+    fixture_flush();
+    ssd1306_get_stats(oled, &stats);
+    return stats.flushes;
+}
+
+int main(void) {
+    ssd1306_stats_t stats;
+    CHECK(fixture_init(400000) != NULL);
+    ssd1306_clear();
+    CHECK(ssd1306_display(oled));
+
+    // Three requests inside one frame interval: one capture with all three
+    ssd1306_set_frame_rate(oled, 10);
+    host_cycles_advance(100 * MS);
+    ssd1306_reset_stats(oled);
+    ssd1306_set_pixel(1, 1, SSD1306_WHITE);
+    ssd1306_display_async(oled);
+    fixture_flush();
+    CHECK_EQ(ssd1306_model_pixel(&model, 1, 1), 1);
+    uint32_t transactions = model.transactions;
+    ssd1306_set_pixel(2, 2, SSD1306_WHITE);
+    ssd1306_display_async(oled);
+    host_cycles_advance(10 * MS);
+    CHECK(!ssd1306_flush_step(oled, SSD1306_FLUSH_CHUNK_BYTES));  // Not due yet
+    ssd1306_set_pixel(3, 3, SSD1306_WHITE);
+    ssd1306_display_async(oled);
+    ssd1306_set_pixel(4, 4, SSD1306_WHITE);
+    ssd1306_display_async(oled);
+    host_cycles_advance(10 * MS);
+    CHECK(!ssd1306_flush_step(oled, SSD1306_FLUSH_CHUNK_BYTES));
+    CHECK_EQ(model.transactions, transactions);  // Still waiting, nothing sent
+    CHECK_EQ(ssd1306_model_pixel(&model, 2, 2), 0);
+
+    ssd1306_get_stats(oled, &stats);
+    CHECK_EQ(stats.coalesced, 2);
+    CHECK_EQ(stats.flushes, 1);
+    fixture_flush();
+    ssd1306_get_stats(oled, &stats);
+    CHECK_EQ(stats.flushes, 2);
+    CHECK_EQ(ssd1306_model_pixel(&model, 2, 2), 1);
+    CHECK_EQ(ssd1306_model_pixel(&model, 3, 3), 1);
+    CHECK_EQ(ssd1306_model_pixel(&model, 4, 4), 1);
+    CHECK(!ssd1306_flush_busy(oled));
+
+    // Frame rate limit: one update per interval however often it is asked
+    ssd1306_set_frame_rate(oled, 10);
+    uint32_t paced = updates_per_second();
+    CHECK(paced >= 9 && paced <= 11);
+    ssd1306_set_frame_rate(oled, 25);
+    paced = updates_per_second();
+    CHECK(paced >= 24 && paced <= 26);
+
+    // No limit: every request goes out (each is sent within its ms)
+    ssd1306_set_frame_rate(oled, 0);
+    CHECK(updates_per_second() >= 990);
+
+    ssd1306_set_frame_rate(oled, SSD1306_FRAME_RATE);
+    return test_done("test_frame_rate");
+}
@@ -0,0 +1,74 @@
+/*
+ * Bitmap blits clipped to targets whose height is not a multiple of 8
+ *
+ * The last page of such a target is partial: a blit may change its rows
+ * above the bottom edge and nothing below it. A target set without a
+ * dirty callback is drawn to all the same, and leaves the display alone.
+ */
+
+#include "test.h"
+#include "display_fixture.h"
+#include "gfx.h"
+#include <string.h>
+
+#define TARGET_W 16
+#define TARGET_H 20  // Pages 0-1 whole, page 2 has rows 16-19
+
+static uint8_t target[TARGET_W * 3];
+static int dirty_pages;
+
+static void dirty(int page, int x0, int x1) {
+    dirty_pages |= 1 << page;
+}
+
+int main(void) {
+    CHECK(fixture_init(400000) != NULL);
+
+    static const uint8_t solid[TARGET_W * 2] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    };
+
+    // A 16x16 block straddling the bottom edge, every raster op
+    for (int rop = GFX_ROP_COPY; rop <= GFX_ROP_XOR; rop++) {
+        memset(target, 0, sizeof(target));
+        ssd1306_set_target(target, TARGET_W, TARGET_H, dirty);
+        dirty_pages = 0;
+        gfx_draw_bitmap(0, 10, solid, TARGET_W, 16, (gfx_rop_t)rop);
+        if (rop == GFX_ROP_AND) {
+            continue;  // AND on a blank target changes nothing
+        }
+
+        // Rows 10-19 set; rows 20-23 of the last page untouched
+        CHECK_EQ(target[0], 0x00);
+        CHECK_EQ(target[TARGET_W], 0xFC);
+        CHECK_EQ(target[2 * TARGET_W], 0x0F);
+        CHECK_EQ(target[3 * TARGET_W - 1], 0x0F);
+        CHECK_EQ(ssd1306_get_pixel(5, 19), 1);
+        CHECK_EQ(dirty_pages, 0x6);
+    }
+
+    // Entirely below the bottom edge: nothing at all
+    memset(target, 0, sizeof(target));
+    dirty_pages = 0;
+    gfx_draw_bitmap(0, 20, solid, TARGET_W, 4, GFX_ROP_OR);
+    CHECK_EQ(target[2 * TARGET_W], 0);
+    CHECK_EQ(dirty_pages, 0);
+
+    // No dirty callback: still the bitmap, and the display stays clean
+    ssd1306_display(oled);
+    fixture_bus_bytes();
+    memset(target, 0, sizeof(target));
+    ssd1306_set_target(target, TARGET_W, TARGET_H, NULL);
+    gfx_draw_bitmap(0, 0, solid, TARGET_W, 8, GFX_ROP_OR);
+    ssd1306_clear();
+    gfx_draw_bitmap(0, 8, solid, TARGET_W, 8, GFX_ROP_OR);
+    CHECK_EQ(target[0], 0x00);
+    CHECK_EQ(target[TARGET_W], 0xFF);
+    ssd1306_set_target(NULL, 0, 0, NULL);
+    CHECK_EQ(ssd1306_get_pixel(0, 8), 0);
+    ssd1306_display(oled);
+    CHECK_EQ(fixture_bus_bytes(), 0);
+
+    return test_done("test_gfx");
+}
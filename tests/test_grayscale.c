@@ -0,0 +1,121 @@
+/*
+ * Grayscale on the simulated panel at one bus speed (argv[1], in Hz)
+ *
+ * Four vertical bands hold levels 0-3. The panel model is watched byte by
+ * byte while gray_step() runs for two simulated seconds: every byte the
+ * panel takes is a point where the glass may change, and the time each
+ * band's probe pixel spends lit between two such points is added up.
+ * That gives what the eye averages (the lit fraction per level) and how
+ * often the pattern repeats (the grayscale frame rate, i.e. the flicker
+ * frequency), for the bus speed under test.
+ *
+ * Checks:
+ * - the measured frame rate matches gray_estimate_frame_rate(), which
+ *   the shell's gray command prints
+ * - the levels stay in order at any bus speed
+ * - while the bus keeps up with the sub-frame rate, every level is lit
+ *   for level/3 of the time
+ */
+
+#include "test.h"
+#include "display_fixture.h"
+#include "grayscale.h"
+#include <stdlib.h>
+
+#define BANDS GRAY_LEVELS
+#define RUN_CYCLES (2 * CPU_FREQ_HZ)
+#define WARMUP_CYCLES (CPU_FREQ_HZ / 10)   // First upload of both planes
+#define LOOP_CYCLES (CPU_FREQ_HZ / 20000)  // Main loop pass: 50 us
+
+static bool (*model_write)(sim_i2c_device_t *dev, uint8_t byte);
+
+static uint64_t last_sample;
+static bool lit[BANDS];
+static uint64_t lit_cycles[BANDS];
+
+static int probe_x(int band) {
+    return band * SSD1306_WIDTH / BANDS + SSD1306_WIDTH / (2 * BANDS);
+}
+
+// Charge the time since the last sample to what the glass showed, then look again
+static void glass_sample(void) {
+    uint64_t now = host_cycles_total();
+    for (int band = 0; band < BANDS; band++) {
+        if (lit[band]) {
+            lit_cycles[band] += now - last_sample;
+        }
+        lit[band] = ssd1306_model_pixel(&model, probe_x(band), SSD1306_HEIGHT / 2);
+    }
+    last_sample = now;
+}
+
+// Model write callback: the glass can change with every byte
+static bool probe_write(sim_i2c_device_t *dev, uint8_t byte) {
+    glass_sample();
+    bool ack = model_write(dev, byte);
+    glass_sample();
+    return ack;
+}
+
+static void run(uint64_t cycles) {
+    uint64_t end = host_cycles_total() + cycles;
+    while (host_cycles_total() < end) {
+        gray_step(oled);
+        host_cycles_advance(LOOP_CYCLES);
+        glass_sample();
+    }
+}
+
+int main(int argc, char **argv) {
+    uint32_t bus_hz = argc > 1 ? (uint32_t)atoi(argv[1]) : 400000;
+    CHECK(fixture_init(bus_hz) != NULL);
+    model_write = model.dev.write;
+    model.dev.write = probe_write;
+
+    gray_clear();
+    for (int band = 0; band < BANDS; band++) {
+        for (int x = band * SSD1306_WIDTH / BANDS; x < (band + 1) * SSD1306_WIDTH / BANDS; x++) {
+            for (int y = 0; y < SSD1306_HEIGHT; y++) {
+                gray_set_pixel(x, y, band);
+            }
+        }
+    }
+    uint32_t estimate = gray_estimate_frame_rate(oled, bus_hz);
+
+    CHECK(gray_begin(oled));
+    run(WARMUP_CYCLES);
+    glass_sample();
+    for (int band = 0; band < BANDS; band++) {
+        lit_cycles[band] = 0;
+    }
+    uint64_t start = host_cycles_total();
+    run(RUN_CYCLES);
+    uint64_t elapsed = host_cycles_total() - start;
+    uint32_t fps = gray_frame_rate(oled);
+    gray_end(oled);
+
+    int percent[BANDS];
+    for (int band = 0; band < BANDS; band++) {
+        percent[band] = (int)((lit_cycles[band] * 100 + elapsed / 2) / elapsed);
+    }
+    printf("%s at %u Hz: %u fps (estimate %u), levels 0/33/67/100%% lit %d/%d/%d/%d%%\n",
+           TEST_PANEL_NAME, bus_hz, fps, estimate,
+           percent[0], percent[1], percent[2], percent[3]);
+
+    // The estimate the shell prints holds within 10%
+    CHECK(fps * 10 >= estimate * 9 && fps * 10 <= estimate * 11);
+
+    // Levels in order; off and fully lit exact
+    CHECK_EQ(percent[0], 0);
+    CHECK_EQ(percent[3], 100);
+    CHECK(percent[1] > 0 && percent[1] < percent[2] && percent[2] < 100);
+
+    // A bus fast enough for every sub-frame slot gives the nominal levels
+    if (estimate >= GRAY_SUBFRAME_RATE / GRAY_SUBFRAMES) {
+        for (int band = 1; band < 3; band++) {
+            CHECK(abs(percent[band] - band * 100 / 3) <= 5);
+        }
+    }
+
+    return test_done("test_grayscale");
+}
@@ -0,0 +1,371 @@
+/*
+ * The bit-banged driver (i2c.c) on the open-drain line model
+ *
+ * An SSD1306, a 24C32 EEPROM and a register sensor share the lines. The
+ * driver has to speak the protocol the slaves decode bit by bit, keep the
+ * clock within the I2C timing limits at every speed, and get through the
+ * faults injected on the bus: NACKs, clock stretching, stretching past
+ * the timeout and stuck lines. Asynchronous transactions are stepped by
+ * a simulated timer interrupt, a byte per tick, while the main loop
+ * keeps running. The pads have to be open drain, so no line is ever
+ * driven high against a slave holding it low.
+ */
+
+#include "test.h"
+#include "i2c.h"
+#include "i2c_lines.h"
+#include "ssd1306_model.h"
+#include "eeprom_model.h"
+#include "regs_model.h"
+#include "cpu.h"
+#include "host.h"
+#include <string.h>
+
+#define CYCLES_PER_NS(ns) ((uint32_t)((uint64_t)(ns) * (CPU_FREQ_HZ / 1000000) / 1000))
+
+static sim_i2c_bus_t sim;
+static ssd1306_model_t oled;
+static eeprom_model_t eeprom;
+static regs_model_t sensor;
+static i2c_bus_t *bus;
+
+// Minimum SCL low / high times of each mode (I2C specification, table 10)
+// and the data hold time the SSD1306 needs after SCL falls
+#define HOLD_NS 300
+
+static const struct {
+    uint32_t freq_hz;
+    uint32_t low_ns;
+    uint32_t high_ns;
+} modes[] = {
+    {100000, 4700, 4000},
+    {400000, 1300, 600},
+    {1000000, 500, 260},
+};
+
+static void check_protocol(void) {
+    i2c_dev_t dev = {.bus = bus, .addr = 0x3C, .freq_hz = 400000};
+    sim.logging = true;
+    sim_i2c_log_clear(&sim);
+    const uint8_t off[] = {0x00, 0xAE};
+    CHECK(i2c_write(&dev, off, sizeof(off)));
+    CHECK(strcmp(sim.log, "S 78 00 AE P") == 0);
+
+    // Register read: write the pointer, repeated START, read with NACK last
+    regs_model_init(&sensor, 0x48);
+    sensor.regs[0x10] = 0x12;
+    sensor.regs[0x11] = 0x34;
+    i2c_dev_t temp = {.bus = bus, .addr = 0x48};
+    uint8_t value[2];
+    sim_i2c_log_clear(&sim);
+    CHECK(i2c_read_reg(&temp, 0x10, value, 2));
+    CHECK(strcmp(sim.log, "S 90 10 S 91 R12 R34! P") == 0);
+    sim.logging = false;
+}
+
+static void check_clock(void) {
+    i2c_lines_stats_t stats;
+    for (unsigned m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        // Setting a clock puts nothing on the bus
+        i2c_lines_reset_stats();
+        CHECK(i2c_set_freq(bus, modes[m].freq_hz));
+        i2c_lines_get_stats(&stats);
+        CHECK_EQ(stats.falls, 0);
+
+        i2c_dev_t dev = {.bus = bus, .addr = 0x48, .freq_hz = modes[m].freq_hz};
+        uint8_t data[16] = {0x20};
+        CHECK(i2c_write(&dev, data, sizeof(data)));
+
+        i2c_lines_get_stats(&stats);
+        uint32_t freq = i2c_lines_scl_freq();
+        uint32_t reported = i2c_bus_freq(bus);
+        printf("%7u Hz: SCL %u Hz (reported %u Hz), tLOW >= %u ns, tHIGH >= %u ns, tHD;DAT >= %u ns\n",
+               modes[m].freq_hz, freq, reported,
+               stats.scl_low_min * 1000 / (CPU_FREQ_HZ / 1000000),
+               stats.scl_high_min * 1000 / (CPU_FREQ_HZ / 1000000),
+               stats.sda_hold_min * 1000 / (CPU_FREQ_HZ / 1000000));
+
+        // The advertised rate, without cutting the minimum phases short
+        CHECK(freq <= modes[m].freq_hz && freq >= modes[m].freq_hz * 95 / 100);
+        CHECK(stats.scl_low_min >= CYCLES_PER_NS(modes[m].low_ns));
+        CHECK(stats.scl_high_min >= CYCLES_PER_NS(modes[m].high_ns));
+        CHECK(stats.sda_hold_min >= CYCLES_PER_NS(HOLD_NS));
+        CHECK_EQ(stats.contention, 0);
+        CHECK_EQ(stats.glitches, 0);
+
+        // What the driver reports (worked out from the rate measured at
+        // i2c_bus_create()) is what the lines saw, and asking for it puts
+        // nothing on the bus
+        CHECK(reported >= freq * 98 / 100 && reported <= freq * 102 / 100);
+        i2c_lines_stats_t after;
+        i2c_lines_get_stats(&after);
+        CHECK_EQ(after.falls, stats.falls);
+    }
+
+    // A device with a clock the bus has never run at: its transaction is
+    // all that goes on the wire (START, then nine clocks per byte)
+    i2c_dev_t other = {.bus = bus, .addr = 0x48, .freq_hz = 250000};
+    const uint8_t reg[] = {0x21, 0x42};
+    i2c_lines_reset_stats();
+    CHECK(i2c_write(&other, reg, sizeof(reg)));
+    i2c_lines_get_stats(&stats);
+    CHECK_EQ(stats.falls, 1 + 9 * 3);
+    uint32_t freq = i2c_lines_scl_freq();
+    CHECK(i2c_bus_freq(bus) >= freq * 98 / 100 && i2c_bus_freq(bus) <= freq * 102 / 100);
+
+    // Clocks out of range are refused and leave the bus as it was
+    uint32_t before = i2c_bus_freq(bus);
+    CHECK(!i2c_set_freq(bus, 0));
+    CHECK(!i2c_set_freq(bus, I2C_MIN_FREQ_HZ - 1));
+    CHECK(!i2c_set_freq(bus, I2C_MAX_FREQ_HZ + 1));
+    CHECK_EQ(i2c_bus_freq(bus), before);
+    i2c_config_t config = {.scl_pin = 5, .sda_pin = 4, .freq_hz = 0};
+    CHECK(i2c_bus_create(&config) == NULL);
+}
+
+static void check_sensor(void) {
+    regs_model_init(&sensor, 0x48);
+    sensor.regs[0x0F] = 0xA5;  // WHO_AM_I
+    sensor.read_only[0x0F] = true;
+    i2c_dev_t dev = {.bus = bus, .addr = 0x48, .freq_hz = 400000};
+
+    uint8_t id = 0;
+    CHECK(i2c_read_reg(&dev, 0x0F, &id, 1));
+    CHECK_EQ(id, 0xA5);
+
+    const uint8_t config[] = {0x01, 0x02, 0x03};
+    CHECK(i2c_write_reg(&dev, 0x20, config, sizeof(config)));
+    uint8_t back[3] = {0};
+    i2c_lines_reset_stats();
+    CHECK(i2c_read_reg(&dev, 0x20, back, sizeof(back)));
+    CHECK(memcmp(back, config, sizeof(config)) == 0);
+
+    // Repeated START, ACKs and the final NACK also hold SDA after SCL falls
+    i2c_lines_stats_t lines_stats;
+    i2c_lines_get_stats(&lines_stats);
+    CHECK(lines_stats.sda_hold_min >= CYCLES_PER_NS(HOLD_NS));
+    CHECK_EQ(lines_stats.glitches, 0);
+
+    CHECK(i2c_write_reg(&dev, 0x0F, config, 1));
+    CHECK_EQ(sensor.regs[0x0F], 0xA5);
+    CHECK_EQ(sensor.ignored_writes, 1);
+}
+
+static void check_eeprom(void) {
+    i2c_dev_t dev = {.bus = bus, .addr = 0x50, .freq_hz = 400000};
+
+    // Page write, then the chip is busy for tWR
+    const uint8_t write[] = {0x01, 0x23, 'e', 'e', 'p', 'r', 'o', 'm', '!', '!'};
+    CHECK(i2c_write(&dev, write, sizeof(write)));
+    uint64_t written = host_cycles_total();
+    CHECK(!i2c_write(&dev, write, sizeof(write)));
+    CHECK_EQ(i2c_last_error(bus), I2C_ERR_NACK);
+    CHECK(eeprom.busy_nacks > 0);
+
+    // ACK polling: address only until the chip answers again
+    int polls = 0;
+    while (!i2c_write(&dev, write, 0) && polls < 10000) {
+        polls++;
+    }
+    CHECK(polls < 10000);
+    CHECK(host_cycles_total() - written >= eeprom.write_cycles);
+    CHECK_EQ(eeprom.write_cycles_done, 1);
+
+    uint8_t read[8] = {0};
+    CHECK(i2c_write_read(&dev, write, 2, read, sizeof(read)));
+    CHECK(memcmp(read, "eeprom!!", 8) == 0);
+
+    // A write past the end of its page wraps to the page start
+    const uint8_t wrap[] = {0x00, 0x1E, 1, 2, 3, 4};
+    host_cycles_advance(eeprom.write_cycles);
+    CHECK(i2c_write(&dev, wrap, sizeof(wrap)));
+    CHECK_EQ(eeprom.mem[0x1E], 1);
+    CHECK_EQ(eeprom.mem[0x1F], 2);
+    CHECK_EQ(eeprom.mem[0x00], 3);
+    CHECK_EQ(eeprom.mem[0x01], 4);
+    CHECK_EQ(eeprom.mem[0x20], 0xFF);
+    host_cycles_advance(eeprom.write_cycles);
+}
+
+static void check_faults(void) {
+    i2c_dev_t dev = {.bus = bus, .addr = 0x48, .freq_hz = 400000};
+    const uint8_t data[] = {0x30, 0x55};
+    i2c_stats_t stats;
+
+    // One NACKed byte: the call retries and gets through
+    i2c_reset_stats(bus);
+    sim.nack_bytes = 1;
+    CHECK(i2c_write(&dev, data, sizeof(data)));
+    i2c_get_stats(bus, &stats);
+    CHECK_EQ(stats.retries, 1);
+    CHECK_EQ(stats.nacks, 1);
+
+    // A device that never answers
+    i2c_reset_stats(bus);
+    sim.nack_addr = 0x48;
+    CHECK(!i2c_write(&dev, data, sizeof(data)));
+    CHECK_EQ(i2c_last_error(bus), I2C_ERR_NACK);
+    i2c_get_stats(bus, &stats);
+    CHECK_EQ(stats.retries, I2C_RETRIES);
+    sim.nack_addr = 0;
+
+    // Clock stretching within the limit only slows the transfer down
+    i2c_reset_stats(bus);
+    sim.stretch_us = 50;
+    uint64_t start = host_cycles_total();
+    CHECK(i2c_write(&dev, data, sizeof(data)));
+    CHECK(host_cycles_total() - start >= 3 * 50 * (CPU_FREQ_HZ / 1000000));
+    i2c_get_stats(bus, &stats);
+    CHECK_EQ(stats.timeouts, 0);
+
+    // Past the limit: timeout, recovery, and the bus still works afterwards
+    sim.stretch_us = 2 * I2C_STRETCH_TIMEOUT_US;
+    CHECK(!i2c_write(&dev, data, sizeof(data)));
+    CHECK_EQ(i2c_last_error(bus), I2C_ERR_TIMEOUT);
+    i2c_get_stats(bus, &stats);
+    CHECK(stats.timeouts > 0);
+    CHECK(stats.recoveries > 0);
+    sim.stretch_us = 0;
+    host_cycles_advance(4 * I2C_STRETCH_TIMEOUT_US * (CPU_FREQ_HZ / 1000000));
+    CHECK(i2c_write(&dev, data, sizeof(data)));
+
+    // SDA held by a slave that lets go after a few clocks: recovered at START
+    i2c_reset_stats(bus);
+    sim.sda_stuck = true;
+    sim.sda_stuck_clocks = 5;
+    CHECK(i2c_write(&dev, data, sizeof(data)));
+    i2c_get_stats(bus, &stats);
+    CHECK_EQ(stats.recoveries, 1);
+    CHECK(!sim.sda_stuck);
+
+    // SDA or SCL held for good: the bus error is reported, not hung on
+    sim.sda_stuck = true;
+    sim.sda_stuck_clocks = -1;
+    CHECK(!i2c_write(&dev, data, sizeof(data)));
+    CHECK_EQ(i2c_last_error(bus), I2C_ERR_BUS);
+    sim.sda_stuck = false;
+    CHECK(i2c_write(&dev, data, sizeof(data)));
+
+    sim.scl_stuck = true;
+    CHECK(!i2c_write(&dev, data, sizeof(data)));
+    CHECK(i2c_last_error(bus) != I2C_OK);
+    sim.scl_stuck = false;
+    CHECK(i2c_write(&dev, data, sizeof(data)));
+    CHECK_EQ(sensor.regs[0x30], 0x55);
+}
+
+// The timer interrupt, as main.c sets it up
+static void bus_tick(void *arg) {
+    i2c_bus_service(arg);
+}
+
+static void async_done(i2c_err_t error, void *user) {
+    *(i2c_err_t *)user = error;
+}
+
+// The main loop: passes of 10us of other work until *result is set;
+// returns the longest pass in cycles, *passes the number of them
+static uint64_t main_loop(volatile i2c_err_t *result, int *passes) {
+    uint64_t longest = 0;
+    *passes = 0;
+    while (*result == I2C_ERR_BUS && *passes < 100000) {
+        uint64_t start = host_cycles_total();
+        host_cycles_advance(CPU_FREQ_HZ / 100000);
+        uint64_t pass = host_cycles_total() - start;
+        longest = pass > longest ? pass : longest;
+        (*passes)++;
+    }
+    return longest;
+}
+
+static void check_async(void) {
+    i2c_dev_t dev = {.bus = bus, .addr = 0x48, .freq_hz = 400000};
+    const uint8_t wr[] = {0x40, 9, 8, 7};
+    const uint8_t reg = 0x40;
+    uint8_t rd[3] = {0};
+    const i2c_segment_t segments[] = {
+        {.read = false, .tx = wr, .len = sizeof(wr)},
+        {.read = false, .tx = &reg, .len = 1},
+        {.read = true, .rx = rd, .len = sizeof(rd)},
+    };
+    CHECK(i2c_set_freq(bus, 100000));
+    uint32_t freq = i2c_bus_freq(bus);
+
+    // Twelve steps, one per tick: the main loop is held up for a byte at
+    // most, never for the transaction
+    volatile i2c_err_t result = I2C_ERR_BUS;
+    CHECK(i2c_transfer_async(&dev, segments, 3, async_done, (void *)&result));
+    CHECK(i2c_bus_busy(bus));
+    CHECK(!i2c_transfer_async(&dev, segments, 3, async_done, (void *)&result));
+    uint32_t tick = I2C_TICK_US * (CPU_FREQ_HZ / 1000000);
+    uint64_t start = host_cycles_total();
+    int passes;
+    uint64_t longest = main_loop(&result, &passes);
+    CHECK_EQ(result, I2C_OK);
+    CHECK(host_cycles_total() - start >= 11 * tick);
+    CHECK(passes > 200);
+    CHECK(longest < (10 + 2 * 9 * 1000000 / 400000) * (CPU_FREQ_HZ / 1000000));
+    CHECK(memcmp(rd, &wr[1], sizeof(rd)) == 0);
+    CHECK(!i2c_bus_busy(bus));
+    CHECK_EQ(i2c_bus_freq(bus), freq);
+
+    // A synchronous call finishes the running one first, then has the bus
+    const uint8_t data[] = {0x44, 0x66};
+    result = I2C_ERR_BUS;
+    CHECK(i2c_transfer_async(&dev, segments, 1, async_done, (void *)&result));
+    CHECK(i2c_write(&dev, data, sizeof(data)));
+    CHECK_EQ(result, I2C_OK);
+    CHECK_EQ(sensor.regs[0x42], 7);
+    CHECK_EQ(sensor.regs[0x44], 0x66);
+
+    // A device that does not answer: retried, then reported
+    i2c_dev_t missing = {.bus = bus, .addr = 0x51};
+    i2c_stats_t stats;
+    i2c_reset_stats(bus);
+    result = I2C_ERR_BUS;
+    CHECK(i2c_transfer_async(&missing, segments, 1, async_done, (void *)&result));
+    main_loop(&result, &passes);
+    CHECK_EQ(result, I2C_ERR_NACK);
+    i2c_get_stats(bus, &stats);
+    CHECK_EQ(stats.retries, I2C_RETRIES);
+    CHECK(!i2c_bus_busy(bus));
+}
+
+int main(void) {
+    sim_i2c_init(&sim);
+    ssd1306_model_init(&oled, SSD1306_MODEL_SSD1306, 0x3C, 128, 64, 0);
+    eeprom_model_init(&eeprom, 0x50, 4096, 2, 32, 5000);
+    regs_model_init(&sensor, 0x48);
+    sim_i2c_attach(&sim, &oled.dev);
+    sim_i2c_attach(&sim, &eeprom.dev);
+    sim_i2c_attach(&sim, &sensor.dev);
+    i2c_lines_init(&sim, 7, 6);
+
+    i2c_config_t config = {.scl_pin = 7, .sda_pin = 6, .freq_hz = 100000};
+    bus = i2c_bus_create(&config);
+    CHECK(bus != NULL);
+    host_irq_attach(host_timer_line(I2C_TICK_US * (CPU_FREQ_HZ / 1000000)), bus_tick, bus);
+
+    // Creating the bus measures its clock: nine clocks, no START
+    i2c_lines_stats_t created;
+    i2c_lines_get_stats(&created);
+    CHECK_EQ(created.falls, 9);
+    CHECK_EQ(sim.transactions, 0);
+
+    i2c_lines_reset_stats();
+    check_protocol();
+    check_sensor();
+    check_eeprom();
+    check_faults();
+    check_async();
+
+    // Open-drain pads, and no SDA change in mid-byte while SCL was high
+    i2c_lines_stats_t lines;
+    i2c_lines_get_stats(&lines);
+    CHECK_EQ(lines.contention, 0);
+    CHECK_EQ(lines.glitches, 0);
+
+    check_clock();
+
+    return test_done("test_i2c_bitbang");
+}
@@ -0,0 +1,188 @@
+/*
+ * Three displays: two panels on one bus, one on a second bus
+ *
+ * Panels at 0x3C and 0x3D share a bus but update at their own clocks
+ * (1MHz and 400kHz); the third sits alone on a second bus at 100kHz.
+ * Updates go through each display's handle, interleaved in one main loop
+ * with a different display selected for drawing, and every panel must
+ * end up showing its own buffer and only that. Grayscale keeps its
+ * planes per display, so two panels can show different images at once.
+ */
+
+#include "test.h"
+#include "ssd1306.h"
+#include "grayscale.h"
+#include "ssd1306_model.h"
+#include "i2c_fake.h"
+#include "host.h"
+#include "cpu.h"
+
+typedef struct {
+    ssd1306_model_t model;
+    ssd1306_t *display;
+    i2c_bus_t *bus;
+    uint32_t freq_hz;
+} panel_t;
+
+static panel_t panels[3];
+
+static panel_t *panel_add(int index, i2c_bus_t *bus, uint8_t addr, uint32_t freq_hz) {
+    panel_t *p = &panels[index];
+    ssd1306_model_init(&p->model, SSD1306_MODEL_SSD1306, addr, SSD1306_WIDTH, SSD1306_HEIGHT, SSD1306_COLUMN_OFFSET);
+    sim_i2c_attach(i2c_fake_sim(bus), &p->model.dev);
+    ssd1306_config_t config = {.bus = bus, .i2c_addr = addr, .freq_hz = freq_hz};
+    p->display = ssd1306_init(&config);
+    p->bus = bus;
+    p->freq_hz = freq_hz;
+    return p;
+}
+
+// The selected display's buffer, for ssd1306_model_compare()
+static int expect_buffer(int x, int y) {
+    return ssd1306_get_pixel(x, y);
+}
+
+// Pixels where a panel differs from its own display's buffer
+static int panel_diff(panel_t *p) {
+    ssd1306_t *previous = ssd1306_selected();
+    ssd1306_select(p->display);
+    int diff = ssd1306_model_compare(&p->model, expect_buffer);
+    ssd1306_select(previous);
+    return diff;
+}
+
+// Something different on each display: its number, a box at its own place
+static void draw_panel(int index) {
+    ssd1306_select(panels[index].display);
+    ssd1306_clear();
+    char label[] = {'0' + index, '\0'};
+    ssd1306_draw_string(0, 0, label);
+    ssd1306_fill_rect(20 + index * 30, 16 + index * 8, 20, 12, SSD1306_WHITE);
+}
+
+static void check_updates(void) {
+    for (int i = 0; i < 3; i++) {
+        draw_panel(i);
+    }
+
+    // Each display updates through its handle, with the first selected
+    ssd1306_select(panels[0].display);
+    for (int i = 0; i < 3; i++) {
+        ssd1306_set_frame_rate(panels[i].display, 0);
+        ssd1306_display_async(panels[i].display);
+    }
+    bool done = false;
+    for (int loop = 0; loop < 10000 && !done; loop++) {
+        done = true;
+        for (int i = 0; i < 3; i++) {
+            done &= ssd1306_flush_step(panels[i].display, SSD1306_FLUSH_CHUNK_BYTES);
+        }
+    }
+    CHECK(done);
+    for (int i = 0; i < 3; i++) {
+        CHECK(!ssd1306_flush_busy(panels[i].display));
+        CHECK_EQ(panel_diff(&panels[i]), 0);
+        CHECK_EQ(ssd1306_model_pixel(&panels[i].model, 21 + i * 30, 17 + i * 8), 1);
+    }
+    CHECK(ssd1306_selected() == panels[0].display);
+
+    // An update of one display sends nothing to the others
+    uint32_t before[3];
+    for (int i = 0; i < 3; i++) {
+        before[i] = panels[i].model.transactions;
+    }
+    ssd1306_select(panels[1].display);
+    ssd1306_fill_rect(0, 40, 10, 8, SSD1306_WHITE);
+    ssd1306_select(panels[2].display);
+    CHECK(ssd1306_display(panels[1].display));
+    CHECK(panels[1].model.transactions > before[1]);
+    CHECK_EQ(panels[0].model.transactions, before[0]);
+    CHECK_EQ(panels[2].model.transactions, before[2]);
+    CHECK_EQ(panel_diff(&panels[1]), 0);
+    CHECK_EQ(ssd1306_model_pixel(&panels[2].model, 0, 40), 0);
+}
+
+static void check_clocks(void) {
+    // The same update on each: bus time follows each display's own clock,
+    // and the shared bus is left at the clock of the last one to use it
+    uint32_t cycles[3];
+    for (int i = 0; i < 3; i++) {
+        ssd1306_select(panels[i].display);
+        ssd1306_fill_rect(64, 48, 32, 8, SSD1306_INVERSE);
+        CHECK(ssd1306_display(panels[i].display));
+        CHECK_EQ(i2c_bus_freq(panels[i].bus), panels[i].freq_hz);
+
+        ssd1306_stats_t stats;
+        ssd1306_get_stats(panels[i].display, &stats);
+        cycles[i] = stats.last_flush_cycles;
+        CHECK_EQ(panel_diff(&panels[i]), 0);
+    }
+    CHECK(ssd1306_get_bus(panels[0].display) == ssd1306_get_bus(panels[1].display));
+    CHECK(ssd1306_get_bus(panels[2].display) != ssd1306_get_bus(panels[0].display));
+
+    // 1MHz against 400kHz and 100kHz for the same bytes
+    CHECK(cycles[1] * 10 > cycles[0] * 23 && cycles[1] * 10 < cycles[0] * 27);
+    CHECK(cycles[2] > cycles[0] * 9 && cycles[2] < cycles[0] * 11);
+}
+
+// Grayscale planes: full level on the left half of one, right of the other
+static void draw_gray(int index, bool left) {
+    ssd1306_select(panels[index].display);
+    gray_clear();
+    for (int y = 0; y < SSD1306_HEIGHT; y++) {
+        for (int x = 0; x < SSD1306_WIDTH / 2; x++) {
+            gray_set_pixel(left ? x : SSD1306_WIDTH / 2 + x, y, GRAY_LEVELS - 1);
+        }
+    }
+}
+
+static int expect_left(int x, int y) {
+    return x < SSD1306_WIDTH / 2;
+}
+
+static int expect_right(int x, int y) {
+    return x >= SSD1306_WIDTH / 2;
+}
+
+static void check_grayscale(void) {
+    draw_gray(0, true);
+    draw_gray(2, false);
+    ssd1306_select(panels[1].display);
+
+    CHECK(gray_begin(panels[0].display));
+    CHECK(gray_begin(panels[2].display));
+    CHECK(gray_active(panels[0].display));
+    CHECK(!gray_active(panels[1].display));
+    gray_step(panels[0].display);
+    gray_step(panels[2].display);
+    CHECK_EQ(ssd1306_model_compare(&panels[0].model, expect_left), 0);
+    CHECK_EQ(ssd1306_model_compare(&panels[2].model, expect_right), 0);
+
+    // Ending one leaves the other running
+    gray_end(panels[0].display);
+    CHECK(!gray_active(panels[0].display));
+    CHECK(gray_active(panels[2].display));
+    CHECK(ssd1306_display(panels[0].display));
+    CHECK_EQ(panel_diff(&panels[0]), 0);
+    gray_end(panels[2].display);
+    CHECK(ssd1306_display(panels[2].display));
+    CHECK_EQ(panel_diff(&panels[2]), 0);
+}
+
+int main(void) {
+    i2c_config_t config_a = {.scl_pin = 7, .sda_pin = 6, .freq_hz = 400000};
+    i2c_config_t config_b = {.scl_pin = 5, .sda_pin = 4, .freq_hz = 100000};
+    i2c_bus_t *bus_a = i2c_bus_create(&config_a);
+    i2c_bus_t *bus_b = i2c_bus_create(&config_b);
+    CHECK(bus_a != NULL && bus_b != NULL);
+
+    CHECK(panel_add(0, bus_a, SSD1306_I2C_ADDR_DEFAULT, 1000000)->display != NULL);
+    CHECK(panel_add(1, bus_a, SSD1306_I2C_ADDR_ALT, 400000)->display != NULL);
+    CHECK(panel_add(2, bus_b, SSD1306_I2C_ADDR_DEFAULT, 100000)->display != NULL);
+
+    check_updates();
+    check_clocks();
+    check_grayscale();
+
+    return test_done("test_multi_display");
+}
@@ -0,0 +1,274 @@
+/*
+ * The I2C transaction queue on the fake bus
+ *
+ * The queue is drained from the bus's simulated interrupt while a main
+ * loop keeps making passes of its own work. Ordering: transactions
+ * finish in submission order, whoever submitted them, with their
+ * callbacks in the interrupt. Fairness: a user that keeps resubmitting
+ * from its callback goes to the back each time, so another user's
+ * transaction waits only for what was queued before it. Also
+ * synchronous calls waiting for the running transaction, cancelling,
+ * errors that do not hold up the rest, and a bus owned by a synchronous
+ * caller when a transaction's turn comes.
+ */
+
+#include "test.h"
+#include "i2c_queue.h"
+#include "i2c_fake.h"
+#include "regs_model.h"
+#include "host.h"
+#include "cpu.h"
+#include <string.h>
+
+static i2c_bus_t *bus;
+static sim_i2c_bus_t *sim;
+static regs_model_t sensor_a;
+static regs_model_t sensor_b;
+static i2c_dev_t dev_a;
+static i2c_dev_t dev_b;
+static i2c_dev_t dev_missing;
+
+// Completion order, one letter per finished transaction (txn->user)
+static char finished[64];
+static int finished_count;
+static int finished_unmasked;  // Callbacks run with interrupts enabled
+
+static void record_done(i2c_txn_t *txn) {
+    if (host_irq_enabled()) {
+        finished_unmasked++;
+    }
+    if (finished_count < (int)sizeof(finished) - 1) {
+        finished[finished_count++] = *(const char *)txn->user;
+        finished[finished_count] = '\0';
+    }
+}
+
+static void finished_clear(void) {
+    finished_count = 0;
+    finished[0] = '\0';
+}
+
+// A one-byte register write to dev, named by a letter
+typedef struct {
+    i2c_txn_t txn;
+    uint8_t bytes[2];
+    i2c_segment_t segment;
+    char name;
+    int repeat;  // Resubmits left (repeat_done)
+} job_t;
+
+static void job_init(job_t *job, const i2c_dev_t *dev, char name, uint8_t reg, uint8_t value) {
+    memset(job, 0, sizeof(*job));
+    job->name = name;
+    job->bytes[0] = reg;
+    job->bytes[1] = value;
+    job->segment = (i2c_segment_t){.tx = job->bytes, .len = 2};
+    job->txn.dev = dev;
+    job->txn.segments = &job->segment;
+    job->txn.count = 1;
+    job->txn.done = record_done;
+    job->txn.user = &job->name;
+}
+
+// The bus's interrupt handler, as main.c attaches it
+static void bus_isr(void *arg) {
+    i2c_bus_service(arg);
+}
+
+// The main loop: passes of 10us of other work each, polling the queue,
+// until the interrupt has drained it; returns the number of passes
+static int main_loop(void) {
+    int passes = 0;
+    while (i2c_queue_pending() > 0 && passes < 100000) {
+        host_cycles_advance(CPU_FREQ_HZ / 100000);
+        i2c_queue_poll();
+        passes++;
+    }
+    return passes;
+}
+
+static void check_order(void) {
+    job_t jobs[6];
+    const i2c_dev_t *devs[] = {&dev_a, &dev_b, &dev_a, &dev_a, &dev_b, &dev_b};
+    finished_clear();
+    for (int i = 0; i < 6; i++) {
+        job_init(&jobs[i], devs[i], 'A' + i, 0x10 + i, i);
+        CHECK(i2c_queue_submit(&jobs[i].txn));
+    }
+    CHECK_EQ(i2c_queue_pending(), 6);
+    CHECK(!i2c_queue_submit(&jobs[2].txn));  // Already queued
+
+    // The first starts as it is submitted, the rest wait their turn
+    CHECK_EQ(jobs[0].txn.state, I2C_TXN_ACTIVE);
+    CHECK(i2c_bus_busy(bus));
+    for (int i = 1; i < 6; i++) {
+        CHECK_EQ(jobs[i].txn.state, I2C_TXN_QUEUED);
+    }
+    CHECK_EQ(finished_count, 0);
+
+    // The interrupt runs them, oldest first, while the main loop goes on
+    finished_unmasked = 0;
+    uint64_t start = host_cycles_total();
+    int passes = main_loop();
+    CHECK(passes > 20);
+    CHECK(strcmp(finished, "ABCDEF") == 0);
+    CHECK_EQ(finished_unmasked, 0);
+    for (int i = 0; i < 6; i++) {
+        CHECK_EQ(jobs[i].txn.state, I2C_TXN_DONE);
+        CHECK_EQ(jobs[i].txn.error, I2C_OK);
+    }
+    // Six three-byte writes: 3 at 400kHz and 3 at 100kHz
+    uint64_t bus_cycles = 3 * 29 * (CPU_FREQ_HZ / 400000) + 3 * 29 * (CPU_FREQ_HZ / 100000);
+    uint64_t elapsed = host_cycles_total() - start;
+    CHECK(elapsed >= bus_cycles && elapsed < bus_cycles + CPU_FREQ_HZ / 10000);
+    CHECK(!i2c_bus_busy(bus));
+    CHECK(i2c_queue_poll());
+    CHECK_EQ(sensor_a.regs[0x13], 3);
+    CHECK_EQ(sensor_b.regs[0x15], 5);
+    CHECK(host_irq_enabled());
+}
+
+// A busy user: its callback submits the same transaction again, repeat
+// more times
+static void repeat_done(i2c_txn_t *txn) {
+    job_t *job = (job_t *)txn;  // txn is the first member
+    record_done(txn);
+    if (job->repeat > 0) {
+        job->repeat--;
+        CHECK(i2c_queue_submit(txn));
+    }
+}
+
+static void check_fairness(void) {
+    job_t busy, other;
+    finished_clear();
+    job_init(&busy, &dev_a, 'a', 0x20, 1);
+    busy.txn.done = repeat_done;
+    busy.repeat = 5;
+    CHECK(i2c_queue_submit(&busy.txn));
+    CHECK_EQ(busy.txn.state, I2C_TXN_ACTIVE);
+
+    // Another user joins: it only waits for the 'a' running
+    job_init(&other, &dev_b, 'b', 0x21, 2);
+    CHECK(i2c_queue_submit(&other.txn));
+    CHECK_EQ(other.txn.state, I2C_TXN_QUEUED);
+    main_loop();
+    CHECK_EQ(other.txn.state, I2C_TXN_DONE);
+    CHECK(strcmp(finished, "abaaaaa") == 0);
+
+    // Two busy users, at different clocks, take turns
+    finished_clear();
+    job_init(&busy, &dev_a, 'a', 0x22, 3);
+    job_init(&other, &dev_b, 'b', 0x23, 4);
+    busy.txn.done = repeat_done;
+    other.txn.done = repeat_done;
+    busy.repeat = 3;
+    other.repeat = 3;
+    CHECK(i2c_queue_submit(&busy.txn));
+    CHECK(i2c_queue_submit(&other.txn));
+    main_loop();
+    CHECK(strcmp(finished, "abababab") == 0);
+}
+
+static void check_sync(void) {
+    job_t job;
+    finished_clear();
+    job_init(&job, &dev_b, 's', 0x60, 1);
+    CHECK(i2c_queue_submit(&job.txn));
+    CHECK_EQ(job.txn.state, I2C_TXN_ACTIVE);
+
+    // A synchronous write waits for the running transaction, then goes
+    // out at its own clock
+    uint8_t data[] = {0x61, 2};
+    i2c_dev_select(&dev_a);
+    CHECK(i2c_write(&dev_a, data, sizeof(data)));
+    CHECK(strcmp(finished, "s") == 0);
+    CHECK_EQ(job.txn.state, I2C_TXN_DONE);
+    CHECK_EQ(i2c_bus_freq(bus), 400000);
+    CHECK_EQ(sensor_b.regs[0x60], 1);
+    CHECK_EQ(sensor_a.regs[0x61], 2);
+    CHECK_EQ(i2c_queue_pending(), 0);
+}
+
+static void check_cancel(void) {
+    job_t first, second, third;
+    finished_clear();
+    job_init(&first, &dev_a, 'x', 0x30, 1);
+    job_init(&second, &dev_a, 'y', 0x31, 2);
+    job_init(&third, &dev_a, 'z', 0x32, 3);
+    CHECK(i2c_queue_submit(&first.txn));
+    CHECK(i2c_queue_submit(&second.txn));
+    CHECK(i2c_queue_submit(&third.txn));
+    CHECK(!i2c_queue_cancel(&first.txn));  // Running
+
+    // Out of the middle and off the end; the rest keeps its order
+    CHECK(i2c_queue_cancel(&second.txn));
+    CHECK_EQ(second.txn.state, I2C_TXN_IDLE);
+    CHECK(i2c_queue_cancel(&third.txn));
+    CHECK(!i2c_queue_cancel(&third.txn));
+    CHECK_EQ(i2c_queue_pending(), 1);
+    CHECK(i2c_queue_submit(&third.txn));
+    main_loop();
+    CHECK(strcmp(finished, "xz") == 0);
+    CHECK(!i2c_queue_cancel(&first.txn));  // Done already
+    CHECK_EQ(sensor_a.regs[0x31], 0);
+}
+
+static void check_errors(void) {
+    job_t missing, after;
+    finished_clear();
+    job_init(&missing, &dev_missing, 'm', 0x40, 1);
+    job_init(&after, &dev_a, 'n', 0x41, 2);
+    CHECK(i2c_queue_submit(&missing.txn));
+    CHECK(i2c_queue_submit(&after.txn));
+    main_loop();
+    CHECK(strcmp(finished, "mn") == 0);
+    CHECK_EQ(missing.txn.error, I2C_ERR_NACK);
+    CHECK_EQ(after.txn.error, I2C_OK);
+    CHECK_EQ(sensor_a.regs[0x41], 2);
+}
+
+static void check_bus_owned(void) {
+    job_t job;
+    finished_clear();
+    job_init(&job, &dev_a, 'o', 0x50, 1);
+
+    // A byte-level transaction is open: the job waits for the bus
+    CHECK(i2c_start(bus));
+    CHECK(i2c_queue_submit(&job.txn));
+    CHECK(!i2c_queue_poll());
+    host_cycles_advance(CPU_FREQ_HZ / 1000);
+    CHECK_EQ(job.txn.state, I2C_TXN_QUEUED);
+    i2c_stop(bus);
+
+    // The main loop's next poll starts it, the interrupt finishes it
+    CHECK(!i2c_queue_poll());
+    CHECK_EQ(job.txn.state, I2C_TXN_ACTIVE);
+    main_loop();
+    CHECK(strcmp(finished, "o") == 0);
+    CHECK_EQ(sensor_a.regs[0x50], 1);
+}
+
+int main(void) {
+    i2c_config_t config = {.scl_pin = 7, .sda_pin = 6, .freq_hz = 400000};
+    bus = i2c_bus_create(&config);
+    CHECK(bus != NULL);
+    host_irq_attach(i2c_fake_irq(bus), bus_isr, bus);
+    sim = i2c_fake_sim(bus);
+    regs_model_init(&sensor_a, 0x48);
+    regs_model_init(&sensor_b, 0x49);
+    sim_i2c_attach(sim, &sensor_a.dev);
+    sim_i2c_attach(sim, &sensor_b.dev);
+    dev_a = (i2c_dev_t){.bus = bus, .addr = 0x48, .freq_hz = 400000};
+    dev_b = (i2c_dev_t){.bus = bus, .addr = 0x49, .freq_hz = 100000};
+    dev_missing = (i2c_dev_t){.bus = bus, .addr = 0x50};
+
+    check_order();
+    check_fairness();
+    check_sync();
+    check_cancel();
+    check_errors();
+    check_bus_owned();
+
+    return test_done("test_queue");
+}
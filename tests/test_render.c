@@ -0,0 +1,157 @@
+/*
+ * Rendering through the controller model
+ *
+ * Draws with the driver, sends the frame over the simulated bus into the
+ * SSD1306/SH1106 model and checks that the glass shows the canvas in
+ * every orientation, after hardware scrolling and with the display
+ * inverted. Each case also leaves a PBM snapshot of the glass in the
+ * build directory, and the shell's dump command has to produce the same
+ * image as the model.
+ */
+
+#include "test.h"
+#include "display_fixture.h"
+#include "shell.h"
+#include "textgrid.h"
+#include <string.h>
+
+// Canvas pixel that glass pixel (x, y) should show
+static int glass_to_canvas(int x, int y) {
+    switch (ssd1306_get_rotation(oled)) {
+        case SSD1306_ROTATE_0:   return ssd1306_get_pixel(x, y);
+        case SSD1306_ROTATE_180: return ssd1306_get_pixel(SSD1306_WIDTH - 1 - x, SSD1306_HEIGHT - 1 - y);
+        case SSD1306_ROTATE_90:  return ssd1306_get_pixel(y, SSD1306_WIDTH - 1 - x);
+        case SSD1306_ROTATE_270: return ssd1306_get_pixel(SSD1306_HEIGHT - 1 - y, x);
+    }
+    return 0;
+}
+
+static bool inverted;
+
+static int expected_pixel(int x, int y) {
+    return glass_to_canvas(x, y) ^ inverted;
+}
+
+// Compare the glass with the canvas and save a snapshot
+static void check_glass(const char *name) {
+    char path[96];
+    snprintf(path, sizeof(path), "render_%s_%s.pbm", TEST_PANEL_NAME, name);
+    CHECK(ssd1306_model_write_pbm(&model, path));
+
+    int differ = ssd1306_model_compare(&model, expected_pixel);
+    if (differ) {
+        fprintf(stderr, "%s: %d pixels differ, glass:\n", name, differ);
+        ssd1306_model_print(&model, stderr);
+    }
+    CHECK_EQ(differ, 0);
+    CHECK_EQ(model.unknown_commands, 0);
+    CHECK_EQ(model.truncated_commands, 0);
+}
+
+// Something asymmetric in every corner, text and a few stray pixels
+static void draw_pattern(int seed) {
+    int w = ssd1306_width();
+    int h = ssd1306_height();
+    ssd1306_clear();
+    ssd1306_fill_rect(0, 0, 5, 3, SSD1306_WHITE);
+    ssd1306_fill_rect(w - 2, 0, 2, 7, SSD1306_WHITE);
+    ssd1306_fill_rect(1, h - 4, 9, 4, SSD1306_WHITE);
+    ssd1306_set_pixel(w - 1, h - 1, SSD1306_WHITE);
+    ssd1306_draw_string(3, 9 + seed % 5, "Hi 42");
+    for (int i = 0; i < 20; i++) {
+        ssd1306_set_pixel((i * 37 + seed * 11) % w, (i * 23 + seed * 7) % h, SSD1306_INVERSE);
+    }
+}
+
+// The dump command has to print exactly what the glass shows
+static void check_dump(void) {
+    char path[96];
+    snprintf(path, sizeof(path), "render_%s_dump.pbm", TEST_PANEL_NAME);
+
+    host_console_clear();
+    shell_execute("dump");
+    ssd1306_display(oled);
+    CHECK(ssd1306_model_write_pbm(&model, path));
+
+    // Both are P1 images; compare them with the whitespace taken out
+    const char *dump = strstr(host_console_output(), "P1\n");
+    CHECK(dump != NULL);
+    FILE *f = fopen(path, "r");
+    CHECK(f != NULL);
+    if (!dump || !f) {
+        return;
+    }
+
+    char header[32];
+    snprintf(header, sizeof(header), "P1\n%d %d\n", SSD1306_WIDTH, SSD1306_HEIGHT);
+    CHECK(strncmp(dump, header, strlen(header)) == 0);
+    dump += strlen(header);
+    char line[32];
+    CHECK(fgets(line, sizeof(line), f) && fgets(line, sizeof(line), f));
+
+    int pixels = 0;
+    int mismatches = 0;
+    for (int c; (c = fgetc(f)) != EOF; ) {
+        if (c != '0' && c != '1') {
+            continue;
+        }
+        while (*dump == '\n') {
+            dump++;
+        }
+        mismatches += *dump++ != c;
+        pixels++;
+    }
+    fclose(f);
+    CHECK_EQ(pixels, SSD1306_WIDTH * SSD1306_HEIGHT);
+    CHECK_EQ(mismatches, 0);
+}
+
+int main(void) {
+    CHECK(fixture_init(1000000) != NULL);
+    CHECK(model.display_on);
+    CHECK_EQ(model.multiplex, SSD1306_HEIGHT);
+    check_glass("blank");
+
+    // Landscape, then a few hardware scrolls with new text at the bottom
+    draw_pattern(0);
+    ssd1306_display(oled);
+    check_glass("rot0");
+
+    for (int i = 0; i < 3; i++) {
+        ssd1306_scroll_page();
+        ssd1306_draw_string(0, ssd1306_height() - 8, i == 0 ? "one" : i == 1 ? "two" : "three");
+        ssd1306_display(oled);
+    }
+    check_glass("scroll");
+#if SSD1306_HW_SCROLL
+    CHECK(model.start_line == 24);
+#endif
+
+    // Partial updates: a single character and a cleared corner
+    ssd1306_draw_char(60, 20, 'X');
+    ssd1306_fill_rect(0, 0, 3, 3, SSD1306_BLACK);
+    ssd1306_display(oled);
+    check_glass("partial");
+
+    ssd1306_invert_display(oled, true);
+    inverted = true;
+    check_glass("inverted");
+    ssd1306_invert_display(oled, false);
+    inverted = false;
+
+    static const char *const names[] = {"rot0", "rot90", "rot180", "rot270"};
+    for (int r = SSD1306_ROTATE_90; r <= SSD1306_ROTATE_270; r++) {
+        ssd1306_set_rotation(oled, (ssd1306_rotation_t)r);
+        draw_pattern(r);
+        ssd1306_display(oled);
+        check_glass(names[r]);
+    }
+
+    // Back to landscape for the shell
+    ssd1306_set_rotation(oled, SSD1306_ROTATE_0);
+    shell_init(oled);
+    shell_execute("echo dump me");
+    check_dump();
+
+    return test_done("test_render_" TEST_PANEL_NAME);
+}
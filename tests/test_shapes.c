@@ -0,0 +1,230 @@
+/*
+ * Lines, circles and rounded rectangles, pixel for pixel on the panel
+ *
+ * Small shapes are compared with their pixels written out by hand. Shapes
+ * cut by the screen edges must show exactly the on-screen part of the
+ * same shape drawn whole into a larger off-screen target. Every pixel is
+ * drawn once, so SSD1306_INVERSE on a blank screen gives the same image
+ * as SSD1306_WHITE, and drawing a shape twice with it restores the
+ * screen.
+ */
+
+#include "test.h"
+#include "display_fixture.h"
+#include "gfx.h"
+#include <string.h>
+
+typedef enum {
+    LINE,
+    CIRCLE,
+    FILL_CIRCLE,
+    ROUND_RECT,
+    FILL_ROUND_RECT,
+} shape_kind_t;
+
+typedef struct {
+    shape_kind_t kind;
+    int a, b, c, d, e;  // LINE x0 y0 x1 y1, CIRCLE x y r, ROUND_RECT x y w h r
+} shape_t;
+
+static void draw_shape(const shape_t *s, int dx, int dy, uint8_t color) {
+    switch (s->kind) {
+        case LINE:            gfx_draw_line(s->a + dx, s->b + dy, s->c + dx, s->d + dy, color); break;
+        case CIRCLE:          gfx_draw_circle(s->a + dx, s->b + dy, s->c, color); break;
+        case FILL_CIRCLE:     gfx_fill_circle(s->a + dx, s->b + dy, s->c, color); break;
+        case ROUND_RECT:      gfx_draw_round_rect(s->a + dx, s->b + dy, s->c, s->d, s->e, color); break;
+        case FILL_ROUND_RECT: gfx_fill_round_rect(s->a + dx, s->b + dy, s->c, s->d, s->e, color); break;
+    }
+}
+
+// Expected image for ssd1306_model_compare()
+static uint8_t expected[SSD1306_HEIGHT][SSD1306_WIDTH];
+
+static int expect_image(int x, int y) {
+    return expected[y][x];
+}
+
+// Expect a picture ('#' lit) with its top left corner at (x, y)
+static void expect_art(int x, int y, const char *const *rows, int count) {
+    memset(expected, 0, sizeof(expected));
+    for (int row = 0; row < count; row++) {
+        for (int col = 0; rows[row][col]; col++) {
+            expected[y + row][x + col] = rows[row][col] == '#';
+        }
+    }
+}
+
+// Draw on a blank screen and compare what the panel shows
+static int panel_diff(const shape_t *s, uint8_t color) {
+    ssd1306_clear();
+    draw_shape(s, 0, 0, color);
+    ssd1306_display(oled);
+    return ssd1306_model_compare(&model, expect_image);
+}
+
+#define ART(x, y, ...) do { \
+        static const char *const rows_[] = {__VA_ARGS__}; \
+        expect_art(x, y, rows_, sizeof(rows_) / sizeof(rows_[0])); \
+    } while (0)
+
+static void check_by_hand(void) {
+    shape_t s;
+
+    s = (shape_t){LINE, 10, 20, 17, 23};
+    ART(10, 20,
+        "##......",
+        "..##....",
+        "....##..",
+        "......##");
+    CHECK_EQ(panel_diff(&s, SSD1306_WHITE), 0);
+    s = (shape_t){LINE, 17, 23, 10, 20};  // Same line drawn backwards
+    CHECK_EQ(panel_diff(&s, SSD1306_WHITE), 0);
+
+    s = (shape_t){CIRCLE, 33, 13, 3};
+    ART(30, 10,
+        "..###..",
+        ".#...#.",
+        "#.....#",
+        "#.....#",
+        "#.....#",
+        ".#...#.",
+        "..###..");
+    CHECK_EQ(panel_diff(&s, SSD1306_WHITE), 0);
+
+    s = (shape_t){FILL_CIRCLE, 33, 13, 3};
+    ART(30, 10,
+        "..###..",
+        ".#####.",
+        "#######",
+        "#######",
+        "#######",
+        ".#####.",
+        "..###..");
+    CHECK_EQ(panel_diff(&s, SSD1306_WHITE), 0);
+
+    s = (shape_t){ROUND_RECT, 50, 5, 10, 7, 2};
+    ART(50, 5,
+        ".########.",
+        "#........#",
+        "#........#",
+        "#........#",
+        "#........#",
+        "#........#",
+        ".########.");
+    CHECK_EQ(panel_diff(&s, SSD1306_WHITE), 0);
+
+    s = (shape_t){FILL_ROUND_RECT, 50, 5, 10, 7, 2};
+    ART(50, 5,
+        ".########.",
+        "##########",
+        "##########",
+        "##########",
+        "##########",
+        "##########",
+        ".########.");
+    CHECK_EQ(panel_diff(&s, SSD1306_WHITE), 0);
+}
+
+// Off-screen reference: the screen with a MARGIN pixel border all round
+#define MARGIN 64
+#define REF_W (SSD1306_WIDTH + 2 * MARGIN)
+#define REF_H (SSD1306_HEIGHT + 2 * MARGIN)
+
+static uint8_t reference[REF_W * REF_H / 8];
+
+// Expect the on-screen part of the shape drawn whole
+static void expect_unclipped(const shape_t *s) {
+    memset(reference, 0, sizeof(reference));
+    ssd1306_set_target(reference, REF_W, REF_H, NULL);
+    draw_shape(s, MARGIN, MARGIN, SSD1306_WHITE);
+    ssd1306_set_target(NULL, 0, 0, NULL);
+
+    for (int y = 0; y < SSD1306_HEIGHT; y++) {
+        for (int x = 0; x < SSD1306_WIDTH; x++) {
+            int rx = x + MARGIN;
+            int ry = y + MARGIN;
+            expected[y][x] = (reference[(ry / 8) * REF_W + rx] >> (ry & 7)) & 1;
+        }
+    }
+}
+
+static const shape_t edge_shapes[] = {
+    // Lines leaving through each edge, shallow and steep, and one that
+    // crosses the whole screen from outside to outside
+    {LINE, 20, 10, -30, 25},
+    {LINE, 100, 50, 160, 40},
+    {LINE, 64, 20, 70, -40},
+    {LINE, 40, 40, 35, SSD1306_HEIGHT + 30},
+    {LINE, -20, -10, SSD1306_WIDTH + 20, SSD1306_HEIGHT + 5},
+    {LINE, -50, 5, -10, 30},  // Entirely off screen
+    // Circles over corners and edges
+    {CIRCLE, 0, 0, 10},
+    {CIRCLE, SSD1306_WIDTH - 1, SSD1306_HEIGHT - 1, 20},
+    {CIRCLE, -5, SSD1306_HEIGHT / 2, 12},
+    {CIRCLE, SSD1306_WIDTH / 2, -3, 9},
+    {FILL_CIRCLE, 3, SSD1306_HEIGHT - 2, 14},
+    {FILL_CIRCLE, SSD1306_WIDTH + 4, 10, 11},
+    {FILL_CIRCLE, SSD1306_WIDTH / 2, SSD1306_HEIGHT / 2, 40},
+    // Rounded rectangles hanging off the edges
+    {ROUND_RECT, -8, -4, 30, 20, 6},
+    {ROUND_RECT, SSD1306_WIDTH - 18, SSD1306_HEIGHT - 10, 40, 30, 8},
+    {ROUND_RECT, -10, 5, SSD1306_WIDTH + 20, SSD1306_HEIGHT - 10, 12},
+    {FILL_ROUND_RECT, -6, SSD1306_HEIGHT - 15, 35, 25, 7},
+    {FILL_ROUND_RECT, SSD1306_WIDTH - 20, -12, 30, 28, 5},
+};
+
+#define SHAPE_COUNT ((int)(sizeof(edge_shapes) / sizeof(edge_shapes[0])))
+
+static void check_clipping(void) {
+    for (int i = 0; i < SHAPE_COUNT; i++) {
+        expect_unclipped(&edge_shapes[i]);
+        int diff = panel_diff(&edge_shapes[i], SSD1306_WHITE);
+        if (diff) {
+            fprintf(stderr, "edge shape %d: %d pixels differ\n", i, diff);
+        }
+        CHECK_EQ(diff, 0);
+    }
+}
+
+// A pattern to draw over, so XOR has lit pixels to clear too
+static void checkerboard(void) {
+    for (int y = 0; y < SSD1306_HEIGHT; y++) {
+        for (int x = 0; x < SSD1306_WIDTH; x++) {
+            ssd1306_set_pixel(x, y, (x ^ y) & 1);
+        }
+    }
+}
+
+static void check_xor(void) {
+    static uint8_t before[SSD1306_HEIGHT][SSD1306_WIDTH];
+
+    for (int i = 0; i < SHAPE_COUNT; i++) {
+        // Once on a blank screen: each pixel flipped once, none twice
+        expect_unclipped(&edge_shapes[i]);
+        CHECK_EQ(panel_diff(&edge_shapes[i], SSD1306_INVERSE), 0);
+
+        // Twice over a pattern: back to the pattern
+        ssd1306_clear();
+        checkerboard();
+        for (int y = 0; y < SSD1306_HEIGHT; y++) {
+            for (int x = 0; x < SSD1306_WIDTH; x++) {
+                before[y][x] = ssd1306_get_pixel(x, y);
+            }
+        }
+        draw_shape(&edge_shapes[i], 0, 0, SSD1306_INVERSE);
+        draw_shape(&edge_shapes[i], 0, 0, SSD1306_INVERSE);
+        ssd1306_display(oled);
+        memcpy(expected, before, sizeof(expected));
+        CHECK_EQ(ssd1306_model_compare(&model, expect_image), 0);
+    }
+}
+
+int main(void) {
+    CHECK(fixture_init(1000000) != NULL);
+
+    check_by_hand();
+    check_clipping();
+    check_xor();
+
+    return test_done("test_shapes");
+}
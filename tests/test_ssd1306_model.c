@@ -0,0 +1,122 @@
+/*
+ * The controller model itself: control bytes, addressing modes and the
+ * window, fed byte by byte the way a driver would send them
+ */
+
+#include "test.h"
+#include "ssd1306_model.h"
+#include <string.h>
+
+static sim_i2c_bus_t bus;
+static ssd1306_model_t model;
+
+// One transaction: address, then the bytes as given
+static void send(const uint8_t *bytes, int len) {
+    sim_i2c_start(&bus);
+    sim_i2c_write(&bus, 0x3C << 1);
+    for (int i = 0; i < len; i++) {
+        sim_i2c_write(&bus, bytes[i]);
+    }
+    sim_i2c_stop(&bus);
+}
+
+static void setup(ssd1306_model_chip_t chip) {
+    sim_i2c_init(&bus);
+    ssd1306_model_init(&model, chip, 0x3C, 128, 64, chip == SSD1306_MODEL_SH1106 ? 2 : 0);
+    sim_i2c_attach(&bus, &model.dev);
+}
+
+static void test_horizontal_window(void) {
+    setup(SSD1306_MODEL_SSD1306);
+    const uint8_t cmds[] = {0x00, 0x20, 0x00, 0x21, 10, 12, 0x22, 2, 3};
+    send(cmds, sizeof(cmds));
+    const uint8_t data[] = {0x40, 1, 2, 3, 4, 5, 6, 7};
+    send(data, sizeof(data));
+
+    // Three columns per page, then back to the first page of the window
+    CHECK_EQ(model.gram[2][11], 2);
+    CHECK_EQ(model.gram[2][12], 3);
+    CHECK_EQ(model.gram[3][10], 4);
+    CHECK_EQ(model.gram[3][12], 6);
+    CHECK_EQ(model.gram[2][10], 7);
+    CHECK_EQ(model.column, 11);
+    CHECK_EQ(model.page, 2);
+    CHECK_EQ(model.data_bytes, 7);
+}
+
+static void test_vertical(void) {
+    setup(SSD1306_MODEL_SSD1306);
+    const uint8_t cmds[] = {0x00, 0x20, 0x01, 0x21, 0, 127, 0x22, 0, 1};
+    send(cmds, sizeof(cmds));
+    const uint8_t data[] = {0x40, 0x11, 0x22, 0x33};
+    send(data, sizeof(data));
+    CHECK_EQ(model.gram[0][0], 0x11);
+    CHECK_EQ(model.gram[1][0], 0x22);
+    CHECK_EQ(model.gram[0][1], 0x33);
+}
+
+static void test_single_bytes(void) {
+    // Co set: every byte has its own control byte, commands and data mixed
+    setup(SSD1306_MODEL_SSD1306);
+    const uint8_t mixed[] = {0x80, 0xB5, 0x80, 0x04, 0x80, 0x11, 0xC0, 0x5A, 0x80, 0xA7};
+    send(mixed, sizeof(mixed));
+    CHECK_EQ(model.gram[5][0x14], 0x5A);
+    CHECK(model.inverted);
+    CHECK_EQ(model.commands, 4);
+}
+
+static void test_truncated_and_unknown(void) {
+    setup(SSD1306_MODEL_SSD1306);
+    const uint8_t cut[] = {0x00, 0x21, 0x05};  // Column range without its end
+    send(cut, sizeof(cut));
+    CHECK_EQ(model.truncated_commands, 1);
+
+    // The SH1106 has no window commands
+    setup(SSD1306_MODEL_SH1106);
+    const uint8_t window[] = {0x00, 0x20};
+    send(window, sizeof(window));
+    CHECK_EQ(model.unknown_commands, 1);
+
+    // Its page addressing stops at the end of the 132-column page
+    const uint8_t cmds[] = {0x00, 0xB1, 0x02, 0x18};
+    send(cmds, sizeof(cmds));
+    uint8_t data[1 + 4] = {0x40, 9, 9, 9, 9};
+    send(data, sizeof(data));
+    CHECK_EQ(model.gram[1][130], 9);
+    CHECK_EQ(model.gram[1][131], 9);
+    CHECK_EQ(model.gram[2][0], (uint8_t)(0xA5 ^ 62));  // Untouched
+}
+
+static int lit_top_left(int x, int y) {
+    return x == 0 && y == 0;
+}
+
+static void test_glass(void) {
+    // Remap and reverse scan show RAM column 0, row 0 at the top left;
+    // the start line moves the picture up
+    setup(SSD1306_MODEL_SSD1306);
+    const uint8_t cmds[] = {0x00, 0xA1, 0xC8, 0x20, 0x00, 0x21, 0, 127, 0x22, 0, 7, 0xAF};
+    send(cmds, sizeof(cmds));
+    uint8_t frame[1 + 1024] = {0x40};
+    frame[1] = 0x01;
+    send(frame, sizeof(frame));
+    CHECK_EQ(ssd1306_model_compare(&model, lit_top_left), 0);
+
+    const uint8_t flip[] = {0x00, 0xA0, 0xC0};
+    send(flip, sizeof(flip));
+    CHECK_EQ(ssd1306_model_pixel(&model, 127, 63), 1);
+
+    const uint8_t back[] = {0x00, 0xA1, 0xC8, 0x48};  // Start line 8
+    send(back, sizeof(back));
+    CHECK_EQ(ssd1306_model_pixel(&model, 0, 56), 1);
+    CHECK_EQ(model.start_line_commands, 1);
+}
+
+int main(void) {
+    test_horizontal_window();
+    test_vertical();
+    test_single_bytes();
+    test_truncated_and_unknown();
+    test_glass();
+    return test_done("test_ssd1306_model");
+}
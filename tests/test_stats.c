@@ -0,0 +1,72 @@
+/*
+ * Driver statistics for known updates on the fake bus
+ *
+ * Two dirty rectangles far apart go out as two windows: one addressing
+ * and one data transaction each, with the byte counts the model sees.
+ * The timing fields follow the bus time the update took, and an
+ * asynchronous update sent in chunks keeps each step below the whole.
+ */
+
+#include "test.h"
+#include "display_fixture.h"
+
+int main(void) {
+    ssd1306_stats_t stats;
+    CHECK(fixture_init(400000) != NULL);
+    ssd1306_clear();
+    CHECK(ssd1306_display(oled));
+    ssd1306_reset_stats(oled);
+    ssd1306_get_stats(oled, &stats);
+    CHECK_EQ(stats.flushes, 0);
+    CHECK_EQ(stats.max_step_cycles, 0);
+
+    // Page 1 columns 10-29 and page 5 columns 100-109
+    ssd1306_fill_rect(10, 8, 20, 8, SSD1306_WHITE);
+    ssd1306_fill_rect(100, 40, 10, 8, SSD1306_WHITE);
+    uint32_t model_data = model.data_bytes;
+    uint32_t model_transactions = model.transactions;
+    fixture_bus_bytes();
+    CHECK(ssd1306_display(oled));
+    uint32_t bus_bytes = fixture_bus_bytes();
+
+    ssd1306_get_stats(oled, &stats);
+    CHECK_EQ(stats.flushes, 1);
+    CHECK_EQ(stats.transactions, 4);
+    CHECK_EQ(stats.command_bytes, 2 * 6);  // COLUMN_ADDR and PAGE_ADDR per window
+    CHECK_EQ(stats.data_bytes, 20 + 10);
+    CHECK_EQ(stats.errors, 0);
+    CHECK_EQ(model.data_bytes - model_data, stats.data_bytes);
+    CHECK_EQ(model.transactions - model_transactions, stats.transactions);
+
+    // At least the bus time of what was sent (nine SCL periods a byte)
+    uint32_t bus_cycles = bus_bytes * 9 * (CPU_FREQ_HZ / 400000);
+    CHECK(stats.last_flush_cycles >= bus_cycles);
+    CHECK(stats.last_flush_cycles < 2 * bus_cycles);
+    CHECK_EQ(stats.max_flush_cycles, stats.last_flush_cycles);
+    CHECK_EQ(stats.total_flush_cycles, stats.last_flush_cycles);
+    CHECK(stats.last_flush_latency_cycles >= stats.last_flush_cycles);
+    CHECK_EQ(stats.max_step_cycles, stats.last_flush_cycles);  // One blocking step
+    CHECK_EQ(stats.coalesced, 0);
+
+    // Asynchronous: 100 bytes in chunks, each step shorter than the update
+    ssd1306_reset_stats(oled);
+    ssd1306_set_frame_rate(oled, 0);
+    ssd1306_fill_rect(0, 56, 100, 8, SSD1306_WHITE);
+    ssd1306_display_async(oled);
+    fixture_flush();
+    ssd1306_get_stats(oled, &stats);
+    CHECK_EQ(stats.flushes, 1);
+    CHECK_EQ(stats.data_bytes, 100);
+    CHECK_EQ(stats.transactions, 1 + (100 + SSD1306_FLUSH_CHUNK_BYTES - 1) / SSD1306_FLUSH_CHUNK_BYTES);
+    CHECK(stats.max_step_cycles > 0);
+    CHECK(stats.max_step_cycles < stats.last_flush_cycles);
+    CHECK(stats.last_flush_latency_cycles >= stats.last_flush_cycles);
+
+    ssd1306_reset_stats(oled);
+    ssd1306_get_stats(oled, &stats);
+    CHECK_EQ(stats.data_bytes, 0);
+    CHECK_EQ(stats.last_flush_cycles, 0);
+
+    ssd1306_set_frame_rate(oled, SSD1306_FRAME_RATE);
+    return test_done("test_stats");
+}
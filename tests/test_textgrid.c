@@ -0,0 +1,64 @@
+/*
+ * Text grid sizing: the canvas in each orientation, capped by the
+ * TEXTGRID_COLS x TEXTGRID_ROWS storage (the SMALLGRID build overrides
+ * both), and the bytes sent for cells edited far apart on one row
+ */
+
+#include "test.h"
+#include "display_fixture.h"
+#include "textgrid.h"
+#include "shell.h"
+
+static int min(int a, int b) {
+    return a < b ? a : b;
+}
+
+int main(void) {
+    CHECK(fixture_init(400000) != NULL);
+
+    textgrid_init();
+    CHECK_EQ(textgrid_cols(), min(SSD1306_WIDTH / TEXTGRID_CELL_WIDTH, TEXTGRID_COLS));
+    CHECK_EQ(textgrid_rows(), min(SSD1306_HEIGHT / TEXTGRID_CELL_HEIGHT, TEXTGRID_ROWS));
+
+    ssd1306_set_rotation(oled, SSD1306_ROTATE_90);
+    textgrid_init();
+    CHECK_EQ(textgrid_cols(), min(SSD1306_HEIGHT / TEXTGRID_CELL_WIDTH, TEXTGRID_COLS));
+    CHECK_EQ(textgrid_rows(), min(SSD1306_WIDTH / TEXTGRID_CELL_HEIGHT, TEXTGRID_ROWS));
+    ssd1306_set_rotation(oled, SSD1306_ROTATE_0);
+
+    // Text past the grid is cut off, and the shell scrolls within the grid
+    textgrid_init();
+    textgrid_set_line(0, "0123456789abcdefghijklmnopqrstuvwxyz");
+    CHECK_EQ(textgrid_get(textgrid_cols() - 1, 0), "0123456789abcdefghijklmnopqrstuvwxyz"[textgrid_cols() - 1]);
+    CHECK_EQ(textgrid_get(textgrid_cols(), 0), '\0');
+
+    shell_init(oled);
+    for (int i = 0; i < 20; i++) {
+        shell_execute("echo scrolled");
+    }
+    ssd1306_display(oled);
+    CHECK_EQ(textgrid_get(0, textgrid_rows() - 1), 's');
+    int cols = textgrid_cols();
+    for (int x = cols * TEXTGRID_CELL_WIDTH; x < SSD1306_WIDTH; x++) {
+        for (int y = 0; y < SSD1306_HEIGHT; y++) {
+            CHECK_EQ(ssd1306_get_pixel(x, y), 0);  // Nothing drawn right of the grid
+        }
+    }
+
+    // Edits at both ends of a row: two cells' bytes, not the row between
+    textgrid_init();
+    textgrid_clear();
+    textgrid_render();
+    ssd1306_display(oled);
+    uint32_t before = model.data_bytes;
+    textgrid_put(0, 1, 'X');
+    textgrid_put(cols - 1, 1, 'Y');
+    textgrid_render();
+    ssd1306_display(oled);
+    CHECK(model.data_bytes - before > 0);
+    CHECK(model.data_bytes - before <= 2 * TEXTGRID_CELL_WIDTH);
+    CHECK_EQ(ssd1306_model_pixel(&model, 0, TEXTGRID_CELL_HEIGHT), 1);  // 'X' top left
+    CHECK_EQ(ssd1306_model_pixel(&model, (cols - 1) * TEXTGRID_CELL_WIDTH, TEXTGRID_CELL_HEIGHT), 1);  // 'Y'
+
+    return test_done("test_textgrid_" TEST_PANEL_NAME);
+}
@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+"""
+bdf2font.py - Convert a BDF bitmap font into an SSD1306 font table
+==================================================================
+
+Produces a C source file defining one `font_t` (see main/assets/font.h).
+Glyphs are stored in the display's own layout: column-major bytes with
+bit 0 at the top, one run of `width` bytes per 8-pixel page. Drawing a
+page-aligned glyph is then a straight byte copy into the framebuffer.
+
+Fixed mode keeps every glyph at the font bounding-box width. Proportional
+mode trims blank columns on both sides of each glyph and stores the
+per-glyph widths, which fits noticeably more text on a 128-pixel line.
+
+Usage:
+    bdf2font.py font5x7.bdf font_5x7.c --name font_5x7
+    bdf2font.py font5x7.bdf font_5x7_prop.c --name font_5x7_prop --proportional
+
+Runs at build time from main/CMakeLists.txt.
+"""
+
+import argparse
+import os
+import sys
+
+
+class Glyph:
+    def __init__(self, code):
+        self.code = code
+        self.advance = 0
+        self.bbx = (0, 0, 0, 0)  # width, height, x offset, y offset
+        self.rows = []           # Bitmap rows as (value, bit count), MSB = leftmost pixel
+
+
+def parse_bdf(path):
+    """Parse a BDF file into (font properties, {code: Glyph})."""
+    props = {}
+    glyphs = {}
+    glyph = None
+    in_bitmap = False
+
+    with open(path) as f:
+        for line in f:
+            parts = line.split()
+            if not parts:
+                continue
+            key = parts[0]
+
+            if in_bitmap:
+                if key == "ENDCHAR":
+                    in_bitmap = False
+                    if glyph.code >= 0:
+                        glyphs[glyph.code] = glyph
+                    glyph = None
+                else:
+                    glyph.rows.append((int(key, 16), len(key) * 4))
+                continue
+
+            if key == "FONTBOUNDINGBOX":
+                props["bbx"] = tuple(int(v) for v in parts[1:5])
+            elif key in ("FONT_ASCENT", "FONT_DESCENT"):
+                props[key] = int(parts[1])
+            elif key == "STARTCHAR":
+                glyph = Glyph(-1)
+            elif key == "ENCODING" and glyph is not None:
+                glyph.code = int(parts[1])
+            elif key == "DWIDTH" and glyph is not None:
+                glyph.advance = int(parts[1])
+            elif key == "BBX" and glyph is not None:
+                glyph.bbx = tuple(int(v) for v in parts[1:5])
+            elif key == "BITMAP":
+                in_bitmap = True
+
+    if "bbx" not in props:
+        sys.exit("%s: missing FONTBOUNDINGBOX" % path)
+    return props, glyphs
+
+
+def render(glyph, cell_w, cell_h, ascent, font_xoff):
+    """Render a glyph into a cell_w x cell_h pixel grid (list of columns)."""
+    columns = [[0] * cell_h for _ in range(cell_w)]
+    if glyph is None:
+        return columns
+
+    w, h, xoff, yoff = glyph.bbx
+    top = ascent - (yoff + h)  # Cell row of the glyph's first bitmap row
+
+    for r, (bits, row_bits) in enumerate(glyph.rows[:h]):
+        y = top + r
+        if y < 0 or y >= cell_h:
+            continue
+        for c in range(w):
+            x = xoff - font_xoff + c
+            if 0 <= x < cell_w and bits & (1 << (row_bits - 1 - c)):
+                columns[x][y] = 1
+    return columns
+
+
+def pack_columns(columns, pages):
+    """Pack pixel columns into page-major bytes (bit 0 = top row of page)."""
+    data = []
+    for page in range(pages):
+        for col in columns:
+            byte = 0
+            for bit in range(8):
+                y = page * 8 + bit
+                if y < len(col) and col[y]:
+                    byte |= 1 << bit
+            data.append(byte)
+    return data
+
+
+def c_array(values, per_line=12, fmt="0x%02X"):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append("    " + ", ".join(fmt % v for v in values[i:i + per_line]) + ",")
+    return "\n".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    parser.add_argument("bdf", help="input BDF font")
+    parser.add_argument("output", help="output C source file")
+    parser.add_argument("--name", required=True, help="C identifier of the font_t")
+    parser.add_argument("--first", type=int, default=32, help="first character code")
+    parser.add_argument("--last", type=int, default=126, help="last character code")
+    parser.add_argument("--proportional", action="store_true",
+                        help="trim blank columns and store per-glyph widths")
+    parser.add_argument("--spacing", type=int, default=None,
+                        help="blank columns between glyphs (default: from DWIDTH)")
+    args = parser.parse_args()
+
+    props, glyphs = parse_bdf(args.bdf)
+    cell_w, cell_h, font_xoff, font_yoff = props["bbx"]
+    ascent = props.get("FONT_ASCENT", cell_h + font_yoff)
+    descent = props.get("FONT_DESCENT", -font_yoff)
+    cell_h = ascent + descent
+    pages = (cell_h + 7) // 8
+
+    if cell_h > 255 or cell_w > 255:
+        sys.exit("%s: glyphs too large" % args.bdf)
+
+    # Default gap: whatever DWIDTH adds on top of the bounding box
+    sample = glyphs.get(ord("0")) or next(iter(glyphs.values()))
+    spacing = args.spacing if args.spacing is not None else max(0, sample.advance - cell_w)
+
+    bitmap = []
+    offsets = []
+    widths = []
+    for code in range(args.first, args.last + 1):
+        columns = render(glyphs.get(code), cell_w, cell_h, ascent, font_xoff)
+
+        if args.proportional:
+            inked = [i for i, col in enumerate(columns) if any(col)]
+            if inked:
+                columns = columns[inked[0]:inked[-1] + 1]
+            else:
+                # Blank glyph (space): keep about half the cell width
+                columns = columns[:max(1, (cell_w + 1) // 2)]
+
+        offsets.append(len(bitmap))
+        widths.append(len(columns))
+        bitmap.extend(pack_columns(columns, pages))
+
+    if len(bitmap) > 0xFFFF:
+        sys.exit("%s: glyph data exceeds 64KB" % args.bdf)
+
+    name = args.name
+    out = []
+    out.append("/*")
+    out.append(" * %s - generated by tools/bdf2font.py from %s" % (name, os.path.basename(args.bdf)))
+    out.append(" * Do not edit; change the BDF source or the generator instead.")
+    out.append(" *")
+    out.append(" * %s, %dpx tall, characters %d-%d" % (
+        "Proportional" if args.proportional else "Fixed %dpx wide" % cell_w,
+        cell_h, args.first, args.last))
+    out.append(" */")
+    out.append("")
+    out.append('#include "font.h"')
+    out.append("")
+    out.append("static const uint8_t %s_bitmap[] = {" % name)
+    out.append(c_array(bitmap))
+    out.append("};")
+    out.append("")
+    if args.proportional:
+        out.append("static const uint8_t %s_widths[] = {" % name)
+        out.append(c_array(widths, fmt="%d"))
+        out.append("};")
+        out.append("")
+        out.append("static const uint16_t %s_offsets[] = {" % name)
+        out.append(c_array(offsets, per_line=10, fmt="%d"))
+        out.append("};")
+        out.append("")
+    out.append("const font_t %s = {" % name)
+    out.append("    .first = %d," % args.first)
+    out.append("    .last = %d," % args.last)
+    out.append("    .height = %d," % cell_h)
+    out.append("    .pages = %d," % pages)
+    out.append("    .spacing = %d," % spacing)
+    out.append("    .fixed_width = %d," % (0 if args.proportional else cell_w))
+    out.append("    .widths = %s," % ("%s_widths" % name if args.proportional else "NULL"))
+    out.append("    .offsets = %s," % ("%s_offsets" % name if args.proportional else "NULL"))
+    out.append("    .bitmap = %s_bitmap," % name)
+    out.append("};")
+
+    with open(args.output, "w") as f:
+        f.write("\n".join(out) + "\n")
+
+
+if __name__ == "__main__":
+    main()